@@ -18,6 +18,7 @@ from __future__ import division
 from __future__ import print_function
 
 import abc
+import collections
 import six
 
 from nucleus.protos import bed_pb2
@@ -127,6 +128,23 @@ class WrappedSamIterable(WrappedCppIterable):
     return record, not_done
 
 
+# The numpy arrays of a batch of variants from a GenotypeMatrixIterable. See
+# GenotypeMatrix in nucleus/io/genotype_matrix.h for their layout.
+GenotypeMatrix = collections.namedtuple(
+    'GenotypeMatrix',
+    ['contig_ids', 'starts', 'genotypes', 'dosages', 'missing', 'phased'])
+
+
+class WrappedGenotypeMatrixIterable(WrappedCppIterable):
+
+  def _raw_next(self):
+    not_done, contig_ids, starts, genotypes, dosages, missing, phased = (
+        self._cc_iterable.PythonNext())
+    record = GenotypeMatrix(contig_ids, starts, genotypes, dosages, missing,
+                            phased)
+    return record, not_done
+
+
 class WrappedVariantIterable(WrappedCppIterable):
 
   def _raw_next(self):
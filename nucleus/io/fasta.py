@@ -69,15 +69,22 @@ class FastaReader(genomics_reader.DispatchingGenomicsReader):
 class IndexedFastaReader(genomics_reader.GenomicsReader):
   """Class for reading from FASTA files containing a reference genome."""
 
-  def __init__(self, input_path, keep_true_case=False, cache_size=None):
+  def __init__(self,
+               input_path,
+               keep_true_case=False,
+               cache_size=None,
+               cache_num_blocks=None):
     """Initializes an IndexedFastaReader.
 
     Args:
       input_path: string. A path to a resource containing FASTA records.
       keep_true_case: bool. If False, casts all bases to uppercase before
         returning them.
-      cache_size: integer. Number of bases to cache from previous queries.
-        Defaults to 64K.  The cache can be disabled using cache_size=0.
+      cache_size: integer. Number of bases in each of the blocks of the LRU
+        cache of previous queries. Defaults to 64K.  The cache can be disabled
+        using cache_size=0.
+      cache_num_blocks: integer. Number of blocks kept in the LRU cache of
+        previous queries. Defaults to 8; 0 disables the cache.
     """
     super(IndexedFastaReader, self).__init__()
 
@@ -85,13 +92,14 @@ class IndexedFastaReader(genomics_reader.GenomicsReader):
 
     fasta_path = input_path
     fai_path = fasta_path + '.fai'
-    if cache_size is None:
-      # Use the C++-defined default cache size.
-      self._reader = reference.IndexedFastaReader.from_file(
-          fasta_path, fai_path, options)
-    else:
-      self._reader = reference.IndexedFastaReader.from_file(
-          fasta_path, fai_path, options, cache_size)
+    # Arguments left as None use the C++-defined defaults.
+    cache_options = {}
+    if cache_size is not None:
+      cache_options['cache_size_bases'] = cache_size
+    if cache_num_blocks is not None:
+      cache_options['cache_num_blocks'] = cache_num_blocks
+    self._reader = reference.IndexedFastaReader.from_file(
+        fasta_path, fai_path, options, **cache_options)
 
     # TODO(thomaswc): Define a RefFastaHeader proto, and use it instead of this.
     self.header = RefFastaHeader(contigs=self._reader.contigs)
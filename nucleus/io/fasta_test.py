@@ -63,6 +63,21 @@ class IndexedFastaReaderTests(parameterized.TestCase):
     with fasta.IndexedFastaReader(fasta_path, cache_size=10) as reader:
       self.assertEqual(reader.query(ranges.make_range('chrM', 1, 5)), 'ATCA')
 
+  @parameterized.parameters(
+      dict(cache_size=None, cache_num_blocks=1),
+      dict(cache_size=10, cache_num_blocks=2),
+      dict(cache_size=10, cache_num_blocks=0))
+  def test_make_ref_reader_cache_num_blocks_specified(self, cache_size,
+                                                      cache_num_blocks):
+    fasta_path = test_utils.genomics_core_testdata('test.fasta')
+    with fasta.IndexedFastaReader(
+        fasta_path, cache_size=cache_size,
+        cache_num_blocks=cache_num_blocks) as reader:
+      self.assertEqual(reader.query(ranges.make_range('chrM', 1, 5)), 'ATCA')
+      self.assertEqual(
+          reader.query(ranges.make_range('chrM', 22, 27)), 'TAACC')
+      self.assertEqual(reader.query(ranges.make_range('chrM', 1, 5)), 'ATCA')
+
   def test_c_reader(self):
     with fasta.IndexedFastaReader(
         test_utils.genomics_core_testdata('test.fasta')) as reader:
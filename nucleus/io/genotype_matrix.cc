@@ -0,0 +1,150 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/genotype_matrix.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <utility>
+
+#include "tensorflow/core/lib/core/errors.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+GenotypeMatrixBuilder::GenotypeMatrixBuilder(int num_samples, int ploidy)
+    : num_samples_(num_samples),
+      ploidy_(ploidy),
+      phased_bytes_((num_samples + 7) / 8) {
+  SetShapes();
+}
+
+GenotypeMatrixBuilder::~GenotypeMatrixBuilder() { free(gt_arr_); }
+
+void GenotypeMatrixBuilder::SetShapes() {
+  matrix_.contig_ids.shape = {num_variants_};
+  matrix_.starts.shape = {num_variants_};
+  matrix_.genotypes.shape = {num_variants_, num_samples_, ploidy_};
+  matrix_.dosages.shape = {num_variants_, num_samples_};
+  matrix_.missing.shape = {num_variants_, num_samples_};
+  matrix_.phased.shape = {num_variants_, phased_bytes_};
+}
+
+tf::Status GenotypeMatrixBuilder::Add(const bcf_hdr_t* header,
+                                      bcf1_t* record) {
+  if (record->n_sample != num_samples_) {
+    return tf::errors::FailedPrecondition(
+        "Record has ", record->n_sample, " samples but the matrix has ",
+        num_samples_);
+  }
+  // Records without a GT field get all-missing calls.
+  const int n_gts = bcf_get_genotypes(header, record, &gt_arr_, &n_gt_arr_);
+  if (n_gts < 0 && n_gts != -1 && n_gts != -3) {
+    return tf::errors::DataLoss("Couldn't parse genotypes");
+  }
+  const int record_ploidy =
+      n_gts > 0 && num_samples_ > 0 ? n_gts / num_samples_ : 0;
+
+  // Append an empty row. It is only kept if the whole record decodes.
+  const int64 row = num_variants_;
+  const int64 calls = static_cast<int64>(num_samples_);
+  matrix_.contig_ids.values.push_back(record->rid);
+  matrix_.starts.values.push_back(record->pos);
+  matrix_.genotypes.values.resize((row + 1) * calls * ploidy_,
+                                  kGenotypeMatrixPadding);
+  matrix_.dosages.values.resize((row + 1) * calls);
+  matrix_.missing.values.resize((row + 1) * calls);
+  matrix_.phased.values.resize((row + 1) * phased_bytes_);
+  int8* row_genotypes = &matrix_.genotypes.values[row * calls * ploidy_];
+  int8* row_dosages = &matrix_.dosages.values[row * calls];
+  uint8* row_missing = &matrix_.missing.values[row * calls];
+  uint8* row_phased = &matrix_.phased.values[row * phased_bytes_];
+
+  tf::Status status;
+  for (int i = 0; i < num_samples_ && status.ok(); ++i) {
+    int8* call = row_genotypes + static_cast<int64>(i) * ploidy_;
+    const int32* sample_gts = gt_arr_ + i * record_ploidy;
+    bool is_missing = record_ploidy == 0;
+    bool is_phased = false;
+    int dosage = 0;
+    if (is_missing) {
+      std::fill(call, call + ploidy_, kGenotypeMatrixMissingAllele);
+    }
+    for (int j = 0; j < record_ploidy; ++j) {
+      const int32 gt = sample_gts[j];
+      // Check whether this sample has smaller ploidy. A call padded from its
+      // first allele has no alleles at all, so it is a no-call.
+      if (gt == bcf_int32_vector_end) {
+        if (j == 0) {
+          std::fill(call, call + ploidy_, kGenotypeMatrixMissingAllele);
+          is_missing = true;
+        }
+        break;
+      }
+      if (j >= ploidy_) {
+        status = tf::errors::InvalidArgument(
+            "Call of sample ", i, " at ", bcf_hdr_id2name(header, record->rid),
+            ":", record->pos + 1, " has more than ", ploidy_, " alleles");
+        break;
+      }
+      is_phased = is_phased || bcf_gt_is_phased(gt);
+      // Some writers encode a missing allele as the missing integer rather
+      // than as a missing genotype.
+      if (gt == bcf_int32_missing || bcf_gt_is_missing(gt)) {
+        call[j] = kGenotypeMatrixMissingAllele;
+        is_missing = true;
+        continue;
+      }
+      const int allele = bcf_gt_allele(gt);
+      if (allele > 127) {
+        status = tf::errors::InvalidArgument(
+            "Allele index ", allele, " at ",
+            bcf_hdr_id2name(header, record->rid), ":", record->pos + 1,
+            " does not fit in a GenotypeMatrix");
+        break;
+      }
+      call[j] = static_cast<int8>(allele);
+      if (allele > 0) ++dosage;
+    }
+    row_dosages[i] = is_missing ? -1 : static_cast<int8>(dosage);
+    row_missing[i] = is_missing ? 1 : 0;
+    if (is_phased) row_phased[i / 8] |= 0x80 >> (i % 8);
+  }
+
+  if (!status.ok()) {
+    // Drop the partially decoded row.
+    matrix_.contig_ids.values.pop_back();
+    matrix_.starts.values.pop_back();
+    matrix_.genotypes.values.resize(row * calls * ploidy_);
+    matrix_.dosages.values.resize(row * calls);
+    matrix_.missing.values.resize(row * calls);
+    matrix_.phased.values.resize(row * phased_bytes_);
+    return status;
+  }
+  ++num_variants_;
+  return tf::Status::OK();
+}
+
+void GenotypeMatrixBuilder::Finish(GenotypeMatrix* matrix) {
+  SetShapes();
+  *matrix = std::move(matrix_);
+  matrix_ = GenotypeMatrix();
+  num_variants_ = 0;
+  SetShapes();
+}
+
+}  // namespace nucleus
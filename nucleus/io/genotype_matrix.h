@@ -0,0 +1,94 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef THIRD_PARTY_NUCLEUS_IO_GENOTYPE_MATRIX_H_
+#define THIRD_PARTY_NUCLEUS_IO_GENOTYPE_MATRIX_H_
+
+#include "htslib/vcf.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/util/dense_array.h"
+#include "tensorflow/core/lib/core/status.h"
+
+namespace nucleus {
+
+// Allele value of a missing ('.') allele in GenotypeMatrix::genotypes.
+constexpr int8 kGenotypeMatrixMissingAllele = -1;
+// Allele value used to pad calls whose ploidy is smaller than the matrix's.
+constexpr int8 kGenotypeMatrixPadding = -2;
+
+// The genotypes of a batch of variants as dense variants-by-samples arrays,
+// decoded straight from htslib records without going through Variant protos.
+// Row i of every array describes the i-th variant of the batch.
+struct GenotypeMatrix {
+  // [num_variants] The index of the variant's contig in VcfHeader.contigs.
+  DenseArray<int32> contig_ids;
+  // [num_variants] The 0-based start position of each variant.
+  DenseArray<int64> starts;
+  // [num_variants, num_samples, ploidy] Allele indices of each call, with
+  // kGenotypeMatrixMissingAllele for missing alleles and
+  // kGenotypeMatrixPadding after the last allele of lower-ploidy calls.
+  DenseArray<int8> genotypes;
+  // [num_variants, num_samples] The number of non-reference alleles of each
+  // call, or -1 if any of its alleles is missing.
+  DenseArray<int8> dosages;
+  // [num_variants, num_samples] 1 if any allele of the call is missing.
+  DenseArray<uint8> missing;
+  // [num_variants, ceil(num_samples / 8)] Bit j % 8 (most significant first,
+  // as with numpy.unpackbits) of byte j / 8 is set if the call of sample j is
+  // phased.
+  DenseArray<uint8> phased;
+};
+
+// Accumulates records into a GenotypeMatrix.
+class GenotypeMatrixBuilder {
+ public:
+  // Creates a builder for records with |num_samples| samples, leaving room for
+  // |ploidy| alleles per call.
+  GenotypeMatrixBuilder(int num_samples, int ploidy);
+  ~GenotypeMatrixBuilder();
+
+  // Disable copy or assignment
+  GenotypeMatrixBuilder(const GenotypeMatrixBuilder& other) = delete;
+  GenotypeMatrixBuilder& operator=(const GenotypeMatrixBuilder&) = delete;
+
+  // Appends the genotypes of |record| as a new row. Fails if a call has more
+  // than ploidy alleles or an allele index does not fit in an int8.
+  tensorflow::Status Add(const bcf_hdr_t* header, bcf1_t* record);
+
+  // The number of rows added since the last call to Finish.
+  int64 num_variants() const { return num_variants_; }
+
+  // Moves the rows added so far into |matrix| and starts a new, empty batch.
+  void Finish(GenotypeMatrix* matrix);
+
+ private:
+  // Shapes the arrays of |matrix_| for num_variants_ rows.
+  void SetShapes();
+
+  const int num_samples_;
+  const int ploidy_;
+  const int phased_bytes_;
+  int64 num_variants_ = 0;
+  GenotypeMatrix matrix_;
+
+  // Scratch buffer for bcf_get_genotypes, reused across records.
+  int32* gt_arr_ = nullptr;
+  int n_gt_arr_ = 0;
+};
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_IO_GENOTYPE_MATRIX_H_
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/genotype_matrix.h"
+
+#include <memory>
+#include <vector>
+
+#include <gmock/gmock-generated-matchers.h>
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock-more-matchers.h>
+
+#include "tensorflow/core/platform/test.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/vendor/status_matchers.h"
+
+namespace nucleus {
+
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+
+class GenotypeMatrixBuilderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    header_ = MakeVcfHeader(
+        {"##contig=<ID=Chr1,length=1000>",
+         "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"GT\">",
+         "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"GQ\">"},
+        {"s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9"});
+    record_ = bcf_init();
+  }
+
+  void TearDown() override {
+    bcf_destroy(record_);
+    bcf_hdr_destroy(header_);
+  }
+
+  // Parses |line| into record_.
+  void Parse(const string& line) { ParseVcfLine(header_, line, record_); }
+
+  bcf_hdr_t* header_;
+  bcf1_t* record_;
+};
+
+TEST_F(GenotypeMatrixBuilderTest, DecodesCalls) {
+  GenotypeMatrixBuilder builder(9, 2);
+  Parse("Chr1\t10\t.\tA\tC,G\t.\t.\t.\tGT\t0/0\t0/1\t1|2\t./.\t0/.\t1\t"
+        ".\t2|2\t0|0");
+  ASSERT_THAT(builder.Add(header_, record_), IsOK());
+  Parse("Chr1\t20\t.\tA\tC\t.\t.\t.\tGT\t1/1\t0/0\t0/0\t0/0\t0/0\t0/0\t"
+        "0/0\t0/0\t0|1");
+  ASSERT_THAT(builder.Add(header_, record_), IsOK());
+  EXPECT_EQ(2, builder.num_variants());
+
+  GenotypeMatrix matrix;
+  builder.Finish(&matrix);
+  EXPECT_EQ(0, builder.num_variants());
+
+  EXPECT_THAT(matrix.contig_ids.shape, ElementsAre(2));
+  EXPECT_THAT(matrix.contig_ids.values, ElementsAre(0, 0));
+  EXPECT_THAT(matrix.starts.values, ElementsAre(9, 19));
+
+  EXPECT_THAT(matrix.genotypes.shape, ElementsAre(2, 9, 2));
+  const int8 kM = kGenotypeMatrixMissingAllele;
+  const int8 kP = kGenotypeMatrixPadding;
+  EXPECT_THAT(std::vector<int8>(matrix.genotypes.values.begin(),
+                                matrix.genotypes.values.begin() + 18),
+              ElementsAreArray(std::vector<int8>{0, 0, 0, 1, 1, 2, kM, kM, 0,
+                                                 kM, 1, kP, kM, kP, 2, 2, 0,
+                                                 0}));
+
+  EXPECT_THAT(matrix.dosages.shape, ElementsAre(2, 9));
+  EXPECT_THAT(matrix.dosages.values,
+              ElementsAre(0, 1, 2, -1, -1, 1, -1, 2, 0,
+                          2, 0, 0, 0, 0, 0, 0, 0, 1));
+  EXPECT_THAT(matrix.missing.values,
+              ElementsAre(0, 0, 0, 1, 1, 0, 1, 0, 0,
+                          0, 0, 0, 0, 0, 0, 0, 0, 0));
+
+  // Samples 3, 8 and 9 of the first variant and 9 of the second are phased.
+  EXPECT_THAT(matrix.phased.shape, ElementsAre(2, 2));
+  EXPECT_THAT(matrix.phased.values, ElementsAre(0x21, 0x80, 0x00, 0x80));
+}
+
+TEST_F(GenotypeMatrixBuilderTest, RecordsWithoutGenotypesAreMissing) {
+  GenotypeMatrixBuilder builder(9, 2);
+  Parse("Chr1\t10\t.\tA\tC\t.\t.\t.\tGQ\t1\t2\t3\t4\t5\t6\t7\t8\t9");
+  ASSERT_THAT(builder.Add(header_, record_), IsOK());
+  GenotypeMatrix matrix;
+  builder.Finish(&matrix);
+  EXPECT_THAT(matrix.genotypes.values,
+              ElementsAreArray(std::vector<int8>(
+                  18, kGenotypeMatrixMissingAllele)));
+  EXPECT_THAT(matrix.missing.values,
+              ElementsAreArray(std::vector<uint8>(9, 1)));
+}
+
+TEST_F(GenotypeMatrixBuilderTest, MissingIntegersAndEmptyCallsAreMissing) {
+  GenotypeMatrixBuilder builder(9, 2);
+  Parse("Chr1\t10\t.\tA\tC\t.\t.\t.\tGT\t0/1\t0/1\t0/1\t0/1\t0/1\t0/1\t"
+        "0/1\t0/1\t0/1");
+  // Alleles encoded as the missing integer, and a call that is all padding.
+  std::vector<int32> gts;
+  for (int i = 0; i < 9; ++i) {
+    gts.push_back(bcf_gt_unphased(0));
+    gts.push_back(bcf_gt_unphased(1));
+  }
+  gts[0] = gts[1] = bcf_int32_missing;
+  gts[3] = bcf_int32_missing;
+  gts[4] = gts[5] = bcf_int32_vector_end;
+  ASSERT_EQ(0, bcf_update_genotypes(header_, record_, gts.data(), gts.size()));
+  ASSERT_THAT(builder.Add(header_, record_), IsOK());
+  GenotypeMatrix matrix;
+  builder.Finish(&matrix);
+  const int8 kM = kGenotypeMatrixMissingAllele;
+  EXPECT_THAT(matrix.genotypes.values,
+              ElementsAreArray(std::vector<int8>{kM, kM, 0, kM, kM, kM, 0, 1,
+                                                 0, 1, 0, 1, 0, 1, 0, 1, 0,
+                                                 1}));
+  EXPECT_THAT(matrix.dosages.values,
+              ElementsAre(-1, -1, -1, 1, 1, 1, 1, 1, 1));
+  EXPECT_THAT(matrix.missing.values, ElementsAre(1, 1, 1, 0, 0, 0, 0, 0, 0));
+}
+
+TEST_F(GenotypeMatrixBuilderTest, RejectsCallsAboveMatrixPloidy) {
+  GenotypeMatrixBuilder builder(9, 2);
+  Parse("Chr1\t10\t.\tA\tC\t.\t.\t.\tGT\t0/0\t0/0\t0/0/1\t0/0\t0/0\t0/0\t"
+        "0/0\t0/0\t0/0");
+  EXPECT_THAT(builder.Add(header_, record_), IsNotOKWithCodeAndMessage(
+      tensorflow::error::INVALID_ARGUMENT, "more than 2 alleles"));
+  // The failed record leaves no partial row behind.
+  EXPECT_EQ(0, builder.num_variants());
+  GenotypeMatrix matrix;
+  builder.Finish(&matrix);
+  EXPECT_THAT(matrix.genotypes.shape, ElementsAre(0, 9, 2));
+  EXPECT_TRUE(matrix.genotypes.values.empty());
+  EXPECT_TRUE(matrix.contig_ids.values.empty());
+}
+
+}  // namespace nucleus
@@ -0,0 +1,413 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/gvcf_blocks.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "absl/strings/string_view.h"
+#include "htslib/vcf.h"
+#include "nucleus/io/vcf_variant_view.h"
+#include "nucleus/util/math.h"
+#include "nucleus/util/utils.h"
+#include "nucleus/vendor/statusor.h"
+#include "tensorflow/core/lib/core/errors.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+using nucleus::genomics::v1::Range;
+using nucleus::genomics::v1::Variant;
+using nucleus::genomics::v1::VariantCall;
+using nucleus::genomics::v1::VcfFormatInfo;
+using nucleus::genomics::v1::VcfHeader;
+
+namespace {
+
+constexpr char kMinDp[] = "MIN_DP";
+
+// Is |allele| one of the symbolic alleles standing for any unobserved
+// alternate allele?
+bool IsSymbolicAllele(absl::string_view allele) {
+  return allele == "<*>" || allele == "<NON_REF>";
+}
+
+// Adds a FORMAT definition of |id| to |header| if it has none.
+void AddFormatIfMissing(const string& id, const string& description,
+                        VcfHeader* header) {
+  for (const VcfFormatInfo& format : header->formats()) {
+    if (format.id() == id) return;
+  }
+  VcfFormatInfo* format = header->add_formats();
+  format->set_id(id);
+  format->set_number("1");
+  format->set_type("Integer");
+  format->set_description(description);
+}
+
+// The running summary of the calls of one sample over a reference block.
+struct BlockCall {
+  int gq_band;
+  int min_gq;
+  // -1 if none of the records has a DP.
+  int min_dp;
+  // The (DP, span) of each record with a DP, for the median DP.
+  std::vector<std::pair<int, int64>> dps;
+  // The element-wise minimum PLs, if has_pls.
+  std::vector<int> min_pls;
+  bool has_pls;
+};
+
+// Returns the median of the DPs in |dps|, each weighted by its span.
+int WeightedMedianDp(std::vector<std::pair<int, int64>>* dps) {
+  std::sort(dps->begin(), dps->end());
+  int64 total = 0;
+  for (const auto& dp : *dps) total += dp.second;
+  int64 seen = 0;
+  for (const auto& dp : *dps) {
+    seen += dp.second;
+    if (2 * seen >= total) return dp.first;
+  }
+  return dps->back().first;
+}
+
+// Merges the records given to Add into reference blocks, writing the blocks
+// and the records that can't join one to a VcfWriter.
+class GvcfCompactor {
+ public:
+  GvcfCompactor(const VcfReader& reader, const GvcfCompactionOptions& options,
+                VcfWriter* writer, GvcfCompactionStats* stats)
+      : reader_(reader), options_(options), writer_(writer), stats_(stats) {}
+
+  // Adds the next record of the input.
+  tf::Status Add(const VcfVariantView& view);
+
+  // Writes the current block, if any.
+  tf::Status Flush();
+
+ private:
+  // Reads the calls of |view| into calls_ if it can be part of a reference
+  // block. Returns false if not.
+  bool ReadBlockCalls(const VcfVariantView& view);
+
+  // Can the record |view|, whose calls are in calls_, extend block_?
+  bool CanExtendBlock(const VcfVariantView& view) const;
+
+  // Merges calls_ into block_calls_.
+  void MergeBlockCalls();
+
+  // Sets the fields of block_ summarizing the records merged into it.
+  void FinishBlock();
+
+  tf::Status Write(const Variant& variant, bool is_block);
+
+  const VcfReader& reader_;
+  const GvcfCompactionOptions& options_;
+  VcfWriter* writer_;
+  GvcfCompactionStats* stats_;
+
+  // The header the tag ids below were resolved with.
+  const bcf_hdr_t* header_ = nullptr;
+  int gt_id_, gq_id_, dp_id_, min_dp_id_, pl_id_, gl_id_;
+
+  // The current block: its first record with the bcf contig id and end of
+  // the last record merged into it, and the summaries of its calls.
+  bool in_block_ = false;
+  Variant block_;
+  int block_rid_;
+  int64 block_end_;
+  int64 block_records_;
+  std::vector<BlockCall> block_calls_;
+
+  // Scratch space for the calls of the current record and for records that
+  // are written unchanged.
+  std::vector<BlockCall> calls_;
+  Variant record_;
+};
+
+tf::Status GvcfCompactor::Add(const VcfVariantView& view) {
+  ++stats_->records_read;
+  if (view.header() != header_) {
+    header_ = view.header();
+    gt_id_ = view.FormatTagId("GT");
+    gq_id_ = view.FormatTagId("GQ");
+    dp_id_ = view.FormatTagId("DP");
+    min_dp_id_ = view.FormatTagId(kMinDp);
+    pl_id_ = view.FormatTagId("PL");
+    gl_id_ = view.FormatTagId("GL");
+  }
+
+  if (!ReadBlockCalls(view)) {
+    TF_RETURN_IF_ERROR(Flush());
+    TF_RETURN_IF_ERROR(reader_.RecordConverter().ConvertToPb(
+        view.header(), view.record(), &record_));
+    return Write(record_, false);
+  }
+  if (CanExtendBlock(view)) {
+    MergeBlockCalls();
+    block_end_ = view.end();
+    ++block_records_;
+    return tf::Status::OK();
+  }
+
+  TF_RETURN_IF_ERROR(Flush());
+  TF_RETURN_IF_ERROR(reader_.RecordConverter().ConvertToPb(
+      view.header(), view.record(), &block_));
+  in_block_ = true;
+  block_rid_ = view.contig_id();
+  block_end_ = view.end();
+  block_records_ = 1;
+  std::swap(block_calls_, calls_);
+  return tf::Status::OK();
+}
+
+bool GvcfCompactor::ReadBlockCalls(const VcfVariantView& view) {
+  for (int i = 1; i < view.num_alleles(); ++i) {
+    if (!IsSymbolicAllele(view.allele(i))) return false;
+  }
+  if (gt_id_ < 0 || gq_id_ < 0 || view.num_samples() == 0) return false;
+
+  calls_.resize(view.num_samples());
+  for (int s = 0; s < view.num_samples(); ++s) {
+    const VcfValues<int> gt = view.Format<int>(gt_id_, s);
+    if (gt.empty()) return false;
+    for (int j = 0; j < gt.size(); ++j) {
+      if (bcf_gt_is_missing(gt[j]) || bcf_gt_allele(gt[j]) != 0) return false;
+    }
+    const VcfValues<int> gq = view.Format<int>(gq_id_, s);
+    if (gq.empty() || gq.IsMissing(0)) return false;
+
+    BlockCall& call = calls_[s];
+    call.min_gq = gq[0];
+    call.gq_band = std::upper_bound(options_.gq_bands.begin(),
+                                    options_.gq_bands.end(), gq[0]) -
+                   options_.gq_bands.begin();
+
+    call.min_dp = -1;
+    call.dps.clear();
+    const VcfValues<int> dp = view.Format<int>(dp_id_, s);
+    if (!dp.empty() && !dp.IsMissing(0)) {
+      call.min_dp = dp[0];
+      call.dps.emplace_back(dp[0], view.end() - view.start());
+    }
+    // Records that are blocks already carry their own minimum.
+    const VcfValues<int> min_dp = view.Format<int>(min_dp_id_, s);
+    if (!min_dp.empty() && !min_dp.IsMissing(0)) call.min_dp = min_dp[0];
+
+    call.min_pls.clear();
+    call.has_pls = view.Format<float>(gl_id_, s).empty();
+    const VcfValues<int> pls = view.Format<int>(pl_id_, s);
+    for (int j = 0; call.has_pls && j < pls.size(); ++j) {
+      if (pls.IsMissing(j)) call.has_pls = false;
+      call.min_pls.push_back(pls[j]);
+    }
+    call.has_pls = call.has_pls && !pls.empty();
+  }
+  return true;
+}
+
+bool GvcfCompactor::CanExtendBlock(const VcfVariantView& view) const {
+  if (!in_block_ || view.contig_id() != block_rid_ ||
+      view.start() != block_end_) {
+    return false;
+  }
+  if (options_.max_block_length > 0 &&
+      view.end() - block_.start() > options_.max_block_length) {
+    return false;
+  }
+  if (view.num_alleles() != block_.alternate_bases_size() + 1) return false;
+  for (int i = 1; i < view.num_alleles(); ++i) {
+    if (view.allele(i) != block_.alternate_bases(i - 1)) return false;
+  }
+  for (size_t s = 0; s < calls_.size(); ++s) {
+    if (calls_[s].gq_band != block_calls_[s].gq_band) return false;
+  }
+  return true;
+}
+
+void GvcfCompactor::MergeBlockCalls() {
+  for (size_t s = 0; s < calls_.size(); ++s) {
+    const BlockCall& call = calls_[s];
+    BlockCall& block = block_calls_[s];
+    block.min_gq = std::min(block.min_gq, call.min_gq);
+    if (call.min_dp >= 0) {
+      block.min_dp =
+          block.min_dp < 0 ? call.min_dp : std::min(block.min_dp, call.min_dp);
+    }
+    block.dps.insert(block.dps.end(), call.dps.begin(), call.dps.end());
+    if (!call.has_pls || call.min_pls.size() != block.min_pls.size()) {
+      block.has_pls = false;
+    }
+    for (size_t j = 0; block.has_pls && j < block.min_pls.size(); ++j) {
+      block.min_pls[j] = std::min(block.min_pls[j], call.min_pls[j]);
+    }
+  }
+}
+
+void GvcfCompactor::FinishBlock() {
+  const bool pls_in_info_map =
+      reader_.Options().store_gl_and_pl_in_info_map();
+  block_.set_end(block_end_);
+  for (int s = 0; s < block_.calls_size(); ++s) {
+    BlockCall& block = block_calls_[s];
+    VariantCall* call = block_.mutable_calls(s);
+    SetInfoField("GQ", block.min_gq, call);
+    if (block.min_dp >= 0) {
+      SetInfoField(kMinDp, block.min_dp, call);
+      const bool median =
+          options_.dp == GvcfBlockDp::kMedianDp && !block.dps.empty();
+      SetInfoField("DP", median ? WeightedMedianDp(&block.dps) : block.min_dp,
+                   call);
+    }
+    if (block.has_pls) {
+      if (pls_in_info_map) {
+        SetInfoField("PL", block.min_pls, call);
+      } else {
+        call->clear_genotype_likelihood();
+        for (int pl : block.min_pls) {
+          call->add_genotype_likelihood(PhredToLog10PError(pl));
+        }
+      }
+    } else {
+      // Drop the likelihoods of the first record of the block, which don't
+      // hold for the records without them.
+      call->clear_genotype_likelihood();
+      call->mutable_info()->erase("PL");
+      call->mutable_info()->erase("GL");
+    }
+  }
+}
+
+tf::Status GvcfCompactor::Flush() {
+  if (!in_block_) return tf::Status::OK();
+  in_block_ = false;
+  // A lone record is written as it was read.
+  if (block_records_ > 1) FinishBlock();
+  return Write(block_, block_records_ > 1);
+}
+
+tf::Status GvcfCompactor::Write(const Variant& variant, bool is_block) {
+  TF_RETURN_IF_ERROR(writer_->Write(variant));
+  ++stats_->records_written;
+  if (is_block) ++stats_->blocks_written;
+  return tf::Status::OK();
+}
+
+// Is |variant| a reference block spanning more than one base?
+bool IsReferenceBlock(const Variant& variant) {
+  if (variant.end() - variant.start() <= 1) return false;
+  for (const string& alt : variant.alternate_bases()) {
+    if (!IsSymbolicAllele(alt)) return false;
+  }
+  return variant.reference_bases().size() == 1;
+}
+
+}  // namespace
+
+std::vector<int> GvcfCompactionOptions::DefaultGqBands() {
+  std::vector<int> bands;
+  for (int gq = 1; gq < 60; ++gq) bands.push_back(gq);
+  for (int gq : {60, 70, 80, 90, 99}) bands.push_back(gq);
+  return bands;
+}
+
+VcfHeader GvcfBlockHeader(const VcfHeader& header) {
+  VcfHeader block_header = header;
+  AddFormatIfMissing("GQ", "Conditional genotype quality", &block_header);
+  AddFormatIfMissing("DP", "Read depth", &block_header);
+  AddFormatIfMissing(kMinDp, "Minimum DP observed within the gVCF block",
+                     &block_header);
+  return block_header;
+}
+
+tf::Status CompactGvcf(VcfReader* reader, const GvcfCompactionOptions& options,
+                       VcfWriter* writer, GvcfCompactionStats* stats) {
+  if (!std::is_sorted(options.gq_bands.begin(), options.gq_bands.end()) ||
+      std::adjacent_find(options.gq_bands.begin(), options.gq_bands.end()) !=
+          options.gq_bands.end()) {
+    return tf::errors::InvalidArgument(
+        "GQ bands must be strictly increasing");
+  }
+  StatusOr<std::shared_ptr<VariantViewIterable>> iterable =
+      reader->IterateViews();
+  TF_RETURN_IF_ERROR(iterable.status());
+  std::shared_ptr<VariantViewIterable> views = iterable.ValueOrDie();
+
+  GvcfCompactionStats unused_stats;
+  GvcfCompactor compactor(*reader, options, writer,
+                          stats != nullptr ? stats : &unused_stats);
+  VcfVariantView view;
+  tf::Status status;
+  while (status.ok()) {
+    StatusOr<bool> has_next = views->Next(&view);
+    if (!has_next.ok()) {
+      status = has_next.status();
+    } else if (!has_next.ValueOrDie()) {
+      status = compactor.Flush();
+      break;
+    } else {
+      status = compactor.Add(view);
+    }
+  }
+  status.Update(views->Release());
+  return status;
+}
+
+tf::Status ExpandGvcfBlocks(VcfReader* reader, const Range& region,
+                            const GenomeReference& ref, VcfWriter* writer) {
+  StatusOr<std::shared_ptr<VariantIterable>> iterable = reader->Query(region);
+  TF_RETURN_IF_ERROR(iterable.status());
+  std::shared_ptr<VariantIterable> variants = iterable.ValueOrDie();
+
+  Variant variant;
+  tf::Status status;
+  while (status.ok()) {
+    StatusOr<bool> has_next = variants->Next(&variant);
+    if (!has_next.ok()) {
+      status = has_next.status();
+      break;
+    }
+    if (!has_next.ValueOrDie()) break;
+    if (!IsReferenceBlock(variant)) {
+      status = writer->Write(variant);
+      continue;
+    }
+
+    const int64 start = std::max(variant.start(), region.start());
+    const int64 end = std::min(variant.end(), region.end());
+    StatusOr<string> bases =
+        ref.GetBases(MakeRange(variant.reference_name(), start, end));
+    if (!bases.ok()) {
+      status = bases.status();
+      break;
+    }
+    // The expanded records share everything but their position and
+    // reference base.
+    for (int64 pos = start; pos < end && status.ok(); ++pos) {
+      variant.set_start(pos);
+      variant.set_end(pos + 1);
+      variant.set_reference_bases(bases.ValueOrDie().substr(pos - start, 1));
+      status = writer->Write(variant);
+    }
+  }
+  status.Update(variants->Release());
+  return status;
+}
+
+}  // namespace nucleus
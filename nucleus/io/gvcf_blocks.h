@@ -0,0 +1,106 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+// Compaction of adjacent homozygous reference gVCF records into reference
+// blocks, and the expansion of reference blocks back into per-position
+// records.
+//
+// A gVCF record can join a reference block if its alternate alleles are all
+// symbolic (<*> or <NON_REF>) or absent and the calls of all of its samples
+// are homozygous reference with a GQ. Adjacent such records on the same contig
+// are merged as long as their alleles agree and the GQ of each sample stays
+// in the same band, in the style of GATK's -GQB banding. The block keeps the
+// site-level fields of its first record, and for each call:
+//   GQ is the minimum GQ of the merged records,
+//   MIN_DP is the minimum DP (or MIN_DP, for records that are blocks already),
+//   DP is either the minimum or the length-weighted median DP, and
+//   the PLs are the element-wise minimum PLs, when the records have no GLs.
+#ifndef THIRD_PARTY_NUCLEUS_IO_GVCF_BLOCKS_H_
+#define THIRD_PARTY_NUCLEUS_IO_GVCF_BLOCKS_H_
+
+#include <vector>
+
+#include "nucleus/io/reference.h"
+#include "nucleus/io/vcf_reader.h"
+#include "nucleus/io/vcf_writer.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/range.pb.h"
+#include "nucleus/protos/variants.pb.h"
+#include "tensorflow/core/lib/core/status.h"
+
+namespace nucleus {
+
+// How the DP of a compacted reference block is computed from the DPs of the
+// records it merges.
+enum class GvcfBlockDp {
+  // DP is the same as MIN_DP, the smallest DP of the block.
+  kMinDp,
+  // DP is the median of the per-position DPs of the block (MED_DP).
+  kMedianDp,
+};
+
+// Options of CompactGvcf.
+struct GvcfCompactionOptions {
+  // The ascending lower bounds of the GQ bands. A GQ belongs to the band of
+  // the largest bound that is not greater than it, or to a band of its own
+  // below the first bound. The defaults follow GATK's HaplotypeCaller: one
+  // band per GQ below 60, then 60-69, 70-79, 80-89, 90-98 and 99 and above.
+  std::vector<int> gq_bands = DefaultGqBands();
+  GvcfBlockDp dp = GvcfBlockDp::kMinDp;
+  // If positive, blocks are split so that none is longer than this.
+  int64 max_block_length = 0;
+
+  static std::vector<int> DefaultGqBands();
+};
+
+// Counts of the records read and written by CompactGvcf.
+struct GvcfCompactionStats {
+  int64 records_read = 0;
+  int64 records_written = 0;
+  // The number of records written that are reference blocks.
+  int64 blocks_written = 0;
+};
+
+// Returns |header| with the FORMAT definitions compacted reference blocks use
+// (GQ, DP and MIN_DP) added if it lacks any of them. The VcfWriter given to
+// CompactGvcf should be created with this header.
+nucleus::genomics::v1::VcfHeader GvcfBlockHeader(
+    const nucleus::genomics::v1::VcfHeader& header);
+
+// Streams all records of the position-sorted gVCF |reader|, merging adjacent
+// reference records into blocks as described above, and writes the result to
+// |writer|. Records that can't join a block are written unchanged. Only the
+// records that are written are converted to Variant protos. |stats| may be
+// null.
+tensorflow::Status CompactGvcf(VcfReader* reader,
+                               const GvcfCompactionOptions& options,
+                               VcfWriter* writer, GvcfCompactionStats* stats);
+
+// Writes the records of |reader| that overlap |region| to |writer|, expanding
+// every reference block (a record with only symbolic alternate alleles that
+// spans more than one base) into one record per position of the block within
+// |region|. The reference base of each expanded record comes from |ref|; its
+// other fields are those of the block, as the per-position values are lost by
+// compaction. All other records are written unchanged. |reader| must be
+// indexed.
+tensorflow::Status ExpandGvcfBlocks(VcfReader* reader,
+                                    const nucleus::genomics::v1::Range& region,
+                                    const GenomeReference& ref,
+                                    VcfWriter* writer);
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_IO_GVCF_BLOCKS_H_
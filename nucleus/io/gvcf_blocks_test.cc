@@ -0,0 +1,228 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/gvcf_blocks.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock-generated-matchers.h>
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock-more-matchers.h>
+
+#include "tensorflow/core/platform/test.h"
+#include "nucleus/io/tabix_indexer.h"
+#include "nucleus/protos/reference.pb.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/util/utils.h"
+#include "nucleus/vendor/status_matchers.h"
+
+namespace nucleus {
+
+using genomics::v1::ContigInfo;
+using genomics::v1::ReferenceSequence;
+using genomics::v1::Variant;
+using genomics::v1::VariantCall;
+using genomics::v1::VcfReaderOptions;
+using genomics::v1::VcfWriterOptions;
+using ::testing::DoubleEq;
+using ::testing::ElementsAre;
+
+namespace {
+
+constexpr char kGvcf[] =
+    "##fileformat=VCFv4.2\n"
+    "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End\">\n"
+    "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+    "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"GQ\">\n"
+    "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"DP\">\n"
+    "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"PL\">\n"
+    "##contig=<ID=chr1,length=20>\n"
+    "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\n"
+    "chr1\t1\t.\tA\t<*>\t0\t.\tEND=2\tGT:GQ:DP:PL\t0/0:30:10:0,30,300\n"
+    "chr1\t3\t.\tG\t<*>\t0\t.\t.\tGT:GQ:DP:PL\t0/0:35:20:0,35,200\n"
+    "chr1\t4\t.\tT\t<*>\t0\t.\tEND=5\tGT:GQ:DP:PL\t0/0:38:12:0,38,400\n"
+    "chr1\t6\t.\tA\tC,<*>\t50\t.\t.\tGT:GQ:DP\t0/1:50:30\n"
+    "chr1\t7\t.\tC\t<*>\t0\t.\t.\tGT:GQ:DP\t0/0:45:8\n"
+    "chr1\t8\t.\tG\t<*>\t0\t.\t.\tGT:GQ:DP\t0/0:10:9\n"
+    "chr1\t9\t.\tT\t<*>\t0\t.\t.\tGT:GQ:DP\t0/0:15:11\n";
+
+constexpr char kReferenceBases[] = "ACGTTACGTACGTACGTACG";
+
+std::vector<int> IntField(const VariantCall& call, const string& key) {
+  return ListValues<int>(call.info().at(key));
+}
+
+}  // namespace
+
+class GvcfBlocksTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    reader_ = MakeVcfReader("gvcf_blocks_input.vcf", kGvcf);
+    options_.gq_bands = {0, 20, 40};
+  }
+
+  // Compacts reader_ into the file |path| and returns its records.
+  std::vector<Variant> Compact(const string& path) {
+    std::unique_ptr<VcfWriter> writer =
+        std::move(VcfWriter::ToFile(path, GvcfBlockHeader(reader_->Header()),
+                                    VcfWriterOptions())
+                      .ValueOrDie());
+    TF_CHECK_OK(CompactGvcf(reader_.get(), options_, writer.get(), &stats_));
+    TF_CHECK_OK(writer->Close());
+    std::unique_ptr<VcfReader> reader =
+        std::move(VcfReader::FromFile(path, VcfReaderOptions()).ValueOrDie());
+    return as_vector(reader->Iterate());
+  }
+
+  std::unique_ptr<VcfReader> reader_;
+  GvcfCompactionOptions options_;
+  GvcfCompactionStats stats_;
+};
+
+TEST_F(GvcfBlocksTest, CompactsReferenceBlocks) {
+  const std::vector<Variant> variants =
+      Compact(MakeTempFile("gvcf_blocks_compacted.vcf"));
+  EXPECT_EQ(7, stats_.records_read);
+  EXPECT_EQ(4, stats_.records_written);
+  EXPECT_EQ(2, stats_.blocks_written);
+  ASSERT_EQ(4, variants.size());
+
+  // The first three records share a GQ band.
+  const Variant& block = variants[0];
+  EXPECT_EQ(0, block.start());
+  EXPECT_EQ(5, block.end());
+  EXPECT_EQ("A", block.reference_bases());
+  EXPECT_THAT(block.alternate_bases(), ElementsAre("<*>"));
+  ASSERT_EQ(1, block.calls_size());
+  EXPECT_THAT(block.calls(0).genotype(), ElementsAre(0, 0));
+  EXPECT_THAT(IntField(block.calls(0), "GQ"), ElementsAre(30));
+  EXPECT_THAT(IntField(block.calls(0), "MIN_DP"), ElementsAre(10));
+  EXPECT_THAT(IntField(block.calls(0), "DP"), ElementsAre(10));
+  EXPECT_THAT(block.calls(0).genotype_likelihood(),
+              ElementsAre(DoubleEq(0), DoubleEq(-3), DoubleEq(-20)));
+
+  // A variant ends the block and is written unchanged.
+  EXPECT_EQ(5, variants[1].start());
+  EXPECT_THAT(variants[1].alternate_bases(), ElementsAre("C", "<*>"));
+
+  // A lone reference record is written as it was read.
+  EXPECT_EQ(6, variants[2].start());
+  EXPECT_EQ(7, variants[2].end());
+  EXPECT_EQ(0, variants[2].calls(0).info().count("MIN_DP"));
+
+  EXPECT_EQ(7, variants[3].start());
+  EXPECT_EQ(9, variants[3].end());
+  EXPECT_THAT(IntField(variants[3].calls(0), "GQ"), ElementsAre(10));
+  EXPECT_THAT(IntField(variants[3].calls(0), "MIN_DP"), ElementsAre(9));
+}
+
+TEST_F(GvcfBlocksTest, DropsPlsMissingFromSomeRecords) {
+  constexpr char kMixedPls[] =
+      "##fileformat=VCFv4.2\n"
+      "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End\">\n"
+      "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+      "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"GQ\">\n"
+      "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"PL\">\n"
+      "##contig=<ID=chr1,length=20>\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\n"
+      "chr1\t1\t.\tA\t<*>\t0\t.\t.\tGT:GQ:PL\t0/0:30:0,30,300\n"
+      "chr1\t2\t.\tC\t<*>\t0\t.\t.\tGT:GQ\t0/0:35\n";
+  reader_ = MakeVcfReader("gvcf_blocks_mixed_pls.vcf", kMixedPls);
+  const std::vector<Variant> variants =
+      Compact(MakeTempFile("gvcf_blocks_mixed_pls_compacted.vcf"));
+  ASSERT_EQ(1, variants.size());
+  EXPECT_EQ(2, variants[0].end());
+  // The PLs of the first record don't hold for the whole block.
+  EXPECT_THAT(variants[0].calls(0).genotype_likelihood(), ElementsAre());
+}
+
+TEST_F(GvcfBlocksTest, MedianDp) {
+  options_.dp = GvcfBlockDp::kMedianDp;
+  const std::vector<Variant> variants =
+      Compact(MakeTempFile("gvcf_blocks_median.vcf"));
+  ASSERT_EQ(4, variants.size());
+  // The DPs 10, 20 and 12 span 2, 1 and 2 bases.
+  EXPECT_THAT(IntField(variants[0].calls(0), "MIN_DP"), ElementsAre(10));
+  EXPECT_THAT(IntField(variants[0].calls(0), "DP"), ElementsAre(12));
+}
+
+TEST_F(GvcfBlocksTest, MaxBlockLength) {
+  options_.max_block_length = 3;
+  const std::vector<Variant> variants =
+      Compact(MakeTempFile("gvcf_blocks_max_length.vcf"));
+  ASSERT_EQ(5, variants.size());
+  EXPECT_EQ(0, variants[0].start());
+  EXPECT_EQ(3, variants[0].end());
+  EXPECT_EQ(3, variants[1].start());
+  EXPECT_EQ(5, variants[1].end());
+}
+
+TEST_F(GvcfBlocksTest, RejectsUnsortedBands) {
+  options_.gq_bands = {20, 10};
+  VcfWriterOptions writer_options;
+  std::unique_ptr<VcfWriter> writer = std::move(
+      VcfWriter::ToFile(MakeTempFile("gvcf_blocks_unused.vcf"),
+                        reader_->Header(), writer_options)
+          .ValueOrDie());
+  EXPECT_THAT(CompactGvcf(reader_.get(), options_, writer.get(), nullptr),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+}
+
+TEST_F(GvcfBlocksTest, ExpandsBlocksInRange) {
+  const string compacted = MakeTempFile("gvcf_blocks_to_expand.vcf.gz");
+  Compact(compacted);
+  TF_CHECK_OK(TbxIndexBuild(compacted));
+  std::unique_ptr<VcfReader> reader = std::move(
+      VcfReader::FromFile(compacted, VcfReaderOptions()).ValueOrDie());
+
+  std::vector<ContigInfo> contigs(1);
+  contigs[0].set_name("chr1");
+  contigs[0].set_n_bases(20);
+  std::vector<ReferenceSequence> seqs(1);
+  *seqs[0].mutable_region() = MakeRange("chr1", 0, 20);
+  seqs[0].set_bases(kReferenceBases);
+  std::unique_ptr<InMemoryFastaReader> ref =
+      std::move(InMemoryFastaReader::Create(contigs, seqs).ValueOrDie());
+
+  const string expanded = MakeTempFile("gvcf_blocks_expanded.vcf");
+  std::unique_ptr<VcfWriter> writer = std::move(
+      VcfWriter::ToFile(expanded, reader->Header(), VcfWriterOptions())
+          .ValueOrDie());
+  ASSERT_THAT(ExpandGvcfBlocks(reader.get(), MakeRange("chr1", 1, 6), *ref,
+                               writer.get()),
+              IsOK());
+  ASSERT_THAT(writer->Close(), IsOK());
+
+  const std::vector<Variant> variants = as_vector(
+      std::move(VcfReader::FromFile(expanded, VcfReaderOptions()).ValueOrDie())
+          ->Iterate());
+  ASSERT_EQ(5, variants.size());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(i + 1, variants[i].start());
+    EXPECT_EQ(i + 2, variants[i].end());
+    EXPECT_EQ(string(1, kReferenceBases[i + 1]),
+              variants[i].reference_bases());
+    EXPECT_THAT(IntField(variants[i].calls(0), "GQ"), ElementsAre(30));
+  }
+  // The variant in the range is written unchanged.
+  EXPECT_EQ(5, variants[4].start());
+  EXPECT_THAT(variants[4].alternate_bases(), ElementsAre("C", "<*>"));
+}
+
+}  // namespace nucleus
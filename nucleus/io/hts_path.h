@@ -23,6 +23,7 @@
 #include "htslib/faidx.h"
 #include "htslib/hts.h"
 #include "htslib/tbx.h"
+#include "htslib/vcf.h"
 
 namespace nucleus {
 
@@ -39,6 +40,8 @@ faidx_t *fai_load3_x(const std::string &fa_path, const std::string &fai_path,
 int tbx_index_build_x(const std::string &fn, int min_shift,
                       const tbx_conf_t *conf);
 
+int bcf_index_build_x(const std::string &fn, int min_shift);
+
 }  // namespace nucleus
 
 #endif  // THIRD_PARTY_NUCLEUS_IO_HTS_PATH_H_
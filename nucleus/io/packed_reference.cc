@@ -0,0 +1,463 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/packed_reference.h"
+
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "nucleus/io/reader_base.h"
+#include "nucleus/util/utils.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+using nucleus::genomics::v1::ContigInfo;
+using nucleus::genomics::v1::FastaReaderOptions;
+using nucleus::genomics::v1::Range;
+
+// The buffer holds, in host byte order and with every part 8-byte aligned:
+//
+//   A FileHeader.
+//   A ContigEntry for each contig.
+//   For each contig, its name, its packed bases, its exception runs and its
+//   lower case runs, at the offsets given by its ContigEntry.
+//
+// The bases are packed four to a byte, the first in the lowest bits. The
+// exception runs are the runs of bases other than A, C, G and T, which are
+// packed as A; their base is the upper-cased base. The runs of each contig are
+// sorted and don't overlap.
+struct PackedReference::BaseRun {
+  int64 start;
+  int64 end;
+  int64 base;
+};
+
+namespace {
+
+constexpr char kMagic[8] = {'N', 'U', 'C', 'P', 'K', 'R', 'E', 'F'};
+
+struct FileHeader {
+  char magic[8];
+  int64 num_contigs;
+};
+
+// Offsets are from the start of the buffer.
+struct ContigEntry {
+  int64 n_bases;
+  int64 name_offset;
+  int64 name_size;
+  int64 bases_offset;
+  int64 exceptions_offset;
+  int64 num_exceptions;
+  int64 lower_case_offset;
+  int64 num_lower_case;
+};
+
+constexpr char kBases[4] = {'A', 'C', 'G', 'T'};
+
+// The 2-bit code of an upper-cased base, or -1 if it isn't A, C, G or T.
+int BaseCode(char base) {
+  switch (base) {
+    case 'A':
+      return 0;
+    case 'C':
+      return 1;
+    case 'G':
+      return 2;
+    case 'T':
+      return 3;
+    default:
+      return -1;
+  }
+}
+
+// The four bases packed in each byte value.
+struct DecodeTable {
+  char bases[256][4];
+
+  DecodeTable() {
+    for (int byte = 0; byte < 256; ++byte) {
+      for (int i = 0; i < 4; ++i) {
+        bases[byte][i] = kBases[(byte >> (2 * i)) & 3];
+      }
+    }
+  }
+};
+
+const DecodeTable& GetDecodeTable() {
+  static const DecodeTable* table = new DecodeTable();
+  return *table;
+}
+
+// Calls fn(run, first, last) for each of the sorted runs overlapping
+// [start, end), with [first, last) the overlap. fn is a template parameter so
+// that it can be inlined.
+template <class Run, class Fn>
+void ForEachOverlap(const Run* runs, int64 num_runs, int64 start, int64 end,
+                    Fn fn) {
+  const Run* run =
+      std::upper_bound(runs, runs + num_runs, start,
+                       [](int64 pos, const Run& r) { return pos < r.end; });
+  for (; run != runs + num_runs && run->start < end; ++run) {
+    fn(*run, std::max(run->start, start), std::min(run->end, end));
+  }
+}
+
+// Appends size bytes of data to buffer, padded to a multiple of 8 bytes, and
+// returns the offset they were appended at.
+int64 AppendAligned(const void* data, size_t size, string* buffer) {
+  const int64 offset = buffer->size();
+  buffer->append(static_cast<const char*>(data), size);
+  buffer->append((8 - size % 8) % 8, '\0');
+  return offset;
+}
+
+}  // namespace
+
+// Iterable class for traversing all of the contigs of the reference.
+class PackedReferenceIterable : public GenomeReferenceRecordIterable {
+ public:
+  // Advance to the next record.
+  StatusOr<bool> Next(GenomeReferenceRecord* out) override;
+
+  // Constructor is invoked via PackedReference::Iterate.
+  PackedReferenceIterable(const PackedReference* reader);
+  ~PackedReferenceIterable() override;
+
+ private:
+  size_t pos_ = 0;
+};
+
+StatusOr<std::unique_ptr<PackedReference>> PackedReference::FromReference(
+    const GenomeReference& reference, const FastaReaderOptions& options) {
+  StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>> records =
+      reference.Iterate();
+  TF_RETURN_IF_ERROR(records.status());
+
+  // The parts after the contig entries, whose offsets are made relative to
+  // the start of the buffer once the number of contigs is known.
+  std::vector<ContigEntry> entries;
+  string payload;
+  GenomeReferenceRecord record;
+  while (true) {
+    StatusOr<bool> has_next = records.ValueOrDie()->Next(&record);
+    TF_RETURN_IF_ERROR(has_next.status());
+    if (!has_next.ValueOrDie()) break;
+    const string& bases = record.second;
+    const int64 n_bases = bases.size();
+    string packed((n_bases + 3) / 4, '\0');
+    std::vector<BaseRun> exceptions;
+    std::vector<BaseRun> lower_case;
+    for (int64 i = 0; i < n_bases; ++i) {
+      const char upper = absl::ascii_toupper(bases[i]);
+      int code = BaseCode(upper);
+      if (code < 0) {
+        if (!exceptions.empty() && exceptions.back().end == i &&
+            exceptions.back().base == upper) {
+          ++exceptions.back().end;
+        } else {
+          exceptions.push_back({i, i + 1, upper});
+        }
+        code = 0;
+      }
+      packed[i / 4] |= code << (2 * (i % 4));
+      if (bases[i] != upper) {
+        if (!lower_case.empty() && lower_case.back().end == i) {
+          ++lower_case.back().end;
+        } else {
+          lower_case.push_back({i, i + 1, 0});
+        }
+      }
+    }
+
+    ContigEntry entry;
+    entry.n_bases = n_bases;
+    entry.name_size = record.first.size();
+    entry.name_offset =
+        AppendAligned(record.first.data(), record.first.size(), &payload);
+    entry.bases_offset = AppendAligned(packed.data(), packed.size(), &payload);
+    entry.num_exceptions = exceptions.size();
+    entry.exceptions_offset = AppendAligned(
+        exceptions.data(), exceptions.size() * sizeof(BaseRun), &payload);
+    entry.num_lower_case = lower_case.size();
+    entry.lower_case_offset = AppendAligned(
+        lower_case.data(), lower_case.size() * sizeof(BaseRun), &payload);
+    entries.push_back(entry);
+  }
+  TF_RETURN_IF_ERROR(records.ValueOrDie()->Release());
+
+  const int64 payload_offset =
+      sizeof(FileHeader) + entries.size() * sizeof(ContigEntry);
+  for (ContigEntry& entry : entries) {
+    entry.name_offset += payload_offset;
+    entry.bases_offset += payload_offset;
+    entry.exceptions_offset += payload_offset;
+    entry.lower_case_offset += payload_offset;
+  }
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.num_contigs = entries.size();
+  string buffer;
+  buffer.reserve(payload_offset + payload.size());
+  AppendAligned(&header, sizeof(header), &buffer);
+  AppendAligned(entries.data(), entries.size() * sizeof(ContigEntry), &buffer);
+  buffer.append(payload);
+
+  std::unique_ptr<PackedReference> packed(
+      new PackedReference(std::move(buffer), nullptr, options));
+  TF_RETURN_IF_ERROR(packed->Load());
+  return std::move(packed);
+}
+
+StatusOr<std::unique_ptr<PackedReference>> PackedReference::FromFasta(
+    const string& fasta_path, const string& fai_path,
+    const FastaReaderOptions& options) {
+  // The FASTA is read once, in its true case, so it isn't worth caching.
+  FastaReaderOptions fasta_options;
+  fasta_options.set_keep_true_case(true);
+  StatusOr<std::unique_ptr<IndexedFastaReader>> fasta =
+      IndexedFastaReader::FromFile(fasta_path, fai_path, fasta_options, 0);
+  TF_RETURN_IF_ERROR(fasta.status());
+  return FromReference(*fasta.ValueOrDie(), options);
+}
+
+StatusOr<std::unique_ptr<PackedReference>> PackedReference::FromFile(
+    const string& path, const FastaReaderOptions& options) {
+  std::unique_ptr<tf::ReadOnlyMemoryRegion> region;
+  TF_RETURN_IF_ERROR(
+      tf::Env::Default()->NewReadOnlyMemoryRegionFromFile(path, &region));
+  std::unique_ptr<PackedReference> packed(
+      new PackedReference(string(), std::move(region), options));
+  tf::Status status = packed->Load();
+  if (!status.ok()) {
+    return tf::errors::DataLoss("Malformed packed reference ", path, ": ",
+                                status.error_message());
+  }
+  return std::move(packed);
+}
+
+PackedReference::PackedReference(
+    string owned_buffer, std::unique_ptr<tf::ReadOnlyMemoryRegion> region,
+    const FastaReaderOptions& options)
+    : owned_buffer_(std::move(owned_buffer)),
+      region_(std::move(region)),
+      options_(options) {
+  if (region_ != nullptr) {
+    data_ = static_cast<const char*>(region_->data());
+    size_ = region_->length();
+  } else {
+    data_ = owned_buffer_.data();
+    size_ = owned_buffer_.size();
+  }
+}
+
+PackedReference::~PackedReference() {}
+
+tf::Status PackedReference::Load() {
+  // Is [offset, offset + size) within the buffer?
+  auto in_bounds = [this](int64 offset, int64 size) {
+    return offset >= 0 && size >= 0 && offset <= size_ &&
+           size <= size_ - offset;
+  };
+  // Are the num runs at offset aligned, in the buffer, sorted and within a
+  // contig of n_bases?
+  auto valid_runs = [&](int64 offset, int64 num, int64 n_bases) {
+    if (offset % 8 != 0 || num < 0 ||
+        num > size_ / static_cast<int64>(sizeof(BaseRun)) ||
+        !in_bounds(offset, num * sizeof(BaseRun))) {
+      return false;
+    }
+    const BaseRun* runs = reinterpret_cast<const BaseRun*>(data_ + offset);
+    int64 previous_end = 0;
+    for (int64 i = 0; i < num; ++i) {
+      if (runs[i].start < previous_end || runs[i].start >= runs[i].end ||
+          runs[i].end > n_bases) {
+        return false;
+      }
+      previous_end = runs[i].end;
+    }
+    return true;
+  };
+
+  if (!in_bounds(0, sizeof(FileHeader))) {
+    return tf::errors::DataLoss("Buffer too small for the header");
+  }
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(data_);
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+    return tf::errors::DataLoss("Not a packed reference");
+  }
+  if (header->num_contigs < 0 ||
+      header->num_contigs > size_ / static_cast<int64>(sizeof(ContigEntry)) ||
+      !in_bounds(sizeof(FileHeader),
+                 header->num_contigs * sizeof(ContigEntry))) {
+    return tf::errors::DataLoss("Bad number of contigs ",
+                                header->num_contigs);
+  }
+  const ContigEntry* entries =
+      reinterpret_cast<const ContigEntry*>(data_ + sizeof(FileHeader));
+  for (int64 i = 0; i < header->num_contigs; ++i) {
+    const ContigEntry& entry = entries[i];
+    if (entry.n_bases < 0 || !in_bounds(entry.name_offset, entry.name_size) ||
+        !in_bounds(entry.bases_offset, (entry.n_bases + 3) / 4) ||
+        !valid_runs(entry.exceptions_offset, entry.num_exceptions,
+                    entry.n_bases) ||
+        !valid_runs(entry.lower_case_offset, entry.num_lower_case,
+                    entry.n_bases)) {
+      return tf::errors::DataLoss("Bad entry for contig ", i);
+    }
+    ContigInfo contig;
+    contig.set_name(string(data_ + entry.name_offset, entry.name_size));
+    contig.set_description("");
+    contig.set_n_bases(entry.n_bases);
+    contig.set_pos_in_fasta(i);
+    contig_indices_[contig.name()] = i;
+    contigs_.push_back(contig);
+    packed_.push_back(
+        {reinterpret_cast<const uint8*>(data_ + entry.bases_offset),
+         reinterpret_cast<const BaseRun*>(data_ + entry.exceptions_offset),
+         entry.num_exceptions,
+         reinterpret_cast<const BaseRun*>(data_ + entry.lower_case_offset),
+         entry.num_lower_case});
+  }
+  return tf::Status::OK();
+}
+
+tf::Status PackedReference::DecodeBases(const Range& range,
+                                        string* bases) const {
+  if (data_ == nullptr) {
+    return tf::errors::FailedPrecondition(
+        "can't read from closed PackedReference object.");
+  }
+  const auto it = contig_indices_.find(range.reference_name());
+  if (it == contig_indices_.end() || range.start() < 0 ||
+      range.start() > range.end() ||
+      range.start() >= contigs_[it->second].n_bases() ||
+      range.end() > contigs_[it->second].n_bases()) {
+    return tf::errors::InvalidArgument("Invalid interval: ",
+                                       range.ShortDebugString());
+  }
+  const PackedContig& contig = packed_[it->second];
+  const int64 start = range.start();
+  const int64 end = range.end();
+  bases->resize(end - start);
+  char* out = &(*bases)[0];
+
+  // Bases up to a byte boundary are decoded one at a time, and the bases of
+  // whole bytes four at a time.
+  const DecodeTable& table = GetDecodeTable();
+  int64 pos = start;
+  for (; pos < end && pos % 4 != 0; ++pos) {
+    *out++ = kBases[(contig.bases[pos / 4] >> (2 * (pos % 4))) & 3];
+  }
+  for (; pos + 4 <= end; pos += 4, out += 4) {
+    memcpy(out, table.bases[contig.bases[pos / 4]], 4);
+  }
+  for (; pos < end; ++pos) {
+    *out++ = kBases[(contig.bases[pos / 4] >> (2 * (pos % 4))) & 3];
+  }
+
+  ForEachOverlap(contig.exceptions, contig.num_exceptions, start, end,
+                 [&](const BaseRun& run, int64 first, int64 last) {
+                   std::fill(bases->begin() + (first - start),
+                             bases->begin() + (last - start),
+                             static_cast<char>(run.base));
+                 });
+  if (options_.keep_true_case()) {
+    ForEachOverlap(contig.lower_case, contig.num_lower_case, start, end,
+                   [&](const BaseRun& run, int64 first, int64 last) {
+                     for (int64 i = first; i < last; ++i) {
+                       (*bases)[i - start] =
+                           absl::ascii_tolower((*bases)[i - start]);
+                     }
+                   });
+  }
+  return tf::Status::OK();
+}
+
+StatusOr<string> PackedReference::GetBases(const Range& range) const {
+  string bases;
+  TF_RETURN_IF_ERROR(DecodeBases(range, &bases));
+  return bases;
+}
+
+tf::Status PackedReference::GetBasesBatch(const std::vector<Range>& ranges,
+                                          std::vector<string>* bases) const {
+  bases->resize(ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    TF_RETURN_IF_ERROR(DecodeBases(ranges[i], &(*bases)[i]));
+  }
+  return tf::Status::OK();
+}
+
+tf::Status PackedReference::WriteToFile(const string& path) const {
+  if (data_ == nullptr) {
+    return tf::errors::FailedPrecondition(
+        "can't write closed PackedReference object.");
+  }
+  return tf::WriteStringToFile(tf::Env::Default(), path,
+                               tf::StringPiece(data_, size_));
+}
+
+StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>>
+PackedReference::Iterate() const {
+  return StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>>(
+      MakeIterable<PackedReferenceIterable>(this));
+}
+
+tf::Status PackedReference::Close() {
+  if (data_ == nullptr) {
+    return tf::errors::FailedPrecondition("PackedReference already closed");
+  }
+  data_ = nullptr;
+  size_ = 0;
+  packed_.clear();
+  string().swap(owned_buffer_);
+  region_ = nullptr;
+  return tf::Status::OK();
+}
+
+StatusOr<bool> PackedReferenceIterable::Next(GenomeReferenceRecord* out) {
+  TF_RETURN_IF_ERROR(CheckIsAlive());
+  const PackedReference* reference =
+      static_cast<const PackedReference*>(reader_);
+  if (pos_ >= reference->contigs_.size()) {
+    return false;
+  }
+  const ContigInfo& contig = reference->contigs_.at(pos_);
+  out->first = contig.name();
+  if (contig.n_bases() > 0) {
+    TF_RETURN_IF_ERROR(reference->DecodeBases(
+        MakeRange(contig.name(), 0, contig.n_bases()), &out->second));
+  } else {
+    out->second.clear();
+  }
+  pos_++;
+  return true;
+}
+
+PackedReferenceIterable::~PackedReferenceIterable() {}
+
+PackedReferenceIterable::PackedReferenceIterable(
+    const PackedReference* reader)
+    : Iterable(reader) {}
+
+}  // namespace nucleus
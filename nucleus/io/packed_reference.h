@@ -0,0 +1,153 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+// A compact, read-only reference genome with 2 bits per base.
+//
+// A PackedReference stores the A, C, G and T bases of each contig in 2 bits,
+// four bases per byte. The other bases (N and the IUPAC ambiguity codes) are
+// kept as a sorted list of runs of identical bases, and the case of the bases
+// as a sorted list of runs of lower case bases. A human genome thus takes a
+// bit over a quarter of the memory of its FASTA.
+//
+// The packed representation is a single contiguous buffer that can be written
+// to a file with WriteToFile and memory-mapped back with FromFile, so that
+// many processes can share one read-only copy through the page cache. The
+// files are in the byte order of the host that wrote them.
+#ifndef THIRD_PARTY_NUCLEUS_IO_PACKED_REFERENCE_H_
+#define THIRD_PARTY_NUCLEUS_IO_PACKED_REFERENCE_H_
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "nucleus/io/reference.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/fasta.pb.h"
+#include "nucleus/protos/range.pb.h"
+#include "nucleus/protos/reference.pb.h"
+#include "nucleus/vendor/statusor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/file_system.h"
+
+namespace nucleus {
+
+class PackedReference : public GenomeReference {
+ public:
+  // Packs all of the contigs of reference, in order. The bases are packed in
+  // the case reference returns them in, so reference must keep their true
+  // case for the case to be preserved.
+  static StatusOr<std::unique_ptr<PackedReference>> FromReference(
+      const GenomeReference& reference,
+      const nucleus::genomics::v1::FastaReaderOptions& options);
+
+  // Packs the FASTA file fasta_path, which has the FAI index fai_path and can
+  // be block-gzipped.
+  static StatusOr<std::unique_ptr<PackedReference>> FromFasta(
+      const string& fasta_path, const string& fai_path,
+      const nucleus::genomics::v1::FastaReaderOptions& options);
+
+  // Memory-maps the packed reference written by WriteToFile to path.
+  static StatusOr<std::unique_ptr<PackedReference>> FromFile(
+      const string& path,
+      const nucleus::genomics::v1::FastaReaderOptions& options);
+
+  ~PackedReference();
+
+  // Disable copy and assignment operations
+  PackedReference(const PackedReference& other) = delete;
+  PackedReference& operator=(const PackedReference&) = delete;
+
+  const std::vector<nucleus::genomics::v1::ContigInfo>& Contigs()
+      const override {
+    return contigs_;
+  }
+
+  // Gets the bases of range, upper-cased unless the keep_true_case option is
+  // set.
+  StatusOr<string> GetBases(
+      const nucleus::genomics::v1::Range& range) const override;
+
+  // Gets the bases of each of ranges into the corresponding element of bases,
+  // which is resized to the number of ranges. The existing strings of bases
+  // are reused, so decoding into the same vector repeatedly doesn't allocate
+  // once its strings are large enough. Fails if any of the ranges is invalid.
+  tensorflow::Status GetBasesBatch(
+      const std::vector<nucleus::genomics::v1::Range>& ranges,
+      std::vector<string>* bases) const;
+
+  // Writes the packed reference to path, to be loaded with FromFile.
+  tensorflow::Status WriteToFile(const string& path) const;
+
+  // Get the options controlling the behavior of this FastaReader.
+  const nucleus::genomics::v1::FastaReaderOptions& Options() const {
+    return options_;
+  }
+
+  StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>> Iterate()
+      const override;
+
+  // Releases the packed bases.
+  tensorflow::Status Close() override;
+
+ private:
+  // Allow iteration to access the underlying reader.
+  friend class PackedReferenceIterable;
+
+  // A run of bases of a contig, as stored in the buffer.
+  struct BaseRun;
+
+  // The packed data of a contig, pointing into the buffer.
+  struct PackedContig {
+    const uint8* bases;
+    const BaseRun* exceptions;
+    int64 num_exceptions;
+    const BaseRun* lower_case;
+    int64 num_lower_case;
+  };
+
+  // Must use one of the static factory methods. The buffer is either owned,
+  // or the mapped region.
+  PackedReference(string owned_buffer,
+                  std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region,
+                  const nucleus::genomics::v1::FastaReaderOptions& options);
+
+  // Checks the layout of the buffer and fills in contigs_ and packed_.
+  tensorflow::Status Load();
+
+  // Decodes the bases of range into bases, whose contents are replaced.
+  tensorflow::Status DecodeBases(const nucleus::genomics::v1::Range& range,
+                                 string* bases) const;
+
+  // The buffer holding the packed reference, and its size. Points into either
+  // owned_buffer_ or region_, and is nullptr once closed.
+  const char* data_;
+  int64 size_;
+  string owned_buffer_;
+  std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region_;
+
+  std::vector<nucleus::genomics::v1::ContigInfo> contigs_;
+  std::vector<PackedContig> packed_;
+
+  // The index of each contig in contigs_, by name.
+  std::unordered_map<string, int> contig_indices_;
+
+  // The options controlling the behavior of this FastaReader.
+  const nucleus::genomics::v1::FastaReaderOptions options_;
+};
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_IO_PACKED_REFERENCE_H_
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/packed_reference.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock-generated-matchers.h>
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock-more-matchers.h>
+
+#include "tensorflow/core/platform/test.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "nucleus/io/reference.h"
+#include "nucleus/protos/fasta.pb.h"
+#include "nucleus/protos/range.pb.h"
+#include "nucleus/protos/reference.pb.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/util/utils.h"
+#include "nucleus/vendor/status_matchers.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace nucleus {
+
+using absl::StrCat;
+using genomics::v1::ContigInfo;
+using genomics::v1::FastaReaderOptions;
+using genomics::v1::Range;
+using genomics::v1::ReferenceSequence;
+using ::testing::ElementsAre;
+
+namespace {
+
+// Has runs of N and IUPAC codes and of lower case bases, crossing the byte
+// boundaries of the packed bases.
+constexpr char kMixedBases[] = "ACGTNNNNNacgtnnRYKMacgTTGCAwsbdhvNACGT";
+
+FastaReaderOptions KeepTrueCase(bool keep_true_case) {
+  FastaReaderOptions options;
+  options.set_keep_true_case(keep_true_case);
+  return options;
+}
+
+// An InMemoryFastaReader with a contig of kMixedBases and a contig with a
+// single base.
+std::unique_ptr<InMemoryFastaReader> MixedReference() {
+  std::vector<ContigInfo> contigs(2);
+  std::vector<ReferenceSequence> seqs(2);
+  const std::vector<std::pair<string, string>> records = {
+      {"mixed", kMixedBases}, {"single", "g"}};
+  for (int i = 0; i < 2; ++i) {
+    contigs[i].set_name(records[i].first);
+    contigs[i].set_pos_in_fasta(i);
+    contigs[i].set_n_bases(records[i].second.size());
+    *seqs[i].mutable_region() =
+        MakeRange(records[i].first, 0, records[i].second.size());
+    seqs[i].set_bases(records[i].second);
+  }
+  return std::move(InMemoryFastaReader::Create(contigs, seqs).ValueOrDie());
+}
+
+// Checks that packed has the contigs of expected, and gets the same bases as
+// it for every range.
+void ExpectSameReference(const GenomeReference& expected,
+                         const GenomeReference& packed) {
+  ASSERT_EQ(expected.ContigNames(), packed.ContigNames());
+  for (const ContigInfo& contig : expected.Contigs()) {
+    EXPECT_EQ(contig.n_bases(),
+              packed.Contig(contig.name()).ValueOrDie()->n_bases());
+    for (int64 start = 0; start < contig.n_bases(); ++start) {
+      for (int64 end = start; end <= contig.n_bases(); ++end) {
+        const Range range = MakeRange(contig.name(), start, end);
+        EXPECT_EQ(expected.GetBases(range).ValueOrDie(),
+                  packed.GetBases(range).ValueOrDie())
+            << range.ShortDebugString();
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(PackedReferenceTest, PacksFasta) {
+  const string fasta = GetTestData("test.fasta");
+  for (bool keep_true_case : {false, true}) {
+    std::unique_ptr<IndexedFastaReader> expected =
+        std::move(IndexedFastaReader::FromFile(fasta, StrCat(fasta, ".fai"),
+                                               KeepTrueCase(keep_true_case))
+                      .ValueOrDie());
+    std::unique_ptr<PackedReference> packed = std::move(
+        PackedReference::FromFasta(fasta, StrCat(fasta, ".fai"),
+                                   KeepTrueCase(keep_true_case))
+            .ValueOrDie());
+    ExpectSameReference(*expected, *packed);
+  }
+}
+
+TEST(PackedReferenceTest, PacksExceptionsAndCase) {
+  std::unique_ptr<InMemoryFastaReader> expected = MixedReference();
+  std::unique_ptr<PackedReference> packed = std::move(
+      PackedReference::FromReference(*expected, KeepTrueCase(true))
+          .ValueOrDie());
+  ExpectSameReference(*expected, *packed);
+
+  std::unique_ptr<PackedReference> upper_cased = std::move(
+      PackedReference::FromReference(*expected, KeepTrueCase(false))
+          .ValueOrDie());
+  EXPECT_EQ(absl::AsciiStrToUpper(kMixedBases),
+            upper_cased->GetBases(MakeRange("mixed", 0, 38)).ValueOrDie());
+  EXPECT_EQ("G", upper_cased->GetBases(MakeRange("single", 0, 1)).ValueOrDie());
+}
+
+TEST(PackedReferenceTest, RoundTripsThroughFile) {
+  std::unique_ptr<InMemoryFastaReader> expected = MixedReference();
+  const string path = MakeTempFile("mixed.packed");
+  ASSERT_THAT(PackedReference::FromReference(*expected, KeepTrueCase(true))
+                  .ValueOrDie()
+                  ->WriteToFile(path),
+              IsOK());
+  StatusOr<std::unique_ptr<PackedReference>> packed =
+      PackedReference::FromFile(path, KeepTrueCase(true));
+  ASSERT_THAT(packed.status(), IsOK());
+  ExpectSameReference(*expected, *packed.ValueOrDie());
+
+  auto iterator = packed.ValueOrDie()->Iterate().ValueOrDie();
+  GenomeReferenceRecord r;
+  ASSERT_TRUE(iterator->Next(&r).ValueOrDie());
+  EXPECT_EQ(std::make_pair(string("mixed"), string(kMixedBases)), r);
+  ASSERT_TRUE(iterator->Next(&r).ValueOrDie());
+  EXPECT_EQ(std::make_pair(string("single"), string("g")), r);
+  EXPECT_FALSE(iterator->Next(&r).ValueOrDie());
+}
+
+TEST(PackedReferenceTest, RejectsMalformedFiles) {
+  EXPECT_THAT(PackedReference::FromFile(GetTestData("test.fasta"),
+                                        FastaReaderOptions()),
+              IsNotOKWithCodeAndMessage(tensorflow::error::DATA_LOSS,
+                                        "Not a packed reference"));
+
+  // A packed reference cut short in the lower case runs of its last contig.
+  const string full = MakeTempFile("full.packed");
+  ASSERT_THAT(PackedReference::FromReference(*MixedReference(),
+                                             FastaReaderOptions())
+                  .ValueOrDie()
+                  ->WriteToFile(full),
+              IsOK());
+  string contents;
+  TF_CHECK_OK(tensorflow::ReadFileToString(tensorflow::Env::Default(), full,
+                                           &contents));
+  const string truncated = MakeTempFile("truncated.packed");
+  TF_CHECK_OK(tensorflow::WriteStringToFile(
+      tensorflow::Env::Default(), truncated,
+      contents.substr(0, contents.size() - 16)));
+  EXPECT_THAT(PackedReference::FromFile(truncated, FastaReaderOptions()),
+              IsNotOKWithCodeAndMessage(tensorflow::error::DATA_LOSS,
+                                        "Bad entry for contig"));
+}
+
+TEST(PackedReferenceTest, GetsBasesInBatches) {
+  std::unique_ptr<PackedReference> packed = std::move(
+      PackedReference::FromReference(*MixedReference(), KeepTrueCase(true))
+          .ValueOrDie());
+  std::vector<string> bases = {"stale", "strings", "to", "reuse"};
+  ASSERT_THAT(packed->GetBasesBatch(
+                  {MakeRange("mixed", 3, 10), MakeRange("single", 0, 1),
+                   MakeRange("mixed", 17, 21)},
+                  &bases),
+              IsOK());
+  EXPECT_THAT(bases, ElementsAre("TNNNNNa", "g", "KMac"));
+
+  EXPECT_THAT(packed->GetBasesBatch(
+                  {MakeRange("mixed", 0, 1), MakeRange("mixed", 0, 39)},
+                  &bases),
+              IsNotOKWithCodeAndMessage(tensorflow::error::INVALID_ARGUMENT,
+                                        "Invalid interval"));
+}
+
+TEST(PackedReferenceTest, ReadAfterCloseIsntOK) {
+  std::unique_ptr<PackedReference> packed = std::move(
+      PackedReference::FromReference(*MixedReference(), FastaReaderOptions())
+          .ValueOrDie());
+  ASSERT_THAT(packed->Close(), IsOK());
+  EXPECT_THAT(packed->GetBases(MakeRange("mixed", 0, 10)),
+              IsNotOKWithCodeAndMessage(
+                  tensorflow::error::FAILED_PRECONDITION,
+                  "can't read from closed PackedReference object"));
+  EXPECT_THAT(packed->WriteToFile(MakeTempFile("closed.packed")),
+              IsNotOKWithCode(tensorflow::error::FAILED_PRECONDITION));
+  EXPECT_THAT(packed->Close(),
+              IsNotOKWithCode(tensorflow::error::FAILED_PRECONDITION));
+}
+
+}  // namespace nucleus
@@ -18,6 +18,7 @@ from __future__ import division
 from __future__ import print_function
 
 from absl.testing import absltest
+import numpy as np
 
 from nucleus.io.python import vcf_reader
 from nucleus.protos import reference_pb2
@@ -172,6 +173,20 @@ class WrapVcfReaderTests(absltest.TestCase):
     iterable = self.samples_reader.query(range1)
     self.assertEqual(test_utils.iterable_len(iterable), 4)
 
+  def test_vcf_query_genotype_matrices(self):
+    range1 = ranges.parse_literal('chr3:100,000-500,000')
+    with self.samples_reader.query_genotype_matrices(range1, 0, 2) as it:
+      matrices = list(it)
+    self.assertLen(matrices, 1)
+    matrix = matrices[0]
+    self.assertEqual(matrix.genotypes.shape, (4, 1, 2))
+    self.assertEqual(matrix.genotypes.dtype, np.int8)
+    self.assertEqual(matrix.dosages.shape, (4, 1))
+    self.assertEqual(matrix.phased.shape, (4, 1))
+    self.assertEqual(matrix.phased.dtype, np.uint8)
+    self.assertEqual(list(matrix.starts),
+                     [v.start for v in self.samples_reader.query(range1)])
+
   def test_vcf_from_string(self):
     v = self.samples_reader.from_string(
         'chr3\t370537\trs142286746\tC\tCA,CAA\t350.73\tPASS\t'
@@ -23,6 +23,8 @@
 #include <utility>
 
 #include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "htslib/tbx.h"
 #include "nucleus/io/hts_path.h"
@@ -33,6 +35,7 @@
 #include "nucleus/util/utils.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 
 namespace tf = tensorflow;
@@ -129,37 +132,37 @@ class IndexedFastaReaderIterable : public GenomeReferenceRecordIterable {
 
 StatusOr<std::unique_ptr<IndexedFastaReader>> IndexedFastaReader::FromFile(
     const string& fasta_path, const string& fai_path,
-    int cache_size_bases) {
+    int cache_size_bases, int cache_num_blocks) {
   nucleus::genomics::v1::FastaReaderOptions options =
       nucleus::genomics::v1::FastaReaderOptions();
-  return FromFile(fasta_path, fai_path, options, cache_size_bases);
+  return FromFile(fasta_path, fai_path, options, cache_size_bases,
+                  cache_num_blocks);
 }
 
 StatusOr<std::unique_ptr<IndexedFastaReader>> IndexedFastaReader::FromFile(
     const string& fasta_path, const string& fai_path,
     const nucleus::genomics::v1::FastaReaderOptions& options,
-    int cache_size_bases) {
+    int cache_size_bases, int cache_num_blocks) {
   const string gzi = fasta_path + ".gzi";
   faidx_t* faidx = fai_load3_x(fasta_path, fai_path, gzi, 0);
   if (faidx == nullptr) {
     return tensorflow::errors::NotFound(
         "could not load fasta and/or fai for fasta ", fasta_path);
   }
-  return std::unique_ptr<IndexedFastaReader>(
-      new IndexedFastaReader(fasta_path, faidx, options, cache_size_bases));
+  return std::unique_ptr<IndexedFastaReader>(new IndexedFastaReader(
+      fasta_path, faidx, options, cache_size_bases, cache_num_blocks));
 }
 
 IndexedFastaReader::IndexedFastaReader(
     const string& fasta_path, faidx_t* faidx,
     const nucleus::genomics::v1::FastaReaderOptions& options,
-    int cache_size_bases)
+    int cache_size_bases, int cache_num_blocks)
     : fasta_path_(fasta_path),
       faidx_(faidx),
       options_(options),
       contigs_(ExtractContigsFromFai(faidx)),
       cache_size_bases_(cache_size_bases),
-      small_read_cache_(),
-      cached_range_() {}
+      cache_num_blocks_(cache_num_blocks) {}
 
 IndexedFastaReader::~IndexedFastaReader() {
   if (faidx_) {
@@ -182,30 +185,32 @@ StatusOr<string> IndexedFastaReader::GetBases(const Range& range) const {
     return string("");
   }
 
-  bool use_cache = (cache_size_bases_ > 0) &&
+  bool use_cache = (cache_size_bases_ > 0) && (cache_num_blocks_ > 0) &&
                    (range.end() - range.start() <= cache_size_bases_);
-  Range range_to_fetch;
-
-  if (use_cache) {
-    if (cached_range_ && RangeContains(*cached_range_, range)) {
-      // Get from cache!
-      string result = small_read_cache_.substr(
-          range.start() - cached_range_->start(), range.end() - range.start());
-      return result;
-    } else {
-      // Prepare to fetch a sizeable chunk from the FASTA.
-      int64 contig_n_bases =
-          Contig(range.reference_name()).ValueOrDie()->n_bases();
-      range_to_fetch = MakeRange(
-          range.reference_name(), range.start(),
-          std::min(static_cast<int64>(range.start() + cache_size_bases_),
-                   contig_n_bases));
-      CHECK(IsValidInterval(range_to_fetch));
-    }
-  } else {
-    range_to_fetch = range;
+  if (!use_cache) {
+    return FetchBases(range);
   }
 
+  // The range spans one or two blocks, which are copied from as they are
+  // looked up, as getting the second can evict the first.
+  const int contig =
+      Contig(range.reference_name()).ValueOrDie()->pos_in_fasta();
+  string result;
+  result.reserve(range.end() - range.start());
+  for (int64 index = range.start() / cache_size_bases_;
+       index * cache_size_bases_ < range.end(); ++index) {
+    StatusOr<const string*> block = GetCacheBlock(contig, index);
+    TF_RETURN_IF_ERROR(block.status());
+    const int64 block_start = index * cache_size_bases_;
+    const int64 first = std::max<int64>(range.start(), block_start);
+    const int64 last =
+        std::min<int64>(range.end(), block_start + cache_size_bases_);
+    result.append(*block.ValueOrDie(), first - block_start, last - first);
+  }
+  return result;
+}
+
+StatusOr<string> IndexedFastaReader::FetchBases(const Range& range) const {
   // According to htslib docs, faidx_fetch_seq c_name is the contig name,
   // start is the first base (zero-based) to include and end is the last base
   // (zero-based) to include. Len is an output variable returning the length
@@ -213,9 +218,8 @@ StatusOr<string> IndexedFastaReader::GetBases(const Range& range) const {
   // The returned pointer must be freed. We need to subtract one from our end
   // since end is exclusive in GenomeReference but faidx has an inclusive one.
   int len;
-  char* bases =
-      faidx_fetch_seq(faidx_, range_to_fetch.reference_name().c_str(),
-                      range_to_fetch.start(), range_to_fetch.end() - 1, &len);
+  char* bases = faidx_fetch_seq(faidx_, range.reference_name().c_str(),
+                                range.start(), range.end() - 1, &len);
   if (len <= 0)
     return tensorflow::errors::InvalidArgument("Couldn't fetch bases for ",
                                                range.ShortDebugString());
@@ -224,15 +228,38 @@ StatusOr<string> IndexedFastaReader::GetBases(const Range& range) const {
     absl::AsciiStrToUpper(&result);
   }
   free(bases);
+  return result;
+}
 
-  if (use_cache) {
-    // Update cache.
-    small_read_cache_ = result;
-    cached_range_ = range_to_fetch;
-    // Return the requested substring.
-    result = small_read_cache_.substr(0, range.end() - range.start());
+StatusOr<const string*> IndexedFastaReader::GetCacheBlock(int contig,
+                                                          int64 index) const {
+  const auto key = std::make_pair(contig, index);
+  const auto cached = cache_index_.find(key);
+  if (cached != cache_index_.end()) {
+    ++cache_hits_;
+    // Moves the block to the front of the list.
+    cache_blocks_.splice(cache_blocks_.begin(), cache_blocks_,
+                         cached->second);
+    return &cached->second->bases;
   }
-  return result;
+
+  ++cache_misses_;
+  const string& name = contigs_[contig].name();
+  const int64 block_start = index * cache_size_bases_;
+  StatusOr<string> bases = FetchBases(MakeRange(
+      name, block_start,
+      std::min<int64>(block_start + cache_size_bases_,
+                      contigs_[contig].n_bases())));
+  TF_RETURN_IF_ERROR(bases.status());
+  if (cache_blocks_.size() >= static_cast<size_t>(cache_num_blocks_)) {
+    // Evicts the least recently used block.
+    const CacheBlock& evicted = cache_blocks_.back();
+    cache_index_.erase(std::make_pair(evicted.contig, evicted.index));
+    cache_blocks_.pop_back();
+  }
+  cache_blocks_.push_front({contig, index, bases.ConsumeValueOrDie()});
+  cache_index_[key] = cache_blocks_.begin();
+  return &cache_blocks_.front().bases;
 }
 
 StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>>
@@ -248,6 +275,8 @@ tensorflow::Status IndexedFastaReader::Close() {
   } else {
     fai_destroy(faidx_);
     faidx_ = nullptr;
+    cache_blocks_.clear();
+    cache_index_.clear();
   }
   return tensorflow::Status::OK();
 }
@@ -275,6 +304,187 @@ IndexedFastaReaderIterable::IndexedFastaReaderIterable(
     const IndexedFastaReader* reader)
     : Iterable(reader) {}
 
+// ###########################################################################
+//
+// MmapFastaReader code
+//
+// ###########################################################################
+
+// Iterable class for traversing all Fasta records in the file.
+class MmapFastaReaderIterable : public GenomeReferenceRecordIterable {
+ public:
+  // Advance to the next record.
+  StatusOr<bool> Next(GenomeReferenceRecord* out) override;
+
+  // Constructor is invoked via MmapFastaReader::Iterate.
+  MmapFastaReaderIterable(const MmapFastaReader* reader);
+  ~MmapFastaReaderIterable() override;
+
+ private:
+  size_t pos_ = 0;
+};
+
+StatusOr<std::unique_ptr<MmapFastaReader>> MmapFastaReader::FromFile(
+    const string& fasta_path, const string& fai_path,
+    const nucleus::genomics::v1::FastaReaderOptions& options) {
+  string fai;
+  TF_RETURN_IF_ERROR(tf::ReadFileToString(tf::Env::Default(), fai_path, &fai));
+  std::unique_ptr<tf::ReadOnlyMemoryRegion> region;
+  TF_RETURN_IF_ERROR(tf::Env::Default()->NewReadOnlyMemoryRegionFromFile(
+      fasta_path, &region));
+  const char* data = static_cast<const char*>(region->data());
+  const int64 length = region->length();
+  if (length >= 2 && static_cast<unsigned char>(data[0]) == 0x1f &&
+      static_cast<unsigned char>(data[1]) == 0x8b) {
+    return tf::errors::InvalidArgument(
+        "Cannot map compressed fasta ", fasta_path,
+        "; use an IndexedFastaReader instead");
+  }
+
+  // Each FAI line is NAME, LENGTH, OFFSET, LINEBASES and LINEWIDTH, separated
+  // by tabs.
+  std::vector<nucleus::genomics::v1::ContigInfo> contigs;
+  std::vector<ContigLayout> layouts;
+  for (absl::string_view line : absl::StrSplit(fai, '\n', absl::SkipEmpty())) {
+    const std::vector<absl::string_view> fields = absl::StrSplit(line, '\t');
+    int64 n_bases;
+    ContigLayout layout;
+    if (fields.size() < 5 || fields[0].empty() ||
+        !absl::SimpleAtoi(fields[1], &n_bases) ||
+        !absl::SimpleAtoi(fields[2], &layout.offset) ||
+        !absl::SimpleAtoi(fields[3], &layout.line_bases) ||
+        !absl::SimpleAtoi(fields[4], &layout.line_width) || n_bases < 0 ||
+        layout.offset < 0 || layout.line_bases <= 0 ||
+        layout.line_width < layout.line_bases ||
+        (n_bases > 0 && BaseOffset(layout, n_bases - 1) >= length)) {
+      return tf::errors::DataLoss("Malformed fai line '", line, "' for fasta ",
+                                  fasta_path);
+    }
+    nucleus::genomics::v1::ContigInfo contig;
+    contig.set_name(string(fields[0]));
+    contig.set_description("");
+    contig.set_n_bases(n_bases);
+    contig.set_pos_in_fasta(contigs.size());
+    contigs.push_back(contig);
+    layouts.push_back(layout);
+  }
+  return std::unique_ptr<MmapFastaReader>(
+      new MmapFastaReader(std::move(region), contigs, layouts, options));
+}
+
+MmapFastaReader::MmapFastaReader(
+    std::unique_ptr<tf::ReadOnlyMemoryRegion> region,
+    const std::vector<nucleus::genomics::v1::ContigInfo>& contigs,
+    const std::vector<ContigLayout>& layouts,
+    const nucleus::genomics::v1::FastaReaderOptions& options)
+    : region_(std::move(region)),
+      contigs_(contigs),
+      layouts_(layouts),
+      options_(options) {
+  for (size_t i = 0; i < contigs_.size(); ++i) {
+    contig_indices_[contigs_[i].name()] = i;
+  }
+}
+
+MmapFastaReader::~MmapFastaReader() {}
+
+StatusOr<int> MmapFastaReader::CheckRange(const Range& range) const {
+  if (region_ == nullptr) {
+    return tensorflow::errors::FailedPrecondition(
+        "can't read from closed MmapFastaReader object.");
+  }
+  // Looks the contig up by name rather than with IsValidInterval, which scans
+  // all of the contigs.
+  const auto it = contig_indices_.find(range.reference_name());
+  if (it == contig_indices_.end() || range.start() < 0 ||
+      range.start() > range.end() ||
+      range.start() >= contigs_[it->second].n_bases() ||
+      range.end() > contigs_[it->second].n_bases()) {
+    return tensorflow::errors::InvalidArgument("Invalid interval: ",
+                                               range.ShortDebugString());
+  }
+  return it->second;
+}
+
+StatusOr<string> MmapFastaReader::GetBases(const Range& range) const {
+  StatusOr<int> contig_index = CheckRange(range);
+  TF_RETURN_IF_ERROR(contig_index.status());
+  const ContigLayout& layout = layouts_[contig_index.ValueOrDie()];
+  const char* data = static_cast<const char*>(region_->data());
+
+  // Copies the bases a line at a time.
+  string result;
+  result.reserve(range.end() - range.start());
+  for (int64 pos = range.start(); pos < range.end();) {
+    const int64 n = std::min<int64>(
+        layout.line_bases - pos % layout.line_bases, range.end() - pos);
+    result.append(data + BaseOffset(layout, pos), n);
+    pos += n;
+  }
+  if (!options_.keep_true_case()) {
+    absl::AsciiStrToUpper(&result);
+  }
+  return result;
+}
+
+StatusOr<absl::string_view> MmapFastaReader::GetBasesView(
+    const Range& range) const {
+  StatusOr<int> contig_index = CheckRange(range);
+  TF_RETURN_IF_ERROR(contig_index.status());
+  const ContigLayout& layout = layouts_[contig_index.ValueOrDie()];
+  const int64 n = range.end() - range.start();
+  if (n > 0 && range.start() / layout.line_bases !=
+                   (range.end() - 1) / layout.line_bases) {
+    return tensorflow::errors::InvalidArgument(
+        "Interval spans a line break of the fasta: ", range.ShortDebugString());
+  }
+  return absl::string_view(
+      static_cast<const char*>(region_->data()) +
+          BaseOffset(layout, range.start()),
+      n);
+}
+
+StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>>
+MmapFastaReader::Iterate() const {
+  return StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>>(
+      MakeIterable<MmapFastaReaderIterable>(this));
+}
+
+tensorflow::Status MmapFastaReader::Close() {
+  if (region_ == nullptr) {
+    return tensorflow::errors::FailedPrecondition(
+        "MmapFastaReader already closed");
+  }
+  region_ = nullptr;
+  return tensorflow::Status::OK();
+}
+
+StatusOr<bool> MmapFastaReaderIterable::Next(GenomeReferenceRecord* out) {
+  TF_RETURN_IF_ERROR(CheckIsAlive());
+  const MmapFastaReader* fasta_reader =
+      static_cast<const MmapFastaReader*>(reader_);
+  if (pos_ >= fasta_reader->contigs_.size()) {
+    return false;
+  }
+  const genomics::v1::ContigInfo& contig = fasta_reader->contigs_.at(pos_);
+  out->first = contig.name();
+  if (contig.n_bases() > 0) {
+    StatusOr<string> bases =
+        fasta_reader->GetBases(MakeRange(contig.name(), 0, contig.n_bases()));
+    TF_RETURN_IF_ERROR(bases.status());
+    out->second = bases.ConsumeValueOrDie();
+  } else {
+    out->second.clear();
+  }
+  pos_++;
+  return true;
+}
+
+MmapFastaReaderIterable::~MmapFastaReaderIterable() {}
+
+MmapFastaReaderIterable::MmapFastaReaderIterable(const MmapFastaReader* reader)
+    : Iterable(reader) {}
+
 // ###########################################################################
 //
 // UnindexedFastaReader code
@@ -42,13 +42,15 @@
 #ifndef THIRD_PARTY_NUCLEUS_IO_REFERENCE_H_
 #define THIRD_PARTY_NUCLEUS_IO_REFERENCE_H_
 
+#include <list>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
-#include "absl/types/optional.h"
+#include "absl/strings/string_view.h"
 #include "htslib/faidx.h"
 #include "nucleus/io/reader_base.h"
 #include "nucleus/io/text_reader.h"
@@ -58,10 +60,12 @@
 #include "nucleus/protos/reference.pb.h"
 #include "nucleus/vendor/statusor.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/file_system.h"
 
 namespace nucleus {
 
 constexpr int INDEXED_FASTA_READER_DEFAULT_CACHE_SIZE = 64 * 1024;
+constexpr int INDEXED_FASTA_READER_DEFAULT_CACHE_NUM_BLOCKS = 8;
 
 // Alias for the abstract base class for FASTA record iterables, which
 // corresponds to (name, sequence) pairs.
@@ -168,18 +172,23 @@ class IndexedFastaReader : public GenomeReference {
   // htslib currently assumes that the FAI file is named fasta_path + '.fai',
   // so that file must exist and be readable by htslib.
   //
-  // We maintain a single entry cache of the bases from the last FASTA fetch, to
-  // reduce the number of file reads, which can be quite costly for remote
+  // We maintain an LRU cache of cache_num_blocks blocks of cache_size_bases
+  // bases, aligned to multiples of cache_size_bases on their contig, to reduce
+  // the number of file reads, which can be quite costly for remote
   // filesystems.  64K is the default block size for htslib faidx fetches, so
-  // there is no penalty to rounding up all small access sizes to 64K.  The
-  // cache can be disabled using `cache_size=0`.
+  // there is no penalty to rounding up all small access sizes to 64K.  Having
+  // several blocks lets callers alternate between a few loci, such as a read
+  // and its mate, without refetching them.  Queries longer than a block bypass
+  // the cache.  The cache can be disabled using `cache_size=0`.
   static StatusOr<std::unique_ptr<IndexedFastaReader>> FromFile(
       const string& fasta_path, const string& fai_path,
       const nucleus::genomics::v1::FastaReaderOptions& options,
-      int cache_size_bases = INDEXED_FASTA_READER_DEFAULT_CACHE_SIZE);
+      int cache_size_bases = INDEXED_FASTA_READER_DEFAULT_CACHE_SIZE,
+      int cache_num_blocks = INDEXED_FASTA_READER_DEFAULT_CACHE_NUM_BLOCKS);
   static StatusOr<std::unique_ptr<IndexedFastaReader>> FromFile(
       const string& fasta_path, const string& fai_path,
-      int cache_size_bases = INDEXED_FASTA_READER_DEFAULT_CACHE_SIZE);
+      int cache_size_bases = INDEXED_FASTA_READER_DEFAULT_CACHE_SIZE,
+      int cache_num_blocks = INDEXED_FASTA_READER_DEFAULT_CACHE_NUM_BLOCKS);
 
   ~IndexedFastaReader();
 
@@ -200,6 +209,11 @@ class IndexedFastaReader : public GenomeReference {
     return options_;
   }
 
+  // The number of cache blocks that GetBases found in, and had to fetch into,
+  // the cache. A query can use up to two blocks.
+  int64 cache_hits() const { return cache_hits_; }
+  int64 cache_misses() const { return cache_misses_; }
+
   StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>> Iterate()
       const override;
 
@@ -210,10 +224,27 @@ class IndexedFastaReader : public GenomeReference {
   // Allow iteration to access the underlying reader.
   friend class IndexedFastaReaderIterable;
 
+  // A cached block of bases.
+  struct CacheBlock {
+    // The index of the contig of the block in contigs_.
+    int contig;
+    // The index of the block on the contig, so that it starts at
+    // index * cache_size_bases_.
+    int64 index;
+    string bases;
+  };
+
   // Must use one of the static factory methods.
   IndexedFastaReader(const string& fasta_path, faidx_t* faidx,
                      const nucleus::genomics::v1::FastaReaderOptions& options,
-                     int cache_size_bases);
+                     int cache_size_bases, int cache_num_blocks);
+
+  // Fetches the bases of range from the FASTA, bypassing the cache.
+  StatusOr<string> FetchBases(const nucleus::genomics::v1::Range& range) const;
+
+  // Gets the bases of the block with index on contig from the cache, fetching
+  // it if needed. The returned bases are valid until the next call.
+  StatusOr<const string*> GetCacheBlock(int contig, int64 index) const;
 
   // Path to the FASTA file containing our genomic bases.
   const string fasta_path_;
@@ -230,15 +261,120 @@ class IndexedFastaReader : public GenomeReference {
   // contigs used by this BAM file.
   const std::vector<nucleus::genomics::v1::ContigInfo> contigs_;
 
-  // Size, in bases, of the read cache.
+  // Size, in bases, of the blocks of the read cache.
   const int cache_size_bases_;
 
-  // Cache of the last "small" read from the FASTA (<= kFastaCacheSize).
-  mutable string small_read_cache_;
+  // The maximum number of blocks in the read cache.
+  const int cache_num_blocks_;
+
+  // The cached blocks, most recently used first, and their positions in the
+  // list by contig and block index.
+  mutable std::list<CacheBlock> cache_blocks_;
+  mutable std::map<std::pair<int, int64>, std::list<CacheBlock>::iterator>
+      cache_index_;
+
+  mutable int64 cache_hits_ = 0;
+  mutable int64 cache_misses_ = 0;
+};
+
+// A FASTA reader that memory-maps an uncompressed FASTA file with a FAI index.
+//
+// The FAI index gives the offset of the first base of each contig in the FASTA
+// and the layout of its lines, from which the byte offset of any base can be
+// computed. GetBases copies the bases of the query straight out of the mapped
+// file, skipping the line breaks, without the allocations and copies of a
+// htslib faidx fetch, so there is no need for a read cache. Block-gzipped
+// FASTA files can't be mapped and must be read with an IndexedFastaReader.
+//
+// GetBasesView avoids even the copy, returning a view into the mapped file
+// for queries that don't span a line break, which is every query on a FASTA
+// with each contig on a single line.
+class MmapFastaReader : public GenomeReference {
+ public:
+  // Creates a new MmapFastaReader mapping the uncompressed FASTA file
+  // fasta_path, indexed by the FAI file fai_path.
+  static StatusOr<std::unique_ptr<MmapFastaReader>> FromFile(
+      const string& fasta_path, const string& fai_path,
+      const nucleus::genomics::v1::FastaReaderOptions& options);
+
+  ~MmapFastaReader();
+
+  // Disable copy and assignment operations
+  MmapFastaReader(const MmapFastaReader& other) = delete;
+  MmapFastaReader& operator=(const MmapFastaReader&) = delete;
+
+  const std::vector<nucleus::genomics::v1::ContigInfo>& Contigs()
+      const override {
+    return contigs_;
+  }
+
+  StatusOr<string> GetBases(
+      const nucleus::genomics::v1::Range& range) const override;
+
+  // Gets the bases of range as a view into the mapped FASTA file, which is
+  // valid until the reader is closed or destroyed.
+  //
+  // The bases are returned as they are in the file, regardless of the
+  // keep_true_case option, so this is meant for references that are already
+  // upper-cased. Returns a value whose status is not ok() if the range is
+  // invalid or spans a line break of the FASTA.
+  StatusOr<absl::string_view> GetBasesView(
+      const nucleus::genomics::v1::Range& range) const;
+
+  // Get the options controlling the behavior of this FastaReader.
+  const nucleus::genomics::v1::FastaReaderOptions& Options() const {
+    return options_;
+  }
+
+  StatusOr<std::shared_ptr<GenomeReferenceRecordIterable>> Iterate()
+      const override;
+
+  // Unmaps the FASTA file.
+  tensorflow::Status Close() override;
+
+ private:
+  // Allow iteration to access the underlying reader.
+  friend class MmapFastaReaderIterable;
+
+  // The layout of the bases of a contig in the FASTA, as given by the FAI.
+  struct ContigLayout {
+    // The byte offset of the first base of the contig.
+    int64 offset;
+    // The number of bases on each full line.
+    int64 line_bases;
+    // The number of bytes of each full line, including its line break.
+    int64 line_width;
+  };
 
-  // The range that is held in the cache, or "empty" if there is no range cached
-  // yet.  Range must be <= kFastaCacheSize in length.
-  mutable absl::optional<nucleus::genomics::v1::Range> cached_range_;
+  // Must use one of the static factory methods.
+  MmapFastaReader(
+      std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region,
+      const std::vector<nucleus::genomics::v1::ContigInfo>& contigs,
+      const std::vector<ContigLayout>& layouts,
+      const nucleus::genomics::v1::FastaReaderOptions& options);
+
+  // Checks that the reader is open and range is a valid interval, and returns
+  // the index of its contig.
+  StatusOr<int> CheckRange(const nucleus::genomics::v1::Range& range) const;
+
+  // The byte offset in the FASTA of base pos of the contig with layout.
+  static int64 BaseOffset(const ContigLayout& layout, int64 pos) {
+    return layout.offset + (pos / layout.line_bases) * layout.line_width +
+           pos % layout.line_bases;
+  }
+
+  // The mapped FASTA file, or nullptr once closed.
+  std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region_;
+
+  // The contigs of the FASTA, in the order of the FAI, and their layouts.
+  const std::vector<nucleus::genomics::v1::ContigInfo> contigs_;
+  const std::vector<ContigLayout> layouts_;
+
+  // The index of each contig in contigs_, by name.
+  std::unordered_map<string, int> contig_indices_;
+
+  // The options controlling the behavior of this FastaReader.
+  const nucleus::genomics::v1::FastaReaderOptions options_;
 };
 
 // A FASTA reader that is not backed by a htslib FAI index.
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+// Compares the query throughput and cache hit rate of IndexedFastaReader with
+// various numbers of cache blocks, under the access patterns of read
+// processing and variant calling.
+//
+// Usage: bazel run //nucleus/io:reference_benchmark -- [n_queries]
+//
+// The input is synthesized: kNumContigs contigs of kContigLength random bases.
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "nucleus/io/reference.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/range.pb.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/util/utils.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace nucleus {
+namespace {
+
+using genomics::v1::Range;
+
+constexpr int kNumContigs = 4;
+constexpr int64 kContigLength = 4 * 1000 * 1000;
+constexpr int kLineBases = 60;
+constexpr int kQueryLength = 150;
+
+string ContigName(int c) { return absl::StrCat("chr", c + 1); }
+
+// Writes the FASTA and its FAI to |path| and |path|.fai.
+void WriteFasta(const string& path) {
+  std::mt19937 random(42);
+  string fasta;
+  string fai;
+  for (int c = 0; c < kNumContigs; ++c) {
+    const string name = ContigName(c);
+    absl::StrAppend(&fasta, ">", name, "\n");
+    absl::StrAppend(&fai, name, "\t", kContigLength, "\t", fasta.size(), "\t",
+                    kLineBases, "\t", kLineBases + 1, "\n");
+    for (int64 i = 0; i < kContigLength; ++i) {
+      fasta += "ACGT"[random() % 4];
+      if ((i + 1) % kLineBases == 0 || i + 1 == kContigLength) fasta += "\n";
+    }
+  }
+  TF_CHECK_OK(
+      tensorflow::WriteStringToFile(tensorflow::Env::Default(), path, fasta));
+  TF_CHECK_OK(tensorflow::WriteStringToFile(tensorflow::Env::Default(),
+                                            path + ".fai", fai));
+}
+
+struct Pattern {
+  string name;
+  std::vector<Range> queries;
+};
+
+std::vector<Pattern> MakePatterns(int n_queries) {
+  std::mt19937 random(17);
+  std::vector<Pattern> patterns;
+
+  // Reads sorted by position, as when processing a sorted BAM.
+  Pattern sorted = {"sorted reads"};
+  for (int i = 0; i < n_queries; ++i) {
+    const int64 start = (i * 37) % (kContigLength - kQueryLength);
+    sorted.queries.push_back(
+        MakeRange(ContigName(0), start, start + kQueryLength));
+  }
+  patterns.push_back(sorted);
+
+  // Sorted reads alternating with their mates, 100kb downstream.
+  Pattern mates = {"reads and distant mates"};
+  for (int i = 0; i < n_queries / 2; ++i) {
+    const int64 start = (i * 37) % (kContigLength - 200000);
+    mates.queries.push_back(
+        MakeRange(ContigName(0), start, start + kQueryLength));
+    mates.queries.push_back(
+        MakeRange(ContigName(0), start + 100000,
+                  start + 100000 + kQueryLength));
+  }
+  patterns.push_back(mates);
+
+  // Alternating between candidates advancing along two contigs, as when
+  // interleaving work on two shards.
+  Pattern contigs = {"two contigs interleaved"};
+  for (int i = 0; i < n_queries / 2; ++i) {
+    const int64 start = (i * 53) % (kContigLength - kQueryLength);
+    for (int c = 0; c < 2; ++c) {
+      contigs.queries.push_back(
+          MakeRange(ContigName(c), start, start + kQueryLength));
+    }
+  }
+  patterns.push_back(contigs);
+
+  // Unsorted reads, which no cache helps with.
+  Pattern uniform = {"uniformly random"};
+  for (int i = 0; i < n_queries; ++i) {
+    const int64 start = random() % (kContigLength - kQueryLength);
+    uniform.queries.push_back(MakeRange(ContigName(random() % kNumContigs),
+                                        start, start + kQueryLength));
+  }
+  patterns.push_back(uniform);
+  return patterns;
+}
+
+void Run(int n_queries) {
+  const string path = MakeTempFile("reference_benchmark.fasta");
+  WriteFasta(path);
+
+  std::cout << absl::StrFormat("%-26s %8s %10s %14s %10s\n", "pattern",
+                               "blocks", "seconds", "queries/s", "hit rate");
+  for (const Pattern& pattern : MakePatterns(n_queries)) {
+    for (int num_blocks : {0, 1, 2, 8, 32}) {
+      // Zero blocks disables the cache.
+      std::unique_ptr<IndexedFastaReader> reader = std::move(
+          IndexedFastaReader::FromFile(
+              path, path + ".fai", genomics::v1::FastaReaderOptions(),
+              INDEXED_FASTA_READER_DEFAULT_CACHE_SIZE, num_blocks)
+              .ValueOrDie());
+      const absl::Time start = absl::Now();
+      int64 n_bases = 0;
+      for (const Range& query : pattern.queries) {
+        n_bases += reader->GetBases(query).ValueOrDie().size();
+      }
+      CHECK_EQ(static_cast<int64>(pattern.queries.size()) * kQueryLength,
+               n_bases);
+      const double seconds = absl::ToDoubleSeconds(absl::Now() - start);
+      const int64 lookups = reader->cache_hits() + reader->cache_misses();
+      std::cout << absl::StrFormat(
+          "%-26s %8d %10.3f %14.0f %10.3f\n", pattern.name, num_blocks,
+          seconds, pattern.queries.size() / seconds,
+          lookups > 0 ? static_cast<double>(reader->cache_hits()) / lookups
+                      : 0.0);
+    }
+  }
+  TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(path));
+  TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(path + ".fai"));
+}
+
+}  // namespace
+}  // namespace nucleus
+
+int main(int argc, char** argv) {
+  const int n_queries = argc > 1 ? atoi(argv[1]) : 200000;
+  CHECK_GT(n_queries, 0) << "n_queries must be positive";
+  nucleus::Run(n_queries);
+  return 0;
+}
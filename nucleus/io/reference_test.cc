@@ -36,6 +36,7 @@
 #include "nucleus/util/utils.h"
 #include "nucleus/vendor/status_matchers.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 
 using absl::StrCat;
@@ -225,6 +226,27 @@ INSTANTIATE_TEST_CASE_P(GRT1, GenomeReferenceTest,
 INSTANTIATE_TEST_CASE_P(GRT3, GenomeReferenceTest,
                         ::testing::Values(make_pair(&JustLoadFai, 64 * 1024)));
 
+static std::unique_ptr<IndexedFastaReader> LoadWithCacheBlocks(
+    const string& fasta, int cache_size, int cache_num_blocks) {
+  StatusOr<std::unique_ptr<IndexedFastaReader>> fai_status =
+      IndexedFastaReader::FromFile(fasta, StrCat(fasta, ".fai"),
+                                   nucleus::genomics::v1::FastaReaderOptions(),
+                                   cache_size, cache_num_blocks);
+  TF_CHECK_OK(fai_status.status());
+  return std::move(fai_status.ValueOrDie());
+}
+
+static std::unique_ptr<GenomeReference> LoadWithOneSmallBlock(
+    const string& fasta, int cache_size) {
+  return LoadWithCacheBlocks(fasta, cache_size, 1);
+}
+
+// Test with a cache of one block smaller than the contigs, so that queries
+// span blocks and evict them.
+INSTANTIATE_TEST_CASE_P(GRT4, GenomeReferenceTest,
+                        ::testing::Values(make_pair(&LoadWithOneSmallBlock,
+                                                    7)));
+
 TEST(StatusOrLoadFromFile, ReturnsBadStatusIfFaiIsMissing) {
   StatusOr<std::unique_ptr<IndexedFastaReader>> result =
       IndexedFastaReader::FromFile(GetTestData("unindexed.fasta"),
@@ -244,6 +266,34 @@ TEST(IndexedFastaReaderTest, WriteAfterCloseIsntOK) {
                   "can't read from closed IndexedFastaReader object"));
 }
 
+TEST(IndexedFastaReaderTest, CacheEvictsLeastRecentlyUsedBlocks) {
+  auto reader = LoadWithCacheBlocks(TestFastaPath(), 10, 2);
+  auto expect_bases = [&reader](const string& chrom, int64 start, int64 end,
+                                int64 hits, int64 misses) {
+    StatusOr<string> bases = reader->GetBases(MakeRange(chrom, start, end));
+    ASSERT_THAT(bases, IsOK());
+    EXPECT_EQ(JustLoadFai(TestFastaPath(), 0)
+                  ->GetBases(MakeRange(chrom, start, end))
+                  .ValueOrDie(),
+              bases.ValueOrDie());
+    EXPECT_EQ(hits, reader->cache_hits());
+    EXPECT_EQ(misses, reader->cache_misses());
+  };
+  expect_bases("chrM", 0, 5, 0, 1);
+  expect_bases("chr1", 0, 5, 0, 2);
+  // Alternating between the two loci doesn't refetch them.
+  expect_bases("chrM", 2, 8, 1, 2);
+  expect_bases("chr1", 3, 4, 2, 2);
+  // The chrM block is the least recently used, and is evicted.
+  expect_bases("chr2", 0, 5, 2, 3);
+  expect_bases("chr1", 1, 2, 3, 3);
+  expect_bases("chrM", 0, 1, 3, 4);
+  // Queries spanning two blocks look both up.
+  expect_bases("chrM", 8, 12, 4, 5);
+  // Queries longer than a block bypass the cache.
+  expect_bases("chrM", 0, 20, 4, 5);
+}
+
 TEST(IndexedFastaReaderTest, TestTrueCase) {
   auto reader = LoadWithCaseOption(TestFastaPath(), true);
   auto iterator = reader->Iterate().ValueOrDie();
@@ -288,6 +338,117 @@ TEST(IndexedFastaReaderTest, TestIterate) {
   EXPECT_FALSE(status.ValueOrDie());
 }
 
+static std::unique_ptr<MmapFastaReader> OpenMmap(
+    const string& fasta,
+    const nucleus::genomics::v1::FastaReaderOptions& options =
+        nucleus::genomics::v1::FastaReaderOptions()) {
+  StatusOr<std::unique_ptr<MmapFastaReader>> mmap_status =
+      MmapFastaReader::FromFile(fasta, StrCat(fasta, ".fai"), options);
+  TF_CHECK_OK(mmap_status.status());
+  return std::move(mmap_status.ValueOrDie());
+}
+
+static std::unique_ptr<GenomeReference> LoadMmap(const string& fasta,
+                                                 int cache_size) {
+  // Mapped FASTAs have no cache, so cache_size is ignored.
+  return OpenMmap(fasta);
+}
+
+// Test the memory-mapped reader.
+INSTANTIATE_TEST_CASE_P(GRT5, GenomeReferenceTest,
+                        ::testing::Values(make_pair(&LoadMmap, 0)));
+
+TEST(MmapFastaReaderTest, ReturnsBadStatusIfFaiIsMissing) {
+  EXPECT_THAT(
+      MmapFastaReader::FromFile(GetTestData("unindexed.fasta"),
+                                GetTestData("unindexed.fasta.fai"),
+                                nucleus::genomics::v1::FastaReaderOptions()),
+      IsNotOKWithCode(tensorflow::error::NOT_FOUND));
+}
+
+TEST(MmapFastaReaderTest, ReturnsBadStatusIfFastaIsCompressed) {
+  EXPECT_THAT(
+      MmapFastaReader::FromFile(GetTestData("test.fasta.gz"),
+                                GetTestData("test.fasta.gz.fai"),
+                                nucleus::genomics::v1::FastaReaderOptions()),
+      IsNotOKWithCodeAndMessage(tensorflow::error::INVALID_ARGUMENT,
+                                "Cannot map compressed fasta"));
+}
+
+TEST(MmapFastaReaderTest, ReturnsBadStatusIfFaiIsMalformed) {
+  const string fai = MakeTempFile("malformed.fasta.fai");
+  // chrM can't extend beyond the end of the FASTA.
+  TF_CHECK_OK(tensorflow::WriteStringToFile(tensorflow::Env::Default(), fai,
+                                            "chrM\t1000\t6\t50\t51\n"));
+  EXPECT_THAT(
+      MmapFastaReader::FromFile(TestFastaPath(), fai,
+                                nucleus::genomics::v1::FastaReaderOptions()),
+      IsNotOKWithCodeAndMessage(tensorflow::error::DATA_LOSS,
+                                "Malformed fai line"));
+}
+
+TEST(MmapFastaReaderTest, ReadAfterCloseIsntOK) {
+  auto reader = OpenMmap(TestFastaPath());
+  ASSERT_THAT(reader->Close(), IsOK());
+  EXPECT_THAT(reader->GetBases(MakeRange("chrM", 0, 100)),
+              IsNotOKWithCodeAndMessage(
+                  tensorflow::error::FAILED_PRECONDITION,
+                  "can't read from closed MmapFastaReader object"));
+  EXPECT_THAT(reader->GetBasesView(MakeRange("chrM", 0, 10)),
+              IsNotOKWithCode(tensorflow::error::FAILED_PRECONDITION));
+}
+
+TEST(MmapFastaReaderTest, TestTrueCase) {
+  nucleus::genomics::v1::FastaReaderOptions options;
+  options.set_keep_true_case(true);
+  auto reader = OpenMmap(TestFastaPath(), options);
+  EXPECT_EQ("CCCTATTaaCCACT",
+            reader->GetBases(MakeRange("chrM", 16, 30)).ValueOrDie());
+}
+
+TEST(MmapFastaReaderTest, GetBasesViewWithinLines) {
+  auto reader = OpenMmap(TestFastaPath());
+  // The bases are viewed in their original case.
+  EXPECT_EQ("CCCTATTaaCCACT",
+            reader->GetBasesView(MakeRange("chrM", 16, 30)).ValueOrDie());
+  EXPECT_THAT(reader->GetBasesView(MakeRange("chrM", 45, 55)),
+              IsNotOKWithCodeAndMessage(tensorflow::error::INVALID_ARGUMENT,
+                                        "spans a line break"));
+  EXPECT_EQ("TTGGTATTTT",
+            reader->GetBasesView(MakeRange("chrM", 50, 60)).ValueOrDie());
+  EXPECT_EQ("", reader->GetBasesView(MakeRange("chr1", 5, 5)).ValueOrDie());
+  EXPECT_THAT(reader->GetBasesView(MakeRange("chr1", 0, 77)),
+              IsNotOKWithMessage("Invalid interval"));
+}
+
+TEST(MmapFastaReaderTest, GetBasesViewOnSingleLineFasta) {
+  const string fasta = MakeTempFile("single_line.fasta");
+  TF_CHECK_OK(tensorflow::WriteStringToFile(tensorflow::Env::Default(), fasta,
+                                            ">a\nACGTACGT\n>b\nTTTT\n"));
+  TF_CHECK_OK(tensorflow::WriteStringToFile(
+      tensorflow::Env::Default(), StrCat(fasta, ".fai"),
+      "a\t8\t3\t8\t9\nb\t4\t15\t4\t5\n"));
+  auto reader = OpenMmap(fasta);
+  EXPECT_EQ("ACGTACGT",
+            reader->GetBasesView(MakeRange("a", 0, 8)).ValueOrDie());
+  EXPECT_EQ("GTAC", reader->GetBasesView(MakeRange("a", 2, 6)).ValueOrDie());
+  EXPECT_EQ("TTTT", reader->GetBasesView(MakeRange("b", 0, 4)).ValueOrDie());
+}
+
+TEST(MmapFastaReaderTest, TestIterate) {
+  auto reader = OpenMmap(TestFastaPath());
+  auto expected = JustLoadFai(TestFastaPath());
+  auto iterator = reader->Iterate().ValueOrDie();
+  auto expected_iterator = expected->Iterate().ValueOrDie();
+  GenomeReferenceRecord r;
+  GenomeReferenceRecord expected_r;
+  while (expected_iterator->Next(&expected_r).ValueOrDie()) {
+    ASSERT_TRUE(iterator->Next(&r).ValueOrDie());
+    EXPECT_EQ(expected_r, r);
+  }
+  EXPECT_FALSE(iterator->Next(&r).ValueOrDie());
+}
+
 TEST(UnindexedFastaReaderTest, ReturnsBadStatusIfFileIsMissing) {
   StatusOr<std::unique_ptr<UnindexedFastaReader>> result =
       UnindexedFastaReader::FromFile(GetTestData("nonexistent.fasta"));
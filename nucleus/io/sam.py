@@ -250,7 +250,12 @@ class NativeSamWriter(genomics_writer.GenomicsWriter):
   files or TFRecords files, based on the output filename's extensions.
   """
 
-  def __init__(self, output_path, header, ref_path=None, embed_ref=False):
+  def __init__(self,
+               output_path,
+               header,
+               ref_path=None,
+               embed_ref=False,
+               options=None):
     """Initializer for NativeSamWriter.
 
     Args:
@@ -260,12 +265,15 @@ class NativeSamWriter(genomics_writer.GenomicsWriter):
         Default is False.
       header: A nucleus.SamHeader proto.  The header is used both for writing
         the header, and to control the sorting applied to the rest of the file.
+      options: A nucleus.genomics.v1.SamWriterOptions proto controlling
+        compression, threading and CRAM encoder settings. Default is None,
+        which uses the htslib defaults.
     """
     super(NativeSamWriter, self).__init__()
     self._writer = sam_writer.SamWriter.to_file(
         output_path,
         ref_path.encode('utf8') if ref_path is not None else '', embed_ref,
-        header)
+        options or reads_pb2.SamWriterOptions(), header)
 
   def write(self, proto):
     self._writer.write(proto)
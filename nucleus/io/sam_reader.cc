@@ -36,6 +36,7 @@
 #include "htslib/sam.h"
 #include "nucleus/io/hts_path.h"
 #include "nucleus/io/sam_utils.h"
+#include "nucleus/io/sam_writer.h"
 #include "nucleus/platform/types.h"
 #include "nucleus/protos/cigar.pb.h"
 #include "nucleus/protos/position.pb.h"
@@ -218,6 +219,31 @@ bool ReadSatisfiesRequirements(
       (!read.has_alignment() || read.alignment().mapping_quality() >=
        requirements.min_mapping_quality());
 }
+
+bool NativeReadSatisfiesRequirements(
+    const bam1_t& record,
+    const nucleus::genomics::v1::ReadRequirements& requirements) {
+  // This mirrors how ConvertToPb populates the Read fields that
+  // ReadSatisfiesRequirements and IsReadProperlyPlaced look at.
+  const bam1_core_t& c = record.core;
+  const bool paired = c.flag & BAM_FPAIRED;
+  const bool aligned = !(c.flag & BAM_FUNMAP);
+  const bool has_mate_position =
+      paired && !(c.flag & BAM_FMUNMAP) && c.mtid >= 0;
+  const bool properly_placed = !paired || (c.flag & BAM_FPROPER_PAIR) ||
+                               !has_mate_position || !aligned ||
+                               c.tid == c.mtid;
+  return (requirements.keep_duplicates() || !(c.flag & BAM_FDUP)) &&
+         (requirements.keep_failed_vendor_quality_checks() ||
+          !(c.flag & BAM_FQCFAIL)) &&
+         (requirements.keep_secondary_alignments() ||
+          !(c.flag & BAM_FSECONDARY)) &&
+         (requirements.keep_supplementary_alignments() ||
+          !(c.flag & BAM_FSUPPLEMENTARY)) &&
+         (requirements.keep_unaligned() || aligned) &&
+         (requirements.keep_improperly_placed() || properly_placed) &&
+         (!aligned || c.qual >= requirements.min_mapping_quality());
+}
 } // namespace sam_reader_internal
 
 // -----------------------------------------------------------------------------
@@ -582,6 +608,13 @@ class SamIterableBase : public SamIterable {
   // Advance to the next record.
   StatusOr<bool> Next(nucleus::genomics::v1::Read* out) override;
 
+  // Advance to the next record satisfying |predicate| and the reader's
+  // KeepNativeRecord, without converting it to a Read. On success the record
+  // is available through native_record() until the next call.
+  StatusOr<bool> NextNative(const NativeReadPredicate& predicate);
+
+  const bam1_t& native_record() const { return *bam1_; }
+
   // Base class constructor. Intializes common attrubutes.
   SamIterableBase(const SamReader* reader,
                   htsFile* fp,
@@ -768,6 +801,13 @@ bool SamReader::KeepRead(const nucleus::genomics::v1::Read& read) const {
          (options_.downsample_fraction() == 0.0 || sampler_.Keep());
 }
 
+bool SamReader::KeepNativeRecord(const bam1_t& record) const {
+  return (!options_.has_read_requirements() ||
+          sam_reader_internal::NativeReadSatisfiesRequirements(
+              record, options_.read_requirements())) &&
+         (options_.downsample_fraction() == 0.0 || sampler_.Keep());
+}
+
 StatusOr<std::shared_ptr<SamIterable>> SamReader::Iterate() const {
   if (fp_ == nullptr)
     return tf::errors::FailedPrecondition("Cannot Iterate a closed SamReader.");
@@ -803,6 +843,46 @@ StatusOr<std::shared_ptr<SamIterable>> SamReader::Query(
         MakeIterable<SamQueryIterable>(this, fp_, header_, iter));
 }
 
+// Drains |iterable|, writing each native record accepted by |predicate| to
+// |writer|. Returns the number of records written.
+static StatusOr<int64> WriteNativeRecords(
+    const StatusOr<std::shared_ptr<SamIterable>>& iterable_status,
+    const NativeReadPredicate& predicate, SamWriter* writer) {
+  if (!iterable_status.ok()) {
+    return iterable_status.status();
+  }
+  std::shared_ptr<SamIterable> iterable = iterable_status.ValueOrDie();
+  if (iterable == nullptr) {
+    return tf::errors::FailedPrecondition(
+        "Cannot write native records while another iterable is live");
+  }
+  auto* native_iterable = static_cast<SamIterableBase*>(iterable.get());
+  int64 n_written = 0;
+  while (true) {
+    StatusOr<bool> has_next = native_iterable->NextNative(predicate);
+    if (!has_next.ok()) {
+      return has_next.status();
+    }
+    if (!has_next.ValueOrDie()) break;
+    TF_RETURN_IF_ERROR(writer->WriteNative(native_iterable->native_record()));
+    ++n_written;
+  }
+  return n_written;
+}
+
+StatusOr<int64> SamReader::WriteFilteredNative(
+    const NativeReadPredicate& predicate, SamWriter* writer) const {
+  CHECK(writer != nullptr) << "writer cannot be null";
+  return WriteNativeRecords(Iterate(), predicate, writer);
+}
+
+StatusOr<int64> SamReader::WriteFilteredNative(
+    const Range& region, const NativeReadPredicate& predicate,
+    SamWriter* writer) const {
+  CHECK(writer != nullptr) << "writer cannot be null";
+  return WriteNativeRecords(Query(region), predicate, writer);
+}
+
 
 tf::Status SamReader::Close() {
   if (HasIndex()) {
@@ -845,6 +925,24 @@ StatusOr<bool> SamIterableBase::Next(Read* out) {
   return true;
 }
 
+StatusOr<bool> SamIterableBase::NextNative(
+    const NativeReadPredicate& predicate) {
+  TF_RETURN_IF_ERROR(CheckIsAlive());
+  const SamReader* sam_reader = static_cast<const SamReader*>(reader_);
+  while (true) {
+    int code = next_sam_record();
+    if (code == -1) {
+      return false;
+    } else if (code < -1) {
+      return tf::errors::DataLoss("Failed to parse SAM record");
+    }
+    if ((!predicate || predicate(*header_, *bam1_)) &&
+        sam_reader->KeepNativeRecord(*bam1_)) {
+      return true;
+    }
+  }
+}
+
 SamIterableBase::SamIterableBase(const SamReader* reader,
                                  htsFile* fp,
                                  bam_hdr_t* header)
@@ -18,6 +18,7 @@
 #ifndef THIRD_PARTY_NUCLEUS_IO_SAM_READER_H_
 #define THIRD_PARTY_NUCLEUS_IO_SAM_READER_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -38,6 +39,13 @@ namespace nucleus {
 // Alias for the abstract base class for SAM record iterables.
 using SamIterable = Iterable<nucleus::genomics::v1::Read>;
 
+// A predicate evaluated on a raw htslib record and the header it was decoded
+// against. Returns true if the record should be kept.
+using NativeReadPredicate =
+    std::function<bool(const bam_hdr_t& header, const bam1_t& record)>;
+
+class SamWriter;
+
 // A SAM/BAM/CRAM reader.
 //
 // SAM/BAM/CRAM files store information about next-generation DNA sequencing
@@ -131,6 +139,25 @@ class SamReader : public Reader {
   StatusOr<std::shared_ptr<SamIterable>> Query(
       const nucleus::genomics::v1::Range& region) const;
 
+  // Writes every record in this file that satisfies |predicate| to |writer|,
+  // copying the raw htslib record instead of decoding it into a Read proto and
+  // re-encoding it. The read_requirements and downsample_fraction in our
+  // options are also applied, directly on the raw record. |writer| should be
+  // created with SamWriter::ToFile from NativeHeader() so that reference ids
+  // stay valid. Aux fields are copied verbatim regardless of
+  // aux_field_handling, and use_original_base_quality_scores has no effect.
+  //
+  // Like Iterate(), this requires that no other iterable is live on this
+  // reader. Returns the number of records written.
+  StatusOr<int64> WriteFilteredNative(const NativeReadPredicate& predicate,
+                                      SamWriter* writer) const;
+
+  // Same as above, but only considers the records overlapping |region|, as
+  // Query() would return them.
+  StatusOr<int64> WriteFilteredNative(
+      const nucleus::genomics::v1::Range& region,
+      const NativeReadPredicate& predicate, SamWriter* writer) const;
+
   // Returns True if this SamReader loaded an index file.
   bool HasIndex() const { return idx_ != nullptr; }
 
@@ -144,6 +171,9 @@ class SamReader : public Reader {
 
   bool KeepRead(const nucleus::genomics::v1::Read& read) const;
 
+  // Same as KeepRead, but evaluated on a raw htslib record.
+  bool KeepNativeRecord(const bam1_t& record) const;
+
   const nucleus::genomics::v1::SamReaderOptions& options() const {
     return options_;
   }
@@ -151,6 +181,10 @@ class SamReader : public Reader {
   // Returns a SamHeader message representing the structured header information.
   const nucleus::genomics::v1::SamHeader& Header() const { return sam_header_; }
 
+  // Returns the htslib header of this file, or nullptr if the reader is
+  // closed. The header is owned by this reader.
+  const bam_hdr_t* NativeHeader() const { return header_; }
+
  private:
   // Private constructor; use FromFile to safely create a SamReader from a
   // file.
@@ -186,6 +220,12 @@ bool ReadSatisfiesRequirements(
     const nucleus::genomics::v1::Read& read,
     const nucleus::genomics::v1::ReadRequirements& requirements);
 
+// Same as ReadSatisfiesRequirements, but evaluated directly on a raw htslib
+// record so that records can be rejected without decoding them.
+bool NativeReadSatisfiesRequirements(
+    const bam1_t& record,
+    const nucleus::genomics::v1::ReadRequirements& requirements);
+
 }  // namespace sam_reader_internal
 
 }  // namespace nucleus
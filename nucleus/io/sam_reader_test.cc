@@ -270,6 +270,44 @@ TEST(SamReaderTest, TestMatePosition) {
   TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(output_filename));
 }
 
+TEST(SamReaderTest, TestWriteFilteredNativeMatchesProtoFiltering) {
+  SamReaderOptions options;
+  options.mutable_read_requirements()->set_min_mapping_quality(38);
+  auto keep_forward = [](const bam_hdr_t& header, const bam1_t& record) {
+    return !bam_is_rev(&record);
+  };
+
+  // The reads we expect, filtered through the usual proto path.
+  std::unique_ptr<SamReader> reader = std::move(
+      SamReader::FromFile(GetTestData(kBamTestFilename), options)
+          .ValueOrDie());
+  std::vector<Read> expected;
+  for (const Read& read : as_vector(reader->Iterate())) {
+    if (!read.alignment().position().reverse_strand()) {
+      expected.push_back(read);
+    }
+  }
+  ASSERT_FALSE(expected.empty());
+
+  string output_filename(MakeTempFile("sam_reader_native_test.bam"));
+  {
+    std::unique_ptr<SamWriter> writer = std::move(
+        SamWriter::ToFile(output_filename, "", false, *reader->NativeHeader())
+            .ValueOrDie());
+    StatusOr<int64> n_written =
+        reader->WriteFilteredNative(keep_forward, writer.get());
+    ASSERT_THAT(n_written, IsOK());
+    EXPECT_EQ(static_cast<int64>(expected.size()), n_written.ValueOrDie());
+    ASSERT_THAT(writer->Close(), IsOK());
+  }
+
+  std::unique_ptr<SamReader> reader2 = std::move(
+      SamReader::FromFile(output_filename, SamReaderOptions()).ValueOrDie());
+  EXPECT_THAT(reader2->Header(), EqualsProto(reader->Header()));
+  EXPECT_THAT(as_vector(reader2->Iterate()), Pointwise(EqualsProto(), expected));
+  TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(output_filename));
+}
+
 class SamReaderQueryTest : public ::testing::Test {
  protected:
   void SetUp() override {
@@ -401,6 +439,31 @@ TEST_F(SamReaderQueryTest, QueriedRespectsReadRequirements) {
   EXPECT_THAT(as_vector(reader_->Query(range)), SizeIs(104));
 }
 
+TEST_F(SamReaderQueryTest, WriteFilteredNativeRespectsReadRequirements) {
+  Range range = MakeRange("chr20", 9999999, 10000100);
+  options_.mutable_read_requirements()->set_min_mapping_quality(38);
+  RecreateReader();
+
+  string output_filename(MakeTempFile("sam_reader_native_query_test.bam"));
+  std::unique_ptr<SamWriter> writer = std::move(
+      SamWriter::ToFile(output_filename, "", false, *reader_->NativeHeader())
+          .ValueOrDie());
+  StatusOr<int64> n_written =
+      reader_->WriteFilteredNative(range, nullptr, writer.get());
+  ASSERT_THAT(n_written, IsOK());
+  EXPECT_EQ(104, n_written.ValueOrDie());
+  ASSERT_THAT(writer->Close(), IsOK());
+
+  // A live iterable prevents native passthrough, just like Iterate().
+  std::shared_ptr<SamIterable> it = reader_->Iterate().ValueOrDie();
+  std::unique_ptr<SamWriter> writer2 = std::move(
+      SamWriter::ToFile(output_filename, "", false, *reader_->NativeHeader())
+          .ValueOrDie());
+  EXPECT_THAT(reader_->WriteFilteredNative(range, nullptr, writer2.get()),
+              IsNotOKWithMessage("another iterable is live"));
+  TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(output_filename));
+}
+
 TEST_F(SamReaderQueryTest, ReadAfterClose) {
   ASSERT_THAT(reader_->Close(), IsOK());
   EXPECT_THAT(reader_->Iterate(),
@@ -524,6 +587,40 @@ TEST_F(ReadRequirementTest, TestMappingQuality) {
   EXPECT_TRUE(ReadSatisfiesRequirements(read_, reqs_));
 }
 
+// The native and proto requirement checks must agree on every read we have.
+TEST(NativeReadRequirementTest, AgreesWithReadSatisfiesRequirements) {
+  ReadRequirements reqs;
+  reqs.set_min_mapping_quality(38);
+  std::unique_ptr<SamReader> reader = std::move(
+      SamReader::FromFile(GetTestData(kSamTestFilename), SamReaderOptions())
+          .ValueOrDie());
+  std::vector<Read> reads = as_vector(reader->Iterate());
+  ASSERT_THAT(reader->Close(), IsOK());
+
+  string output_filename(MakeTempFile("native_requirements_test.bam"));
+  std::unique_ptr<SamWriter> writer = std::move(
+      SamWriter::ToFile(output_filename, reader->Header()).ValueOrDie());
+  for (const Read& read : reads) {
+    ASSERT_THAT(writer->Write(read), IsOK());
+  }
+  ASSERT_THAT(writer->Close(), IsOK());
+
+  htsFile* fp = hts_open(output_filename.c_str(), "r");
+  ASSERT_NE(nullptr, fp);
+  bam_hdr_t* header = sam_hdr_read(fp);
+  bam1_t* record = bam_init1();
+  for (const Read& read : reads) {
+    ASSERT_GE(sam_read1(fp, header, record), 0);
+    EXPECT_EQ(ReadSatisfiesRequirements(read, reqs),
+              NativeReadSatisfiesRequirements(*record, reqs))
+        << read.fragment_name();
+  }
+  bam_destroy1(record);
+  bam_hdr_destroy(header);
+  hts_close(fp);
+  TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(output_filename));
+}
+
 }  // namespace sam_reader_internal
 
 }  // namespace nucleus
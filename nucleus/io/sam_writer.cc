@@ -45,6 +45,7 @@ namespace nucleus {
 namespace tf = tensorflow;
 using genomics::v1::Read;
 using genomics::v1::SamHeader;
+using genomics::v1::SamWriterOptions;
 using genomics::v1::Value;
 
 namespace {
@@ -488,6 +489,122 @@ string GetFileExtension(absl::string_view file_path) {
   return string(file_path.substr(pos + 1));
 }
 
+// Sets the integer CRAM encoder option |opt| to |value| if |value| is
+// positive, leaving the htslib default in place otherwise.
+tf::Status MaybeSetCramOption(samFile* fp, enum hts_fmt_option opt,
+                              const char* opt_name, int value) {
+  if (value <= 0) {
+    return tf::Status::OK();
+  }
+  if (cram_set_option(fp->fp.cram, opt, value) < 0) {
+    return tf::errors::Unknown("Failed to set ", opt_name, " to ", value);
+  }
+  return tf::Status::OK();
+}
+
+// Applies the CRAM-specific encoder settings in |options| to |fp|.
+tf::Status SetCramOptions(const SamWriterOptions& options, samFile* fp) {
+  TF_RETURN_IF_ERROR(MaybeSetCramOption(fp, CRAM_OPT_SEQS_PER_SLICE,
+                                        "CRAM_OPT_SEQS_PER_SLICE",
+                                        options.cram_seqs_per_slice()));
+  TF_RETURN_IF_ERROR(MaybeSetCramOption(fp, CRAM_OPT_BASES_PER_SLICE,
+                                        "CRAM_OPT_BASES_PER_SLICE",
+                                        options.cram_bases_per_slice()));
+  TF_RETURN_IF_ERROR(MaybeSetCramOption(fp, CRAM_OPT_SLICES_PER_CONTAINER,
+                                        "CRAM_OPT_SLICES_PER_CONTAINER",
+                                        options.cram_slices_per_container()));
+  if (cram_set_option(fp->fp.cram, CRAM_OPT_USE_BZIP2,
+                      options.cram_use_bzip2() ? 1 : 0) < 0 ||
+      cram_set_option(fp->fp.cram, CRAM_OPT_USE_LZMA,
+                      options.cram_use_lzma() ? 1 : 0) < 0 ||
+      cram_set_option(fp->fp.cram, CRAM_OPT_USE_RANS,
+                      options.cram_disable_rans() ? 0 : 1) < 0) {
+    return tf::errors::Unknown("Failed to configure the CRAM block codecs");
+  }
+  return tf::Status::OK();
+}
+
+// Opens |sam_path| for writing in the format implied by its extension, and
+// configures it according to |options|. For CRAM output, also configures the
+// reference used for encoding.
+StatusOr<samFile*> OpenForWriting(const string& sam_path,
+                                  const string& ref_path, bool embed_ref,
+                                  const SamWriterOptions& options) {
+  htsFormat fmt;
+  fmt.specific = nullptr;
+
+  if (hts_parse_format(&fmt, GetFileExtension(sam_path).c_str()) < 0) {
+    return tf::errors::Unknown("Parsing file format fails: ", sam_path);
+  }
+  samFile* fp = hts_open_format_x(sam_path, "w", &fmt);
+  if (fp == nullptr) {
+    return tf::errors::Unknown("Could not open file for writing: ", sam_path);
+  }
+  // Set user provided reference FASTA to decode CRAM.
+  if (fp->format.format == cram) {
+    if (ref_path.empty()) {
+      hts_close(fp);
+      return tf::errors::FailedPrecondition(
+          "Writing CRAM format requires a reference file");
+    }
+    LOG(INFO) << "Setting CRAM reference path to '" << ref_path << "'";
+    if (cram_set_option(fp->fp.cram, CRAM_OPT_REFERENCE, ref_path.c_str()) <
+        0) {
+      hts_close(fp);
+      return tf::errors::Unknown(
+          "Failed to set the CRAM_OPT_REFERENCE value to ", ref_path);
+    }
+    cram_set_option(fp->fp.cram, CRAM_OPT_EMBED_REF, embed_ref ? 1 : 0);
+    tf::Status status = SetCramOptions(options, fp);
+    if (!status.ok()) {
+      hts_close(fp);
+      return status;
+    }
+  }
+  if (options.compression_level() > 0 &&
+      hts_set_opt(fp, HTS_OPT_COMPRESSION_LEVEL,
+                  options.compression_level()) < 0) {
+    hts_close(fp);
+    return tf::errors::Unknown("Failed to set HTS_OPT_COMPRESSION_LEVEL to ",
+                               options.compression_level());
+  }
+  // The thread pool is owned by |fp| and torn down by hts_close.
+  if (options.num_threads() > 0) {
+    LOG(INFO) << "Using " << options.num_threads()
+              << " compression threads for " << sam_path;
+    if (hts_set_threads(fp, options.num_threads()) < 0) {
+      hts_close(fp);
+      return tf::errors::Unknown("Failed to set up ", options.num_threads(),
+                                 " threads for writing ", sam_path);
+    }
+  }
+  return fp;
+}
+
+// Maps a base quality score to its bin under the Illumina 8-level scheme.
+inline uint8_t Illumina8LevelBin(uint8_t qual) {
+  if (qual < 2) return qual;
+  if (qual < 10) return 6;
+  if (qual < 20) return 15;
+  if (qual < 25) return 22;
+  if (qual < 30) return 27;
+  if (qual < 35) return 33;
+  if (qual < 40) return 37;
+  return 40;
+}
+
+// Bins the base qualities of |b| in place according to |binning|.
+void BinQualities(SamWriterOptions::QualityBinning binning, bam1_t* b) {
+  if (binning == SamWriterOptions::NO_QUALITY_BINNING || b->core.l_qseq == 0) {
+    return;
+  }
+  uint8_t* quals = bam_get_qual(b);
+  if (quals[0] == 0xff) return;  // Missing qualities.
+  for (int i = 0; i < b->core.l_qseq; ++i) {
+    quals[i] = Illumina8LevelBin(quals[i]);
+  }
+}
+
 }  // namespace
 
 // -----------------------------------------------------------------------------
@@ -552,30 +669,19 @@ StatusOr<std::unique_ptr<SamWriter>> SamWriter::ToFile(
 StatusOr<std::unique_ptr<SamWriter>> SamWriter::ToFile(
     const string& sam_path, const string& ref_path, bool embed_ref,
     const genomics::v1::SamHeader& sam_header) {
-  htsFormat fmt;
-  fmt.specific = nullptr;
+  return ToFile(sam_path, ref_path, embed_ref, SamWriterOptions(), sam_header);
+}
 
-  if (hts_parse_format(&fmt, GetFileExtension(sam_path).c_str()) < 0) {
-    return tf::errors::Unknown("Parsing file format fails: ", sam_path);
-  }
-  samFile* fp = hts_open_format_x(sam_path, "w", &fmt);
-  if (fp == nullptr) {
-    return tf::errors::Unknown("Could not open file for writing: ", sam_path);
-  }
-  // Set user provided reference FASTA to decode CRAM.
-  if (fp->format.format == cram) {
-    if (ref_path.empty()) {
-      return tf::errors::FailedPrecondition(
-          "Writing CRAM format requires a reference file");
-    }
-    LOG(INFO) << "Setting CRAM reference path to '" << ref_path << "'";
-    if (cram_set_option(fp->fp.cram, CRAM_OPT_REFERENCE, ref_path.c_str()) <
-        0) {
-      return tf::errors::Unknown(
-          "Failed to set the CRAM_OPT_REFERENCE value to ", ref_path);
-    }
-    cram_set_option(fp->fp.cram, CRAM_OPT_EMBED_REF, embed_ref ? 1 : 0);
+StatusOr<std::unique_ptr<SamWriter>> SamWriter::ToFile(
+    const string& sam_path, const string& ref_path, bool embed_ref,
+    const SamWriterOptions& options,
+    const genomics::v1::SamHeader& sam_header) {
+  StatusOr<samFile*> fp_status =
+      OpenForWriting(sam_path, ref_path, embed_ref, options);
+  if (!fp_status.ok()) {
+    return fp_status.status();
   }
+  samFile* fp = fp_status.ValueOrDie();
 
   auto native_file = absl::make_unique<NativeFile>(fp);
   auto native_header = absl::make_unique<NativeHeader>(bam_hdr_init());
@@ -585,13 +691,47 @@ StatusOr<std::unique_ptr<SamWriter>> SamWriter::ToFile(
   if (sam_hdr_write(fp, native_header->value()) < 0) {
     return tf::errors::Unknown("Writing header to file failed");
   }
+  return absl::WrapUnique<SamWriter>(new SamWriter(
+      options, std::move(native_file), std::move(native_header)));
+}
+
+StatusOr<std::unique_ptr<SamWriter>> SamWriter::ToFile(
+    const string& sam_path, const string& ref_path, bool embed_ref,
+    const bam_hdr_t& native_header) {
+  return ToFile(sam_path, ref_path, embed_ref, SamWriterOptions(),
+                native_header);
+}
+
+StatusOr<std::unique_ptr<SamWriter>> SamWriter::ToFile(
+    const string& sam_path, const string& ref_path, bool embed_ref,
+    const SamWriterOptions& options, const bam_hdr_t& native_header) {
+  StatusOr<samFile*> fp_status =
+      OpenForWriting(sam_path, ref_path, embed_ref, options);
+  if (!fp_status.ok()) {
+    return fp_status.status();
+  }
+  auto native_file = absl::make_unique<NativeFile>(fp_status.ValueOrDie());
+  // The header text of a file we read already contains its @SQ lines, so
+  // unlike the proto path no CRAM-specific fixup is needed.
+  bam_hdr_t* h = bam_hdr_dup(&native_header);
+  if (h == nullptr) {
+    return tf::errors::Unknown("Failed to copy the native SAM header");
+  }
+  auto header = absl::make_unique<NativeHeader>(h);
+
+  if (sam_hdr_write(native_file->value(), header->value()) < 0) {
+    return tf::errors::Unknown("Writing header to file failed");
+  }
   return absl::WrapUnique<SamWriter>(
-      new SamWriter(std::move(native_file), std::move(native_header)));
+      new SamWriter(options, std::move(native_file), std::move(header)));
 }
 
-SamWriter::SamWriter(std::unique_ptr<NativeFile> file,
+SamWriter::SamWriter(const SamWriterOptions& options,
+                     std::unique_ptr<NativeFile> file,
                      std::unique_ptr<NativeHeader> header)
-    : native_file_(std::move(file)), native_header_(std::move(header)) {}
+    : options_(options),
+      native_file_(std::move(file)),
+      native_header_(std::move(header)) {}
 
 SamWriter::~SamWriter() {
   if (native_file_) {
@@ -602,6 +742,7 @@ SamWriter::~SamWriter() {
 }
 
 tf::Status SamWriter::Close() {
+  scratch_body_.reset();
   native_file_.reset();
   native_header_ = nullptr;
   return tf::Status::OK();
@@ -614,6 +755,7 @@ tf::Status SamWriter::Write(const Read& read) {
   if (!status.ok()) {
     return status;
   }
+  BinQualities(options_.quality_binning(), body->value());
   if (sam_write1(native_file_->value(), native_header_->value(),
                  body->value()) < 0) {
     return tf::errors::Unknown("Cannot add record");
@@ -621,4 +763,33 @@ tf::Status SamWriter::Write(const Read& read) {
   return tf::Status::OK();
 }
 
+tf::Status SamWriter::WriteNative(const bam1_t& record) {
+  if (!native_file_) {
+    return tf::errors::FailedPrecondition("Cannot write to a closed SamWriter");
+  }
+  if (record.core.tid >= native_header_->value()->n_targets ||
+      record.core.mtid >= native_header_->value()->n_targets) {
+    return tf::errors::InvalidArgument(
+        "Record ", bam_get_qname(&record),
+        " refers to a reference sequence not in this writer's header");
+  }
+  const bam1_t* to_write = &record;
+  if (options_.quality_binning() != SamWriterOptions::NO_QUALITY_BINNING) {
+    if (!scratch_body_) {
+      scratch_body_ = absl::make_unique<NativeBody>(bam_init1());
+    }
+    if (bam_copy1(scratch_body_->value(), &record) == nullptr) {
+      return tf::errors::Unknown("Failed to copy record ",
+                                 bam_get_qname(&record));
+    }
+    BinQualities(options_.quality_binning(), scratch_body_->value());
+    to_write = scratch_body_->value();
+  }
+  if (sam_write1(native_file_->value(), native_header_->value(), to_write) <
+      0) {
+    return tf::errors::Unknown("Cannot add record");
+  }
+  return tf::Status::OK();
+}
+
 }  // namespace nucleus
@@ -63,6 +63,29 @@ class SamWriter {
       const string& sam_path, const string& ref_path, bool embed_ref,
       const nucleus::genomics::v1::SamHeader& sam_header);
 
+  // Same as above, but |options| controls compression, threading and the CRAM
+  // encoder settings of the output.
+  static StatusOr<std::unique_ptr<SamWriter>> ToFile(
+      const string& sam_path, const string& ref_path, bool embed_ref,
+      const nucleus::genomics::v1::SamWriterOptions& options,
+      const nucleus::genomics::v1::SamHeader& sam_header);
+
+  // Creates a new SamWriter writing to the file at |sam_path| whose header is
+  // a copy of the native htslib header |native_header|, typically the one
+  // owned by the SamReader the records come from (see SamReader::NativeHeader).
+  // This is the writer to use with WriteNative, since raw records carry
+  // reference ids that are only meaningful with respect to the header they
+  // were decoded against. |ref_path| and |embed_ref| are as above.
+  static StatusOr<std::unique_ptr<SamWriter>> ToFile(
+      const string& sam_path, const string& ref_path, bool embed_ref,
+      const bam_hdr_t& native_header);
+
+  // Same as above, with writer |options|.
+  static StatusOr<std::unique_ptr<SamWriter>> ToFile(
+      const string& sam_path, const string& ref_path, bool embed_ref,
+      const nucleus::genomics::v1::SamWriterOptions& options,
+      const bam_hdr_t& native_header);
+
   ~SamWriter();
 
   // Disable copy and assignment operations.
@@ -79,6 +102,12 @@ class SamWriter {
     return Write(*(wrapped.p_));
   }
 
+  // Write the native htslib record |record| to the file as-is, without going
+  // through a Read proto. The record's tid/mtid must refer to this writer's
+  // header, so the writer should have been created from the native header of
+  // the file |record| was read from.
+  tensorflow::Status WriteNative(const bam1_t& record);
+
   // Close the underlying resource descriptors. Returns Status::OK() if the
   // close was successful; otherwise the status provides information about what
   // error occurred.
@@ -93,14 +122,22 @@ class SamWriter {
   class NativeFile;
   class NativeBody;
   // Private constructor; use ToFile to safely create a SamWriter.
-  SamWriter(std::unique_ptr<NativeFile> file,
+  SamWriter(const nucleus::genomics::v1::SamWriterOptions& options,
+            std::unique_ptr<NativeFile> file,
             std::unique_ptr<NativeHeader> header);
 
+  // The options controlling the behavior of this SamWriter.
+  const nucleus::genomics::v1::SamWriterOptions options_;
+
   // A pointer to the htslib file used to access the SAM/BAM/CRAM data.
   std::unique_ptr<NativeFile> native_file_;
 
   // A htslib header data structure obtained by parsing the header of this file.
   std::unique_ptr<NativeHeader> native_header_;
+
+  // Scratch record used by WriteNative when the record has to be modified
+  // (e.g. quality binning) before being written. Lazily allocated.
+  std::unique_ptr<NativeBody> scratch_body_;
 };
 
 }  // namespace nucleus
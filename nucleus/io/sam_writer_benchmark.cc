@@ -0,0 +1,130 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares write throughput and output size of SamWriter for BAM and CRAM
+// under various SamWriterOptions, using the test CRAM data.
+//
+// Usage: bazel run //nucleus/io:sam_writer_benchmark -- [n_replicates]
+//
+// Each read of the test file is written n_replicates times in a row (so the
+// output stays coordinate sorted), to get a file large enough to time.
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "nucleus/io/sam_reader.h"
+#include "nucleus/io/sam_writer.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/reads.pb.h"
+#include "nucleus/testing/test_utils.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace nucleus {
+namespace {
+
+using genomics::v1::Read;
+using genomics::v1::SamReaderOptions;
+using genomics::v1::SamWriterOptions;
+
+struct Config {
+  string name;
+  string extension;
+  SamWriterOptions options;
+};
+
+std::vector<Config> MakeConfigs() {
+  std::vector<Config> configs;
+  configs.push_back({"bam", "bam", SamWriterOptions()});
+  SamWriterOptions threaded;
+  threaded.set_num_threads(4);
+  configs.push_back({"bam threads=4", "bam", threaded});
+
+  configs.push_back({"cram", "cram", SamWriterOptions()});
+  configs.push_back({"cram threads=4", "cram", threaded});
+  SamWriterOptions small;
+  small.set_compression_level(9);
+  small.set_cram_use_bzip2(true);
+  small.set_cram_use_lzma(true);
+  small.set_cram_slices_per_container(4);
+  configs.push_back({"cram level=9 bzip2 lzma slices=4", "cram", small});
+  SamWriterOptions binned = small;
+  binned.set_quality_binning(SamWriterOptions::ILLUMINA_8_LEVEL);
+  configs.push_back({"cram level=9 bzip2 lzma slices=4 binned", "cram",
+                     binned});
+  SamWriterOptions fast;
+  fast.set_num_threads(4);
+  fast.set_compression_level(1);
+  fast.set_quality_binning(SamWriterOptions::ILLUMINA_8_LEVEL);
+  configs.push_back({"cram level=1 threads=4 binned", "cram", fast});
+  return configs;
+}
+
+void Run(int n_replicates) {
+  const string ref_path = GetTestData("test.fasta");
+  std::unique_ptr<SamReader> reader = std::move(
+      SamReader::FromFile(
+          GetTestData("test_cram.embed_ref_0_version_3.0.cram"), ref_path,
+          SamReaderOptions())
+          .ValueOrDie());
+  std::vector<Read> reads = as_vector(reader->Iterate());
+  TF_CHECK_OK(reader->Close());
+  const int64 n_reads = static_cast<int64>(reads.size()) * n_replicates;
+
+  std::cout << absl::StrFormat("%-42s %10s %14s %14s\n", "config", "seconds",
+                               "reads/s", "bytes");
+  for (const Config& config : MakeConfigs()) {
+    const string path =
+        MakeTempFile(absl::StrCat("sam_writer_benchmark.", config.extension));
+    const absl::Time start = absl::Now();
+    {
+      std::unique_ptr<SamWriter> writer =
+          std::move(SamWriter::ToFile(path, ref_path, false, config.options,
+                                      reader->Header())
+                        .ValueOrDie());
+      for (const Read& read : reads) {
+        for (int i = 0; i < n_replicates; ++i) {
+          TF_CHECK_OK(writer->Write(read));
+        }
+      }
+      TF_CHECK_OK(writer->Close());
+    }
+    const double seconds = absl::ToDoubleSeconds(absl::Now() - start);
+    tensorflow::uint64 size = 0;
+    TF_CHECK_OK(tensorflow::Env::Default()->GetFileSize(path, &size));
+    TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(path));
+    std::cout << absl::StrFormat("%-42s %10.3f %14.0f %14d\n", config.name,
+                                 seconds, n_reads / seconds, size);
+  }
+}
+
+}  // namespace
+}  // namespace nucleus
+
+int main(int argc, char** argv) {
+  const int n_replicates = argc > 1 ? atoi(argv[1]) : 20000;
+  CHECK_GT(n_replicates, 0) << "n_replicates must be positive";
+  nucleus::Run(n_replicates);
+  return 0;
+}
@@ -17,6 +17,7 @@
 
 #include "nucleus/io/sam_writer.h"
 
+#include <set>
 #include <utility>
 #include <vector>
 
@@ -40,6 +41,7 @@ namespace nucleus {
 
 using nucleus::genomics::v1::Read;
 using nucleus::genomics::v1::SamReaderOptions;
+using nucleus::genomics::v1::SamWriterOptions;
 
 namespace {
 
@@ -343,4 +345,58 @@ TEST_P(CramWriterTest, WriteAndThenRead) {
   TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(output_filename));
 }
 
+// Test that the CRAM encoder and threading options produce a readable file
+// with the same reads, modulo the requested quality binning.
+class SamWriterOptionsTest : public SamWriterTest,
+                             public ::testing::WithParamInterface<string> {};
+
+INSTANTIATE_TEST_CASE_P(All, SamWriterOptionsTest,
+                        ::testing::Values("bam", "cram"));
+
+TEST_P(SamWriterOptionsTest, WriteWithOptionsAndThenRead) {
+  const string ref_path = GetTestData("test.fasta");
+  auto reader = std::move(
+      SamReader::FromFile(
+          GetTestData("test_cram.embed_ref_0_version_3.0.cram"), ref_path,
+          SamReaderOptions())
+          .ValueOrDie());
+  std::vector<Read> reads = as_vector(reader->Iterate());
+  ASSERT_THAT(reader->Close(), IsOK());
+
+  SamWriterOptions options;
+  options.set_num_threads(2);
+  options.set_compression_level(9);
+  options.set_cram_seqs_per_slice(2);
+  options.set_cram_slices_per_container(2);
+  options.set_cram_use_bzip2(true);
+  options.set_quality_binning(SamWriterOptions::ILLUMINA_8_LEVEL);
+  const string output_filename = MakeTempFile("options_test." + GetParam());
+  std::unique_ptr<SamWriter> writer =
+      std::move(SamWriter::ToFile(output_filename, ref_path, false, options,
+                                  reader->Header())
+                    .ValueOrDie());
+  for (const Read& r : reads) {
+    EXPECT_THAT(writer->Write(r), IsOK());
+  }
+  ASSERT_THAT(writer->Close(), IsOK());
+
+  auto reader2 = std::move(
+      SamReader::FromFile(output_filename, ref_path, SamReaderOptions())
+          .ValueOrDie());
+  std::vector<Read> reads2 = as_vector(reader2->Iterate());
+  ASSERT_THAT(reader2->Close(), IsOK());
+
+  const std::set<int> kBins = {0, 1, 6, 15, 22, 27, 33, 37, 40};
+  ASSERT_EQ(reads.size(), reads2.size());
+  for (size_t i = 0; i < reads.size(); ++i) {
+    for (int qual : reads2[i].aligned_quality()) {
+      EXPECT_EQ(1u, kBins.count(qual)) << qual;
+    }
+    reads[i].clear_aligned_quality();
+    reads2[i].clear_aligned_quality();
+    EXPECT_THAT(reads2[i], EqualsProto(reads[i]));
+  }
+  TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(output_filename));
+}
+
 }  // namespace nucleus
@@ -28,3 +28,8 @@ def build_index(path):
 def build_csi_index(path, min_shift):
   """Builds a csi index for VCF at the specified path."""
   tabix_indexer.csi_index_build(path, min_shift)
+
+
+def build_bcf_index(path, min_shift):
+  """Builds a csi index for the bgzipped BCF at the specified path."""
+  tabix_indexer.bcf_index_build(path, min_shift)
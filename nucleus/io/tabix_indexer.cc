@@ -44,4 +44,18 @@ tf::Status CSIIndexBuild(string path, int min_shift) {
   return tf::Status::OK();
 }
 
+tf::Status BcfIndexBuild(const string& path, int min_shift) {
+  if (min_shift <= 0) {
+    return tf::errors::InvalidArgument(
+        "BCF files can only be indexed with CSI, which needs a positive "
+        "min_shift, but got ", min_shift);
+  }
+  int val = bcf_index_build_x(path, min_shift);
+  if (val < 0) {
+    LOG(WARNING) << "Return code: " << val << "\nFile path: " << path;
+    return tf::errors::Internal("Failure to write BCF CSI index.");
+  }
+  return tf::Status::OK();
+}
+
 }  // namespace nucleus
@@ -26,6 +26,10 @@ namespace nucleus {
 // Builds a tabix index for bgzipped VCF at the specified path.
 tensorflow::Status TbxIndexBuild(const string& path);
 tensorflow::Status CSIIndexBuild(string path, int min_shift);
+
+// Builds a CSI index for the BGZF-compressed BCF at the specified path. The
+// index is written to path + '.csi'.
+tensorflow::Status BcfIndexBuild(const string& path, int min_shift);
 }  // namespace nucleus
 
 #endif  // THIRD_PARTY_NUCLEUS_IO_TABIX_INDEXER_H_
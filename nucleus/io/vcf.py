@@ -149,7 +149,15 @@ class NativeVcfReader(genomics_reader.GenomicsReader):
                excluded_info_fields=None,
                excluded_format_fields=None,
                store_gl_and_pl_in_info_map=False,
-               header=None):
+               header=None,
+               num_threads=0,
+               included_samples=None,
+               excluded_samples=None,
+               sites_only=False,
+               omit_call_set_names=False,
+               included_info_fields=None,
+               included_format_fields=None,
+               filter_expression=''):
     """Initializer for NativeVcfReader.
 
     Args:
@@ -164,13 +172,43 @@ class NativeVcfReader(genomics_reader.GenomicsReader):
         values in the VariantCall.genotype_likelihood field.
       header: If not None, specifies the variants_pb2.VcfHeader. The file at
         input_path must not contain any header information.
+      num_threads: int. Number of additional threads htslib uses to decompress
+        bgzipped VCF and BCF input. If 0, decompress on the calling thread.
+      included_samples: list(str). If not None, only the calls of these
+        samples are decoded into the Variants.
+      excluded_samples: list(str). If not None, the calls of these samples are
+        not decoded into the Variants. Cannot be combined with
+        included_samples.
+      sites_only: bool. If True, per-sample data is skipped entirely and the
+        Variants have no calls.
+      omit_call_set_names: bool. If True, VariantCalls carry only the index of
+        their sample in header.sample_names, instead of the sample name. Use
+        variantcall_utils.get_call_set_name to get the name.
+      included_info_fields: list(str). If not None, only these INFO field IDs
+        are parsed into the Variants. Fields in excluded_info_fields are
+        skipped even if listed here.
+      included_format_fields: list(str). If not None, only these FORMAT field
+        IDs are parsed into the Variants. Fields in excluded_format_fields are
+        skipped even if listed here.
+      filter_expression: str. If not empty, only the records satisfying this
+        expression, such as 'QUAL > 30 && FILTER == PASS', are returned. It is
+        evaluated before records are converted to Variants. See
+        nucleus/io/vcf_filter.h for the syntax.
     """
     super(NativeVcfReader, self).__init__()
 
     options = variants_pb2.VcfReaderOptions(
         excluded_info_fields=excluded_info_fields,
         excluded_format_fields=excluded_format_fields,
-        store_gl_and_pl_in_info_map=store_gl_and_pl_in_info_map)
+        store_gl_and_pl_in_info_map=store_gl_and_pl_in_info_map,
+        num_threads=num_threads,
+        included_samples=included_samples,
+        excluded_samples=excluded_samples,
+        sites_only=sites_only,
+        omit_call_set_names=omit_call_set_names,
+        included_info_fields=included_info_fields,
+        included_format_fields=included_format_fields,
+        filter_expression=filter_expression)
     if header is not None:
       self._reader = vcf_reader.VcfReader.from_file_with_header(
           input_path.encode('utf8'), options, header)
@@ -189,6 +227,24 @@ class NativeVcfReader(genomics_reader.GenomicsReader):
     """Returns an iterator for going through variants in the region."""
     return self._reader.query(region)
 
+  def iterate_genotype_matrices(self, batch_size=0, ploidy=2):
+    """Returns an iterable of the file's genotypes as dense numpy arrays.
+
+    Args:
+      batch_size: int. The number of variants per GenotypeMatrix. If 0, all
+        variants are returned in a single GenotypeMatrix.
+      ploidy: int. The number of alleles stored per call.
+
+    Returns:
+      An iterable of GenotypeMatrix namedtuples. The numpy arrays take over the
+      memory they were decoded into in C++, so no data is copied.
+    """
+    return self._reader.iterate_genotype_matrices(batch_size, ploidy)
+
+  def query_genotype_matrices(self, region, batch_size=0, ploidy=2):
+    """Same as iterate_genotype_matrices, for the variants in the region."""
+    return self._reader.query_genotype_matrices(region, batch_size, ploidy)
+
   def __exit__(self, exit_type, exit_value, exit_traceback):
     self._reader.__exit__(exit_type, exit_value, exit_traceback)
 
@@ -238,7 +294,8 @@ class NativeVcfWriter(genomics_writer.GenomicsWriter):
                excluded_info_fields=None,
                excluded_format_fields=None,
                retrieve_gl_and_pl_from_info_map=False,
-               exclude_header=False):
+               exclude_header=False,
+               num_threads=0):
     """Initializer for NativeVcfWriter.
 
     Args:
@@ -257,6 +314,8 @@ class NativeVcfWriter(genomics_writer.GenomicsWriter):
         fields are retrieved from the VariantCall.info map rather than from the
         top-level value in the VariantCall.genotype_likelihood field.
       exclude_header: bool. If True, write a headerless VCF.
+      num_threads: int. Number of additional threads htslib uses to compress
+        bgzipped VCF and BCF output. If 0, compress on the calling thread.
     """
     super(NativeVcfWriter, self).__init__()
 
@@ -268,6 +327,7 @@ class NativeVcfWriter(genomics_writer.GenomicsWriter):
         excluded_format_fields=excluded_format_fields,
         retrieve_gl_and_pl_from_info_map=retrieve_gl_and_pl_from_info_map,
         exclude_header=exclude_header,
+        num_threads=num_threads,
     )
     self._writer = vcf_writer.VcfWriter.to_file(output_path, header,
                                                 writer_options)
@@ -290,7 +350,8 @@ class VcfWriter(genomics_writer.DispatchingGenomicsWriter):
                      excluded_info_fields=None,
                      excluded_format_fields=None,
                      retrieve_gl_and_pl_from_info_map=False,
-                     exclude_header=False):
+                     exclude_header=False,
+                     num_threads=0):
     return NativeVcfWriter(
         output_path,
         header=header,
@@ -298,7 +359,8 @@ class VcfWriter(genomics_writer.DispatchingGenomicsWriter):
         excluded_info_fields=excluded_info_fields,
         excluded_format_fields=excluded_format_fields,
         retrieve_gl_and_pl_from_info_map=retrieve_gl_and_pl_from_info_map,
-        exclude_header=exclude_header)
+        exclude_header=exclude_header,
+        num_threads=num_threads)
 
   def _post_init_hook(self):
     # Initialize field_access_cache.  If we are dispatching to a
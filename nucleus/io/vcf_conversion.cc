@@ -127,93 +127,102 @@ void AddContigToHeader(const nucleus::genomics::v1::ContigInfo& contig,
   bcf_hdr_append(header, contigStr.c_str());
 }
 
+// Id of `tag` (of hl_type) in `h`; -1 if undefined, kUnresolvedTagId if !h.
+int HeaderTagId(const bcf_hdr_t* h, const char* tag, int hl_type) {
+  if (h == nullptr) return kUnresolvedTagId;
+  const int id = bcf_hdr_id2int(h, BCF_DT_ID, tag);
+  return bcf_hdr_idinfo_exists(h, hl_type, id) ? id : -1;
+}
+
 // -----------------------------------------------------------------------------
 // "Raw" low-level interface to encoding/decoding to FORMAT fields.  We use
 // these directly for FORMAT fields that have special semantics and so cannot be
 // handled by VcfFormatFieldAdapter.
 
-// Read in one of the format tags for a variant line of a VCF file, and return
-// a vector of vectors, where each subvector records values for a single sample.
-// An empty subvector represents that the field is "missing" for this sample.
-// If the tag is not represented in this variant, a zero-length vector is
-// returned.
+// Returns the FORMAT field with header id `tag_id` of a variant line of a VCF
+// file, if it is represented in this variant and its values can be read as
+// ValueType. Otherwise returns nullptr.
 template <class ValueType>
-std::vector<std::vector<ValueType>> ReadFormatValues(const bcf_hdr_t* h,
-                                                     const bcf1_t* v,
-                                                     const char* tag) {
-  using VT = VcfType<ValueType>;
+const bcf_fmt_t* GetFormatField(bcf1_t* v, int tag_id) {
+  if (tag_id < 0) return nullptr;
+  const bcf_fmt_t* fmt = bcf_get_fmt_id(v, tag_id);
+  if (fmt == nullptr || fmt->p == nullptr) return nullptr;
+  if (!VcfType<ValueType>::IsPackedType(fmt->type)) {
+    LOG(WARNING) << "Error reading format values (unexpected type "
+                 << fmt->type << ") for tag id " << tag_id;
+    return nullptr;
+  }
+  return fmt;
+}
 
-  if (bcf_get_fmt(h, const_cast<bcf1_t*>(v), tag) == nullptr) {
-    return std::vector<std::vector<ValueType>>();
-  }
+// Returns the number of values of sample `i` in the FORMAT field `fmt`. We
+// only support fields that are entirely missing, so 0 is returned if any value
+// is missing.
+template <class ValueType>
+int NumSampleValues(const bcf_fmt_t* fmt, int i) {
+  using VT = VcfType<ValueType>;
 
-  int n_values, n_dst = 0;
-  ValueType* dst = nullptr;
-  n_values = VT::GetFormatValues(h, v, tag, &dst, &n_dst);
-  if (dst == nullptr) {
-    LOG(WARNING) << "Error reading format values (dst == nullptr) for tag "
-                 << tag;
-    return std::vector<std::vector<ValueType>>();
-  }
-  if (n_values < 0) {
-    LOG(WARNING) << "Error reading format values (n_values < 0) for tag "
-                 << tag;
-    free(dst);
-    return std::vector<std::vector<ValueType>>();
+  const uint8_t* p = fmt->p + i * fmt->size;
+  for (int j = 0; j < fmt->n; j++) {
+    const ValueType value = VcfType<ValueType>::ReadPacked(p, fmt->type, j);
+    if (VT::IsVectorEnd(value)) return j;
+    if (VT::IsMissing(value)) return 0;
   }
+  return fmt->n;
+}
 
-  int n_values_per_sample = n_values / v->n_sample;
-  std::vector<std::vector<ValueType>> values(v->n_sample);
-
+// Decode the format tag `tag` with header id `tag_id` of a variant line of a
+// VCF file into the info maps of the calls of `variant`. Samples for which the
+// field is missing get no entry.
+template <class ValueType>
+void DecodeFormatValues(bcf1_t* v, const string& tag, int tag_id,
+                        nucleus::genomics::v1::Variant* variant) {
+  const bcf_fmt_t* fmt = GetFormatField<ValueType>(v, tag_id);
+  if (fmt == nullptr) return;
   for (int i = 0; i < v->n_sample; i++) {
-    for (int j = 0; j < n_values_per_sample; j++) {
-      ValueType* p = dst + n_values_per_sample * i + j;
-      if (VT::IsVectorEnd(*p)) break;
-      // We only support fields that are entirely missing, so if we encounter a
-      // single missing field, we clear this subvector and break.
-      if (VT::IsMissing(*p)) {
-        values[i].clear();
-        break;
+    const int n_values = NumSampleValues<ValueType>(fmt, i);
+    if (n_values > 0) {
+      nucleus::genomics::v1::ListValue& list =
+          (*variant->mutable_calls(i)->mutable_info())[tag];
+      list.clear_values();
+      const uint8_t* p = fmt->p + i * fmt->size;
+      for (int j = 0; j < n_values; j++) {
+        SetValuesValue<ValueType>(
+            VcfType<ValueType>::ReadPacked(p, fmt->type, j), list.add_values());
       }
-      values[i].push_back(*p);
     }
   }
-
-  free(dst);
-  return values;
 }
 
-
 // Specialized instantiation for string fields, which require different
-// memory management and semantics.
-template<>
-std::vector<std::vector<string>> ReadFormatValues(const bcf_hdr_t* h,
-                                                  const bcf1_t* v,
-                                                  const char* tag) {
-  if (bcf_get_fmt(h, const_cast<bcf1_t*>(v), tag) == nullptr) {
-    return {};
-  }
-
-  int n_dst = 0;
-  char** dst = nullptr;
-  std::vector<std::vector<string>> values(v->n_sample);
-  if (bcf_get_format_string(h, const_cast<bcf1_t*>(v), tag, &dst, &n_dst) > 0) {
-    for (int i = 0; i < bcf_hdr_nsamples(h); i++) {
-      // TODO(xunjieli): (1) validate the length of this list is as declared in
-      // the header, and figure out what to do when declared length is smaller
-      // than the actual length of the list.
-
-      // According to https://samtools.github.io/hts-specs/VCFv4.3.pdf
-      // Section 6.3.3 strings in VCF cannot contain ',' (a field separator).
-      values[i] = absl::StrSplit(dst[i], ',');
+// semantics.
+template <>
+void DecodeFormatValues<string>(bcf1_t* v, const string& tag, int tag_id,
+                                nucleus::genomics::v1::Variant* variant) {
+  if (tag_id < 0) return;
+  const bcf_fmt_t* fmt = bcf_get_fmt_id(v, tag_id);
+  if (fmt == nullptr || fmt->p == nullptr) return;
+  if (fmt->type != BCF_BT_CHAR) {
+    LOG(WARNING) << "Error reading format values (unexpected type "
+                 << fmt->type << ") for tag " << tag;
+    return;
+  }
+  for (int i = 0; i < v->n_sample; i++) {
+    // TODO(xunjieli): (1) validate the length of this list is as declared in
+    // the header, and figure out what to do when declared length is smaller
+    // than the actual length of the list.
+    nucleus::genomics::v1::ListValue& list =
+        (*variant->mutable_calls(i)->mutable_info())[tag];
+    list.clear_values();
+    // Each sample's string is padded with NULs to fmt->n bytes.
+    const char* p = reinterpret_cast<const char*>(fmt->p + i * fmt->size);
+    // According to https://samtools.github.io/hts-specs/VCFv4.3.pdf
+    // Section 6.3.3 strings in VCF cannot contain ',' (a field separator).
+    for (absl::string_view value :
+         absl::StrSplit(absl::string_view(p, strnlen(p, fmt->n)), ',')) {
+      list.add_values()->set_string_value(value.data(), value.size());
     }
-    // As noted in bcf_get_format_string declaration in vcf.h, the format
-    // function we are using here allocates two arrays and both must be cleaned
-    // by the user.
-    free(dst[0]);
-    free(dst);
   }
-  return values;
 }
 
 // Sentinel value used to set variant.quality if one was not specified.
@@ -240,7 +249,7 @@ int32 vcfEncodeAllele(int pbAllele, bool isPhased) {
 //     an empty vector, it means the values are MISSING for this sample.
 //   - the subvectors of vv should all be the same length, except for potential
 //     empty subvectors
-// (This the inverse of ReadFormatValues)
+// (This the inverse of DecodeFormatValues)
 template <class ValueType>
 tensorflow::Status EncodeFormatValues(
     const std::vector<std::vector<ValueType>>& values, const char* tag,
@@ -336,69 +345,49 @@ tensorflow::Status EncodeFormatValues(
 // "Raw" low-level interface to encoding/decoding to INFO fields. These
 // functions parallel the "FORMAT" functions above.
 
+// Read in the info tag with header id `tag_id` of a variant line of a VCF
+// file and append its values to `list`. Nothing is appended if the tag is not
+// represented in this variant.
 template <class ValueType>
-std::vector<ValueType> ReadInfoValue(const bcf_hdr_t* h,
-                                     const bcf1_t* v,
-                                     const char* tag) {
+void ReadInfoValue(bcf1_t* v, int tag_id,
+                   nucleus::genomics::v1::ListValue* list) {
   using VT = VcfType<ValueType>;
 
-  if (bcf_get_info(h, const_cast<bcf1_t*>(v), tag) == nullptr) {
-    return {};
-  }
-
-  int n_values, n_dst = 0;
-  ValueType* dst = nullptr;
-  n_values = VT::GetInfoValues(h, v, tag, &dst, &n_dst);
-  if (dst == nullptr) {
-    LOG(WARNING) << "Error reading info (dst == nullptr) value " << tag;
-    return {};
+  if (tag_id < 0) return;
+  const bcf_info_t* info = bcf_get_info_id(v, tag_id);
+  if (info == nullptr || info->vptr == nullptr) return;
+  if (!VcfType<ValueType>::IsPackedType(info->type)) {
+    LOG(WARNING) << "Error reading info (unexpected type " << info->type
+                 << ") value with tag id " << tag_id;
+    return;
   }
-  if (n_values < 0) {
-    free(dst);
-    LOG(WARNING) << "Error reading info (n_values < 0) value " << tag;
-    return {};
+  for (int j = 0; j < info->len; j++) {
+    const ValueType value =
+        VcfType<ValueType>::ReadPacked(info->vptr, info->type, j);
+    if (VT::IsVectorEnd(value)) break;
+    SetValuesValue<ValueType>(value, list->add_values());
   }
-
-  std::vector<ValueType> value(dst, dst + n_values);
-
-  free(dst);
-  return value;
 }
 
 template <>
-std::vector<string> ReadInfoValue(const bcf_hdr_t* h,
-                                  const bcf1_t* v,
-                                  const char* tag) {
-  if (bcf_get_info(h, const_cast<bcf1_t*>(v), tag) == nullptr) {
-    return {};
-  }
-
-  int n_dst = 0;
-  char* dst = nullptr;
-  if (bcf_get_info_string(h, const_cast<bcf1_t*>(v), tag, &dst, &n_dst) < 0) {
+void ReadInfoValue<string>(bcf1_t* v, int tag_id,
+                           nucleus::genomics::v1::ListValue* list) {
+  if (tag_id < 0) return;
+  const bcf_info_t* info = bcf_get_info_id(v, tag_id);
+  if (info == nullptr || info->vptr == nullptr) return;
+  if (info->type != BCF_BT_CHAR) {
     // TODO(b/69332066): cleanup error handling.
     LOG(FATAL) << "Failure to get INFO string";
   }
-  std::string string_value(dst);
-  free(dst);
-  return std::vector<string> { string_value };
+  const char* p = reinterpret_cast<const char*>(info->vptr);
+  list->add_values()->set_string_value(p, strnlen(p, info->len));
 }
 
 template <>
-std::vector<bool> ReadInfoValue(const bcf_hdr_t* h,
-                                const bcf1_t* v,
-                                const char* tag) {
-  void* dst;
-  int n_dst = 0;
-  int rc = bcf_get_info_flag(h, const_cast<bcf1_t*>(v), tag, &dst, &n_dst);
-  if (rc == 1) {
-    return {true};
-  } else if (rc == 0) {
-    return {false};
-  } else {
-    // TODO(b/69332066): cleanup error handling.
-    LOG(FATAL) << "Failure to get INFO flag.";
-  }
+void ReadInfoValue<bool>(bcf1_t* v, int tag_id,
+                         nucleus::genomics::v1::ListValue* list) {
+  list->add_values()->set_bool_value(tag_id >= 0 &&
+                                     bcf_get_info_id(v, tag_id) != nullptr);
 }
 
 template <class ValueType>
@@ -578,14 +567,31 @@ void AddExtra(const bcf_hrec_t* hrec, nucleus::genomics::v1::VcfExtra* extra) {
   extra->set_value(hrec->value);
 }
 
+// Returns true if the field |tag| is selected by the |include| and |exclude|
+// lists of a VcfRecordConverter. An empty |include| list selects all fields.
+bool IsFieldSelected(const string& tag, const std::vector<string>& include,
+                     const std::vector<string>& exclude) {
+  if (!include.empty() &&
+      std::find(include.begin(), include.end(), tag) == include.end()) {
+    return false;
+  }
+  return std::find(exclude.begin(), exclude.end(), tag) == exclude.end();
+}
+
 }  // namespace
 
 // -----------------------------------------------------------------------------
 // VcfFormatFieldAdapter implemenation.
 
 VcfFormatFieldAdapter::VcfFormatFieldAdapter(const string& field_name,
-                                             int vcf_type)
-    : field_name_(field_name), vcf_type_(vcf_type) {}
+                                             int vcf_type, int tag_id)
+    : field_name_(field_name), vcf_type_(vcf_type), tag_id_(tag_id) {}
+
+int VcfFormatFieldAdapter::TagId(const bcf_hdr_t* header) const {
+  return tag_id_ != kUnresolvedTagId
+             ? tag_id_
+             : HeaderTagId(header, field_name_.c_str(), BCF_HL_FMT);
+}
 
 
 tensorflow::Status VcfFormatFieldAdapter::EncodeValues(
@@ -652,17 +658,8 @@ template <class T> tensorflow::Status VcfFormatFieldAdapter::DecodeValues(
     nucleus::genomics::v1::Variant *variant) const {
 
   if (bcf_record->n_sample > 0) {
-    std::vector<std::vector<T>> values =
-        ReadFormatValues<T>(header, bcf_record, field_name_.c_str());
-    for (int i = 0; i < bcf_record->n_sample; i++) {
-      // Is the format field present for this variant, *and* non-missing for
-      // this sample?
-      bool have_field = !values.empty() && !values[i].empty();
-      if (have_field) {
-        nucleus::genomics::v1::VariantCall* call = variant->mutable_calls(i);
-        SetInfoField(field_name_, values[i], call);
-      }
-    }
+    DecodeFormatValues<T>(const_cast<bcf1_t*>(bcf_record), field_name_,
+                          TagId(header), variant);
   }
   return tensorflow::Status::OK();
 }
@@ -671,8 +668,14 @@ template <class T> tensorflow::Status VcfFormatFieldAdapter::DecodeValues(
 // VcfInfoFieldAdapter implementation.
 
 VcfInfoFieldAdapter::VcfInfoFieldAdapter(const string& field_name,
-                                         int vcf_type)
-    : field_name_(field_name), vcf_type_(vcf_type) {}
+                                         int vcf_type, int tag_id)
+    : field_name_(field_name), vcf_type_(vcf_type), tag_id_(tag_id) {}
+
+int VcfInfoFieldAdapter::TagId(const bcf_hdr_t* header) const {
+  return tag_id_ != kUnresolvedTagId
+             ? tag_id_
+             : HeaderTagId(header, field_name_.c_str(), BCF_HL_INFO);
+}
 
 
 tensorflow::Status VcfInfoFieldAdapter::EncodeValues(
@@ -729,100 +732,156 @@ tensorflow::Status VcfInfoFieldAdapter::DecodeValues(
 template <class T> tensorflow::Status VcfInfoFieldAdapter::DecodeValues(
     const bcf_hdr_t *header, const bcf1_t *bcf_record,
     nucleus::genomics::v1::Variant *variant) const {
-  std::vector<T> value =
-      ReadInfoValue<T>(header, bcf_record, field_name_.c_str());
-  SetInfoField(field_name_, value, variant);
+  nucleus::genomics::v1::ListValue& list =
+      (*variant->mutable_info())[field_name_];
+  list.clear_values();
+  ReadInfoValue<T>(const_cast<bcf1_t*>(bcf_record), TagId(header), &list);
   return tensorflow::Status::OK();
 }
 
 
 
+const string& CallSetName(const nucleus::genomics::v1::VcfHeader& vcf_header,
+                          const nucleus::genomics::v1::VariantCall& call) {
+  if (call.call_set_case() ==
+          nucleus::genomics::v1::VariantCall::kCallSetIndex &&
+      call.call_set_index() >= 0 &&
+      call.call_set_index() < vcf_header.sample_names_size()) {
+    return vcf_header.sample_names(call.call_set_index());
+  }
+  return call.call_set_name();
+}
+
 // -----------------------------------------------------------------------------
 // VcfRecordConverter implementation.
 
 VcfRecordConverter::VcfRecordConverter(
-    const nucleus::genomics::v1::VcfHeader& vcf_header,
+    const nucleus::genomics::v1::VcfHeader& vcf_header, const bcf_hdr_t* h,
+    const std::vector<string>& infos_to_include,
     const std::vector<string>& infos_to_exclude,
+    const std::vector<string>& formats_to_include,
     const std::vector<string>& formats_to_exclude,
-    const bool gl_and_pl_in_info_map) {
+    const bool gl_and_pl_in_info_map, const bool omit_call_set_names)
+    : infos_to_include_(infos_to_include),
+      infos_to_exclude_(infos_to_exclude),
+      formats_to_include_(formats_to_include),
+      formats_to_exclude_(formats_to_exclude),
+      want_gl_(false),
+      want_pl_(false),
+      gl_and_pl_in_info_map_(gl_and_pl_in_info_map),
+      omit_call_set_names_(omit_call_set_names) {
   // Install adapters for INFO fields.
   for (const auto& format_spec : vcf_header.infos()) {
-    string tag = format_spec.id();
-    string type = format_spec.type();
-
-    // Skip fields that are handled specially.
-    if (tag == "END") continue;
-
-    // Check if configuration has disabled this INFO field.
-    if (std::find(infos_to_exclude.begin(), infos_to_exclude.end(), tag) !=
-        infos_to_exclude.end())
-      continue;
-
-    int vcf_type;
-    if (type == "Integer") {
-      vcf_type = BCF_HT_INT;
-    } else if (type == "Float") {
-      vcf_type = BCF_HT_REAL;
-    } else if (type == "String" || type == "Character") {
-      vcf_type = BCF_HT_STR;
-    } else if (type == "Flag") {
-      vcf_type = BCF_HT_FLAG;
-    } else {
-      LOG(WARNING) << "Unhandled INFO field type: field " << tag
-                   << " of type " << type;
-      continue;
-    }
-    info_adapters_.emplace_back(tag, vcf_type);
+    AddInfoAdapter(format_spec, h);
   }
 
   // Install adapters for FORMAT fields.
-  want_pl_ = false;
-  want_gl_ = false;
-  gl_and_pl_in_info_map_ = gl_and_pl_in_info_map;
   for (const auto& format_spec : vcf_header.formats()) {
-    string tag = format_spec.id();
-    string type = format_spec.type();
+    AddFormatAdapter(format_spec, h);
+  }
+
+  // Update special-cased variant fields.
+  want_variant_end_ =
+      IsFieldSelected("END", infos_to_include, infos_to_exclude);
+  want_genotypes_ =
+      IsFieldSelected("GT", formats_to_include, formats_to_exclude);
+  ResolveSpecialFields(vcf_header, h);
+}
 
-    // Check if configuration has disabled this FORMAT field.
-    if (std::find(formats_to_exclude.begin(), formats_to_exclude.end(), tag) !=
-        formats_to_exclude.end())
-      continue;
+void VcfRecordConverter::AddFields(
+    const nucleus::genomics::v1::VcfHeader& vcf_header, const bcf_hdr_t* h,
+    int first_info, int first_format) {
+  for (int i = first_info; i < vcf_header.infos_size(); ++i) {
+    AddInfoAdapter(vcf_header.infos(i), h);
+  }
+  for (int i = first_format; i < vcf_header.formats_size(); ++i) {
+    AddFormatAdapter(vcf_header.formats(i), h);
+  }
+  ResolveSpecialFields(vcf_header, h);
+}
 
-    // These fields are handled specially.
-    if (tag == "GT") continue;
+void VcfRecordConverter::AddInfoAdapter(
+    const nucleus::genomics::v1::VcfInfo& format_spec, const bcf_hdr_t* h) {
+  const string& tag = format_spec.id();
+  const string& type = format_spec.type();
+
+  // Skip fields that are handled specially.
+  if (tag == "END") return;
+
+  // Check if configuration has disabled this INFO field.
+  if (!IsFieldSelected(tag, infos_to_include_, infos_to_exclude_)) return;
+
+  int vcf_type;
+  if (type == "Integer") {
+    vcf_type = BCF_HT_INT;
+  } else if (type == "Float") {
+    vcf_type = BCF_HT_REAL;
+  } else if (type == "String" || type == "Character") {
+    vcf_type = BCF_HT_STR;
+  } else if (type == "Flag") {
+    vcf_type = BCF_HT_FLAG;
+  } else {
+    LOG(WARNING) << "Unhandled INFO field type: field " << tag
+                 << " of type " << type;
+    return;
+  }
+  info_adapters_.emplace_back(tag, vcf_type,
+                              HeaderTagId(h, tag.c_str(), BCF_HL_INFO));
+}
 
-    if (tag == "GL") {
-      want_gl_ = true;
-      if (!gl_and_pl_in_info_map) continue;
-    }
-    if (tag == "PL") {
-      want_pl_ = true;
-      if (!gl_and_pl_in_info_map) continue;
-    }
+void VcfRecordConverter::AddFormatAdapter(
+    const nucleus::genomics::v1::VcfFormatInfo& format_spec,
+    const bcf_hdr_t* h) {
+  const string& tag = format_spec.id();
+  const string& type = format_spec.type();
 
-    // TODO(dhalexander): how do we really want to encode the type here?
-    int vcf_type;
-    if (type == "Integer") {
-      vcf_type = BCF_HT_INT;
-    } else if (type == "Float") {
-      vcf_type = BCF_HT_REAL;
-    } else if (type == "String" || type == "Character") {
-      vcf_type = BCF_HT_STR;
-    } else {
-      LOG(WARNING) << "Unhandled FORMAT field type: field " << tag
-                   << " of type " << type;
-      continue;
-    }
-    format_adapters_.emplace_back(tag, vcf_type);
+  // Check if configuration has disabled this FORMAT field.
+  if (!IsFieldSelected(tag, formats_to_include_, formats_to_exclude_)) return;
+
+  // These fields are handled specially.
+  if (tag == "GT") return;
+
+  if (tag == "GL") {
+    want_gl_ = true;
+    if (!gl_and_pl_in_info_map_) return;
+  }
+  if (tag == "PL") {
+    want_pl_ = true;
+    if (!gl_and_pl_in_info_map_) return;
   }
 
-  // Update special-cased variant fields.
-  want_variant_end_ =
-      std::find(infos_to_exclude.begin(), infos_to_exclude.end(), "END") ==
-      infos_to_exclude.end();
-  want_genotypes_ =
-      std::find(formats_to_exclude.begin(), formats_to_exclude.end(), "GT") ==
-      formats_to_exclude.end();
+  // TODO(dhalexander): how do we really want to encode the type here?
+  int vcf_type;
+  if (type == "Integer") {
+    vcf_type = BCF_HT_INT;
+  } else if (type == "Float") {
+    vcf_type = BCF_HT_REAL;
+  } else if (type == "String" || type == "Character") {
+    vcf_type = BCF_HT_STR;
+  } else {
+    LOG(WARNING) << "Unhandled FORMAT field type: field " << tag
+                 << " of type " << type;
+    return;
+  }
+  format_adapters_.emplace_back(tag, vcf_type,
+                                HeaderTagId(h, tag.c_str(), BCF_HL_FMT));
+}
+
+void VcfRecordConverter::ResolveSpecialFields(
+    const nucleus::genomics::v1::VcfHeader& vcf_header, const bcf_hdr_t* h) {
+  gt_id_ = HeaderTagId(h, "GT", BCF_HL_FMT);
+  gl_id_ = HeaderTagId(h, "GL", BCF_HL_FMT);
+  pl_id_ = HeaderTagId(h, "PL", BCF_HL_FMT);
+
+  // Figure out how much of each record ConvertToPb has to unpack. Call names
+  // come from the header, so the per-sample block is only needed if some
+  // FORMAT field is actually decoded.
+  unpack_level_ = BCF_UN_STR | BCF_UN_FLT;
+  if (!info_adapters_.empty()) unpack_level_ |= BCF_UN_INFO;
+  if (vcf_header.sample_names_size() > 0 &&
+      (want_genotypes_ || want_gl_ || want_pl_ || !format_adapters_.empty())) {
+    unpack_level_ |= BCF_UN_FMT;
+  }
 }
 
 // static
@@ -837,20 +896,31 @@ void VcfHeaderConverter::ConvertToPb(const bcf_hdr_t* hdr,
     LOG(WARNING) << "Not a valid VCF, fileformat needed.";
   }
   vcf_header->set_fileformat(hdr->hrec[0]->value);
+  AppendToPb(hdr, 1, vcf_header);
 
+  // Populate samples info.
+  int n_samples = bcf_hdr_nsamples(hdr);
+  for (int i = 0; i < n_samples; i++) {
+    vcf_header->add_sample_names(hdr->samples[i]);
+  }
+}
+
+// static
+void VcfHeaderConverter::AppendToPb(const bcf_hdr_t* hdr, int n_hrecs,
+                                    genomics::v1::VcfHeader* vcf_header) {
   // Fill in the contig info for each contig in the VCF header. Directly
   // accesses the low-level C struct because there are no indirection
   // macros/functions by htslib API.
   // BCF_DT_CTG: offset for contig (CTG) information in BCF dictionary (DT).
   const int n_contigs = hdr->n[BCF_DT_CTG];
-  for (int i = 0; i < n_contigs; ++i) {
+  for (int i = vcf_header->contigs_size(); i < n_contigs; ++i) {
     const bcf_idpair_t& idPair = hdr->id[BCF_DT_CTG][i];
     AddContigInfo(idPair, vcf_header->add_contigs(), i);
   }
 
-  // Iterate through all hrecs (except the first, which was 'fileformat') to
+  // Iterate through the new hrecs (never the first, which was 'fileformat') to
   // populate the rest of the headers.
-  for (int i = 1; i < hdr->nhrec; i++) {
+  for (int i = std::max(n_hrecs, 1); i < hdr->nhrec; i++) {
     const bcf_hrec_t* hrec0 = hdr->hrec[i];
     switch (hrec0->type) {
       case BCF_HL_CTG:
@@ -876,12 +946,6 @@ void VcfHeaderConverter::ConvertToPb(const bcf_hdr_t* hdr,
         LOG(WARNING) << "Unknown hrec0->type: " << hrec0->type;
     }
   }
-
-  // Populate samples info.
-  int n_samples = bcf_hdr_nsamples(hdr);
-  for (int i = 0; i < n_samples; i++) {
-    vcf_header->add_sample_names(hdr->samples[i]);
-  }
 }
 
 tensorflow::Status VcfHeaderConverter::ConvertFromPb(
@@ -935,6 +999,12 @@ char *uppercase_allele(char *s) {
   return r;
 }
 
+int VcfRecordConverter::SpecialTagId(const bcf_hdr_t* h, int tag_id,
+                                     const char* tag) const {
+  return tag_id != kUnresolvedTagId ? tag_id
+                                    : HeaderTagId(h, tag, BCF_HL_FMT);
+}
+
 tensorflow::Status VcfRecordConverter::ConvertToPb(
     const bcf_hdr_t* h, bcf1_t* v,
     nucleus::genomics::v1::Variant* variant_message) const {
@@ -944,8 +1014,8 @@ tensorflow::Status VcfRecordConverter::ConvertToPb(
 
   variant_message->Clear();
 
-  // Tell htslib to parse out all of the fields of the VCF record v.
-  bcf_unpack(v, BCF_UN_ALL);
+  // Tell htslib to parse out the fields of the VCF record v that we decode.
+  bcf_unpack(v, unpack_level_);
 
   variant_message->set_reference_name(bcf_hdr_id2name(h, v->rid));
   variant_message->set_start(v->pos);
@@ -989,22 +1059,27 @@ tensorflow::Status VcfRecordConverter::ConvertToPb(
 
   // Parse the calls of the variant.
   if (v->n_sample > 0) {
-    int* gt_arr = nullptr;
-    int n_gts = 0;
-    if (bcf_get_genotypes(h, v, &gt_arr, &n_gts) < 0) {
-      free(gt_arr);
-      return tensorflow::errors::DataLoss("Couldn't parse genotypes");
+    const bcf_fmt_t* gt_fmt = nullptr;
+    if (want_genotypes_) {
+      gt_fmt = GetFormatField<int>(v, SpecialTagId(h, gt_id_, "GT"));
+      if (gt_fmt == nullptr) {
+        return tensorflow::errors::DataLoss("Couldn't parse genotypes");
+      }
     }
-    int max_ploidy = n_gts / v->n_sample;
 
     for (int i = 0; i < v->n_sample; i++) {
       nucleus::genomics::v1::VariantCall* call = variant_message->add_calls();
-      call->set_call_set_name(h->samples[i]);
+      if (omit_call_set_names_) {
+        call->set_call_set_index(i);
+      } else {
+        call->set_call_set_name(h->samples[i]);
+      }
       // Get the GT calls, if requested and available.
       if (want_genotypes_) {
         bool gt_is_phased = false;
-        for (int j = 0; j < max_ploidy; j++) {
-          int gt_idx = gt_arr[i * max_ploidy + j];
+        const uint8_t* gt_arr = gt_fmt->p + i * gt_fmt->size;
+        for (int j = 0; j < gt_fmt->n; j++) {
+          int gt_idx = VcfType<int>::ReadPacked(gt_arr, gt_fmt->type, j);
           // Check whether this sample has smaller ploidy.
           if (gt_idx == bcf_int32_vector_end) break;
 
@@ -1015,7 +1090,6 @@ tensorflow::Status VcfRecordConverter::ConvertToPb(
         call->set_is_phased(gt_is_phased);
       }
     }
-    free(gt_arr);
 
     // Parse "generic" FORMAT fields.
     for (const auto& adapter : format_adapters_) {
@@ -1023,35 +1097,45 @@ tensorflow::Status VcfRecordConverter::ConvertToPb(
     }
 
     // Handle FORMAT fields requiring special logic.
-    if (!gl_and_pl_in_info_map_) {
-      std::vector<std::vector<int>> pl_values =
-          ReadFormatValues<int>(h, v, "PL");
-      std::vector<std::vector<float>> gl_values =
-          ReadFormatValues<float>(h, v, "GL");
+    if (!gl_and_pl_in_info_map_ && (want_gl_ || want_pl_)) {
+      const bcf_fmt_t* pl_fmt =
+          GetFormatField<int>(v, SpecialTagId(h, pl_id_, "PL"));
+      const bcf_fmt_t* gl_fmt =
+          GetFormatField<float>(v, SpecialTagId(h, gl_id_, "GL"));
+      // The PLs of a sample, unpacked for the batch conversion.
+      std::vector<int> pls;
 
       for (int i = 0; i < v->n_sample; i++) {
-        // Each indicator here is true iff the format field is present for this
-        // variant, *and* is non-missing for this sample.
-        bool have_gl = !gl_values.empty() && !gl_values[i].empty();
-        bool have_pl = !pl_values.empty() && !pl_values[i].empty();
+        // Each count here is non-zero iff the format field is present for
+        // this variant, *and* is non-missing for this sample.
+        const int n_sample_gl = gl_fmt ? NumSampleValues<float>(gl_fmt, i) : 0;
+        const int n_sample_pl = pl_fmt ? NumSampleValues<int>(pl_fmt, i) : 0;
 
         nucleus::genomics::v1::VariantCall* call =
             variant_message->mutable_calls(i);
 
-        if (want_gl_ || want_pl_) {
-          // If GL and PL are *both* present, we populate the
-          // genotype_likelihood fields with the GL values per the
-          // variants.proto spec, since PLs are a lower resolution version of
-          // the same information.
-          if (have_gl) {
-            for (const auto& gl : gl_values[i]) {
-              call->add_genotype_likelihood(gl);
-            }
-          } else if (have_pl) {
-            for (int pl : pl_values[i]) {
-              call->add_genotype_likelihood(PhredToLog10PError(pl));
-            }
+        // If GL and PL are *both* present, we populate the
+        // genotype_likelihood fields with the GL values per the
+        // variants.proto spec, since PLs are a lower resolution version of
+        // the same information.
+        if (n_sample_gl > 0) {
+          const uint8_t* gl_values = gl_fmt->p + i * gl_fmt->size;
+          for (int j = 0; j < n_sample_gl; j++) {
+            call->add_genotype_likelihood(
+                VcfType<float>::ReadPacked(gl_values, gl_fmt->type, j));
+          }
+        } else if (n_sample_pl > 0) {
+          const uint8_t* pl_values = pl_fmt->p + i * pl_fmt->size;
+          pls.resize(n_sample_pl);
+          for (int j = 0; j < n_sample_pl; j++) {
+            pls[j] = VcfType<int>::ReadPacked(pl_values, pl_fmt->type, j);
           }
+          google::protobuf::RepeatedField<double>* lls =
+              call->mutable_genotype_likelihood();
+          const int offset = lls->size();
+          lls->Resize(offset + n_sample_pl, 0.0);
+          PhredsToLog10PErrors(pls.data(), n_sample_pl,
+                               lls->mutable_data() + offset);
         }
       }
     }
@@ -1155,13 +1239,23 @@ tensorflow::Status VcfRecordConverter::ConvertFromPb(
       if (vc.genotype_size() > ploidy)
         return tensorflow::errors::FailedPrecondition(
             "Too many genotypes given the ploidy");
-      if (vc.call_set_name() != h.samples[c])
+      // Calls read with omit_call_set_names are matched by index instead.
+      // Calls with neither a name nor an index match no sample.
+      if (vc.call_set_case() ==
+          nucleus::genomics::v1::VariantCall::kCallSetIndex) {
+        if (vc.call_set_index() != c)
+          return tensorflow::errors::FailedPrecondition(
+            "Out-of-order call set index with respect to samples declared "
+            "in VCF header. Variant has call set index ", vc.call_set_index(),
+            " at position ", c);
+      } else if (vc.call_set_name() != h.samples[c]) {
         return tensorflow::errors::FailedPrecondition(
           "Out-of-order call set names, or unrecognized call set name, "
           "with respect to samples declared in VCF header. Variant has ",
           vc.call_set_name(), " at position ", c,
           " while the VCF header expected a sample named ",
           h.samples[c], " at this position");
+      }
 
       const bool isPhased = vc.is_phased();
       int a = 0;
@@ -1212,29 +1306,14 @@ tensorflow::Status VcfRecordConverter::ConvertFromPb(
       }
 
       if (want_pl_ && has_ll) {
-        std::vector<std::vector<int>> ll_values_phred;
+        std::vector<std::vector<int>> ll_values_phred(nCalls);
         for (int c = 0; c < nCalls; c++) {
-          const nucleus::genomics::v1::VariantCall& vc =
-              variant_message.calls(c);
-          bool ll_not_missing = vc.genotype_likelihood_size() > 0;
-          if (ll_not_missing) {
-            std::vector<double> lls_this_call;
-            for (double ll_val : vc.genotype_likelihood()) {
-              lls_this_call.push_back(ll_val);
-            }
-            // "Normalize" likelihoods...
-            std::vector<double> lls_this_call_normalized =
-                ZeroShiftLikelihoods(lls_this_call);
-
-            // Phred-transform them...
-            std::vector<int> phreds_this_call(lls_this_call.size());
-            std::transform(lls_this_call_normalized.cbegin(),
-                           lls_this_call_normalized.cend(),
-                           phreds_this_call.begin(), Log10PErrorToPhred);
-            ll_values_phred.push_back(phreds_this_call);
-          } else {
-            ll_values_phred.push_back({});
-          }
+          const google::protobuf::RepeatedField<double>& lls =
+              variant_message.calls(c).genotype_likelihood();
+          // "Normalize" likelihoods and Phred-transform them, if not missing.
+          ll_values_phred[c].resize(lls.size());
+          ZeroShiftedLog10PErrorsToPhreds(lls.data(), lls.size(),
+                                          ll_values_phred[c].data());
         }
 
         TF_RETURN_IF_ERROR(EncodeFormatValues(ll_values_phred, "PL", &h, v));
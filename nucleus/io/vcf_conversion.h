@@ -75,6 +75,16 @@ struct VcfType {
   static tensorflow::Status PutInfoValues(const char *tag, const T *src,
                                           int nsrc, const bcf_hdr_t *hdr,
                                           bcf1_t *line);
+
+  // Packed value access: reading values in place from a bcf_info_t or
+  // bcf_fmt_t of an unpacked record.
+  // Can values of htslib's packed BCF_BT_* type be read as T?
+  static bool IsPackedType(int type);
+  // Read the j-th of the packed values of BCF_BT_* type at p, as
+  // bcf_get_info_values and bcf_get_format_values do: the missing and vector
+  // end sentinels of narrower types map to those of T. IsPackedType(type)
+  // must be true.
+  static T ReadPacked(const uint8_t *p, int type, int j);
 };
 
 // See interface description comment above.
@@ -113,6 +123,29 @@ struct VcfType<int> {
     else
       return tensorflow::Status::OK();
   }
+
+  static bool IsPackedType(int type) {
+    return type == BCF_BT_INT8 || type == BCF_BT_INT16 || type == BCF_BT_INT32;
+  }
+
+  static int ReadPacked(const uint8_t *p, int type, int j) {
+    switch (type) {
+      case BCF_BT_INT8: {
+        const int8_t v = reinterpret_cast<const int8_t *>(p)[j];
+        if (v == bcf_int8_missing) return bcf_int32_missing;
+        if (v == bcf_int8_vector_end) return bcf_int32_vector_end;
+        return v;
+      }
+      case BCF_BT_INT16: {
+        const int16_t v = reinterpret_cast<const int16_t *>(p)[j];
+        if (v == bcf_int16_missing) return bcf_int32_missing;
+        if (v == bcf_int16_vector_end) return bcf_int32_vector_end;
+        return v;
+      }
+      default:
+        return reinterpret_cast<const int32_t *>(p)[j];
+    }
+  }
 };
 
 // See interface description comment above.
@@ -151,15 +184,25 @@ struct VcfType<float> {
     else
       return tensorflow::Status::OK();
   }
+
+  static bool IsPackedType(int type) { return type == BCF_BT_FLOAT; }
+
+  static float ReadPacked(const uint8_t *p, int type, int j) {
+    return reinterpret_cast<const float *>(p)[j];
+  }
 };
 
 
+// Tag id of a field adapter that doesn't know the header id of its tag, and
+// looks it up in the bcf_hdr_t for every record instead.
+constexpr int kUnresolvedTagId = -2;
+
 // -----------------------------------------------------------------------------
 // Helper class for encoding VariantCall.info values in VCF FORMAT field values.
 // This class is only intended for use with FORMAT fields that can be directly
 // mapped between a VCF record and the FORMAT info dictionary, without special
 // logic.  Where special logic is needed (e.g. for GT, GL/PL, etc.), the lower
-// level functions `ReadFormatValues` and `EncodeFormatValues` are called
+// level functions `GetFormatField` and `EncodeFormatValues` are called
 // directly.
 //
 // The standard way to interact with this class is as follows.
@@ -172,8 +215,11 @@ struct VcfType<float> {
 //
 class VcfFormatFieldAdapter {
  public:
-  // Creates a new adapter for a field name field_name.
-  VcfFormatFieldAdapter(const string& field_name, int vcf_type);
+  // Creates a new adapter for a field name field_name. If known, tag_id is
+  // the header id of field_name in the bcf_hdr_t of the records to decode.
+  // Otherwise the id is looked up in that header for every record.
+  VcfFormatFieldAdapter(const string& field_name, int vcf_type,
+                        int tag_id = kUnresolvedTagId);
 
   // Adds the values for our field_name from variant's calls into our bcf1_t
   // record bcf_record.
@@ -182,7 +228,8 @@ class VcfFormatFieldAdapter {
                                   bcf1_t* bcf_record) const;
 
   // Add the values for this genotype field in the bcf1_t `bcf_record` to the
-  // VariantCall info maps within this Variant proto message `variant`.
+  // VariantCall info maps within this Variant proto message `variant`. The
+  // values are read in place by the header id of the tag.
   tensorflow::Status DecodeValues(
       const bcf_hdr_t *header, const bcf1_t *bcf_record,
       nucleus::genomics::v1::Variant *variant) const;
@@ -198,12 +245,16 @@ class VcfFormatFieldAdapter {
       const bcf_hdr_t *header, const bcf1_t *bcf_record,
       nucleus::genomics::v1::Variant *variant) const;
 
+  // Returns the header id of our field in `header`.
+  int TagId(const bcf_hdr_t *header) const;
 
  private:  // Fields
   // The name of our field, such as "DP", "AD", or "VAF".
   string field_name_;
   // The htslib/VCF "type" of this field, such as BCF_HT_INT.
   int vcf_type_;
+  // The header id of this field, or kUnresolvedTagId.
+  int tag_id_;
 };
 
 
@@ -214,8 +265,11 @@ class VcfFormatFieldAdapter {
 // class.)
 class VcfInfoFieldAdapter {
  public:
-  // Creates a new adapter for a field name field_name.
-  VcfInfoFieldAdapter(const string& field_name, int vcf_type);
+  // Creates a new adapter for a field name field_name. If known, tag_id is
+  // the header id of field_name in the bcf_hdr_t of the records to decode.
+  // Otherwise the id is looked up in that header for every record.
+  VcfInfoFieldAdapter(const string& field_name, int vcf_type,
+                      int tag_id = kUnresolvedTagId);
 
   // Adds the values for our field_name from the Variant into our bcf1_t
   // record bcf_record.
@@ -224,7 +278,8 @@ class VcfInfoFieldAdapter {
                                   bcf1_t* bcf_record) const;
 
   // Add the values for this INFO field in the bcf1_t `bcf_record` to the
-  // Variant message info map.
+  // Variant message info map. The values are read in place by the header id
+  // of the tag.
   tensorflow::Status DecodeValues(
       const bcf_hdr_t *header, const bcf1_t *bcf_record,
       nucleus::genomics::v1::Variant *variant) const;
@@ -240,12 +295,16 @@ class VcfInfoFieldAdapter {
       const bcf_hdr_t *header, const bcf1_t *bcf_record,
       nucleus::genomics::v1::Variant *variant) const;
 
+  // Returns the header id of our field in `header`.
+  int TagId(const bcf_hdr_t *header) const;
 
  private:  // Fields
   // The name of our info field, such as "H2" or "END"
   string field_name_;
   // The htslib/VCF "type" of this field, such as BCF_HT_INT.
   int vcf_type_;
+  // The header id of this field, or kUnresolvedTagId.
+  int tag_id_;
 };
 
 // Helper class for converting between VcfHeader proto messages and bcf_hdr_t
@@ -255,26 +314,71 @@ class VcfHeaderConverter {
   static void ConvertToPb(const bcf_hdr_t *h,
                           nucleus::genomics::v1::VcfHeader *vcf_header);
 
+  // Appends to |vcf_header|, converted from |h| when |h| had |n_hrecs| header
+  // records, the contigs and header records |h| has gained since. htslib only
+  // ever appends to a header, as vcf_parse does when a record refers to a
+  // contig or field the header doesn't define.
+  static void AppendToPb(const bcf_hdr_t *h, int n_hrecs,
+                         nucleus::genomics::v1::VcfHeader *vcf_header);
+
   // Converts a proto VcfHeader to a bcf_hdr_t. Caller needs to take ownership
   // of |h|.
   static tensorflow::Status ConvertFromPb(const nucleus::genomics::v1::VcfHeader &vcf_header,
                             bcf_hdr_t **h);
 };
 
+// Returns the call set (sample) name of |call|. Calls read with
+// VcfReaderOptions.omit_call_set_names have their name resolved from the
+// sample_names of |vcf_header|, the header they were read with. A call with
+// neither a name nor an index has an empty name.
+const string& CallSetName(const nucleus::genomics::v1::VcfHeader &vcf_header,
+                          const nucleus::genomics::v1::VariantCall &call);
+
 // Helper class for converting between Variant proto messages and VCF records.
 class VcfRecordConverter {
  public:
-  // Primary constructor.
+  // Primary constructor. An INFO or FORMAT field is decoded if it is not in
+  // the corresponding exclude list and, when the include list is non-empty,
+  // if it is in the include list. Adapters are only installed for decoded
+  // fields, so fields that are projected away are never unpacked.
+  //
+  // If h is not null, it must be the bcf_hdr_t matching vcf_header that the
+  // records passed to ConvertToPb are decoded with. The header ids of all
+  // decoded tags are then resolved once here, rather than looked up by name
+  // for every field of every record.
+  VcfRecordConverter(const nucleus::genomics::v1::VcfHeader &vcf_header,
+                     const bcf_hdr_t *h,
+                     const std::vector<string> &infos_to_include,
+                     const std::vector<string> &infos_to_exclude,
+                     const std::vector<string> &formats_to_include,
+                     const std::vector<string> &formats_to_exclude,
+                     const bool gl_and_pl_in_info_map,
+                     const bool omit_call_set_names = false);
+
+  // Constructor decoding every field that is not excluded.
   VcfRecordConverter(const nucleus::genomics::v1::VcfHeader &vcf_header,
                      const std::vector<string> &infos_to_exclude,
                      const std::vector<string> &formats_to_exclude,
-                     const bool gl_and_pl_in_info_map);
+                     const bool gl_and_pl_in_info_map,
+                     const bool omit_call_set_names = false)
+      : VcfRecordConverter(vcf_header, nullptr, {}, infos_to_exclude, {},
+                           formats_to_exclude, gl_and_pl_in_info_map,
+                           omit_call_set_names) {}
 
   // Not the constructor you want.
   VcfRecordConverter() = default;
 
+  // Installs adapters for the INFO fields from infos(first_info) on and the
+  // FORMAT fields from formats(first_format) on of |vcf_header|, which were
+  // appended to the header the converter was constructed with, as by
+  // VcfHeaderConverter::AppendToPb. The same field selection applies, and h
+  // is as for the primary constructor. Adapters of existing fields are kept.
+  void AddFields(const nucleus::genomics::v1::VcfHeader &vcf_header,
+                 const bcf_hdr_t *h, int first_info, int first_format);
+
   // Convert a VCF line parsed by htslib into a Variant protocol buffer.
-  // The parsed line is passed in v, and the parsed header is in h.
+  // The parsed line is passed in v, and the parsed header is in h. Only the
+  // parts of v needed for the fields this converter decodes are unpacked.
   tensorflow::Status ConvertToPb(
       const bcf_hdr_t *h, bcf1_t *v,
       nucleus::genomics::v1::Variant *variant_message) const;
@@ -286,6 +390,22 @@ class VcfRecordConverter {
       bcf1_t *v) const;
 
  private:
+  // Install the adapter for INFO field |info| or FORMAT field |format|, if it
+  // is selected and not special-cased.
+  void AddInfoAdapter(const nucleus::genomics::v1::VcfInfo &info,
+                      const bcf_hdr_t *h);
+  void AddFormatAdapter(const nucleus::genomics::v1::VcfFormatInfo &format,
+                        const bcf_hdr_t *h);
+
+  // Resolves the ids of the special-cased FORMAT fields and the unpack level,
+  // once the adapters for all fields of |vcf_header| are installed.
+  void ResolveSpecialFields(const nucleus::genomics::v1::VcfHeader &vcf_header,
+                            const bcf_hdr_t *h);
+
+  // Returns tag_id, one of the ids below, or if it is kUnresolvedTagId the id
+  // of tag in h.
+  int SpecialTagId(const bcf_hdr_t *h, int tag_id, const char *tag) const;
+
   // Lookup table for variant INFO fields adapters by VCF tag name.
   // The order of adapter definitions here determines the order of the fields
   // in a written VCF.
@@ -295,17 +415,36 @@ class VcfRecordConverter {
   // in a written VCF.
   std::vector<VcfFormatFieldAdapter> format_adapters_;
 
+  // The INFO and FORMAT field selection, kept for AddFields.
+  std::vector<string> infos_to_include_;
+  std::vector<string> infos_to_exclude_;
+  std::vector<string> formats_to_include_;
+  std::vector<string> formats_to_exclude_;
+
   // Individual special-cased INFO fields.
   bool want_variant_end_;
   // Individual special-cased FORMAT fields.
   bool want_genotypes_;
   bool want_gl_;
   bool want_pl_;
+  // Header ids of the special-cased FORMAT fields, or kUnresolvedTagId.
+  int gt_id_ = kUnresolvedTagId;
+  int gl_id_ = kUnresolvedTagId;
+  int pl_id_ = kUnresolvedTagId;
 
   // Set to true if the GL and PL fields should be stored to and retrieved from
   // the info map with other FORMAT fields, rather than being special-cased as
   // first-class members of the proto.
   bool gl_and_pl_in_info_map_;
+
+  // Set to true if decoded calls should carry a call_set_index into the
+  // header's samples rather than a copy of the sample name.
+  bool omit_call_set_names_ = false;
+
+  // The bcf_unpack level ConvertToPb needs: BCF_UN_STR and BCF_UN_FLT always,
+  // BCF_UN_INFO only if an INFO field is decoded and BCF_UN_FMT only if a
+  // per-sample field is decoded.
+  int unpack_level_ = BCF_UN_ALL;
 };
 
 }  // namespace nucleus
@@ -0,0 +1,610 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_filter.h"
+
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+class VcfFilterExpression::Node {
+ public:
+  virtual ~Node() = default;
+  virtual bool Evaluate(const VcfVariantView& view) const = 0;
+};
+
+namespace {
+
+using Node = VcfFilterExpression::Node;
+
+enum class Op { kEq, kNe, kLt, kLe, kGt, kGe };
+
+// The operator that gives the same result with its operands swapped.
+Op Flip(Op op) {
+  switch (op) {
+    case Op::kLt: return Op::kGt;
+    case Op::kLe: return Op::kGe;
+    case Op::kGt: return Op::kLt;
+    case Op::kGe: return Op::kLe;
+    default: return op;
+  }
+}
+
+bool Compare(double value, Op op, double constant) {
+  switch (op) {
+    case Op::kEq: return value == constant;
+    case Op::kNe: return value != constant;
+    case Op::kLt: return value < constant;
+    case Op::kLe: return value <= constant;
+    case Op::kGt: return value > constant;
+    case Op::kGe: return value >= constant;
+  }
+  return false;
+}
+
+// Does any non-missing value of |values| satisfy the comparison?
+template <class T>
+bool AnyCompares(const VcfValues<T>& values, Op op, double constant) {
+  for (int j = 0; j < values.size(); ++j) {
+    if (!values.IsMissing(j) && Compare(values[j], op, constant)) return true;
+  }
+  return false;
+}
+
+// Does the string |value|, which is missing if empty or '.', satisfy the
+// comparison? Only kEq and kNe apply to strings.
+bool CompareString(absl::string_view value, Op op, const string& constant) {
+  if (value.empty() || value == ".") return false;
+  return (value == constant) == (op == Op::kEq);
+}
+
+class NotNode : public Node {
+ public:
+  explicit NotNode(std::unique_ptr<Node> child) : child_(std::move(child)) {}
+  bool Evaluate(const VcfVariantView& view) const override {
+    return !child_->Evaluate(view);
+  }
+
+ private:
+  const std::unique_ptr<Node> child_;
+};
+
+// The conjunction and disjunction of a chain of operands. A chain of any
+// length is a single node, so evaluating and destroying it doesn't recurse
+// through the chain.
+class AndNode : public Node {
+ public:
+  explicit AndNode(std::vector<std::unique_ptr<Node>> children)
+      : children_(std::move(children)) {}
+  bool Evaluate(const VcfVariantView& view) const override {
+    for (const std::unique_ptr<Node>& child : children_) {
+      if (!child->Evaluate(view)) return false;
+    }
+    return true;
+  }
+
+ private:
+  const std::vector<std::unique_ptr<Node>> children_;
+};
+
+class OrNode : public Node {
+ public:
+  explicit OrNode(std::vector<std::unique_ptr<Node>> children)
+      : children_(std::move(children)) {}
+  bool Evaluate(const VcfVariantView& view) const override {
+    for (const std::unique_ptr<Node>& child : children_) {
+      if (child->Evaluate(view)) return true;
+    }
+    return false;
+  }
+
+ private:
+  const std::vector<std::unique_ptr<Node>> children_;
+};
+
+// Is an INFO field present?
+class InfoPresentNode : public Node {
+ public:
+  explicit InfoPresentNode(int tag_id) : tag_id_(tag_id) {}
+  bool Evaluate(const VcfVariantView& view) const override {
+    return view.HasInfo(tag_id_);
+  }
+
+ private:
+  const int tag_id_;
+};
+
+enum class NumericField { kQual, kPos, kNumAlts, kInfo, kFormat };
+
+class NumericNode : public Node {
+ public:
+  // |tag_id| and |is_float| only apply to kInfo and kFormat.
+  NumericNode(NumericField field, int tag_id, bool is_float, Op op,
+              double constant)
+      : field_(field),
+        tag_id_(tag_id),
+        is_float_(is_float),
+        op_(op),
+        constant_(constant) {}
+
+  bool Evaluate(const VcfVariantView& view) const override {
+    switch (field_) {
+      case NumericField::kQual:
+        return view.has_quality() && Compare(view.quality(), op_, constant_);
+      case NumericField::kPos:
+        return Compare(view.start() + 1, op_, constant_);
+      case NumericField::kNumAlts:
+        return Compare(view.num_alleles() - 1, op_, constant_);
+      case NumericField::kInfo:
+        return is_float_
+                   ? AnyCompares(view.Info<float>(tag_id_), op_, constant_)
+                   : AnyCompares(view.Info<int>(tag_id_), op_, constant_);
+      case NumericField::kFormat:
+        for (int i = 0; i < view.num_samples(); ++i) {
+          if (is_float_
+                  ? AnyCompares(view.Format<float>(tag_id_, i), op_, constant_)
+                  : AnyCompares(view.Format<int>(tag_id_, i), op_,
+                                constant_)) {
+            return true;
+          }
+        }
+        return false;
+    }
+    return false;
+  }
+
+ private:
+  const NumericField field_;
+  const int tag_id_;
+  const bool is_float_;
+  const Op op_;
+  const double constant_;
+};
+
+enum class StringField { kChrom, kFilter, kInfo, kFormat };
+
+class StringNode : public Node {
+ public:
+  // |tag_id| only applies to kInfo and kFormat.
+  StringNode(StringField field, int tag_id, Op op, const string& constant)
+      : field_(field), tag_id_(tag_id), op_(op), constant_(constant) {}
+
+  bool Evaluate(const VcfVariantView& view) const override {
+    switch (field_) {
+      case StringField::kChrom:
+        return CompareString(view.contig_name(), op_, constant_);
+      case StringField::kFilter: {
+        bool has_filter = false;
+        if (constant_ == ".") {
+          has_filter = view.num_filters() == 0;
+        } else {
+          for (int i = 0; i < view.num_filters() && !has_filter; ++i) {
+            has_filter = constant_ == view.filter_name(i);
+          }
+        }
+        return has_filter == (op_ == Op::kEq);
+      }
+      case StringField::kInfo:
+        return CompareString(view.InfoString(tag_id_), op_, constant_);
+      case StringField::kFormat:
+        for (int i = 0; i < view.num_samples(); ++i) {
+          if (CompareString(view.FormatString(tag_id_, i), op_, constant_)) {
+            return true;
+          }
+        }
+        return false;
+    }
+    return false;
+  }
+
+ private:
+  const StringField field_;
+  const int tag_id_;
+  const Op op_;
+  const string constant_;
+};
+
+enum class GenotypeClass { kRef, kAlt, kHet, kHom, kMissing };
+
+class GenotypeNode : public Node {
+ public:
+  GenotypeNode(int gt_id, Op op, GenotypeClass genotype_class)
+      : gt_id_(gt_id), op_(op), genotype_class_(genotype_class) {}
+
+  bool Evaluate(const VcfVariantView& view) const override {
+    for (int i = 0; i < view.num_samples(); ++i) {
+      const VcfValues<int> gt = view.Format<int>(gt_id_, i);
+      if (gt.empty()) continue;
+      const GenotypeSummary genotype = SummarizeGenotype(gt);
+      if (genotype.missing && genotype_class_ != GenotypeClass::kMissing) {
+        continue;
+      }
+      bool matches = false;
+      switch (genotype_class_) {
+        case GenotypeClass::kMissing: matches = genotype.missing; break;
+        case GenotypeClass::kRef: matches = !genotype.any_alt; break;
+        case GenotypeClass::kAlt: matches = genotype.any_alt; break;
+        case GenotypeClass::kHet: matches = !genotype.all_same; break;
+        case GenotypeClass::kHom: matches = genotype.all_same; break;
+      }
+      if (matches == (op_ == Op::kEq)) return true;
+    }
+    return false;
+  }
+
+ private:
+  const int gt_id_;
+  const Op op_;
+  const GenotypeClass genotype_class_;
+};
+
+enum class TokenType { kWord, kString, kOperator, kEnd };
+
+struct Token {
+  TokenType type;
+  string text;
+};
+
+constexpr char kOperatorChars[] = "()!=<>&|";
+
+// Splits |expression| into tokens, ending with a kEnd token. Returns false,
+// setting |error|, if |expression| has an unterminated string or a stray
+// operator character.
+bool Tokenize(const string& expression, std::vector<Token>* tokens,
+              string* error) {
+  size_t i = 0;
+  while (i < expression.size()) {
+    const char c = expression[i];
+    if (c == ' ' || c == '\t' || c == '\n') {
+      ++i;
+    } else if (c == '"' || c == '\'') {
+      const size_t end = expression.find(c, i + 1);
+      if (end == string::npos) {
+        *error = "unterminated string";
+        return false;
+      }
+      tokens->push_back({TokenType::kString,
+                         expression.substr(i + 1, end - i - 1)});
+      i = end + 1;
+    } else if (strchr(kOperatorChars, c) != nullptr) {
+      const string two = expression.substr(i, 2);
+      if (two == "&&" || two == "||" || two == "==" || two == "!=" ||
+          two == "<=" || two == ">=") {
+        tokens->push_back({TokenType::kOperator, two});
+        i += 2;
+      } else if (c == '&' || c == '|') {
+        *error = absl::StrCat("unexpected '", string(1, c), "'; use '",
+                              string(2, c), "'");
+        return false;
+      } else {
+        tokens->push_back({TokenType::kOperator, string(1, c)});
+        ++i;
+      }
+    } else {
+      size_t end = i;
+      while (end < expression.size() && expression[end] != ' ' &&
+             expression[end] != '\t' && expression[end] != '\n' &&
+             expression[end] != '"' && expression[end] != '\'' &&
+             strchr(kOperatorChars, expression[end]) == nullptr) {
+        ++end;
+      }
+      tokens->push_back({TokenType::kWord, expression.substr(i, end - i)});
+      i = end;
+    }
+  }
+  tokens->push_back({TokenType::kEnd, ""});
+  return true;
+}
+
+bool ParseOp(const Token& token, Op* op) {
+  if (token.type != TokenType::kOperator) return false;
+  if (token.text == "==" || token.text == "=") {
+    *op = Op::kEq;
+  } else if (token.text == "!=") {
+    *op = Op::kNe;
+  } else if (token.text == "<") {
+    *op = Op::kLt;
+  } else if (token.text == "<=") {
+    *op = Op::kLe;
+  } else if (token.text == ">") {
+    *op = Op::kGt;
+  } else if (token.text == ">=") {
+    *op = Op::kGe;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool IsField(const Token& token) {
+  if (token.type != TokenType::kWord) return false;
+  const string& t = token.text;
+  return t == "QUAL" || t == "POS" || t == "N_ALT" || t == "CHROM" ||
+         t == "FILTER" || t == "GT" || absl::StartsWith(t, "INFO/") ||
+         absl::StartsWith(t, "FMT/") || absl::StartsWith(t, "FORMAT/");
+}
+
+// The header id of the INFO (BCF_HL_INFO) or FORMAT (BCF_HL_FMT) field |tag|,
+// or -1 if |header| doesn't define it.
+int TagId(const bcf_hdr_t* header, int line_type, const string& tag) {
+  const int id = bcf_hdr_id2int(header, BCF_DT_ID, tag.c_str());
+  return bcf_hdr_idinfo_exists(header, line_type, id) ? id : -1;
+}
+
+// The deepest nesting of '!' and '(' the parser accepts, which bounds its
+// recursion depth.
+constexpr int kMaxNestingDepth = 256;
+
+// A recursive descent parser of filter expressions, building the compiled
+// Node tree as it goes.
+class Parser {
+ public:
+  Parser(const string& expression, const bcf_hdr_t* header)
+      : expression_(expression), header_(header) {}
+
+  StatusOr<std::unique_ptr<Node>> Parse() {
+    string error;
+    if (!Tokenize(expression_, &tokens_, &error)) return Error(error);
+    if (Peek().type == TokenType::kEnd) return Error("the expression is empty");
+    StatusOr<std::unique_ptr<Node>> root = ParseOr();
+    TF_RETURN_IF_ERROR(root.status());
+    if (Peek().type != TokenType::kEnd) {
+      return Error(absl::StrCat("unexpected '", Peek().text, "'"));
+    }
+    return root;
+  }
+
+ private:
+  const Token& Peek() const { return tokens_[pos_]; }
+
+  const Token& Next() {
+    const Token& token = tokens_[pos_];
+    if (token.type != TokenType::kEnd) ++pos_;
+    return token;
+  }
+
+  bool NextIsOperator(const char* text) const {
+    return Peek().type == TokenType::kOperator && Peek().text == text;
+  }
+
+  tf::Status Error(const string& message) const {
+    return tf::errors::InvalidArgument("Invalid filter expression '",
+                                       expression_, "': ", message);
+  }
+
+  StatusOr<std::unique_ptr<Node>> ParseOr() {
+    std::vector<std::unique_ptr<Node>> children;
+    do {
+      if (!children.empty()) Next();
+      StatusOr<std::unique_ptr<Node>> child = ParseAnd();
+      TF_RETURN_IF_ERROR(child.status());
+      children.push_back(child.ConsumeValueOrDie());
+    } while (NextIsOperator("||"));
+    if (children.size() == 1) return std::move(children[0]);
+    return std::unique_ptr<Node>(
+        absl::make_unique<OrNode>(std::move(children)));
+  }
+
+  StatusOr<std::unique_ptr<Node>> ParseAnd() {
+    std::vector<std::unique_ptr<Node>> children;
+    do {
+      if (!children.empty()) Next();
+      StatusOr<std::unique_ptr<Node>> child = ParseUnary();
+      TF_RETURN_IF_ERROR(child.status());
+      children.push_back(child.ConsumeValueOrDie());
+    } while (NextIsOperator("&&"));
+    if (children.size() == 1) return std::move(children[0]);
+    return std::unique_ptr<Node>(
+        absl::make_unique<AndNode>(std::move(children)));
+  }
+
+  StatusOr<std::unique_ptr<Node>> ParseUnary() {
+    if (!NextIsOperator("!") && !NextIsOperator("(")) return ParseComparison();
+    if (depth_ == kMaxNestingDepth) {
+      return Error(absl::StrCat("'!' and '(' are nested more than ",
+                                kMaxNestingDepth, " deep"));
+    }
+    ++depth_;
+    if (Next().text == "!") {
+      StatusOr<std::unique_ptr<Node>> child = ParseUnary();
+      TF_RETURN_IF_ERROR(child.status());
+      --depth_;
+      return std::unique_ptr<Node>(
+          absl::make_unique<NotNode>(child.ConsumeValueOrDie()));
+    }
+    StatusOr<std::unique_ptr<Node>> node = ParseOr();
+    TF_RETURN_IF_ERROR(node.status());
+    if (!NextIsOperator(")")) return Error("missing ')'");
+    Next();
+    --depth_;
+    return node;
+  }
+
+  StatusOr<std::unique_ptr<Node>> ParseComparison() {
+    const Token left = Next();
+    if (left.type != TokenType::kWord && left.type != TokenType::kString) {
+      return Error(left.type == TokenType::kEnd
+                       ? "unexpected end of the expression"
+                       : absl::StrCat("unexpected '", left.text, "'"));
+    }
+    Op op;
+    if (!ParseOp(Peek(), &op)) {
+      if (left.type == TokenType::kWord &&
+          absl::StartsWith(left.text, "INFO/")) {
+        const string tag = left.text.substr(5);
+        const int tag_id = TagId(header_, BCF_HL_INFO, tag);
+        if (tag_id < 0) return Error(absl::StrCat("unknown INFO field ", tag));
+        return std::unique_ptr<Node>(
+            absl::make_unique<InfoPresentNode>(tag_id));
+      }
+      return Error(absl::StrCat("expected a comparison after '", left.text,
+                                "'"));
+    }
+    Next();
+    const Token right = Next();
+    if (right.type != TokenType::kWord && right.type != TokenType::kString) {
+      return Error(absl::StrCat("expected a constant after '", left.text,
+                                "'"));
+    }
+    if (IsField(left) == IsField(right)) {
+      return Error(absl::StrCat("'", left.text, "' and '", right.text,
+                                "' must be a field and a constant"));
+    }
+    if (IsField(left)) return MakeComparison(left.text, op, right);
+    return MakeComparison(right.text, Flip(op), left);
+  }
+
+  StatusOr<std::unique_ptr<Node>> MakeComparison(const string& field, Op op,
+                                                 const Token& constant) {
+    if (field == "QUAL") {
+      return MakeNumeric(field, NumericField::kQual, -1, false, op, constant);
+    } else if (field == "POS") {
+      return MakeNumeric(field, NumericField::kPos, -1, false, op, constant);
+    } else if (field == "N_ALT") {
+      return MakeNumeric(field, NumericField::kNumAlts, -1, false, op,
+                         constant);
+    } else if (field == "CHROM") {
+      return MakeString(field, StringField::kChrom, -1, op, constant);
+    } else if (field == "FILTER") {
+      return MakeString(field, StringField::kFilter, -1, op, constant);
+    } else if (field == "GT") {
+      return MakeGenotype(op, constant);
+    } else if (absl::StartsWith(field, "INFO/")) {
+      const string tag = field.substr(5);
+      const int tag_id = TagId(header_, BCF_HL_INFO, tag);
+      if (tag_id < 0) return Error(absl::StrCat("unknown INFO field ", tag));
+      switch (bcf_hdr_id2type(header_, BCF_HL_INFO, tag_id)) {
+        case BCF_HT_INT:
+        case BCF_HT_REAL:
+          return MakeNumeric(
+              field, NumericField::kInfo, tag_id,
+              bcf_hdr_id2type(header_, BCF_HL_INFO, tag_id) == BCF_HT_REAL,
+              op, constant);
+        case BCF_HT_STR:
+          return MakeString(field, StringField::kInfo, tag_id, op, constant);
+        default:
+          return Error(absl::StrCat("the Flag INFO field ", tag,
+                                    " can only be used on its own"));
+      }
+    }
+    // FMT/<tag> or FORMAT/<tag>.
+    const string tag = field.substr(field.find('/') + 1);
+    if (tag == "GT") return MakeGenotype(op, constant);
+    const int tag_id = TagId(header_, BCF_HL_FMT, tag);
+    if (tag_id < 0) return Error(absl::StrCat("unknown FORMAT field ", tag));
+    switch (bcf_hdr_id2type(header_, BCF_HL_FMT, tag_id)) {
+      case BCF_HT_INT:
+      case BCF_HT_REAL:
+        return MakeNumeric(
+            field, NumericField::kFormat, tag_id,
+            bcf_hdr_id2type(header_, BCF_HL_FMT, tag_id) == BCF_HT_REAL, op,
+            constant);
+      default:
+        return MakeString(field, StringField::kFormat, tag_id, op, constant);
+    }
+  }
+
+  StatusOr<std::unique_ptr<Node>> MakeNumeric(const string& field,
+                                              NumericField numeric_field,
+                                              int tag_id, bool is_float, Op op,
+                                              const Token& constant) {
+    double value;
+    if (constant.type != TokenType::kWord ||
+        !absl::SimpleAtod(constant.text, &value)) {
+      return Error(absl::StrCat(field, " can only be compared with a number, "
+                                "not '", constant.text, "'"));
+    }
+    return std::unique_ptr<Node>(absl::make_unique<NumericNode>(
+        numeric_field, tag_id, is_float, op, value));
+  }
+
+  StatusOr<std::unique_ptr<Node>> MakeString(const string& field,
+                                             StringField string_field,
+                                             int tag_id, Op op,
+                                             const Token& constant) {
+    if (op != Op::kEq && op != Op::kNe) {
+      return Error(absl::StrCat(field, " can only be compared with == and !="));
+    }
+    return std::unique_ptr<Node>(absl::make_unique<StringNode>(
+        string_field, tag_id, op, constant.text));
+  }
+
+  StatusOr<std::unique_ptr<Node>> MakeGenotype(Op op, const Token& constant) {
+    if (op != Op::kEq && op != Op::kNe) {
+      return Error("GT can only be compared with == and !=");
+    }
+    GenotypeClass genotype_class;
+    if (constant.text == "ref") {
+      genotype_class = GenotypeClass::kRef;
+    } else if (constant.text == "alt") {
+      genotype_class = GenotypeClass::kAlt;
+    } else if (constant.text == "het") {
+      genotype_class = GenotypeClass::kHet;
+    } else if (constant.text == "hom") {
+      genotype_class = GenotypeClass::kHom;
+    } else if (constant.text == "mis") {
+      genotype_class = GenotypeClass::kMissing;
+    } else {
+      return Error(absl::StrCat("GT can only be compared with ref, alt, het, "
+                                "hom or mis, not '", constant.text, "'"));
+    }
+    const int gt_id = TagId(header_, BCF_HL_FMT, "GT");
+    if (gt_id < 0) return Error("the header doesn't define GT");
+    return std::unique_ptr<Node>(
+        absl::make_unique<GenotypeNode>(gt_id, op, genotype_class));
+  }
+
+  const string& expression_;
+  const bcf_hdr_t* header_;
+  std::vector<Token> tokens_;
+  size_t pos_ = 0;
+  // The number of '!' and '(' being parsed.
+  int depth_ = 0;
+};
+
+}  // namespace
+
+StatusOr<std::unique_ptr<VcfFilterExpression>> VcfFilterExpression::Compile(
+    const string& expression, const bcf_hdr_t* header) {
+  StatusOr<std::unique_ptr<Node>> root = Parser(expression, header).Parse();
+  TF_RETURN_IF_ERROR(root.status());
+  return absl::WrapUnique(
+      new VcfFilterExpression(expression, root.ConsumeValueOrDie()));
+}
+
+VcfFilterExpression::VcfFilterExpression(const string& expression,
+                                         std::unique_ptr<Node> root)
+    : expression_(expression), root_(std::move(root)) {}
+
+VcfFilterExpression::~VcfFilterExpression() {}
+
+bool VcfFilterExpression::Matches(const VcfVariantView& view) const {
+  return root_->Evaluate(view);
+}
+
+}  // namespace nucleus
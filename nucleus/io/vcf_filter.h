@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+// A small expression language for selecting VCF records, evaluated directly on
+// the htslib records so that the records it rejects are never converted to
+// Variant protos. For example:
+//
+//   QUAL > 30 && INFO/DP >= 10 && FILTER == PASS && GT != ref
+//
+// The grammar is:
+//
+//   expression := and ('||' and)*
+//   and        := unary ('&&' unary)*
+//   unary      := '!' unary | '(' expression ')' | comparison | INFO/<tag>
+//   comparison := field op constant | constant op field
+//   op         := '==' | '=' | '!=' | '<' | '<=' | '>' | '>='
+//
+// The fields are:
+//
+//   QUAL         The QUAL of the record.
+//   POS          The 1-based position of the record, as in the VCF.
+//   N_ALT        The number of alternate alleles.
+//   CHROM        The contig of the record. Only compared with == and !=.
+//   FILTER       The FILTER values of the record. FILTER == X holds if X is one
+//                of them, where "." stands for a missing FILTER, and
+//                FILTER != X if it isn't.
+//   INFO/<tag>   An Integer, Float or String INFO field. On its own, an INFO
+//                field of any type (such as a Flag) holds if it is present.
+//   FMT/<tag>    An Integer, Float or String FORMAT field, also FORMAT/<tag>.
+//   GT           The genotype, compared with == and != to one of ref (all
+//                alleles are the reference), alt (some allele isn't), het
+//                (two different alleles), hom (all alleles are the same) or
+//                mis (some allele is missing).
+//
+// Constants are numbers, or strings that are either quoted with ' or " or
+// bare words such as PASS. String fields are only compared with == and !=.
+//
+// A field with multiple values, such as a Number=A INFO field, satisfies a
+// comparison if any of its values does, and a FORMAT field or GT if it does for
+// any sample. Missing values and absent fields never satisfy a comparison:
+// when a record has no DP, both INFO/DP < 10 and INFO/DP >= 10 are false, but
+// !(INFO/DP >= 10) is true. Likewise, a genotype with a missing allele is only
+// compared as mis.
+#ifndef THIRD_PARTY_NUCLEUS_IO_VCF_FILTER_H_
+#define THIRD_PARTY_NUCLEUS_IO_VCF_FILTER_H_
+
+#include <memory>
+
+#include "htslib/vcf.h"
+#include "nucleus/io/vcf_variant_view.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/vendor/statusor.h"
+
+namespace nucleus {
+
+class VcfFilterExpression {
+ public:
+  // Parses |expression| and resolves the fields it refers to in |header|.
+  // Returns an InvalidArgument error if the expression is malformed, refers to
+  // INFO or FORMAT fields |header| doesn't define, or compares a field with a
+  // constant or operator of the wrong type. The compiled expression can be
+  // used with all records read with |header|.
+  static StatusOr<std::unique_ptr<VcfFilterExpression>> Compile(
+      const string& expression, const bcf_hdr_t* header);
+
+  ~VcfFilterExpression();
+
+  // Disable copy or assignment
+  VcfFilterExpression(const VcfFilterExpression& other) = delete;
+  VcfFilterExpression& operator=(const VcfFilterExpression&) = delete;
+
+  // Does the record of |view| satisfy the expression? Only the parts of the
+  // record the expression looks at are unpacked.
+  bool Matches(const VcfVariantView& view) const;
+
+  const string& expression() const { return expression_; }
+
+  // A node of the compiled expression tree. Defined in the implementation.
+  class Node;
+
+ private:
+  VcfFilterExpression(const string& expression, std::unique_ptr<Node> root);
+
+  const string expression_;
+  const std::unique_ptr<Node> root_;
+};
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_IO_VCF_FILTER_H_
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_filter.h"
+
+#include <memory>
+
+#include "tensorflow/core/platform/test.h"
+#include "nucleus/io/vcf_variant_view.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/vendor/status_matchers.h"
+
+namespace nucleus {
+
+namespace {
+
+constexpr char kRecord[] =
+    "Chr1\t100\t.\tA\tC,G\t45.5\tPASS\tDP=12;AC=1,3;AF=0.25,0.75;DB;"
+    "CSQ=missense\tGT:AD:HQ:FT\t0/0:10,0,0:1.5,2:PASS\t0/1:4,6,0:.:LowDP\t"
+    "./.:.:.:.";
+
+// Has no QUAL, FILTER or INFO, and only homozygous reference genotypes.
+constexpr char kBareRecord[] = "Chr2\t5\t.\tA\tC\t.\t.\t.\tGT\t0/0\t0/0\t0/0";
+
+// Only has missing genotypes.
+constexpr char kMissingRecord[] =
+    "Chr1\t7\t.\tA\tC\t10\tLowQual\t.\tGT\t./.\t./.\t.";
+
+}  // namespace
+
+class VcfFilterExpressionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    header_ = MakeVcfHeader(
+        {
+            "##contig=<ID=Chr1,length=1000>",
+            "##contig=<ID=Chr2,length=100000>",
+            "##FILTER=<ID=LowQual,Description=\"LowQual\">",
+            "##FILTER=<ID=LowDP,Description=\"LowDP\">",
+            "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"DP\">",
+            "##INFO=<ID=AC,Number=A,Type=Integer,Description=\"AC\">",
+            "##INFO=<ID=AF,Number=A,Type=Float,Description=\"AF\">",
+            "##INFO=<ID=DB,Number=0,Type=Flag,Description=\"DB\">",
+            "##INFO=<ID=CSQ,Number=1,Type=String,Description=\"CSQ\">",
+            "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"GT\">",
+            "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"AD\">",
+            "##FORMAT=<ID=HQ,Number=.,Type=Float,Description=\"HQ\">",
+            "##FORMAT=<ID=FT,Number=1,Type=String,Description=\"FT\">",
+        },
+        {"s1", "s2", "s3"});
+    record_ = bcf_init();
+  }
+
+  void TearDown() override {
+    bcf_destroy(record_);
+    bcf_hdr_destroy(header_);
+  }
+
+  // Does the record |line| satisfy |expression|, which must compile?
+  bool Matches(const string& expression, const string& line) {
+    std::unique_ptr<VcfFilterExpression> filter =
+        VcfFilterExpression::Compile(expression, header_).ConsumeValueOrDie();
+    ParseVcfLine(header_, line, record_);
+    return filter->Matches(VcfVariantView(header_, record_));
+  }
+
+  tensorflow::Status CompileStatus(const string& expression) {
+    return VcfFilterExpression::Compile(expression, header_).status();
+  }
+
+  bcf_hdr_t* header_;
+  bcf1_t* record_;
+};
+
+TEST_F(VcfFilterExpressionTest, SiteFields) {
+  EXPECT_TRUE(Matches("QUAL > 30", kRecord));
+  EXPECT_FALSE(Matches("QUAL > 50", kRecord));
+  EXPECT_TRUE(Matches("30 < QUAL", kRecord));
+  EXPECT_TRUE(Matches("POS == 100", kRecord));
+  EXPECT_TRUE(Matches("POS=100", kRecord));
+  EXPECT_TRUE(Matches("N_ALT >= 2", kRecord));
+  EXPECT_TRUE(Matches("CHROM == Chr1", kRecord));
+  EXPECT_FALSE(Matches("CHROM != \"Chr1\"", kRecord));
+  EXPECT_TRUE(Matches("FILTER == PASS", kRecord));
+  EXPECT_FALSE(Matches("FILTER == LowQual", kRecord));
+  EXPECT_TRUE(Matches("FILTER != LowQual", kRecord));
+  EXPECT_FALSE(Matches("FILTER == '.'", kRecord));
+
+  EXPECT_FALSE(Matches("QUAL > 0", kBareRecord));
+  EXPECT_FALSE(Matches("QUAL <= 0", kBareRecord));
+  EXPECT_TRUE(Matches("FILTER == .", kBareRecord));
+  EXPECT_FALSE(Matches("FILTER == PASS", kBareRecord));
+  EXPECT_TRUE(Matches("FILTER == LowQual", kMissingRecord));
+}
+
+TEST_F(VcfFilterExpressionTest, InfoFields) {
+  EXPECT_TRUE(Matches("INFO/DP >= 10", kRecord));
+  // Any value of a Number=A field can satisfy a comparison.
+  EXPECT_TRUE(Matches("INFO/AC > 2", kRecord));
+  EXPECT_FALSE(Matches("INFO/AC > 3", kRecord));
+  EXPECT_TRUE(Matches("INFO/AF < 0.3", kRecord));
+  EXPECT_TRUE(Matches("INFO/CSQ == missense", kRecord));
+  EXPECT_TRUE(Matches("INFO/DB", kRecord));
+  EXPECT_FALSE(Matches("!INFO/DB", kRecord));
+
+  // Absent fields satisfy no comparison.
+  EXPECT_FALSE(Matches("INFO/DP < 10", kBareRecord));
+  EXPECT_FALSE(Matches("INFO/DP >= 10", kBareRecord));
+  EXPECT_TRUE(Matches("!(INFO/DP >= 10)", kBareRecord));
+  EXPECT_FALSE(Matches("INFO/CSQ != missense", kBareRecord));
+  EXPECT_FALSE(Matches("INFO/DB", kBareRecord));
+}
+
+TEST_F(VcfFilterExpressionTest, FormatFields) {
+  // Any sample can satisfy a comparison.
+  EXPECT_TRUE(Matches("FMT/AD > 5", kRecord));
+  EXPECT_FALSE(Matches("FMT/AD > 10", kRecord));
+  EXPECT_TRUE(Matches("FMT/HQ == 2", kRecord));
+  EXPECT_TRUE(Matches("FORMAT/FT == LowDP", kRecord));
+  EXPECT_FALSE(Matches("FMT/FT == LowQual", kRecord));
+}
+
+TEST_F(VcfFilterExpressionTest, Genotypes) {
+  EXPECT_TRUE(Matches("GT == ref", kRecord));
+  EXPECT_TRUE(Matches("GT != ref", kRecord));
+  EXPECT_TRUE(Matches("GT == het", kRecord));
+  EXPECT_TRUE(Matches("GT == hom", kRecord));
+  EXPECT_TRUE(Matches("GT == alt", kRecord));
+  EXPECT_TRUE(Matches("FMT/GT == mis", kRecord));
+
+  EXPECT_TRUE(Matches("GT == ref", kBareRecord));
+  EXPECT_FALSE(Matches("GT != ref", kBareRecord));
+  EXPECT_FALSE(Matches("GT == het", kBareRecord));
+  EXPECT_FALSE(Matches("GT == mis", kBareRecord));
+
+  // Missing genotypes are only compared as mis.
+  EXPECT_FALSE(Matches("GT == ref", kMissingRecord));
+  EXPECT_FALSE(Matches("GT != ref", kMissingRecord));
+  EXPECT_TRUE(Matches("GT == mis", kMissingRecord));
+  EXPECT_FALSE(Matches("GT != mis", kMissingRecord));
+}
+
+TEST_F(VcfFilterExpressionTest, BooleanOperators) {
+  EXPECT_TRUE(Matches(
+      "QUAL > 30 && INFO/DP >= 10 && FILTER == PASS && GT != ref", kRecord));
+  EXPECT_FALSE(Matches(
+      "QUAL > 30 && INFO/DP >= 10 && FILTER == PASS && GT != ref",
+      kBareRecord));
+  // && binds more tightly than ||.
+  EXPECT_TRUE(
+      Matches("QUAL > 50 || INFO/DP > 10 && FILTER == PASS", kRecord));
+  EXPECT_FALSE(
+      Matches("QUAL > 50 || INFO/DP > 20 && FILTER == PASS", kRecord));
+  EXPECT_TRUE(
+      Matches("QUAL > 40 || INFO/DP > 20 && FILTER == LowQual", kRecord));
+  EXPECT_FALSE(
+      Matches("(QUAL > 40 || INFO/DP > 20) && FILTER == LowQual", kRecord));
+  EXPECT_TRUE(Matches("!!(POS == 100)", kRecord));
+}
+
+TEST_F(VcfFilterExpressionTest, InvalidExpressions) {
+  for (const char* expression : {
+           "",
+           "QUAL",
+           "QUAL >",
+           "QUAL > high",
+           "QUAL > '30'",
+           "1 < 2",
+           "QUAL > POS",
+           "INFO/NOPE > 1",
+           "FMT/NOPE > 1",
+           "INFO/DB == 1",
+           "CHROM < Chr1",
+           "GT == maybe",
+           "GT > ref",
+           "QUAL > 1 & POS > 2",
+           "(QUAL > 1",
+           "QUAL > 1)",
+           "INFO/CSQ == 'missense",
+       }) {
+    EXPECT_THAT(CompileStatus(expression),
+                IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT))
+        << expression;
+  }
+}
+
+TEST_F(VcfFilterExpressionTest, LimitsNesting) {
+  EXPECT_THAT(CompileStatus(string(128, '!') + string(128, '(') +
+                            "POS == 100" + string(128, ')')),
+              IsOK());
+  EXPECT_THAT(CompileStatus("!" + string(256, '(') + "POS == 100" +
+                            string(256, ')')),
+              IsNotOKWithCodeAndMessage(tensorflow::error::INVALID_ARGUMENT,
+                                        "nested more than 256 deep"));
+  // Far too deep to parse by recursion, but rejected without overflowing the
+  // stack.
+  EXPECT_THAT(CompileStatus(string(100000, '(')),
+              IsNotOKWithCodeAndMessage(tensorflow::error::INVALID_ARGUMENT,
+                                        "nested more than 256 deep"));
+  EXPECT_THAT(CompileStatus(string(100000, '!') + "POS == 100"),
+              IsNotOKWithCodeAndMessage(tensorflow::error::INVALID_ARGUMENT,
+                                        "nested more than 256 deep"));
+}
+
+TEST_F(VcfFilterExpressionTest, EvaluatesLongChains) {
+  // Chains of && and || aren't nested, however long they are.
+  string conjunction = "POS == 100";
+  string disjunction = "POS == 200";
+  for (int i = 0; i < 100000; ++i) {
+    conjunction += " && QUAL > 10";
+    disjunction += " || QUAL > 50";
+  }
+  EXPECT_TRUE(Matches(conjunction, kRecord));
+  EXPECT_FALSE(Matches(conjunction + " && QUAL > 50", kRecord));
+  EXPECT_FALSE(Matches(disjunction, kRecord));
+  EXPECT_TRUE(Matches(disjunction + " || QUAL > 30", kRecord));
+  EXPECT_TRUE(Matches(conjunction + " || " + disjunction, kRecord));
+}
+
+}  // namespace nucleus
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_merge.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+
+#include "google/protobuf/repeated_field.h"
+#include "tensorflow/core/lib/core/errors.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+using nucleus::genomics::v1::ContigInfo;
+using nucleus::genomics::v1::Range;
+using nucleus::genomics::v1::Variant;
+using nucleus::genomics::v1::VariantCall;
+using nucleus::genomics::v1::VcfHeader;
+
+namespace {
+
+// Appends the elements of |from| whose id() is not in |ids| yet to |to|.
+template <class T>
+void AddNewById(const google::protobuf::RepeatedPtrField<T>& from,
+                std::set<string>* ids,
+                google::protobuf::RepeatedPtrField<T>* to) {
+  for (const T& element : from) {
+    if (ids->insert(element.id()).second) *to->Add() = element;
+  }
+}
+
+// Do |a| and |b| have the same reference and alternate alleles?
+bool SameAlleles(const Variant& a, const Variant& b) {
+  return a.reference_bases() == b.reference_bases() &&
+         a.alternate_bases_size() == b.alternate_bases_size() &&
+         std::equal(a.alternate_bases().begin(), a.alternate_bases().end(),
+                    b.alternate_bases().begin());
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<VcfMergeIterable>> VcfMergeIterable::Iterate(
+    const std::vector<VcfReader*>& readers) {
+  std::vector<std::shared_ptr<VariantViewIterable>> views;
+  for (VcfReader* reader : readers) {
+    StatusOr<std::shared_ptr<VariantViewIterable>> iterable =
+        reader->IterateViews();
+    TF_RETURN_IF_ERROR(iterable.status());
+    views.push_back(iterable.ConsumeValueOrDie());
+  }
+  return Create(readers, views);
+}
+
+StatusOr<std::unique_ptr<VcfMergeIterable>> VcfMergeIterable::Query(
+    const std::vector<VcfReader*>& readers, const Range& region) {
+  std::vector<std::shared_ptr<VariantViewIterable>> views;
+  for (VcfReader* reader : readers) {
+    StatusOr<std::shared_ptr<VariantViewIterable>> iterable =
+        reader->QueryViews(region);
+    TF_RETURN_IF_ERROR(iterable.status());
+    views.push_back(iterable.ConsumeValueOrDie());
+  }
+  return Create(readers, views);
+}
+
+StatusOr<std::unique_ptr<VcfMergeIterable>> VcfMergeIterable::Create(
+    const std::vector<VcfReader*>& readers,
+    const std::vector<std::shared_ptr<VariantViewIterable>>& views) {
+  if (readers.empty()) {
+    return tf::errors::InvalidArgument("No VCF readers to merge");
+  }
+  std::unique_ptr<VcfMergeIterable> merge(new VcfMergeIterable());
+  VcfHeader& header = merge->header_;
+  const VcfHeader& first_header = readers[0]->Header();
+  header.set_fileformat(first_header.fileformat());
+  *header.mutable_structured_extras() = first_header.structured_extras();
+  *header.mutable_extras() = first_header.extras();
+
+  std::set<string> filter_ids, info_ids, format_ids;
+  int sample_offset = 0;
+  for (size_t i = 0; i < readers.size(); ++i) {
+    const VcfHeader& reader_header = readers[i]->Header();
+    Input input;
+    input.reader = readers[i];
+    input.views = views[i];
+    input.sample_offset = sample_offset;
+    sample_offset += reader_header.sample_names_size();
+
+    // Contig ids of the bcf header are the indices of the contigs.
+    int last_rank = -1;
+    for (const ContigInfo& contig : reader_header.contigs()) {
+      const int rank = merge->InternContig(contig);
+      if (rank <= last_rank) {
+        return tf::errors::InvalidArgument(
+            "The contigs of VCF reader ", i, " are not in the same order as "
+            "those of the previous readers, starting at ", contig.name());
+      }
+      input.contig_ranks.push_back(rank);
+      last_rank = rank;
+    }
+    merge->inputs_.push_back(std::move(input));
+
+    AddNewById(reader_header.filters(), &filter_ids, header.mutable_filters());
+    AddNewById(reader_header.infos(), &info_ids, header.mutable_infos());
+    AddNewById(reader_header.formats(), &format_ids, header.mutable_formats());
+    for (const string& sample : reader_header.sample_names()) {
+      header.add_sample_names(sample);
+    }
+  }
+
+  for (size_t i = 0; i < readers.size(); ++i) {
+    TF_RETURN_IF_ERROR(merge->Advance(i));
+  }
+  return std::move(merge);
+}
+
+int VcfMergeIterable::InternContig(const ContigInfo& contig) {
+  auto it = contig_ranks_.find(contig.name());
+  if (it != contig_ranks_.end()) return it->second;
+  const int rank = header_.contigs_size();
+  ContigInfo* merged = header_.add_contigs();
+  *merged = contig;
+  merged->set_pos_in_fasta(rank);
+  contig_ranks_.emplace(contig.name(), rank);
+  return rank;
+}
+
+tf::Status VcfMergeIterable::Advance(int i) {
+  Input& input = inputs_[i];
+  StatusOr<bool> has_next = input.views->Next(&input.view);
+  TF_RETURN_IF_ERROR(has_next.status());
+  if (!has_next.ValueOrDie()) return tf::Status::OK();
+
+  const int rid = input.view.contig_id();
+  if (rid >= static_cast<int>(input.contig_ranks.size())) {
+    input.contig_ranks.resize(rid + 1, -1);
+  }
+  if (input.contig_ranks[rid] < 0) {
+    // A contig the header of the reader didn't define when the merge started.
+    ContigInfo contig;
+    contig.set_name(input.view.contig_name());
+    input.contig_ranks[rid] = InternContig(contig);
+  }
+  const int rank = input.contig_ranks[rid];
+  const int64 start = input.view.start();
+  if (rank < input.last_rank ||
+      (rank == input.last_rank && start < input.last_start)) {
+    return tf::errors::FailedPrecondition(
+        "The records of VCF reader ", i, " are not sorted: ",
+        input.view.contig_name(), ":", start + 1, " follows ",
+        header_.contigs(input.last_rank).name(), ":", input.last_start + 1);
+  }
+  input.last_rank = rank;
+  input.last_start = start;
+  heap_.emplace(rank, start, i);
+  return tf::Status::OK();
+}
+
+StatusOr<bool> VcfMergeIterable::NextSite(std::vector<Variant>* site,
+                                          std::vector<int>* sources) {
+  site->clear();
+  sources->clear();
+  if (heap_.empty()) return false;
+  const int rank = std::get<0>(heap_.top());
+  const int64 start = std::get<1>(heap_.top());
+  while (!heap_.empty() && std::get<0>(heap_.top()) == rank &&
+         std::get<1>(heap_.top()) == start) {
+    const int i = std::get<2>(heap_.top());
+    heap_.pop();
+    const Input& input = inputs_[i];
+    site->emplace_back();
+    sources->push_back(i);
+    TF_RETURN_IF_ERROR(input.reader->RecordConverter().ConvertToPb(
+        input.view.header(), input.view.record(), &site->back()));
+    // The input's next record, if at the same site, is back on top.
+    TF_RETURN_IF_ERROR(Advance(i));
+  }
+  return true;
+}
+
+StatusOr<bool> VcfMergeIterable::NextMerged(Variant* merged) {
+  while (pending_.empty()) {
+    StatusOr<bool> has_site = NextSite(&site_, &site_sources_);
+    TF_RETURN_IF_ERROR(has_site.status());
+    if (!has_site.ValueOrDie()) return false;
+    MergeSite();
+  }
+  *merged = std::move(pending_.front());
+  pending_.pop_front();
+  return true;
+}
+
+void VcfMergeIterable::MergeSite() {
+  // groups[g][i] is the index in site_ of the record of input i that is
+  // combined into the g-th Variant of the site, or -1.
+  std::vector<std::vector<int>> groups;
+  std::vector<int> group_firsts;
+  for (size_t r = 0; r < site_.size(); ++r) {
+    const int source = site_sources_[r];
+    size_t g = 0;
+    while (g < groups.size() &&
+           (groups[g][source] >= 0 ||
+            !SameAlleles(site_[group_firsts[g]], site_[r]))) {
+      ++g;
+    }
+    if (g == groups.size()) {
+      groups.emplace_back(inputs_.size(), -1);
+      group_firsts.push_back(r);
+    }
+    groups[g][source] = r;
+  }
+
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const int first = group_firsts[g];
+    Variant merged = std::move(site_[first]);
+    google::protobuf::RepeatedPtrField<VariantCall> first_calls;
+    first_calls.Swap(merged.mutable_calls());
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+      const int r = groups[g][i];
+      const int offset = inputs_[i].sample_offset;
+      if (r < 0) {
+        // Diploid no-calls for the samples of inputs without a record.
+        const VcfHeader& reader_header = inputs_[i].reader->Header();
+        const bool omit_names =
+            inputs_[i].reader->Options().omit_call_set_names();
+        for (int s = 0; s < reader_header.sample_names_size(); ++s) {
+          VariantCall* call = merged.add_calls();
+          if (omit_names) {
+            call->set_call_set_index(offset + s);
+          } else {
+            call->set_call_set_name(reader_header.sample_names(s));
+          }
+          call->add_genotype(-1);
+          call->add_genotype(-1);
+        }
+        continue;
+      }
+      google::protobuf::RepeatedPtrField<VariantCall>* calls =
+          r == first ? &first_calls : site_[r].mutable_calls();
+      for (VariantCall& call : *calls) {
+        VariantCall* out = merged.add_calls();
+        out->Swap(&call);
+        if (out->call_set_case() == VariantCall::kCallSetIndex) {
+          out->set_call_set_index(out->call_set_index() + offset);
+        }
+      }
+    }
+    pending_.push_back(std::move(merged));
+  }
+}
+
+tf::Status VcfMergeIterable::Release() {
+  tf::Status status;
+  for (Input& input : inputs_) status.Update(input.views->Release());
+  return status;
+}
+
+}  // namespace nucleus
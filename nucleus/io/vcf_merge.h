@@ -0,0 +1,144 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef THIRD_PARTY_NUCLEUS_IO_VCF_MERGE_H_
+#define THIRD_PARTY_NUCLEUS_IO_VCF_MERGE_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "nucleus/io/vcf_reader.h"
+#include "nucleus/io/vcf_variant_view.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/range.pb.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/vendor/statusor.h"
+#include "tensorflow/core/lib/core/status.h"
+
+namespace nucleus {
+
+// Merges the records of several sorted VCF files by position, as needed for
+// joint analysis of per-sample or per-shard VCFs.
+//
+// The records of all inputs are merged with a min-heap keyed on (contig rank,
+// start, input index). Contig ranks are interned once per input: the contigs
+// of the first reader's header come first, in order, followed by the contigs
+// only other readers define, in the order they are first seen. Every input
+// must list its contigs in an order consistent with these ranks, and its
+// records must be sorted by them.
+//
+// The merged records can be read either grouped by site with NextSite, or
+// combined into multi-sample Variants with NextMerged. Use only one of the two
+// on a given iterable.
+//
+// The iterable holds an iterable of each reader, so only one merge (or other
+// iteration) can be live per reader, and the readers must outlive it.
+class VcfMergeIterable {
+ public:
+  // Merges all of the records of |readers|.
+  static StatusOr<std::unique_ptr<VcfMergeIterable>> Iterate(
+      const std::vector<VcfReader*>& readers);
+
+  // Merges the records of |readers| that overlap |region|, as with
+  // VcfReader::Query.
+  static StatusOr<std::unique_ptr<VcfMergeIterable>> Query(
+      const std::vector<VcfReader*>& readers,
+      const nucleus::genomics::v1::Range& region);
+
+  // A header describing the merged records: the contigs in merge order, the
+  // union of the FILTER, INFO and FORMAT definitions of the readers (the
+  // first definition of an id wins), the other header lines of the first
+  // reader, and the samples of all readers in reader order. Samples are not
+  // deduplicated.
+  const nucleus::genomics::v1::VcfHeader& Header() const { return header_; }
+
+  // Returns all records at the next site, that is with the next contig and
+  // start, in |site|, in input order. (*sources)[i] is the index of the reader
+  // (*site)[i] was read from. Returns false once all records have been
+  // returned.
+  StatusOr<bool> NextSite(std::vector<nucleus::genomics::v1::Variant>* site,
+                          std::vector<int>* sources);
+
+  // Returns the next multi-sample Variant. At each site, the records with the
+  // same reference and alternate alleles are combined, taking at most one
+  // record per input: the site-level fields come from the first of them, and
+  // the calls are those of every input in reader order, with diploid no-calls
+  // for the samples of inputs that have no such record. Calls that carry a
+  // call_set_index instead of a call_set_name have it shifted to index the
+  // samples of Header().
+  StatusOr<bool> NextMerged(nucleus::genomics::v1::Variant* merged);
+
+  // Releases the iterables of the readers so they can be iterated again.
+  tensorflow::Status Release();
+
+ private:
+  // The state of one of the merged readers.
+  struct Input {
+    VcfReader* reader;
+    std::shared_ptr<VariantViewIterable> views;
+    // The current record, if the input is in the heap.
+    VcfVariantView view;
+    // The merge rank of each contig id of the reader's bcf header, or -1 if
+    // not interned yet.
+    std::vector<int> contig_ranks;
+    // The index of the first sample of the reader in Header().
+    int sample_offset;
+    // The position of the last record, to check that the input is sorted.
+    int last_rank = -1;
+    int64 last_start = -1;
+  };
+
+  // (contig rank, start, input index) of the current record of an input.
+  using HeapEntry = std::tuple<int, int64, int>;
+
+  VcfMergeIterable() = default;
+
+  // Shared by Iterate and Query. Builds the merged header and the contig ranks
+  // and reads the first record of each input.
+  static StatusOr<std::unique_ptr<VcfMergeIterable>> Create(
+      const std::vector<VcfReader*>& readers,
+      const std::vector<std::shared_ptr<VariantViewIterable>>& views);
+
+  // Returns the merge rank of |contig|, interning it if it is new.
+  int InternContig(const nucleus::genomics::v1::ContigInfo& contig);
+
+  // Reads the next record of input |i| and pushes it on the heap, if any.
+  tensorflow::Status Advance(int i);
+
+  // Combines site_ into multi-sample Variants appended to pending_.
+  void MergeSite();
+
+  std::vector<Input> inputs_;
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+                      std::greater<HeapEntry>>
+      heap_;
+  std::unordered_map<string, int> contig_ranks_;
+  nucleus::genomics::v1::VcfHeader header_;
+
+  // Scratch space and output queue of NextMerged.
+  std::vector<nucleus::genomics::v1::Variant> site_;
+  std::vector<int> site_sources_;
+  std::deque<nucleus::genomics::v1::Variant> pending_;
+};
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_IO_VCF_MERGE_H_
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_merge.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock-generated-matchers.h>
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock-more-matchers.h>
+
+#include "tensorflow/core/platform/test.h"
+#include "absl/strings/str_cat.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/testing/protocol-buffer-matchers.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/util/utils.h"
+#include "nucleus/vendor/status_matchers.h"
+
+namespace nucleus {
+
+using genomics::v1::Variant;
+using genomics::v1::VcfReaderOptions;
+using ::testing::ElementsAre;
+using ::testing::Not;
+
+constexpr char kVcfIndexSamplesFilename[] = "test_samples.vcf.gz";
+
+// Writes a single-sample VCF with |contigs| and |records| to a temporary file
+// named |name| and returns a reader for it.
+std::unique_ptr<VcfReader> MakeReader(
+    const string& name, const string& sample,
+    const std::vector<string>& contigs, const std::vector<string>& records,
+    const VcfReaderOptions& options = VcfReaderOptions()) {
+  string vcf =
+      "##fileformat=VCFv4.2\n"
+      "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+  for (const string& contig : contigs) {
+    absl::StrAppend(&vcf, "##contig=<ID=", contig, ",length=1000>\n");
+  }
+  absl::StrAppend(&vcf,
+                  "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\t",
+                  sample, "\n");
+  for (const string& record : records) absl::StrAppend(&vcf, record, "\n");
+  return MakeVcfReader(name, vcf, options);
+}
+
+class VcfMergeTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    a_ = MakeReader("merge_a.vcf", "S1", {"chr1", "chr2"},
+                    {"chr1\t10\t.\tA\tG\t.\t.\t.\tGT\t0/1",
+                     "chr1\t20\t.\tC\tT\t.\t.\t.\tGT\t1/1",
+                     "chr2\t5\t.\tG\tA\t.\t.\t.\tGT\t0/1"});
+    b_ = MakeB(VcfReaderOptions());
+  }
+
+  std::unique_ptr<VcfReader> MakeB(const VcfReaderOptions& options) {
+    return MakeReader("merge_b.vcf", "S2", {"chr1", "chr2", "chr3"},
+                      {"chr1\t10\t.\tA\tG\t.\t.\t.\tGT\t0/0",
+                       "chr1\t10\t.\tA\tC\t.\t.\t.\tGT\t0/1",
+                       "chr1\t15\t.\tT\tG\t.\t.\t.\tGT\t0|1",
+                       "chr3\t1\t.\tA\tT\t.\t.\t.\tGT\t1/1"},
+                      options);
+  }
+
+  std::unique_ptr<VcfReader> a_;
+  std::unique_ptr<VcfReader> b_;
+};
+
+TEST_F(VcfMergeTest, MergesHeaders) {
+  auto merge =
+      std::move(VcfMergeIterable::Iterate({a_.get(), b_.get()}).ValueOrDie());
+  const auto& header = merge->Header();
+  ASSERT_EQ(3, header.contigs_size());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(absl::StrCat("chr", i + 1), header.contigs(i).name());
+    EXPECT_EQ(i, header.contigs(i).pos_in_fasta());
+  }
+  ASSERT_EQ(1, header.formats_size());
+  EXPECT_EQ("GT", header.formats(0).id());
+  EXPECT_THAT(header.sample_names(), ElementsAre("S1", "S2"));
+}
+
+TEST_F(VcfMergeTest, GroupsRecordsBySite) {
+  auto merge =
+      std::move(VcfMergeIterable::Iterate({a_.get(), b_.get()}).ValueOrDie());
+  // Another iteration of a merged reader can't start while the merge is live.
+  EXPECT_THAT(a_->Iterate().ValueOrDie(), testing::IsNull());
+
+  std::vector<string> sites;
+  std::vector<std::vector<int>> site_sources;
+  std::vector<Variant> site;
+  std::vector<int> sources;
+  while (merge->NextSite(&site, &sources).ValueOrDie()) {
+    ASSERT_EQ(site.size(), sources.size());
+    for (const Variant& v : site) {
+      EXPECT_EQ(site[0].reference_name(), v.reference_name());
+      EXPECT_EQ(site[0].start(), v.start());
+    }
+    sites.push_back(
+        absl::StrCat(site[0].reference_name(), ":", site[0].start()));
+    site_sources.push_back(sources);
+  }
+  EXPECT_THAT(sites,
+              ElementsAre("chr1:9", "chr1:14", "chr1:19", "chr2:4", "chr3:0"));
+  EXPECT_THAT(site_sources,
+              ElementsAre(ElementsAre(0, 1, 1), ElementsAre(1), ElementsAre(0),
+                          ElementsAre(0), ElementsAre(1)));
+
+  ASSERT_THAT(merge->Release(), IsOK());
+  EXPECT_THAT(a_->Iterate().ValueOrDie(), testing::NotNull());
+}
+
+TEST_F(VcfMergeTest, CombinesCalls) {
+  auto merge =
+      std::move(VcfMergeIterable::Iterate({a_.get(), b_.get()}).ValueOrDie());
+  std::vector<Variant> merged;
+  Variant v;
+  while (merge->NextMerged(&v).ValueOrDie()) merged.push_back(v);
+  ASSERT_EQ(6, merged.size());
+
+  // The records of both inputs with the same alleles are combined.
+  EXPECT_EQ(9, merged[0].start());
+  EXPECT_THAT(merged[0].alternate_bases(), ElementsAre("G"));
+  ASSERT_EQ(2, merged[0].calls_size());
+  EXPECT_EQ("S1", merged[0].calls(0).call_set_name());
+  EXPECT_THAT(merged[0].calls(0).genotype(), ElementsAre(0, 1));
+  EXPECT_EQ("S2", merged[0].calls(1).call_set_name());
+  EXPECT_THAT(merged[0].calls(1).genotype(), ElementsAre(0, 0));
+
+  // Inputs without a record with the same alleles get no-calls.
+  EXPECT_EQ(9, merged[1].start());
+  EXPECT_THAT(merged[1].alternate_bases(), ElementsAre("C"));
+  ASSERT_EQ(2, merged[1].calls_size());
+  EXPECT_EQ("S1", merged[1].calls(0).call_set_name());
+  EXPECT_THAT(merged[1].calls(0).genotype(), ElementsAre(-1, -1));
+  EXPECT_THAT(merged[1].calls(1).genotype(), ElementsAre(0, 1));
+
+  EXPECT_EQ(14, merged[2].start());
+  EXPECT_THAT(merged[2].calls(0).genotype(), ElementsAre(-1, -1));
+  EXPECT_TRUE(merged[2].calls(1).is_phased());
+  EXPECT_EQ(19, merged[3].start());
+  EXPECT_THAT(merged[3].calls(0).genotype(), ElementsAre(1, 1));
+  EXPECT_THAT(merged[3].calls(1).genotype(), ElementsAre(-1, -1));
+  EXPECT_EQ("chr2", merged[4].reference_name());
+  EXPECT_EQ("chr3", merged[5].reference_name());
+  for (const Variant& variant : merged) EXPECT_EQ(2, variant.calls_size());
+}
+
+TEST_F(VcfMergeTest, ShiftsCallSetIndices) {
+  VcfReaderOptions options;
+  options.set_omit_call_set_names(true);
+  b_ = MakeB(options);
+  auto merge =
+      std::move(VcfMergeIterable::Iterate({a_.get(), b_.get()}).ValueOrDie());
+  Variant v;
+  ASSERT_TRUE(merge->NextMerged(&v).ValueOrDie());
+  ASSERT_EQ(2, v.calls_size());
+  EXPECT_EQ(1, v.calls(1).call_set_index());
+  EXPECT_EQ("S2", CallSetName(merge->Header(), v.calls(1)));
+  ASSERT_TRUE(merge->NextMerged(&v).ValueOrDie());
+  EXPECT_EQ(1, v.calls(1).call_set_index());
+  ASSERT_TRUE(merge->NextMerged(&v).ValueOrDie());
+  // A no-call of the second input.
+  ASSERT_TRUE(merge->NextMerged(&v).ValueOrDie());
+  EXPECT_TRUE(v.calls(1).call_set_name().empty());
+  EXPECT_EQ(1, v.calls(1).call_set_index());
+  EXPECT_THAT(v.calls(1).genotype(), ElementsAre(-1, -1));
+}
+
+TEST_F(VcfMergeTest, RejectsUnsortedInputs) {
+  std::unique_ptr<VcfReader> unsorted =
+      MakeReader("merge_unsorted.vcf", "S3", {"chr1"},
+                 {"chr1\t20\t.\tA\tG\t.\t.\t.\tGT\t0/1",
+                  "chr1\t10\t.\tA\tG\t.\t.\t.\tGT\t0/1"});
+  auto merge = std::move(
+      VcfMergeIterable::Iterate({a_.get(), unsorted.get()}).ValueOrDie());
+  std::vector<Variant> site;
+  std::vector<int> sources;
+  StatusOr<bool> result = true;
+  while (result.ok() && result.ValueOrDie()) {
+    result = merge->NextSite(&site, &sources);
+  }
+  EXPECT_THAT(result.status(), IsNotOKWithMessage("not sorted"));
+}
+
+TEST_F(VcfMergeTest, RejectsInconsistentContigOrder) {
+  std::unique_ptr<VcfReader> reversed = MakeReader(
+      "merge_reversed.vcf", "S3", {"chr2", "chr1"}, {});
+  EXPECT_THAT(VcfMergeIterable::Iterate({a_.get(), reversed.get()}),
+              Not(IsOK()));
+  EXPECT_THAT(VcfMergeIterable::Iterate({}), Not(IsOK()));
+}
+
+TEST(VcfMergeQueryTest, MergesQueries) {
+  const string path = GetTestData(kVcfIndexSamplesFilename);
+  std::unique_ptr<VcfReader> first =
+      std::move(VcfReader::FromFile(path, VcfReaderOptions()).ValueOrDie());
+  std::unique_ptr<VcfReader> second =
+      std::move(VcfReader::FromFile(path, VcfReaderOptions()).ValueOrDie());
+  const auto range = MakeRange("chr3", 99999, 500000);
+  const std::vector<Variant> expected = as_vector(first->Query(range));
+  ASSERT_EQ(4, expected.size());
+
+  auto merge = std::move(
+      VcfMergeIterable::Query({first.get(), second.get()}, range)
+          .ValueOrDie());
+  EXPECT_EQ(2, merge->Header().sample_names_size());
+  Variant v;
+  for (const Variant& e : expected) {
+    ASSERT_TRUE(merge->NextMerged(&v).ValueOrDie());
+    EXPECT_EQ(e.start(), v.start());
+    ASSERT_EQ(2, v.calls_size());
+    EXPECT_THAT(v.calls(0), EqualsProto(e.calls(0)));
+    EXPECT_THAT(v.calls(1), EqualsProto(e.calls(0)));
+  }
+  EXPECT_FALSE(merge->NextMerged(&v).ValueOrDie());
+}
+
+}  // namespace nucleus
@@ -22,11 +22,15 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "google/protobuf/map.h"
 #include "google/protobuf/repeated_field.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "htslib/kstring.h"
 #include "htslib/vcf.h"
 #include "nucleus/io/hts_path.h"
@@ -35,6 +39,7 @@
 #include "nucleus/protos/reference.pb.h"
 #include "nucleus/protos/variants.pb.h"
 #include "nucleus/util/math.h"
+#include "nucleus/util/parallel.h"
 #include "nucleus/util/utils.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
@@ -55,15 +60,146 @@ bool FileTypeIsIndexable(htsFormat format) {
   return format.format == vcf && format.compression == bgzf;
 }
 
+// Only BGZF-compressed BCF can be indexed, and its index is always CSI.
+bool FileTypeIsBcfIndexable(htsFormat format) {
+  return format.format == bcf && format.compression == bgzf;
+}
+
+// Restricts |h| to the samples selected by |options|. htslib then drops the
+// FORMAT data of all other samples as records are read, before any of it is
+// decoded into Variant protos.
+tf::Status SetSamples(const nucleus::genomics::v1::VcfReaderOptions& options,
+                      bcf_hdr_t* h) {
+  const auto& included = options.included_samples();
+  const auto& excluded = options.excluded_samples();
+  if (options.sites_only()) {
+    if (!included.empty() || !excluded.empty()) {
+      return tf::errors::InvalidArgument(
+          "sites_only cannot be combined with included_samples or "
+          "excluded_samples");
+    }
+    // A null list selects no samples at all.
+    if (bcf_hdr_set_samples(h, nullptr, 0) != 0) {
+      return tf::errors::Internal("Failed to drop samples for sites_only");
+    }
+    return tf::Status::OK();
+  }
+  if (included.empty() && excluded.empty()) return tf::Status::OK();
+  if (!included.empty() && !excluded.empty()) {
+    return tf::errors::InvalidArgument(
+        "included_samples and excluded_samples cannot both be set");
+  }
+  for (const string& sample : included.empty() ? excluded : included) {
+    // htslib takes the samples as a comma-separated list.
+    if (sample.find(',') != string::npos) {
+      return tf::errors::InvalidArgument(
+          "Cannot select sample with a comma in its name: ", sample);
+    }
+  }
+  const string samples = included.empty()
+                             ? absl::StrCat("^", absl::StrJoin(excluded, ","))
+                             : absl::StrJoin(included, ",");
+  const int ret = bcf_hdr_set_samples(h, samples.c_str(), 0);
+  if (ret < 0) {
+    return tf::errors::Internal("Failed to select samples ", samples);
+  }
+  // A positive value is the 1-based index of a sample missing from the
+  // header. htslib tolerates this, but for an include list it almost
+  // certainly indicates a typo, so we report it.
+  if (ret > 0 && !included.empty()) {
+    return tf::errors::NotFound("Sample '", included.Get(ret - 1),
+                                "' is not present in the VCF header");
+  }
+  return tf::Status::OK();
+}
+
+// Returns a copy of |h| that vcf_parse can add missing contig and field
+// definitions to without affecting |h|, or nullptr on failure. bcf_hdr_dup only
+// keeps the selected samples, so the sample selection of |h| is carried over
+// by hand: records listing all of the original samples then parse as they
+// would with |h|.
+bcf_hdr_t* DuplicateParseHeader(const bcf_hdr_t* h) {
+  bcf_hdr_t* dup = bcf_hdr_dup(h);
+  if (dup != nullptr && h->keep_samples != nullptr) {
+    // The size of the bit array allocated by bcf_hdr_set_samples.
+    const size_t n_bytes = h->nsamples_ori / 8 + 1;
+    dup->keep_samples = static_cast<uint8_t*>(malloc(n_bytes));
+    memcpy(dup->keep_samples, h->keep_samples, n_bytes);
+    dup->nsamples_ori = h->nsamples_ori;
+  }
+  return dup;
+}
+
+// Parses records [begin, end) of |records| into the matching elements of
+// |variants|, as VcfReader::FromString would with header |h| and |converter|.
+// Parsing uses a private copy of |h|, and stops at the first record referring
+// to a contig or field missing from |h|, for which FromString would have to
+// update the header. *first_unparsed is set to that record, or to end.
+tf::Status ParseRecords(const bcf_hdr_t* h, const VcfRecordConverter& converter,
+                        vector<kstring_t>* records, int64 begin, int64 end,
+                        vector<Variant>* variants, int64* first_unparsed) {
+  *first_unparsed = end;
+  bcf_hdr_t* header = DuplicateParseHeader(h);
+  if (header == nullptr) {
+    return tf::errors::Internal("Failed to copy the VCF header");
+  }
+  bcf1_t* record = bcf_init();
+  tf::Status status;
+  for (int64 i = begin; i < end && status.ok(); ++i) {
+    if (vcf_parse1(&(*records)[i], header, record) < 0) {
+      status = tf::errors::DataLoss("Failed to parse VCF record on line ",
+                                    i + 1, " of the batch");
+    } else if (record->errcode == BCF_ERR_CTG_UNDEF ||
+               record->errcode == BCF_ERR_TAG_UNDEF) {
+      *first_unparsed = i;
+      break;
+    } else if (record->errcode != 0) {
+      status = tf::errors::DataLoss("Failed to parse VCF record with errcode: ",
+                                    record->errcode);
+    } else {
+      status = converter.ConvertToPb(header, record, &(*variants)[i]);
+    }
+  }
+  bcf_destroy(record);
+  bcf_hdr_destroy(header);
+  return status;
+}
 
 }  // namespace
 
-// Iterable class for traversing VCF records found in a query window.
-class VcfQueryIterable : public VariantIterable {
+// Base class for the VCF iterables. Subclasses only read the next raw record;
+// converting it into a Variant is shared.
+class VcfIterableBase : public VariantIterable {
  public:
   // Advance to the next record.
   StatusOr<bool> Next(nucleus::genomics::v1::Variant* out) override;
 
+  // Advance to the next record that satisfies the filter expression of the
+  // reader, if any, without converting it to a Variant. On success the record
+  // is available through native_record() until the next call.
+  StatusOr<bool> NextNative();
+
+  bcf1_t* native_record() const { return bcf1_; }
+  const bcf_hdr_t* native_header() const { return header_; }
+
+  ~VcfIterableBase() override;
+
+ protected:
+  // Base class constructor. Intializes common attributes.
+  VcfIterableBase(const VcfReader* reader, htsFile* fp, bcf_hdr_t* header);
+
+  // Reads the next record into bcf1_. Returns false at the end of the
+  // iteration.
+  virtual StatusOr<bool> ReadNextRecord() = 0;
+
+  htsFile* fp_;
+  bcf_hdr_t* header_;
+  bcf1_t* bcf1_;
+};
+
+// Iterable class for traversing VCF records found in a query window.
+class VcfQueryIterable : public VcfIterableBase {
+ public:
   // Constructor will be invoked via VcfReader::Query.
   VcfQueryIterable(const VcfReader* reader,
                    htsFile* fp,
@@ -73,33 +209,45 @@ class VcfQueryIterable : public VariantIterable {
 
   ~VcfQueryIterable() override;
 
+ protected:
+  StatusOr<bool> ReadNextRecord() override;
+
  private:
-  htsFile* fp_;
-  bcf_hdr_t* header_;
-  bcf1_t* bcf1_;
   tbx_t* idx_;
   hts_itr_t* iter_;
   kstring_t str_;
 };
 
+// Iterable class for traversing BCF records found in a query window. Unlike
+// VcfQueryIterable, records are decoded directly from the binary encoding
+// without going through the text parser.
+class BcfQueryIterable : public VcfIterableBase {
+ public:
+  // Constructor will be invoked via VcfReader::Query.
+  BcfQueryIterable(const VcfReader* reader,
+                   htsFile* fp,
+                   bcf_hdr_t* header,
+                   hts_itr_t* iter);
+
+  ~BcfQueryIterable() override;
+
+ protected:
+  StatusOr<bool> ReadNextRecord() override;
+
+ private:
+  hts_itr_t* iter_;
+};
 
 // Iterable class for traversing all VCF records in the file.
-class VcfFullFileIterable : public VariantIterable {
+class VcfFullFileIterable : public VcfIterableBase {
  public:
-  // Advance to the next record.
-  StatusOr<bool> Next(nucleus::genomics::v1::Variant* out) override;
-
   // Constructor will be invoked via VcfReader::Iterate.
   VcfFullFileIterable(const VcfReader* reader,
                       htsFile* fp,
                       bcf_hdr_t* header);
 
-  ~VcfFullFileIterable() override;
-
- private:
-  htsFile* fp_;
-  bcf_hdr_t* header_;
-  bcf1_t* bcf1_;
+ protected:
+  StatusOr<bool> ReadNextRecord() override;
 };
 
 StatusOr<std::unique_ptr<VcfReader>> VcfReader::FromFile(
@@ -124,6 +272,14 @@ StatusOr<std::unique_ptr<VcfReader>> VcfReader::FromFileHelper(
   if (fp == nullptr) {
     return tf::errors::NotFound("Could not open ", vcf_filepath);
   }
+  // The thread pool is owned by |fp| and torn down by hts_close.
+  if (options.num_threads() > 0 &&
+      hts_set_threads(fp, options.num_threads()) < 0) {
+    hts_close(fp);
+    if (h != nullptr) bcf_hdr_destroy(h);
+    return tf::errors::Unknown("Failed to set up ", options.num_threads(),
+                               " threads for reading ", vcf_filepath);
+  }
 
   if (h == nullptr) {
     h = bcf_hdr_read(fp);
@@ -145,36 +301,80 @@ StatusOr<std::unique_ptr<VcfReader>> VcfReader::FromFileHelper(
     fp->format.format = htsExactFormat::vcf;
   }
 
+  tf::Status samples_status = SetSamples(options, h);
+  if (!samples_status.ok()) {
+    hts_close(fp);
+    bcf_hdr_destroy(h);
+    return samples_status;
+  }
+
+  // The filter is compiled against the sample-subsetted header, as records
+  // are.
+  std::unique_ptr<VcfFilterExpression> filter;
+  if (!options.filter_expression().empty()) {
+    StatusOr<std::unique_ptr<VcfFilterExpression>> compiled =
+        VcfFilterExpression::Compile(options.filter_expression(), h);
+    if (!compiled.ok()) {
+      hts_close(fp);
+      bcf_hdr_destroy(h);
+      return compiled.status();
+    }
+    filter = compiled.ConsumeValueOrDie();
+  }
+
   // Try to load the Tabix index if requested.
   tbx_t* idx = nullptr;
+  hts_idx_t* csi_idx = nullptr;
   if (FileTypeIsIndexable(fp->format)) {
     idx = tbx_index_load(fp->fn);
     // idx may be null; only an error if we try to Query later.
+  } else if (FileTypeIsBcfIndexable(fp->format)) {
+    csi_idx = bcf_index_load(fp->fn);
+    // As above, csi_idx may be null.
   }
 
   return absl::WrapUnique<VcfReader>(
-      new VcfReader(vcf_filepath, options, fp, h, idx));
+      new VcfReader(vcf_filepath, options, fp, h, idx, csi_idx,
+                    std::move(filter)));
 }
 
 void VcfReader::NativeHeaderUpdated() {
   VcfHeaderConverter::ConvertToPb(header_, &vcf_header_);
+  vector<string> infos_to_include(options_.included_info_fields().begin(),
+                                  options_.included_info_fields().end());
   vector<string> infos_to_exclude(options_.excluded_info_fields().begin(),
                                   options_.excluded_info_fields().end());
+  vector<string> formats_to_include(options_.included_format_fields().begin(),
+                                    options_.included_format_fields().end());
   vector<string> formats_to_exclude(options_.excluded_format_fields().begin(),
                                     options_.excluded_format_fields().end());
-  record_converter_ =
-      VcfRecordConverter(vcf_header_, infos_to_exclude, formats_to_exclude,
-                         options_.store_gl_and_pl_in_info_map());
+  record_converter_ = VcfRecordConverter(
+      vcf_header_, header_, infos_to_include, infos_to_exclude,
+      formats_to_include, formats_to_exclude,
+      options_.store_gl_and_pl_in_info_map(), options_.omit_call_set_names());
+  n_header_records_ = header_->nhrec;
+}
+
+void VcfReader::NativeHeaderExtended() {
+  const int first_info = vcf_header_.infos_size();
+  const int first_format = vcf_header_.formats_size();
+  VcfHeaderConverter::AppendToPb(header_, n_header_records_, &vcf_header_);
+  n_header_records_ = header_->nhrec;
+  record_converter_.AddFields(vcf_header_, header_, first_info, first_format);
 }
 
 VcfReader::VcfReader(const string& vcf_filepath,
                      const nucleus::genomics::v1::VcfReaderOptions& options,
-                     htsFile* fp, bcf_hdr_t* header, tbx_t* idx)
+                     htsFile* fp, bcf_hdr_t* header, tbx_t* idx,
+                     hts_idx_t* csi_idx,
+                     std::unique_ptr<VcfFilterExpression> filter)
     : vcf_filepath_(vcf_filepath),
       options_(options),
       fp_(fp),
       header_(header),
       idx_(idx),
+      csi_idx_(csi_idx),
+      filter_(std::move(filter)),
       bcf1_(bcf_init()) {
   NativeHeaderUpdated();
 }
@@ -212,6 +412,22 @@ StatusOr<std::shared_ptr<VariantIterable>> VcfReader::Query(
     return tf::errors::InvalidArgument(
         "Malformed region '", region.ShortDebugString(), "'");
 
+  if (csi_idx_ != nullptr) {
+    // BCF indices are keyed by the contig's id in the header, so every contig
+    // known to the header can be queried. Contigs without records yield an
+    // iterator that is immediately exhausted.
+    const int rid = bcf_hdr_name2id(header_, reference_name);
+    hts_itr_t* iter =
+        bcf_itr_queryi(csi_idx_, rid, region.start(), region.end());
+    if (iter == nullptr) {
+      return tf::errors::NotFound(
+          "region '", region.ShortDebugString(),
+          "' returned an invalid bcf_itr_queryi result");
+    }
+    return StatusOr<std::shared_ptr<VariantIterable>>(
+        MakeIterable<BcfQueryIterable>(this, fp_, header_, iter));
+  }
+
   // Get the tid (index of reference_name in our tabix index),
   const int tid = tbx_name2id(idx_, reference_name);
   hts_itr_t* iter = nullptr;
@@ -231,6 +447,55 @@ StatusOr<std::shared_ptr<VariantIterable>> VcfReader::Query(
       MakeIterable<VcfQueryIterable>(this, fp_, header_, idx_, iter));
 }
 
+StatusOr<std::shared_ptr<GenotypeMatrixIterable>>
+VcfReader::IterateGenotypeMatrices(int64 batch_size, int ploidy) {
+  return MakeGenotypeMatrixIterable(Iterate(), batch_size, ploidy);
+}
+
+StatusOr<std::shared_ptr<GenotypeMatrixIterable>>
+VcfReader::QueryGenotypeMatrices(const Range& region, int64 batch_size,
+                                 int ploidy) {
+  return MakeGenotypeMatrixIterable(Query(region), batch_size, ploidy);
+}
+
+StatusOr<std::shared_ptr<GenotypeMatrixIterable>>
+VcfReader::MakeGenotypeMatrixIterable(
+    StatusOr<std::shared_ptr<VariantIterable>> iterable, int64 batch_size,
+    int ploidy) {
+  if (ploidy <= 0) {
+    return tf::errors::InvalidArgument("ploidy must be positive, got ",
+                                       ploidy);
+  }
+  TF_RETURN_IF_ERROR(iterable.status());
+  if (iterable.ValueOrDie() == nullptr) {
+    return tf::errors::FailedPrecondition(
+        "Cannot read genotypes while another iterable is live");
+  }
+  return std::make_shared<GenotypeMatrixIterable>(
+      iterable.ConsumeValueOrDie(), bcf_hdr_nsamples(header_), batch_size,
+      ploidy);
+}
+
+StatusOr<std::shared_ptr<VariantViewIterable>> VcfReader::IterateViews() {
+  return MakeVariantViewIterable(Iterate());
+}
+
+StatusOr<std::shared_ptr<VariantViewIterable>> VcfReader::QueryViews(
+    const Range& region) {
+  return MakeVariantViewIterable(Query(region));
+}
+
+StatusOr<std::shared_ptr<VariantViewIterable>>
+VcfReader::MakeVariantViewIterable(
+    StatusOr<std::shared_ptr<VariantIterable>> iterable) {
+  TF_RETURN_IF_ERROR(iterable.status());
+  if (iterable.ValueOrDie() == nullptr) {
+    return tf::errors::FailedPrecondition(
+        "Cannot read variant views while another iterable is live");
+  }
+  return std::make_shared<VariantViewIterable>(iterable.ConsumeValueOrDie());
+}
+
 tf::Status VcfReader::FromString(
     const absl::string_view& vcf_line, nucleus::genomics::v1::Variant* v) {
   size_t len = vcf_line.length();
@@ -249,7 +514,7 @@ tf::Status VcfReader::FromString(
   if (bcf1_->errcode == BCF_ERR_CTG_UNDEF ||
       bcf1_->errcode == BCF_ERR_TAG_UNDEF) {
     bcf1_->errcode = 0;
-    NativeHeaderUpdated();
+    NativeHeaderExtended();
   }
 
   if (bcf1_->errcode != 0) {
@@ -261,6 +526,57 @@ tf::Status VcfReader::FromString(
   return tf::Status::OK();
 }
 
+tf::Status VcfReader::FromStrings(absl::string_view vcf_lines, int num_threads,
+                                  vector<Variant>* variants) {
+  if (header_ == nullptr) {
+    return tf::errors::FailedPrecondition(
+        "Cannot parse records with a closed VcfReader.");
+  }
+  // vcf_parse tokenizes records in place, so parse all of them from a single
+  // mutable copy of the buffer rather than copying each line.
+  string buffer(vcf_lines);
+  vector<absl::string_view> lines;
+  vector<kstring_t> records;
+  size_t pos = 0;
+  while (pos < buffer.size()) {
+    size_t eol = buffer.find('\n', pos);
+    if (eol == string::npos) eol = buffer.size();
+    size_t len = eol - pos;
+    if (len > 0 && buffer[pos + len - 1] == '\r') --len;
+    if (len > 0) {
+      buffer[pos + len] = '\0';
+      lines.push_back(vcf_lines.substr(pos, len));
+      records.push_back({len, len + 1, &buffer[pos]});
+    }
+    pos = eol + 1;
+  }
+
+  const int64 n_lines = records.size();
+  variants->clear();
+  variants->resize(n_lines);
+  const int n_shards = NumShards(num_threads, n_lines);
+  vector<int64> first_unparsed(n_shards);
+  vector<tf::Status> statuses(n_shards);
+  auto parse_shard = [&](int shard) {
+    statuses[shard] = ParseRecords(
+        header_, record_converter_, &records, n_lines * shard / n_shards,
+        n_lines * (shard + 1) / n_shards, variants, &first_unparsed[shard]);
+  };
+  RunShards("vcf_from_strings", n_shards, parse_shard);
+
+  for (int shard = 0; shard < n_shards; ++shard) {
+    TF_RETURN_IF_ERROR(statuses[shard]);
+    if (first_unparsed[shard] < n_lines * (shard + 1) / n_shards) {
+      // Parse the remaining lines serially, updating the header as needed.
+      for (int64 i = first_unparsed[shard]; i < n_lines; ++i) {
+        TF_RETURN_IF_ERROR(FromString(lines[i], &(*variants)[i]));
+      }
+      break;
+    }
+  }
+  return tf::Status::OK();
+}
+
 StatusOr<bool> VcfReader::FromStringPython(
     const absl::string_view& vcf_line, nucleus::genomics::v1::Variant* v) {
   tf::Status s = FromString(vcf_line, v);
@@ -273,10 +589,14 @@ StatusOr<bool> VcfReader::FromStringPython(
 tf::Status VcfReader::Close() {
   if (fp_ == nullptr)
     return tf::errors::FailedPrecondition("VcfReader already closed");
-  if (HasIndex()) {
+  if (idx_ != nullptr) {
     tbx_destroy(idx_);
     idx_ = nullptr;
   }
+  if (csi_idx_ != nullptr) {
+    hts_idx_destroy(csi_idx_);
+    csi_idx_ = nullptr;
+  }
   bcf_hdr_destroy(header_);
   header_ = nullptr;
   int retval = hts_close(fp_);
@@ -290,21 +610,99 @@ tf::Status VcfReader::Close() {
 
 // Iterable class definitions.
 
-StatusOr<bool> VcfQueryIterable::Next(Variant* out) {
+GenotypeMatrixIterable::GenotypeMatrixIterable(
+    std::shared_ptr<VariantIterable> iterable, int num_samples,
+    int64 batch_size, int ploidy)
+    : iterable_(std::move(iterable)),
+      batch_size_(batch_size),
+      builder_(num_samples, ploidy) {}
+
+StatusOr<bool> GenotypeMatrixIterable::Next(GenotypeMatrix* matrix) {
+  // All VCF iterables handed out by VcfReader share this base class.
+  auto* native_iterable = static_cast<VcfIterableBase*>(iterable_.get());
+  while (batch_size_ <= 0 || builder_.num_variants() < batch_size_) {
+    StatusOr<bool> has_next = native_iterable->NextNative();
+    TF_RETURN_IF_ERROR(has_next.status());
+    if (!has_next.ValueOrDie()) break;
+    TF_RETURN_IF_ERROR(builder_.Add(native_iterable->native_header(),
+                                    native_iterable->native_record()));
+  }
+  const bool has_variants = builder_.num_variants() > 0;
+  builder_.Finish(matrix);
+  return has_variants;
+}
+
+StatusOr<bool> GenotypeMatrixIterable::PythonNext(
+    DenseArray<int32>* contig_ids, DenseArray<int64>* starts,
+    DenseArray<int8>* genotypes, DenseArray<int8>* dosages,
+    DenseArray<uint8>* missing, DenseArray<uint8>* phased) {
+  GenotypeMatrix matrix;
+  StatusOr<bool> has_next = Next(&matrix);
+  *contig_ids = std::move(matrix.contig_ids);
+  *starts = std::move(matrix.starts);
+  *genotypes = std::move(matrix.genotypes);
+  *dosages = std::move(matrix.dosages);
+  *missing = std::move(matrix.missing);
+  *phased = std::move(matrix.phased);
+  return has_next;
+}
+
+StatusOr<bool> VariantViewIterable::Next(VcfVariantView* view) {
+  // All VCF iterables handed out by VcfReader share this base class.
+  auto* native_iterable = static_cast<VcfIterableBase*>(iterable_.get());
+  StatusOr<bool> has_next = native_iterable->NextNative();
+  TF_RETURN_IF_ERROR(has_next.status());
+  if (!has_next.ValueOrDie()) return false;
+  *view = VcfVariantView(native_iterable->native_header(),
+                         native_iterable->native_record());
+  return true;
+}
+
+StatusOr<bool> VcfIterableBase::Next(Variant* out) {
+  StatusOr<bool> has_next = NextNative();
+  if (!has_next.ok() || !has_next.ValueOrDie()) return has_next;
+  const VcfReader* reader = static_cast<const VcfReader*>(reader_);
+  TF_RETURN_IF_ERROR(
+      reader->RecordConverter().ConvertToPb(header_, bcf1_, out));
+  return true;
+}
+
+StatusOr<bool> VcfIterableBase::NextNative() {
   TF_RETURN_IF_ERROR(CheckIsAlive());
+  const VcfFilterExpression* filter =
+      static_cast<const VcfReader*>(reader_)->Filter();
+  while (true) {
+    StatusOr<bool> has_next = ReadNextRecord();
+    if (!has_next.ok() || !has_next.ValueOrDie() || filter == nullptr ||
+        filter->Matches(VcfVariantView(header_, bcf1_))) {
+      return has_next;
+    }
+  }
+}
+
+VcfIterableBase::VcfIterableBase(const VcfReader* reader,
+                                 htsFile* fp,
+                                 bcf_hdr_t* header)
+    : Iterable(reader),
+      fp_(fp),
+      header_(header),
+      bcf1_(bcf_init())
+{}
+
+VcfIterableBase::~VcfIterableBase() {
+  bcf_destroy(bcf1_);
+}
+
+StatusOr<bool> VcfQueryIterable::ReadNextRecord() {
   if (tbx_itr_next(fp_, idx_, iter_, &str_) < 0) return false;
   if (vcf_parse1(&str_, header_, bcf1_) < 0) {
     return tf::errors::DataLoss("Failed to parse VCF record: ", str_.s);
   }
-  const VcfReader* reader = static_cast<const VcfReader*>(reader_);
-  TF_RETURN_IF_ERROR(
-      reader->RecordConverter().ConvertToPb(header_, bcf1_, out));
   return true;
 }
 
 VcfQueryIterable::~VcfQueryIterable() {
   hts_itr_destroy(iter_);
-  bcf_destroy(bcf1_);
   if (str_.s != nullptr) { free(str_.s); }
 }
 
@@ -313,18 +711,40 @@ VcfQueryIterable::VcfQueryIterable(const VcfReader* reader,
                                    bcf_hdr_t* header,
                                    tbx_t* idx,
                                    hts_itr_t* iter)
-    : Iterable(reader),
-      fp_(fp),
-      header_(header),
-      bcf1_(bcf_init()),
+    : VcfIterableBase(reader, fp, header),
       idx_(idx),
       iter_(iter),
       str_({0, 0, nullptr})
 {}
 
+StatusOr<bool> BcfQueryIterable::ReadNextRecord() {
+  // bcf_itr_next returns -1 at the end of the region and < -1 on errors.
+  const int ret = bcf_itr_next(fp_, iter_, bcf1_);
+  if (ret == -1) return false;
+  if (ret < -1 || bcf1_->errcode) {
+    return tf::errors::DataLoss("Failed to read BCF record");
+  }
+  // Unlike bcf_read, the index iterator doesn't apply the sample selection of
+  // the header, so drop the unselected samples here.
+  if (header_->keep_samples && bcf_subset_format(header_, bcf1_) != 0) {
+    return tf::errors::DataLoss("Failed to subset samples of BCF record");
+  }
+  return true;
+}
 
-StatusOr<bool> VcfFullFileIterable::Next(Variant* out) {
-  TF_RETURN_IF_ERROR(CheckIsAlive());
+BcfQueryIterable::~BcfQueryIterable() {
+  hts_itr_destroy(iter_);
+}
+
+BcfQueryIterable::BcfQueryIterable(const VcfReader* reader,
+                                   htsFile* fp,
+                                   bcf_hdr_t* header,
+                                   hts_itr_t* iter)
+    : VcfIterableBase(reader, fp, header),
+      iter_(iter)
+{}
+
+StatusOr<bool> VcfFullFileIterable::ReadNextRecord() {
   if (bcf_read(fp_, header_, bcf1_) < 0) {
     if (bcf1_->errcode) {
       return tf::errors::DataLoss("Failed to parse VCF record");
@@ -332,23 +752,13 @@ StatusOr<bool> VcfFullFileIterable::Next(Variant* out) {
       return false;
     }
   }
-  const VcfReader* reader = static_cast<const VcfReader*>(reader_);
-  TF_RETURN_IF_ERROR(
-      reader->RecordConverter().ConvertToPb(header_, bcf1_, out));
   return true;
 }
 
-VcfFullFileIterable::~VcfFullFileIterable() {
-  bcf_destroy(bcf1_);
-}
-
 VcfFullFileIterable::VcfFullFileIterable(const VcfReader* reader,
                                          htsFile* fp,
                                          bcf_hdr_t* header)
-    : Iterable(reader),
-      fp_(fp),
-      header_(header),
-      bcf1_(bcf_init())
+    : VcfIterableBase(reader, fp, header)
 {}
 
 }  // namespace nucleus
@@ -20,18 +20,24 @@
 
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/strings/string_view.h"
 #include "htslib/hts.h"
 #include "htslib/sam.h"
 #include "htslib/tbx.h"
 #include "htslib/vcf.h"
+#include "nucleus/io/genotype_matrix.h"
 #include "nucleus/io/reader_base.h"
 #include "nucleus/io/vcf_conversion.h"
+#include "nucleus/io/vcf_filter.h"
+#include "nucleus/io/vcf_variant_view.h"
 #include "nucleus/platform/types.h"
 #include "nucleus/protos/range.pb.h"
 #include "nucleus/protos/reference.pb.h"
 #include "nucleus/protos/variants.pb.h"
+#include "nucleus/util/dense_array.h"
 #include "nucleus/vendor/statusor.h"
 #include "tensorflow/core/lib/core/status.h"
 
@@ -41,7 +47,65 @@ namespace nucleus {
 // Alias for the abstract base class for VCF record iterables.
 using VariantIterable = Iterable<nucleus::genomics::v1::Variant>;
 
-// A VCF reader that provides access to Tabix indexed VCF files.
+// Iterates over the variants of a VcfReader in batches, each decoded into a
+// GenotypeMatrix straight from the htslib records. Created by
+// VcfReader::IterateGenotypeMatrices and VcfReader::QueryGenotypeMatrices.
+// Like the VariantIterables it wraps, only one can be live per reader.
+class GenotypeMatrixIterable {
+ public:
+  GenotypeMatrixIterable(std::shared_ptr<VariantIterable> iterable,
+                         int num_samples, int64 batch_size, int ploidy);
+
+  // Decodes the next batch of up to batch_size variants, or all remaining
+  // variants if batch_size <= 0, into |matrix|. Returns false, with an empty
+  // |matrix|, once all variants have been returned.
+  StatusOr<bool> Next(GenotypeMatrix* matrix);
+
+  // Same as Next, but returns the arrays of the matrix separately so that CLIF
+  // can hand them to Python as numpy arrays.
+  StatusOr<bool> PythonNext(DenseArray<int32>* contig_ids,
+                            DenseArray<int64>* starts,
+                            DenseArray<int8>* genotypes,
+                            DenseArray<int8>* dosages,
+                            DenseArray<uint8>* missing,
+                            DenseArray<uint8>* phased);
+
+  // Releases the underlying iterable so the reader can be iterated again.
+  tensorflow::Status Release() { return iterable_->Release(); }
+
+  // Python context manager support.
+  tensorflow::Status PythonEnter() { return iterable_->PythonEnter(); }
+  tensorflow::Status PythonExit() { return iterable_->PythonExit(); }
+
+ private:
+  std::shared_ptr<VariantIterable> iterable_;
+  const int64 batch_size_;
+  GenotypeMatrixBuilder builder_;
+};
+
+// Iterates over the variants of a VcfReader as VcfVariantViews of the htslib
+// records, without converting them to Variant protos. Created by
+// VcfReader::IterateViews and VcfReader::QueryViews. Like the VariantIterables
+// it wraps, only one can be live per reader.
+class VariantViewIterable {
+ public:
+  explicit VariantViewIterable(std::shared_ptr<VariantIterable> iterable)
+      : iterable_(std::move(iterable)) {}
+
+  // Points |view| at the next variant. Returns false once all variants have
+  // been returned. The view is only valid until the next call to Next or
+  // Release.
+  StatusOr<bool> Next(VcfVariantView* view);
+
+  // Releases the underlying iterable so the reader can be iterated again.
+  tensorflow::Status Release() { return iterable_->Release(); }
+
+ private:
+  std::shared_ptr<VariantIterable> iterable_;
+};
+
+// A VCF reader that provides access to Tabix indexed VCF files and CSI indexed
+// BCF files.
 //
 // VCF files store information about genetic variation:
 //
@@ -55,7 +119,8 @@ using VariantIterable = Iterable<nucleus::genomics::v1::Variant>;
 //
 // This class provides methods to iterate through a VCF file or, if indexed
 // with Tabix, to also query() for only variants overlapping a specific regions
-// on the genome.
+// on the genome. BGZF-compressed BCF files indexed with CSI support query() as
+// well, and avoid the text parsing step entirely.
 //
 // The objects returned by iterate() or query() are nucleus.genomics.v1.Variant
 // objects parsed from the VCF records in the file. Currently all fields except
@@ -70,7 +135,8 @@ class VcfReader : public Reader {
   //
   // If the filetype is indexable (BGZF'd vcf.gz) his constructor will attempt
   // to load an Tabix index from file variantsPath + '.tbi', to support
-  // subsequent Query operations.
+  // subsequent Query operations. For BGZF'd BCF files a CSI index is loaded
+  // from variantsPath + '.csi' instead.
   //
   // Returns a StatusOr that is OK if the VcfReader could be successfully
   // created or an error code indicating the error that occurred.
@@ -121,6 +187,28 @@ class VcfReader : public Reader {
   StatusOr<std::shared_ptr<VariantIterable>> Query(
       const nucleus::genomics::v1::Range& region);
 
+  // Gets all of the variants in this file in batches of up to |batch_size|
+  // variants (all of them if batch_size <= 0), decoded into dense
+  // GenotypeMatrix arrays with room for |ploidy| alleles per call.
+  StatusOr<std::shared_ptr<GenotypeMatrixIterable>> IterateGenotypeMatrices(
+      int64 batch_size, int ploidy);
+
+  // Same as IterateGenotypeMatrices, but only for the variants that overlap
+  // |region|, as with Query.
+  StatusOr<std::shared_ptr<GenotypeMatrixIterable>> QueryGenotypeMatrices(
+      const nucleus::genomics::v1::Range& region, int64 batch_size,
+      int ploidy);
+
+  // Gets all of the variants in this file in order as VcfVariantViews. The
+  // INFO and FORMAT field selection options only apply to Variant protos;
+  // views see every field of the (sample-subsetted) records.
+  StatusOr<std::shared_ptr<VariantViewIterable>> IterateViews();
+
+  // Same as IterateViews, but only for the variants that overlap |region|, as
+  // with Query.
+  StatusOr<std::shared_ptr<VariantViewIterable>> QueryViews(
+      const nucleus::genomics::v1::Range& region);
+
   // Parses vcf_line and puts the result into v.
   tensorflow::Status FromString(const absl::string_view& vcf_line,
                                 nucleus::genomics::v1::Variant* v);
@@ -129,8 +217,21 @@ class VcfReader : public Reader {
   StatusOr<bool> FromStringPython(const absl::string_view& vcf_line,
                                   nucleus::genomics::v1::Variant* v);
 
+  // Parses the newline-separated VCF records in |vcf_lines| into |variants|,
+  // one Variant per non-empty line, splitting the lines across up to
+  // |num_threads| threads. The result is the same as calling FromString on
+  // each line in order, but the records are parsed in place from a single
+  // copy of |vcf_lines|, each thread with its own htslib record. Records that
+  // refer to contigs or fields missing from the header update it as with
+  // FromString; the lines from the first such record on are parsed serially.
+  // Like FromString, must not be called concurrently with other methods of
+  // this reader. On error, the contents of |variants| are unspecified.
+  tensorflow::Status FromStrings(
+      absl::string_view vcf_lines, int num_threads,
+      std::vector<nucleus::genomics::v1::Variant>* variants);
+
   // Returns True if this VcfReader loaded an index file.
-  bool HasIndex() const { return idx_ != nullptr; }
+  bool HasIndex() const { return idx_ != nullptr || csi_idx_ != nullptr; }
 
   // Returns the VCF header associated with this reader.
   const nucleus::genomics::v1::VcfHeader& Header() const { return vcf_header_; }
@@ -153,10 +254,14 @@ class VcfReader : public Reader {
     return record_converter_;
   }
 
+  // The compiled filter_expression of the options, or null if there is none.
+  const VcfFilterExpression* Filter() const { return filter_.get(); }
+
  private:
   VcfReader(const string& variants_path,
             const nucleus::genomics::v1::VcfReaderOptions& options, htsFile* fp,
-            bcf_hdr_t* header, tbx_t* idx);
+            bcf_hdr_t* header, tbx_t* idx, hts_idx_t* csi_idx,
+            std::unique_ptr<VcfFilterExpression> filter);
 
   // Shared by FromFile methods. If |h| is non-null, use it as the header for
   // the vcf file at |vcf_filepath|.
@@ -164,11 +269,28 @@ class VcfReader : public Reader {
       const string& vcf_filepath,
       const nucleus::genomics::v1::VcfReaderOptions& options, bcf_hdr_t* h);
 
+  // Shared by the GenotypeMatrix methods. Wraps |iterable|, the result of
+  // Iterate or Query.
+  StatusOr<std::shared_ptr<GenotypeMatrixIterable>> MakeGenotypeMatrixIterable(
+      StatusOr<std::shared_ptr<VariantIterable>> iterable, int64 batch_size,
+      int ploidy);
+
+  // Shared by IterateViews and QueryViews. Wraps |iterable|, the result of
+  // Iterate or Query.
+  StatusOr<std::shared_ptr<VariantViewIterable>> MakeVariantViewIterable(
+      StatusOr<std::shared_ptr<VariantIterable>> iterable);
+
   // Helper method to update other member variables when |header_| is changed.
   // This can happen during initialization or when a new header field is
   // encountered while reading.
   void NativeHeaderUpdated();
 
+  // Helper method to bring the other member variables up to date when htslib
+  // has appended contigs or fields to |header_|, as it does when a parsed
+  // record refers to ones the header doesn't define. Only the new entries are
+  // converted.
+  void NativeHeaderExtended();
+
   // Path to the vcf file.
   const string vcf_filepath_;
 
@@ -185,14 +307,25 @@ class VcfReader : public Reader {
   // index was loaded.
   tbx_t* idx_;
 
+  // The htslib hts_idx_t data structure for CSI indexed BCF files. May be NULL
+  // if no index was loaded. At most one of idx_ and csi_idx_ is non-NULL.
+  hts_idx_t* csi_idx_;
+
   // The VcfHeader data structure that represents the information in the header
   // of the VCF.
   nucleus::genomics::v1::VcfHeader vcf_header_;
 
+  // The number of header records of |header_| reflected in vcf_header_.
+  int n_header_records_ = 0;
+
   // Object for converting VCF records to to Variant proto.
   VcfRecordConverter record_converter_;
 
-  // htslib's representation of a parsed vcf line.  Only used by FromString.
+  // The compiled filter_expression of options_. May be NULL.
+  const std::unique_ptr<VcfFilterExpression> filter_;
+
+  // htslib's representation of a parsed vcf line.  Only used by FromString
+  // and the serial part of FromStrings.
   bcf1_t* bcf1_;
 };
 
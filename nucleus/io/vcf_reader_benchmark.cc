@@ -0,0 +1,149 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares read throughput of VcfReader on a wide-annotation VCF, as produced
+// by VEP-style annotators, under various INFO/FORMAT field projections.
+//
+// Usage: bazel run //nucleus/io:vcf_reader_benchmark -- [n_records]
+//
+// The input is synthesized: every record carries kNumInfoFields INFO keys and
+// a few FORMAT fields for kNumSamples samples.
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "nucleus/io/vcf_reader.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/testing/test_utils.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace nucleus {
+namespace {
+
+using genomics::v1::Variant;
+using genomics::v1::VcfReaderOptions;
+
+constexpr int kNumInfoFields = 200;
+constexpr int kNumSamples = 4;
+
+struct Config {
+  string name;
+  VcfReaderOptions options;
+};
+
+// Writes a VCF with |n_records| records to |path|.
+void WriteWideVcf(const string& path, int n_records) {
+  string vcf = "##fileformat=VCFv4.2\n##contig=<ID=chr1,length=248956422>\n";
+  for (int i = 0; i < kNumInfoFields; ++i) {
+    absl::StrAppend(&vcf, "##INFO=<ID=ANN", i,
+                    ",Number=1,Type=", i % 2 ? "Integer" : "String",
+                    ",Description=\"Annotation ", i, "\">\n");
+  }
+  absl::StrAppend(
+      &vcf,
+      "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+      "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Quality\">\n"
+      "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Depth\">\n"
+      "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Depths\">\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT");
+  for (int s = 0; s < kNumSamples; ++s) absl::StrAppend(&vcf, "\tS", s);
+  vcf += "\n";
+  for (int r = 0; r < n_records; ++r) {
+    absl::StrAppend(&vcf, "chr1\t", 100 + 10 * r, "\t.\tA\tG\t50\tPASS\t");
+    for (int i = 0; i < kNumInfoFields; ++i) {
+      if (i > 0) vcf += ";";
+      if (i % 2) {
+        absl::StrAppend(&vcf, "ANN", i, "=", r + i);
+      } else {
+        absl::StrAppend(&vcf, "ANN", i, "=consequence_", i);
+      }
+    }
+    vcf += "\tGT:GQ:DP:AD";
+    for (int s = 0; s < kNumSamples; ++s) vcf += "\t0/1:40:20:10,10";
+    vcf += "\n";
+  }
+  TF_CHECK_OK(
+      tensorflow::WriteStringToFile(tensorflow::Env::Default(), path, vcf));
+}
+
+std::vector<Config> MakeConfigs() {
+  std::vector<Config> configs;
+  configs.push_back({"all fields", VcfReaderOptions()});
+
+  VcfReaderOptions excluded;
+  for (int i = 2; i < kNumInfoFields; ++i) {
+    excluded.add_excluded_info_fields(absl::StrCat("ANN", i));
+  }
+  configs.push_back({"2 INFO via excluded_info_fields", excluded});
+
+  VcfReaderOptions included;
+  included.add_included_info_fields("ANN0");
+  included.add_included_info_fields("ANN1");
+  configs.push_back({"2 INFO via included_info_fields", included});
+
+  VcfReaderOptions included_gt = included;
+  included_gt.add_included_format_fields("GT");
+  configs.push_back({"2 INFO + GT", included_gt});
+
+  VcfReaderOptions sites = included;
+  sites.set_sites_only(true);
+  configs.push_back({"2 INFO sites_only", sites});
+  return configs;
+}
+
+void Run(int n_records) {
+  const string path = MakeTempFile("vcf_reader_benchmark.vcf");
+  WriteWideVcf(path, n_records);
+
+  std::cout << absl::StrFormat("%-36s %10s %14s\n", "config", "seconds",
+                               "records/s");
+  for (const Config& config : MakeConfigs()) {
+    const absl::Time start = absl::Now();
+    int64 n_read = 0;
+    {
+      std::unique_ptr<VcfReader> reader =
+          std::move(VcfReader::FromFile(path, config.options).ValueOrDie());
+      auto iterable = reader->Iterate().ValueOrDie();
+      Variant variant;
+      while (iterable->Next(&variant).ValueOrDie()) ++n_read;
+    }
+    CHECK_EQ(n_records, n_read);
+    const double seconds = absl::ToDoubleSeconds(absl::Now() - start);
+    std::cout << absl::StrFormat("%-36s %10.3f %14.0f\n", config.name, seconds,
+                                 n_read / seconds);
+  }
+  TF_CHECK_OK(tensorflow::Env::Default()->DeleteFile(path));
+}
+
+}  // namespace
+}  // namespace nucleus
+
+int main(int argc, char** argv) {
+  const int n_records = argc > 1 ? atoi(argv[1]) : 100000;
+  CHECK_GT(n_records, 0) << "n_records must be positive";
+  nucleus::Run(n_records);
+  return 0;
+}
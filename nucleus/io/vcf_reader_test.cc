@@ -18,6 +18,7 @@
 #include "nucleus/io/vcf_reader.h"
 
 #include <stddef.h>
+#include <set>
 #include <utility>
 #include <vector>
 
@@ -28,6 +29,10 @@
 #include <gmock/gmock-more-matchers.h>
 
 #include "tensorflow/core/platform/test.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "nucleus/io/tabix_indexer.h"
+#include "nucleus/io/vcf_writer.h"
 #include "nucleus/protos/struct.pb.h"
 #include "nucleus/protos/variants.pb.h"
 #include "nucleus/testing/protocol-buffer-matchers.h"
@@ -35,6 +40,7 @@
 #include "nucleus/util/utils.h"
 #include "nucleus/vendor/status_matchers.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
 
 namespace nucleus {
 
@@ -323,6 +329,15 @@ TEST_F(VcfWithSamplesReaderTest, IterationWorksWithIndex) {
   EXPECT_THAT(as_vector(reader_->Iterate()), Pointwise(EqualsProto(), golden_));
 }
 
+TEST_F(VcfWithSamplesReaderTest, IterationAndQueryWorkWithThreads) {
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.set_num_threads(2);
+  RecreateReader(&options);
+  EXPECT_THAT(as_vector(reader_->Iterate()), Pointwise(EqualsProto(), golden_));
+  EXPECT_THAT(as_vector(reader_->Query(MakeRange("chr1", 0, CHR1_SIZE))),
+              SizeIs(711));
+}
+
 TEST_F(VcfWithSamplesReaderTest, FilteringInfoFieldsWorks) {
   // Checks that iterate() filters FORMAT fields out as we expect.
   nucleus::genomics::v1::VcfReaderOptions options;
@@ -447,6 +462,377 @@ TEST_F(VcfWithSamplesReaderTest, WholeChromosomeQueries) {
               SizeIs(2));
 }
 
+// Writes the indexed samples VCF out as a CSI indexed BCF, so the BCF query
+// path can be checked against the tabix one.
+class BcfWithSamplesReaderTest : public VcfWithSamplesReaderTest {
+ protected:
+  void SetUp() override {
+    VcfWithSamplesReaderTest::SetUp();
+    bcf_ = MakeTempFile("test_samples.bcf.gz");
+    std::unique_ptr<VcfWriter> writer = std::move(
+        VcfWriter::ToFile(bcf_, reader_->Header(),
+                          nucleus::genomics::v1::VcfWriterOptions())
+            .ValueOrDie());
+    for (const Variant& v : golden_) {
+      TF_CHECK_OK(writer->Write(v));
+    }
+    TF_CHECK_OK(writer->Close());
+    TF_CHECK_OK(BcfIndexBuild(bcf_, 14));
+    bcf_reader_ = std::move(
+        VcfReader::FromFile(bcf_, nucleus::genomics::v1::VcfReaderOptions())
+            .ValueOrDie());
+  }
+
+  string bcf_;
+  std::unique_ptr<VcfReader> bcf_reader_;
+};
+
+TEST_F(BcfWithSamplesReaderTest, LoadsIndex) {
+  EXPECT_TRUE(bcf_reader_->HasIndex());
+}
+
+TEST_F(BcfWithSamplesReaderTest, QueryMatchesTabixQuery) {
+  for (const auto& range :
+       {MakeRange("chr1", 0, CHR1_SIZE), MakeRange("chr2", 0, CHR2_SIZE),
+        MakeRange("chr3", 14317, 14319), MakeRange("chr3", 99999, 500000),
+        MakeRange("chrX", 0, CHRX_SIZE)}) {
+    EXPECT_THAT(as_vector(bcf_reader_->Query(range)),
+                Pointwise(EqualsProto(), as_vector(reader_->Query(range))));
+  }
+}
+
+TEST_F(BcfWithSamplesReaderTest, QueryRangesIsCorrect) {
+  EXPECT_THAT(as_vector(bcf_reader_->Query(MakeRange("chr3", 14318, 14319))),
+              SizeIs(1));
+  EXPECT_THAT(as_vector(bcf_reader_->Query(MakeRange("chr3", 14317, 14318))),
+              SizeIs(0));
+  EXPECT_THAT(as_vector(bcf_reader_->Query(MakeRange("chr3", 14319, 14320))),
+              SizeIs(0));
+  EXPECT_THAT(as_vector(bcf_reader_->Query(MakeRange("chr1", 0, CHR1_SIZE))),
+              SizeIs(711));
+  // There aren't any variants on the valid contig "chr4".
+  EXPECT_THAT(as_vector(bcf_reader_->Query(MakeRange("chr4", 9999, 50000))),
+              SizeIs(0));
+}
+
+TEST_F(BcfWithSamplesReaderTest, QueryWithoutIndexFails) {
+  const string unindexed = MakeTempFile("unindexed.bcf.gz");
+  TF_CHECK_OK(tensorflow::Env::Default()->CopyFile(bcf_, unindexed));
+  std::unique_ptr<VcfReader> reader = std::move(
+      VcfReader::FromFile(unindexed, nucleus::genomics::v1::VcfReaderOptions())
+          .ValueOrDie());
+  EXPECT_FALSE(reader->HasIndex());
+  EXPECT_THAT(reader->Query(MakeRange("chr1", 0, 100)), Not(IsOK()));
+  EXPECT_THAT(as_vector(reader->Iterate()), Pointwise(EqualsProto(), golden_));
+}
+
+TEST_F(BcfWithSamplesReaderTest, SitesOnlyDropsCalls) {
+  vector<Variant> sites = golden_;
+  for (Variant& v : sites) v.clear_calls();
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.set_sites_only(true);
+  for (const string& path : {indexed_vcf_, bcf_}) {
+    std::unique_ptr<VcfReader> reader =
+        std::move(VcfReader::FromFile(path, options).ValueOrDie());
+    EXPECT_THAT(reader->Header().sample_names(), SizeIs(0));
+    EXPECT_THAT(as_vector(reader->Iterate()), Pointwise(EqualsProto(), sites));
+    EXPECT_THAT(as_vector(reader->Query(MakeRange("chr3", 99999, 500000))),
+                SizeIs(4));
+  }
+}
+
+TEST_F(VcfWithSamplesReaderTest, ExcludingAllFormatFieldsKeepsCallNames) {
+  // With no FORMAT field to decode, the per-sample data is never unpacked but
+  // the calls still carry their sample names.
+  nucleus::genomics::v1::VcfReaderOptions options;
+  for (const auto& format : reader_->Header().formats()) {
+    options.add_excluded_format_fields(format.id());
+  }
+  RecreateReader(&options);
+  vector<Variant> expected = golden_;
+  for (Variant& v : expected) {
+    for (auto& call : *v.mutable_calls()) {
+      const string name = call.call_set_name();
+      call.Clear();
+      call.set_call_set_name(name);
+    }
+  }
+  EXPECT_THAT(as_vector(reader_->Iterate()),
+              Pointwise(EqualsProto(), expected));
+}
+
+TEST_F(VcfWithSamplesReaderTest, IncludedFieldsMatchExcludingAllOthers) {
+  // Projecting onto a few fields gives the same records as excluding every
+  // other field of the header.
+  const std::set<string> infos = {"AC", "DP", "END"};
+  const std::set<string> formats = {"GT", "GQ"};
+  nucleus::genomics::v1::VcfReaderOptions exclude_options;
+  for (const auto& info : reader_->Header().infos()) {
+    if (!infos.count(info.id())) {
+      exclude_options.add_excluded_info_fields(info.id());
+    }
+  }
+  for (const auto& format : reader_->Header().formats()) {
+    if (!formats.count(format.id())) {
+      exclude_options.add_excluded_format_fields(format.id());
+    }
+  }
+  RecreateReader(&exclude_options);
+  const vector<Variant> expected = as_vector(reader_->Iterate());
+
+  nucleus::genomics::v1::VcfReaderOptions options;
+  for (const string& info : infos) options.add_included_info_fields(info);
+  for (const string& format : formats) {
+    options.add_included_format_fields(format);
+  }
+  RecreateReader(&options);
+  const vector<Variant> actual = as_vector(reader_->Iterate());
+  EXPECT_THAT(actual, Pointwise(EqualsProto(), expected));
+
+  // Exclusions win over inclusions.
+  options.add_excluded_format_fields("GT");
+  RecreateReader(&options);
+  for (const Variant& v : as_vector(reader_->Iterate())) {
+    for (const auto& call : v.calls()) {
+      EXPECT_EQ(0, call.genotype_size());
+      EXPECT_EQ(1, call.info().count("GQ"));
+    }
+  }
+}
+
+TEST(VcfReaderSamplesTest, OmittedCallSetNamesResolveFromHeader) {
+  const vector<Variant> golden = ReadProtosFromTFRecord<Variant>(
+      GetTestData(kVcfLikelihoodsGoldenFilename));
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.set_omit_call_set_names(true);
+  std::unique_ptr<VcfReader> reader = std::move(
+      VcfReader::FromFile(GetTestData(kVcfLikelihoodsFilename), options)
+          .ValueOrDie());
+  vector<Variant> actual = as_vector(reader->Iterate());
+  for (Variant& v : actual) {
+    for (int i = 0; i < v.calls_size(); ++i) {
+      auto* call = v.mutable_calls(i);
+      EXPECT_TRUE(call->call_set_name().empty());
+      EXPECT_EQ(i, call->call_set_index());
+      call->set_call_set_name(CallSetName(reader->Header(), *call));
+    }
+  }
+  EXPECT_THAT(actual, Pointwise(EqualsProto(), golden));
+}
+
+TEST(VcfReaderSamplesTest, SitesOnlyCannotBeCombinedWithSamples) {
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.set_sites_only(true);
+  options.add_excluded_samples("Fido");
+  EXPECT_THAT(
+      VcfReader::FromFile(GetTestData(kVcfLikelihoodsFilename), options),
+      Not(IsOK()));
+}
+
+// Checks that |matrix| holds the genotypes of |variants|, with room for
+// |ploidy| alleles per call.
+void ExpectMatrixMatchesVariants(const GenotypeMatrix& matrix,
+                                 const vector<Variant>& variants,
+                                 const nucleus::genomics::v1::VcfHeader& header,
+                                 int ploidy) {
+  const int64 n_variants = variants.size();
+  const int n_samples = header.sample_names_size();
+  ASSERT_THAT(matrix.genotypes.shape,
+              testing::ElementsAre(n_variants, n_samples, ploidy));
+  ASSERT_THAT(matrix.phased.shape,
+              testing::ElementsAre(n_variants, (n_samples + 7) / 8));
+  for (int64 row = 0; row < n_variants; ++row) {
+    const Variant& v = variants[row];
+    EXPECT_EQ(v.reference_name(),
+              header.contigs(matrix.contig_ids.values[row]).name());
+    EXPECT_EQ(v.start(), matrix.starts.values[row]);
+    ASSERT_EQ(n_samples, v.calls_size());
+    for (int i = 0; i < n_samples; ++i) {
+      const auto& call = v.calls(i);
+      const int64 cell = row * n_samples + i;
+      bool missing = false;
+      int dosage = 0;
+      for (int j = 0; j < ploidy; ++j) {
+        const int8 allele = matrix.genotypes.values[cell * ploidy + j];
+        if (j < call.genotype_size()) {
+          EXPECT_EQ(call.genotype(j), allele);
+          missing = missing || call.genotype(j) < 0;
+          dosage += call.genotype(j) > 0;
+        } else {
+          EXPECT_EQ(kGenotypeMatrixPadding, allele);
+        }
+      }
+      EXPECT_EQ(missing ? -1 : dosage, matrix.dosages.values[cell]);
+      EXPECT_EQ(missing, matrix.missing.values[cell] == 1);
+      const bool phased =
+          matrix.phased.values[row * ((n_samples + 7) / 8) + i / 8] &
+          (0x80 >> (i % 8));
+      EXPECT_EQ(call.is_phased(), phased);
+    }
+  }
+}
+
+TEST(VcfReaderGenotypeMatrixTest, MatchesVariants) {
+  std::unique_ptr<VcfReader> reader = std::move(
+      VcfReader::FromFile(GetTestData(kVcfPhasesetFilename),
+                          nucleus::genomics::v1::VcfReaderOptions())
+          .ValueOrDie());
+  const vector<Variant> variants = as_vector(reader->Iterate());
+  auto matrices = reader->IterateGenotypeMatrices(0, 2).ValueOrDie();
+  GenotypeMatrix matrix;
+  ASSERT_TRUE(matrices->Next(&matrix).ValueOrDie());
+  ExpectMatrixMatchesVariants(matrix, variants, reader->Header(), 2);
+  EXPECT_FALSE(matrices->Next(&matrix).ValueOrDie());
+  EXPECT_TRUE(matrix.genotypes.values.empty());
+}
+
+TEST_F(VcfWithSamplesReaderTest, GenotypeMatrixBatchesAndQueries) {
+  auto matrices = reader_->IterateGenotypeMatrices(100, 2).ValueOrDie();
+  // Another iterable can't be created while this one is live.
+  EXPECT_THAT(reader_->IterateGenotypeMatrices(100, 2), Not(IsOK()));
+  GenotypeMatrix matrix;
+  int64 offset = 0;
+  while (matrices->Next(&matrix).ValueOrDie()) {
+    const int64 n = matrix.starts.values.size();
+    EXPECT_LE(n, 100);
+    ExpectMatrixMatchesVariants(
+        matrix,
+        vector<Variant>(golden_.begin() + offset, golden_.begin() + offset + n),
+        reader_->Header(), 2);
+    offset += n;
+  }
+  EXPECT_EQ(golden_.size(), offset);
+  ASSERT_THAT(matrices->Release(), IsOK());
+
+  auto chr3 = reader_->QueryGenotypeMatrices(MakeRange("chr3", 99999, 500000),
+                                             0, 2).ValueOrDie();
+  ASSERT_TRUE(chr3->Next(&matrix).ValueOrDie());
+  EXPECT_THAT(matrix.genotypes.shape, testing::ElementsAre(4, 1, 2));
+}
+
+TEST_F(VcfWithSamplesReaderTest, VariantViewsMatchVariants) {
+  auto views = reader_->IterateViews().ValueOrDie();
+  // Another iterable can't be created while this one is live.
+  EXPECT_THAT(reader_->IterateViews(), Not(IsOK()));
+  VcfVariantView view;
+  ASSERT_TRUE(views->Next(&view).ValueOrDie());
+  const int dp_id = view.InfoTagId("DP");
+  const int db_id = view.InfoTagId("DB");
+  const int culprit_id = view.InfoTagId("culprit");
+  const int gq_id = view.FormatTagId("GQ");
+  const int ad_id = view.FormatTagId("AD");
+  EXPECT_EQ(-1, view.InfoTagId("NOT_IN_HEADER"));
+  EXPECT_EQ(-1, view.FormatTagId("DB"));
+
+  for (const Variant& v : golden_) {
+    SCOPED_TRACE(v.ShortDebugString());
+    EXPECT_EQ(v.reference_name(), view.contig_name());
+    EXPECT_EQ(v.start(), view.start());
+    EXPECT_EQ(v.end(), view.end());
+    ASSERT_EQ(v.alternate_bases_size() + 1, view.num_alleles());
+    EXPECT_EQ(v.reference_bases(), view.allele(0));
+    for (int i = 0; i < v.alternate_bases_size(); ++i) {
+      EXPECT_EQ(v.alternate_bases(i), view.allele(i + 1));
+    }
+    EXPECT_EQ(v.quality() >= 0, view.has_quality());
+    if (view.has_quality()) EXPECT_FLOAT_EQ(v.quality(), view.quality());
+    ASSERT_EQ(v.filter_size(), view.num_filters());
+    for (int i = 0; i < v.filter_size(); ++i) {
+      EXPECT_EQ(v.filter(i), view.filter_name(i));
+    }
+
+    const auto& info = v.info();
+    EXPECT_EQ(info.count("DB") > 0, view.HasInfo(db_id));
+    const VcfValues<int> dp = view.Info<int>(dp_id);
+    if (info.count("DP")) {
+      ASSERT_EQ(1, dp.size());
+      EXPECT_EQ(info.at("DP").values(0).int_value(), dp[0]);
+    } else {
+      EXPECT_TRUE(dp.empty());
+    }
+    // DP is an Integer field.
+    EXPECT_TRUE(view.Info<float>(dp_id).empty());
+    if (info.count("culprit")) {
+      EXPECT_EQ(info.at("culprit").values(0).string_value(),
+                view.InfoString(culprit_id));
+    } else {
+      EXPECT_TRUE(view.InfoString(culprit_id).empty());
+    }
+
+    ASSERT_EQ(v.calls_size(), view.num_samples());
+    for (int i = 0; i < v.calls_size(); ++i) {
+      const auto& call_info = v.calls(i).info();
+      const VcfValues<int> gq = view.Format<int>(gq_id, i);
+      if (call_info.count("GQ")) {
+        ASSERT_EQ(1, gq.size());
+        EXPECT_EQ(call_info.at("GQ").values(0).int_value(), gq[0]);
+      }
+      const VcfValues<int> ad = view.Format<int>(ad_id, i);
+      if (call_info.count("AD")) {
+        const auto& values = call_info.at("AD").values();
+        ASSERT_EQ(values.size(), ad.size());
+        for (int j = 0; j < ad.size(); ++j) {
+          EXPECT_EQ(values.Get(j).int_value(), ad[j]);
+        }
+      }
+    }
+    if (&v != &golden_.back()) ASSERT_TRUE(views->Next(&view).ValueOrDie());
+  }
+  EXPECT_FALSE(views->Next(&view).ValueOrDie());
+  ASSERT_THAT(views->Release(), IsOK());
+
+  auto chr3 =
+      reader_->QueryViews(MakeRange("chr3", 99999, 500000)).ValueOrDie();
+  int n_chr3 = 0;
+  while (chr3->Next(&view).ValueOrDie()) {
+    EXPECT_STREQ("chr3", view.contig_name());
+    ++n_chr3;
+  }
+  EXPECT_EQ(4, n_chr3);
+}
+
+TEST_F(VcfWithSamplesReaderTest, FilterExpressionSelectsVariants) {
+  // The variants of golden_ the expression should select.
+  auto selected = [](const Variant& v) {
+    if (v.quality() <= 30 || !v.info().count("DP") ||
+        v.info().at("DP").values(0).int_value() < 10 ||
+        v.filter_size() != 1 || v.filter(0) != "PASS") {
+      return false;
+    }
+    for (const auto& call : v.calls()) {
+      for (int allele : call.genotype()) {
+        if (allele > 0) return true;
+      }
+    }
+    return false;
+  };
+  vector<Variant> expected;
+  vector<Variant> expected_chr1;
+  for (const Variant& v : golden_) {
+    if (!selected(v)) continue;
+    expected.push_back(v);
+    if (v.reference_name() == "chr1") expected_chr1.push_back(v);
+  }
+  ASSERT_THAT(expected, Not(SizeIs(0)));
+  ASSERT_LT(expected.size(), golden_.size());
+
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.set_filter_expression(
+      "QUAL > 30 && INFO/DP >= 10 && FILTER == PASS && GT != ref");
+  RecreateReader(&options);
+  EXPECT_THAT(as_vector(reader_->Iterate()),
+              Pointwise(EqualsProto(), expected));
+  EXPECT_THAT(as_vector(reader_->Query(MakeRange("chr1", 0, CHR1_SIZE))),
+              Pointwise(EqualsProto(), expected_chr1));
+}
+
+TEST_F(VcfWithSamplesReaderTest, InvalidFilterExpressionFails) {
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.set_filter_expression("INFO/NOT_IN_HEADER > 1");
+  EXPECT_THAT(VcfReader::FromFile(indexed_vcf_, options),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+}
+
 TEST(VcfReaderLikelihoodsTest, MatchesGolden) {
   std::unique_ptr<VcfReader> reader =
       std::move(VcfReader::FromFile(GetTestData(kVcfLikelihoodsFilename),
@@ -457,6 +843,117 @@ TEST(VcfReaderLikelihoodsTest, MatchesGolden) {
   EXPECT_THAT(as_vector(reader->Iterate()), Pointwise(EqualsProto(), golden));
 }
 
+TEST(VcfReaderLikelihoodsTest, ConverterWithoutTagIdsMatchesGolden) {
+  // A converter constructed without a bcf_hdr_t looks tags up by name for
+  // every record, and must decode exactly what the reader's converter, which
+  // resolved the tag ids up front, decodes. The records are read with a header
+  // parsed from the same file as the reader's, so the tag ids agree.
+  const string path = GetTestData(kVcfLikelihoodsFilename);
+  std::unique_ptr<VcfReader> reader = std::move(
+      VcfReader::FromFile(path, nucleus::genomics::v1::VcfReaderOptions())
+          .ValueOrDie());
+  const VcfRecordConverter by_name(reader->Header(), {}, {}, false);
+  const vector<Variant> golden = ReadProtosFromTFRecord<Variant>(
+      GetTestData(kVcfLikelihoodsGoldenFilename));
+
+  htsFile* fp = hts_open(path.c_str(), "r");
+  ASSERT_NE(nullptr, fp);
+  bcf_hdr_t* header = bcf_hdr_read(fp);
+  ASSERT_NE(nullptr, header);
+  bcf1_t* record = bcf_init();
+  vector<Variant> by_id_variants, by_name_variants;
+  while (bcf_read(fp, header, record) == 0) {
+    Variant by_id_variant, by_name_variant;
+    ASSERT_THAT(reader->RecordConverter().ConvertToPb(header, record,
+                                                      &by_id_variant),
+                IsOK());
+    ASSERT_THAT(by_name.ConvertToPb(header, record, &by_name_variant), IsOK());
+    by_id_variants.push_back(by_id_variant);
+    by_name_variants.push_back(by_name_variant);
+  }
+  bcf_destroy(record);
+  bcf_hdr_destroy(header);
+  hts_close(fp);
+
+  EXPECT_THAT(by_id_variants, Pointwise(EqualsProto(), golden));
+  EXPECT_THAT(by_name_variants, Pointwise(EqualsProto(), golden));
+}
+
+// Returns |variants| with only the calls of |sample| kept.
+vector<Variant> KeepOnlySample(vector<Variant> variants, const string& sample) {
+  for (Variant& v : variants) {
+    vector<nucleus::genomics::v1::VariantCall> kept;
+    for (const auto& call : v.calls()) {
+      if (call.call_set_name() == sample) kept.push_back(call);
+    }
+    v.clear_calls();
+    for (const auto& call : kept) *v.add_calls() = call;
+  }
+  return variants;
+}
+
+TEST(VcfReaderSamplesTest, IncludedAndExcludedSamplesMatchGolden) {
+  const vector<Variant> golden = KeepOnlySample(
+      ReadProtosFromTFRecord<Variant>(
+          GetTestData(kVcfLikelihoodsGoldenFilename)),
+      "Spot");
+
+  nucleus::genomics::v1::VcfReaderOptions included;
+  included.add_included_samples("Spot");
+  nucleus::genomics::v1::VcfReaderOptions excluded;
+  excluded.add_excluded_samples("Fido");
+  for (const auto& options : {included, excluded}) {
+    std::unique_ptr<VcfReader> reader = std::move(
+        VcfReader::FromFile(GetTestData(kVcfLikelihoodsFilename), options)
+            .ValueOrDie());
+    EXPECT_THAT(reader->Header().sample_names(), testing::ElementsAre("Spot"));
+    EXPECT_THAT(as_vector(reader->Iterate()),
+                Pointwise(EqualsProto(), golden));
+  }
+}
+
+TEST(VcfReaderSamplesTest, FromStringDropsUnselectedSamples) {
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.add_included_samples("Fido");
+  std::unique_ptr<VcfReader> reader = std::move(
+      VcfReader::FromFile(GetTestData(kVcfPhasesetFilename), options)
+          .ValueOrDie());
+  Variant v;
+  TF_CHECK_OK(reader->FromString(
+      "Chr1\t21\t.\tA\tT\t0\t.\t.\tGT:GQ\t0/1:12\t1/1:42", &v));
+  ASSERT_EQ(1, v.calls_size());
+  EXPECT_EQ("Fido", v.calls(0).call_set_name());
+  EXPECT_THAT(v.calls(0).genotype(), testing::ElementsAre(0, 1));
+}
+
+TEST(VcfReaderSamplesTest, InvalidSelectionsFail) {
+  nucleus::genomics::v1::VcfReaderOptions unknown;
+  unknown.add_included_samples("Spot");
+  unknown.add_included_samples("Rex");
+  EXPECT_THAT(
+      VcfReader::FromFile(GetTestData(kVcfLikelihoodsFilename), unknown),
+      Not(IsOK()));
+
+  nucleus::genomics::v1::VcfReaderOptions both;
+  both.add_included_samples("Spot");
+  both.add_excluded_samples("Fido");
+  EXPECT_THAT(VcfReader::FromFile(GetTestData(kVcfLikelihoodsFilename), both),
+              Not(IsOK()));
+}
+
+TEST_F(BcfWithSamplesReaderTest, ExcludingAllSamplesDropsCalls) {
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.add_excluded_samples("NA12878_18_99");
+  for (const string& path : {indexed_vcf_, bcf_}) {
+    std::unique_ptr<VcfReader> reader =
+        std::move(VcfReader::FromFile(path, options).ValueOrDie());
+    const vector<Variant> variants =
+        as_vector(reader->Query(MakeRange("chr1", 0, CHR1_SIZE)));
+    ASSERT_THAT(variants, SizeIs(711));
+    for (const Variant& v : variants) EXPECT_EQ(0, v.calls_size());
+  }
+}
+
 TEST(VcfReaderPhasesetTest, MatchesGolden) {
   // Verify that we can still read the phaseset fields correctly.
   std::unique_ptr<VcfReader> reader =
@@ -516,6 +1013,71 @@ TEST(VcfReaderFromStringTest, MatchesGolden) {
   EXPECT_THAT(parsed, Pointwise(EqualsProto(), golden));
 }
 
+TEST(VcfReaderFromStringTest, FromStringsMatchesGolden) {
+  std::unique_ptr<VcfReader> reader =
+      std::move(VcfReader::FromFile(
+          GetTestData(kVcfPhasesetFilename),
+          nucleus::genomics::v1::VcfReaderOptions()).ValueOrDie());
+  vector<Variant> golden =
+      ReadProtosFromTFRecord<Variant>(GetTestData(kVcfPhasesetGoldenFilename));
+  // Blank lines are skipped, and lines may end with \r\n.
+  const string lines =
+      "Chr1\t21\tDogSNP1\tA\tT\t0\t.\t.\tGT:GQ\t0/1:.\t0/1:42\n"
+      "Chr1\t22\tDogSNP2\tA\tT\t0\t.\t.\tGT:PL\t0/1:.\t0|1:50,40,60\r\n"
+      "\n"
+      "Chr1\t23\tDogSNP3\tA\tT\t0\t.\t.\tGT:GL:PS\t"
+      "0/1:.:.\t0/1:-5.0,-4.0,-6.0:.\n"
+      "Chr1\t24\tDogSNP4\tA\tT\t0\t.\t.\tGT:PL:PS\t"
+      "0|1:50,40,60:24\t0|1:50,40,60:.\n"
+      "Chr1\t25\tDogSNP5\ta\tt\t0\t.\t.\tGT:GQ:PS:PL\t"
+      "0|1:42:24:50,40,60\t1|1:42:.:50,40,60\n";
+  for (int num_threads : {0, 1, 2, 5, 8}) {
+    vector<Variant> parsed;
+    ASSERT_THAT(reader->FromStrings(lines, num_threads, &parsed), IsOK());
+    EXPECT_THAT(parsed, Pointwise(EqualsProto(), golden)) << num_threads;
+  }
+
+  vector<Variant> parsed;
+  ASSERT_THAT(reader->FromStrings("", 4, &parsed), IsOK());
+  EXPECT_THAT(parsed, SizeIs(0));
+  EXPECT_THAT(reader->FromStrings(absl::StrCat(lines, "BAD NOT A VCF RECORD"),
+                                  4, &parsed),
+              Not(IsOK()));
+}
+
+TEST(VcfReaderFromStringTest, FromStringsUpdatesHeaderLikeFromString) {
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.add_included_samples("Fido");
+  std::unique_ptr<VcfReader> serial = std::move(
+      VcfReader::FromFile(GetTestData(kVcfPhasesetFilename), options)
+          .ValueOrDie());
+  std::unique_ptr<VcfReader> batch = std::move(
+      VcfReader::FromFile(GetTestData(kVcfPhasesetFilename), options)
+          .ValueOrDie());
+  // The third and sixth records use an INFO field and a contig that the
+  // header doesn't define.
+  const vector<string> lines = {
+      "Chr1\t21\t.\tA\tT\t0\t.\t.\tGT:GQ\t0/1:12\t1/1:42",
+      "Chr1\t22\t.\tA\tT\t0\t.\t.\tGT:GQ\t0/1:12\t1/1:42",
+      "Chr1\t23\t.\tA\tT\t0\t.\tNEWFLAG\tGT:GQ\t0/1:12\t1/1:42",
+      "Chr1\t24\t.\tA\tT\t0\t.\t.\tGT:GQ\t0/1:12\t1/1:42",
+      "Chr1\t25\t.\tA\tT\t0\t.\tNEWFLAG\tGT:GQ\t0/1:12\t1/1:42",
+      "ChrNew\t26\t.\tA\tT\t0\t.\t.\tGT:GQ\t0/1:12\t1/1:42",
+      "Chr1\t27\t.\tA\tT\t0\t.\t.\tGT:GQ\t0/1:12\t1/1:42",
+  };
+  vector<Variant> expected(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    ASSERT_THAT(serial->FromString(lines[i], &expected[i]), IsOK());
+  }
+  vector<Variant> parsed;
+  ASSERT_THAT(batch->FromStrings(absl::StrJoin(lines, "\n"), 3, &parsed),
+              IsOK());
+  EXPECT_THAT(parsed, Pointwise(EqualsProto(), expected));
+  EXPECT_THAT(batch->Header(), EqualsProto(serial->Header()));
+  ASSERT_EQ(1, parsed[0].calls_size());
+  EXPECT_EQ("Fido", parsed[0].calls(0).call_set_name());
+}
+
 TEST(VcfReaderMultipleNamesTest, SplitsOnSemicolon) {
   std::unique_ptr<VcfReader> reader =
       std::move(VcfReader::FromFile(
@@ -615,6 +1177,58 @@ TEST(VcfReaderTest, MissingHeaderDefinitions) {
   EXPECT_EQ("Chr2", v3.reference_name());
 }
 
+// Tests that missing header definitions are appended to the header, and
+// decoded, without touching the existing entries.
+TEST(VcfReaderTest, MissingHeaderDefinitionsExtendHeader) {
+  nucleus::genomics::v1::VcfReaderOptions options;
+  options.add_excluded_info_fields("SKIPPED");
+  std::unique_ptr<VcfReader> reader = std::move(
+      VcfReader::FromFile(GetTestData(kVcfPhasesetFilename), options)
+          .ValueOrDie());
+  const nucleus::genomics::v1::VcfHeader original = reader->Header();
+  Variant v;
+  TF_CHECK_OK(reader->FromString(
+      "Chr2\t21\t.\tA\tT\t0\tq10\tNEWINFO=7;SKIPPED=x\tGT:AB\t0/1:abc\t"
+      "0/1:def",
+      &v));
+  EXPECT_EQ("Chr2", v.reference_name());
+  EXPECT_EQ("7", v.info().at("NEWINFO").values(0).string_value());
+  EXPECT_EQ(0, v.info().count("SKIPPED"));
+  EXPECT_EQ("abc", v.calls(0).info().at("AB").values(0).string_value());
+
+  const nucleus::genomics::v1::VcfHeader& header = reader->Header();
+  ASSERT_EQ(original.contigs_size() + 1, header.contigs_size());
+  EXPECT_EQ("Chr2", header.contigs(original.contigs_size()).name());
+  EXPECT_EQ(original.contigs_size(),
+            header.contigs(original.contigs_size()).pos_in_fasta());
+  ASSERT_EQ(original.filters_size() + 1, header.filters_size());
+  EXPECT_EQ("q10", header.filters(original.filters_size()).id());
+  ASSERT_EQ(original.infos_size() + 2, header.infos_size());
+  EXPECT_EQ("NEWINFO", header.infos(original.infos_size()).id());
+  EXPECT_EQ("SKIPPED", header.infos(original.infos_size() + 1).id());
+  ASSERT_EQ(original.formats_size() + 1, header.formats_size());
+  EXPECT_EQ("AB", header.formats(original.formats_size()).id());
+  for (int i = 0; i < original.contigs_size(); ++i) {
+    EXPECT_THAT(header.contigs(i), EqualsProto(original.contigs(i)));
+  }
+  for (int i = 0; i < original.infos_size(); ++i) {
+    EXPECT_THAT(header.infos(i), EqualsProto(original.infos(i)));
+  }
+  for (int i = 0; i < original.formats_size(); ++i) {
+    EXPECT_THAT(header.formats(i), EqualsProto(original.formats(i)));
+  }
+  EXPECT_THAT(header.sample_names(),
+              Pointwise(Eq(), original.sample_names()));
+
+  // Fields that are now defined don't grow the header again.
+  const nucleus::genomics::v1::VcfHeader extended = reader->Header();
+  TF_CHECK_OK(reader->FromString(
+      "Chr2\t22\t.\tA\tT\t0\t.\tNEWINFO=8\tGT:AB\t0/1:ghi\t0/1:jkl", &v));
+  EXPECT_EQ("8", v.info().at("NEWINFO").values(0).string_value());
+  EXPECT_EQ("jkl", v.calls(1).info().at("AB").values(0).string_value());
+  EXPECT_THAT(reader->Header(), EqualsProto(extended));
+}
+
 TEST(VcfReaderTest, HeaderAccessor) {
   std::unique_ptr<VcfReader> reader =
       std::move(VcfReader::FromFile(GetTestData(kVcfSamplesFilename),
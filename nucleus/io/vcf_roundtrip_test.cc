@@ -60,4 +60,62 @@ TEST(VcfRoundtripTest, ReadVCFWriteBCF) {
               testing::Pointwise(EqualsProto(), expected_variants));
 }
 
+// Calls that only carry their sample index are written under the matching
+// header sample names.
+TEST(VcfRoundtripTest, WritesCallsWithOmittedNames) {
+  string input_file = GetTestData("test_likelihoods_input.vcf");
+  string output_file = MakeTempFile("omitted_names.vcf");
+  auto reader = std::move(
+      VcfReader::FromFile(input_file, genomics::v1::VcfReaderOptions())
+          .ValueOrDie());
+  std::vector<Variant> expected_variants = as_vector(reader->Iterate());
+
+  genomics::v1::VcfReaderOptions options;
+  options.set_omit_call_set_names(true);
+  auto indexed_reader =
+      std::move(VcfReader::FromFile(input_file, options).ValueOrDie());
+  auto writer = std::move(VcfWriter::ToFile(output_file, reader->Header(),
+                                            genomics::v1::VcfWriterOptions())
+                              .ValueOrDie());
+  for (const auto& v : as_vector(indexed_reader->Iterate())) {
+    ASSERT_THAT(writer->Write(v), IsOK());
+  }
+  ASSERT_THAT(writer->Close(), IsOK());
+
+  auto output_reader = std::move(
+      VcfReader::FromFile(output_file, genomics::v1::VcfReaderOptions())
+          .ValueOrDie());
+  EXPECT_THAT(as_vector(output_reader->Iterate()),
+              testing::Pointwise(EqualsProto(), expected_variants));
+}
+
+// Same as above, but with htslib thread pools on both the writing and the
+// reading side, for both BGZF-compressed output formats.
+TEST(VcfRoundtripTest, ThreadedCompressedRoundtrip) {
+  string input_file = GetTestData("test_samples.vcf.gz");
+  genomics::v1::VcfReaderOptions reader_options;
+  reader_options.set_num_threads(2);
+  auto reader =
+      std::move(VcfReader::FromFile(input_file, reader_options).ValueOrDie());
+  std::vector<Variant> expected_variants = as_vector(reader->Iterate());
+  ASSERT_FALSE(expected_variants.empty());
+
+  for (const string& filename : {"threaded.vcf.gz", "threaded.bcf.gz"}) {
+    string output_file = MakeTempFile(filename);
+    genomics::v1::VcfWriterOptions writer_options;
+    writer_options.set_num_threads(2);
+    auto writer = std::move(
+        VcfWriter::ToFile(output_file, reader->Header(), writer_options)
+            .ValueOrDie());
+    for (const auto& v : expected_variants) {
+      ASSERT_THAT(writer->Write(v), IsOK());
+    }
+    ASSERT_THAT(writer->Close(), IsOK());
+    auto output_reader = std::move(
+        VcfReader::FromFile(output_file, reader_options).ValueOrDie());
+    EXPECT_THAT(as_vector(output_reader->Iterate()),
+                testing::Pointwise(EqualsProto(), expected_variants));
+  }
+}
+
 }  // namespace nucleus
@@ -0,0 +1,280 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_stats.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/string_view.h"
+#include "nucleus/util/parallel.h"
+#include "nucleus/util/utils.h"
+#include "tensorflow/core/lib/core/errors.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+using nucleus::genomics::v1::ContigInfo;
+using nucleus::genomics::v1::Range;
+
+namespace {
+
+// Alternate alleles that stand for unspecified or no other alleles.
+bool IsPlaceholderAllele(absl::string_view allele) {
+  return allele == "." || allele == "<*>" || allele == "<NON_REF>";
+}
+
+// Symbolic alleles, breakends and the spanning deletion allele.
+bool IsSymbolicAllele(absl::string_view allele) {
+  return allele.empty() || allele[0] == '<' || allele == "*" ||
+         allele.find_first_of("[]") != absl::string_view::npos ||
+         allele.front() == '.' || allele.back() == '.';
+}
+
+bool IsPurine(char base) { return base == 'A' || base == 'G'; }
+bool IsPyrimidine(char base) { return base == 'C' || base == 'T'; }
+
+}  // namespace
+
+double SampleGenotypeCounts::CallRate() const {
+  const int64 num_calls = num_called + num_no_calls;
+  return num_calls > 0 ? static_cast<double>(num_called) / num_calls : 0;
+}
+
+double SampleGenotypeCounts::HetHomRatio() const {
+  return num_hom_alt > 0 ? static_cast<double>(num_het) / num_hom_alt : 0;
+}
+
+VcfStats::VcfStats(int num_samples, int num_af_bins)
+    : samples(num_samples), af_histogram(std::max(num_af_bins, 0)) {}
+
+void VcfStats::Add(const VcfVariantView& view, int gt_id) {
+  ++num_records;
+  ++num_records_per_contig[view.contig_name()];
+
+  const int num_alleles = view.num_alleles();
+  const absl::string_view ref = view.allele(0);
+  std::vector<bool> counted(num_alleles, false);
+  int num_alts = 0;
+  for (int i = 1; i < num_alleles; ++i) {
+    const absl::string_view alt = view.allele(i);
+    if (IsPlaceholderAllele(alt)) continue;
+    counted[i] = true;
+    ++num_alts;
+    if (IsSymbolicAllele(alt)) {
+      ++num_symbolic;
+    } else if (alt.size() > ref.size()) {
+      ++num_insertions;
+    } else if (alt.size() < ref.size()) {
+      ++num_deletions;
+    } else if (ref.size() > 1) {
+      ++num_mnps;
+    } else {
+      ++num_snps;
+      const char r = absl::ascii_toupper(ref[0]);
+      const char a = absl::ascii_toupper(alt[0]);
+      if (r != a && (IsPurine(r) || IsPyrimidine(r)) &&
+          (IsPurine(a) || IsPyrimidine(a))) {
+        if (IsPurine(r) == IsPurine(a)) {
+          ++num_transitions;
+        } else {
+          ++num_transversions;
+        }
+      }
+    }
+  }
+  if (num_alts == 0) ++num_ref_records;
+  if (num_alts > 1) ++num_multiallelic_records;
+
+  // The counts of each allele among the called alleles (AC), and their total
+  // (AN).
+  std::vector<int64> allele_counts(num_alleles, 0);
+  int64 num_called_alleles = 0;
+  const int num_samples =
+      std::min(view.num_samples(), static_cast<int>(samples.size()));
+  for (int i = 0; i < num_samples; ++i) {
+    SampleGenotypeCounts& counts = samples[i];
+    const VcfValues<int> gt =
+        gt_id >= 0 ? view.Format<int>(gt_id, i) : VcfValues<int>();
+    for (int j = 0; j < gt.size(); ++j) {
+      const int allele = GenotypeAllele(gt, j);
+      if (allele < 0) continue;
+      ++num_called_alleles;
+      if (allele < num_alleles) ++allele_counts[allele];
+    }
+    const GenotypeSummary genotype = SummarizeGenotype(gt);
+    if (gt.empty() || genotype.missing) {
+      ++counts.num_no_calls;
+      continue;
+    }
+    ++counts.num_called;
+    if (!genotype.all_same) {
+      ++counts.num_het;
+    } else if (genotype.any_alt) {
+      ++counts.num_hom_alt;
+    } else {
+      ++counts.num_hom_ref;
+    }
+  }
+
+  const int num_bins = af_histogram.size();
+  if (num_called_alleles > 0 && num_bins > 0) {
+    for (int i = 1; i < num_alleles; ++i) {
+      if (!counted[i]) continue;
+      const double af =
+          static_cast<double>(allele_counts[i]) / num_called_alleles;
+      ++af_histogram[std::min(static_cast<int>(af * num_bins), num_bins - 1)];
+    }
+  }
+}
+
+tf::Status VcfStats::Merge(const VcfStats& other) {
+  if (other.samples.size() != samples.size() ||
+      other.af_histogram.size() != af_histogram.size()) {
+    return tf::errors::InvalidArgument(
+        "Cannot merge VcfStats of ", other.samples.size(), " samples and ",
+        other.af_histogram.size(), " AF bins into VcfStats of ",
+        samples.size(), " samples and ", af_histogram.size(), " AF bins");
+  }
+  num_records += other.num_records;
+  for (const auto& contig : other.num_records_per_contig) {
+    num_records_per_contig[contig.first] += contig.second;
+  }
+  num_ref_records += other.num_ref_records;
+  num_multiallelic_records += other.num_multiallelic_records;
+  num_snps += other.num_snps;
+  num_mnps += other.num_mnps;
+  num_insertions += other.num_insertions;
+  num_deletions += other.num_deletions;
+  num_symbolic += other.num_symbolic;
+  num_transitions += other.num_transitions;
+  num_transversions += other.num_transversions;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    samples[i].num_called += other.samples[i].num_called;
+    samples[i].num_no_calls += other.samples[i].num_no_calls;
+    samples[i].num_hom_ref += other.samples[i].num_hom_ref;
+    samples[i].num_het += other.samples[i].num_het;
+    samples[i].num_hom_alt += other.samples[i].num_hom_alt;
+  }
+  for (size_t i = 0; i < af_histogram.size(); ++i) {
+    af_histogram[i] += other.af_histogram[i];
+  }
+  return tf::Status::OK();
+}
+
+double VcfStats::TiTvRatio() const {
+  return num_transversions > 0
+             ? static_cast<double>(num_transitions) / num_transversions
+             : 0;
+}
+
+tf::Status AddVcfStats(VariantViewIterable* views, int64 min_start,
+                       VcfStats* stats) {
+  VcfVariantView view;
+  // The GT id is resolved with the first record, as the views are the only
+  // access to the header.
+  int gt_id = -1;
+  bool first = true;
+  while (true) {
+    StatusOr<bool> has_next = views->Next(&view);
+    TF_RETURN_IF_ERROR(has_next.status());
+    if (!has_next.ValueOrDie()) break;
+    if (first) {
+      gt_id = view.FormatTagId("GT");
+      first = false;
+    }
+    if (view.start() >= min_start) stats->Add(view, gt_id);
+  }
+  return views->Release();
+}
+
+namespace {
+
+// Adds the records of |path| starting in |shards| to |stats|, reading them
+// with a single VcfReader.
+tf::Status AddShardStats(const string& path, const VcfStatsOptions& options,
+                         const std::vector<Range>& shards, VcfStats* stats) {
+  StatusOr<std::unique_ptr<VcfReader>> reader =
+      VcfReader::FromFile(path, options.reader_options);
+  TF_RETURN_IF_ERROR(reader.status());
+  for (const Range& shard : shards) {
+    StatusOr<std::shared_ptr<VariantViewIterable>> views =
+        reader.ValueOrDie()->QueryViews(shard);
+    TF_RETURN_IF_ERROR(views.status());
+    TF_RETURN_IF_ERROR(
+        AddVcfStats(views.ValueOrDie().get(), shard.start(), stats));
+  }
+  return tf::Status::OK();
+}
+
+}  // namespace
+
+StatusOr<VcfStats> ComputeVcfStats(const string& path,
+                                   const VcfStatsOptions& options) {
+  StatusOr<std::unique_ptr<VcfReader>> reader =
+      VcfReader::FromFile(path, options.reader_options);
+  TF_RETURN_IF_ERROR(reader.status());
+  const int num_samples = reader.ValueOrDie()->Header().sample_names_size();
+  VcfStats stats(num_samples, options.num_af_bins);
+
+  std::vector<Range> shards = options.regions;
+  if (shards.empty()) {
+    if (!reader.ValueOrDie()->HasIndex()) {
+      StatusOr<std::shared_ptr<VariantViewIterable>> views =
+          reader.ValueOrDie()->IterateViews();
+      TF_RETURN_IF_ERROR(views.status());
+      TF_RETURN_IF_ERROR(AddVcfStats(views.ValueOrDie().get(), 0, &stats));
+      return stats;
+    }
+    for (const ContigInfo& contig : reader.ValueOrDie()->Header().contigs()) {
+      // Contigs of unknown length are queried to the largest position the
+      // index supports.
+      shards.push_back(MakeRange(contig.name(), 0,
+                                 contig.n_bases() > 0
+                                     ? contig.n_bases()
+                                     : std::numeric_limits<int32>::max()));
+    }
+  }
+  TF_RETURN_IF_ERROR(reader.ValueOrDie()->Close());
+
+  // Each worker reads every num_workers-th shard with its own reader, as
+  // readers can't be shared between threads.
+  const int num_workers = NumShards(options.num_threads, shards.size());
+  std::vector<VcfStats> worker_stats(
+      num_workers, VcfStats(num_samples, options.num_af_bins));
+  std::vector<tf::Status> worker_statuses(num_workers);
+  auto run_worker = [&](int worker) {
+    std::vector<Range> worker_shards;
+    for (size_t i = worker; i < shards.size(); i += num_workers) {
+      worker_shards.push_back(shards[i]);
+    }
+    worker_statuses[worker] =
+        AddShardStats(path, options, worker_shards, &worker_stats[worker]);
+  };
+  RunShards("vcf_stats", num_workers, run_worker);
+
+  for (int worker = 0; worker < num_workers; ++worker) {
+    TF_RETURN_IF_ERROR(worker_statuses[worker]);
+    TF_RETURN_IF_ERROR(stats.Merge(worker_stats[worker]));
+  }
+  return stats;
+}
+
+}  // namespace nucleus
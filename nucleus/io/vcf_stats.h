@@ -0,0 +1,142 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+// Summary statistics of the records of a VCF file, such as the counts of
+// variants by type, the transition/transversion ratio, per-sample genotype
+// counts and call rates, and the allele frequency spectrum.
+//
+// The statistics are computed from VcfVariantViews of the htslib records,
+// without converting them to Variant protos, and can be computed for parts of
+// a file in parallel and merged.
+#ifndef THIRD_PARTY_NUCLEUS_IO_VCF_STATS_H_
+#define THIRD_PARTY_NUCLEUS_IO_VCF_STATS_H_
+
+#include <map>
+#include <vector>
+
+#include "nucleus/io/vcf_reader.h"
+#include "nucleus/io/vcf_variant_view.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/range.pb.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/vendor/statusor.h"
+#include "tensorflow/core/lib/core/status.h"
+
+namespace nucleus {
+
+// The counts of the genotypes of one sample.
+struct SampleGenotypeCounts {
+  // Calls with all of their alleles called.
+  int64 num_called = 0;
+  // Calls with a missing allele, or without a GT.
+  int64 num_no_calls = 0;
+  // The called genotypes, by zygosity.
+  int64 num_hom_ref = 0;
+  int64 num_het = 0;
+  int64 num_hom_alt = 0;
+
+  // The fraction of the calls that are called, or 0 without calls.
+  double CallRate() const;
+  // The ratio of heterozygous to homozygous alternate genotypes, or 0 without
+  // homozygous alternate genotypes.
+  double HetHomRatio() const;
+};
+
+// The statistics of a set of VCF records.
+//
+// Alternate alleles that only stand for other alleles (".", "<*>" and
+// "<NON_REF>") are ignored; records that have no other alternate allele are
+// counted as reference records. The others are counted by alternate allele,
+// so a multi-allelic record with an insertion and a deletion counts once in
+// each.
+struct VcfStats {
+  VcfStats() = default;
+  // Statistics with room for |num_samples| samples and an allele frequency
+  // histogram of |num_af_bins| bins.
+  VcfStats(int num_samples, int num_af_bins);
+
+  // Adds the record of |view|. |gt_id| is the header id of the GT FORMAT
+  // field, or -1 if the header doesn't define it, in which case all calls are
+  // no calls.
+  void Add(const VcfVariantView& view, int gt_id);
+
+  // Adds the counts of |other|, which must have the same number of samples and
+  // allele frequency bins.
+  tensorflow::Status Merge(const VcfStats& other);
+
+  // The ratio of transitions to transversions, or 0 without transversions.
+  double TiTvRatio() const;
+
+  int64 num_records = 0;
+  std::map<string, int64> num_records_per_contig;
+  // Records without alternate alleles.
+  int64 num_ref_records = 0;
+  // Records with more than one alternate allele.
+  int64 num_multiallelic_records = 0;
+
+  // Alternate alleles by type. SNPs and MNPs have as many bases as the
+  // reference allele (one for SNPs); insertions have more and deletions fewer.
+  // Symbolic alleles include breakends and the "*" spanning deletion allele.
+  int64 num_snps = 0;
+  int64 num_mnps = 0;
+  int64 num_insertions = 0;
+  int64 num_deletions = 0;
+  int64 num_symbolic = 0;
+
+  // The SNPs between A, C, G and T bases that are transitions (A<->G and
+  // C<->T) and transversions.
+  int64 num_transitions = 0;
+  int64 num_transversions = 0;
+
+  // The genotype counts of each sample, in the order of the header.
+  std::vector<SampleGenotypeCounts> samples;
+
+  // A histogram of the frequencies of the alternate alleles among the called
+  // alleles of the record (AC / AN, as computed from the genotypes rather than
+  // read from INFO fields) in equal-width bins over [0, 1]. A frequency of 1
+  // falls in the last bin. Alleles of records without called alleles aren't
+  // counted.
+  std::vector<int64> af_histogram;
+};
+
+// Options of ComputeVcfStats.
+struct VcfStatsOptions {
+  // The number of threads the records are read and counted on.
+  int num_threads = 1;
+  int num_af_bins = 10;
+  // If non-empty, only the records starting in these regions are counted.
+  // Each region is a shard of the work, read with its own VcfReader. The
+  // regions must not overlap. Otherwise each contig of an indexed file is a
+  // shard, and unindexed files are read serially.
+  std::vector<nucleus::genomics::v1::Range> regions;
+  // The options of the VcfReaders. Their sample selection and filter
+  // expression apply to the statistics.
+  nucleus::genomics::v1::VcfReaderOptions reader_options;
+};
+
+// Adds the records of |views| starting at or after |min_start| to |stats|,
+// which must have room for the samples of the reader of |views|.
+tensorflow::Status AddVcfStats(VariantViewIterable* views, int64 min_start,
+                               VcfStats* stats);
+
+// Computes the statistics of the records of the VCF or BCF file at |path|,
+// sharded and counted in parallel as described by |options|.
+StatusOr<VcfStats> ComputeVcfStats(const string& path,
+                                   const VcfStatsOptions& options);
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_IO_VCF_STATS_H_
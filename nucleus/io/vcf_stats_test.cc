@@ -0,0 +1,200 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_stats.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock-generated-matchers.h>
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock-more-matchers.h>
+
+#include "tensorflow/core/platform/test.h"
+#include "nucleus/io/vcf_reader.h"
+#include "nucleus/io/vcf_writer.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/util/utils.h"
+#include "nucleus/vendor/status_matchers.h"
+
+namespace nucleus {
+
+using genomics::v1::Variant;
+using genomics::v1::VcfReaderOptions;
+using genomics::v1::VcfWriterOptions;
+using ::testing::DoubleEq;
+using ::testing::ElementsAre;
+using ::testing::Pair;
+
+namespace {
+
+constexpr char kVcf[] =
+    "##fileformat=VCFv4.2\n"
+    "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+    "##contig=<ID=chr1,length=1000>\n"
+    "##contig=<ID=chr2,length=1000>\n"
+    "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\n"
+    "chr1\t10\t.\tA\tG\t50\tPASS\t.\tGT\t0/1\t1/1\n"
+    "chr1\t20\t.\tC\tA\t50\tPASS\t.\tGT\t0/0\t0/1\n"
+    "chr1\t30\t.\tAT\tA,ATT\t50\tPASS\t.\tGT\t1/2\t./.\n"
+    "chr2\t5\t.\tAC\tGT\t50\tPASS\t.\tGT\t0/1\t0/0\n"
+    "chr2\t15\t.\tG\t<*>\t0\t.\t.\tGT\t0/0\t0/0\n"
+    "chr2\t25\t.\tT\t<DEL>\t50\tPASS\t.\tGT\t0/1\t.\n";
+
+// Checks that |stats| are those of all of the records of kVcf.
+void ExpectAllRecordStats(const VcfStats& stats) {
+  EXPECT_EQ(6, stats.num_records);
+  EXPECT_THAT(stats.num_records_per_contig,
+              ElementsAre(Pair("chr1", 3), Pair("chr2", 3)));
+  EXPECT_EQ(1, stats.num_ref_records);
+  EXPECT_EQ(1, stats.num_multiallelic_records);
+  EXPECT_EQ(2, stats.num_snps);
+  EXPECT_EQ(1, stats.num_mnps);
+  EXPECT_EQ(1, stats.num_insertions);
+  EXPECT_EQ(1, stats.num_deletions);
+  EXPECT_EQ(1, stats.num_symbolic);
+  EXPECT_EQ(1, stats.num_transitions);
+  EXPECT_EQ(1, stats.num_transversions);
+  EXPECT_THAT(stats.TiTvRatio(), DoubleEq(1));
+
+  ASSERT_EQ(2, stats.samples.size());
+  const SampleGenotypeCounts& s1 = stats.samples[0];
+  EXPECT_EQ(6, s1.num_called);
+  EXPECT_EQ(0, s1.num_no_calls);
+  EXPECT_EQ(2, s1.num_hom_ref);
+  EXPECT_EQ(4, s1.num_het);
+  EXPECT_EQ(0, s1.num_hom_alt);
+  EXPECT_THAT(s1.CallRate(), DoubleEq(1));
+  EXPECT_THAT(s1.HetHomRatio(), DoubleEq(0));
+  const SampleGenotypeCounts& s2 = stats.samples[1];
+  EXPECT_EQ(4, s2.num_called);
+  EXPECT_EQ(2, s2.num_no_calls);
+  EXPECT_EQ(2, s2.num_hom_ref);
+  EXPECT_EQ(1, s2.num_het);
+  EXPECT_EQ(1, s2.num_hom_alt);
+  EXPECT_THAT(s2.CallRate(), DoubleEq(4.0 / 6));
+  EXPECT_THAT(s2.HetHomRatio(), DoubleEq(1));
+
+  // The alternate allele frequencies are 0.75, 0.25, 0.5 and 0.5, 0.25 and
+  // 0.5; the <*> record has none.
+  EXPECT_THAT(stats.af_histogram, ElementsAre(0, 2, 3, 1));
+}
+
+}  // namespace
+
+class VcfStatsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    vcf_ = MakeTempFileWithContents("vcf_stats.vcf", kVcf);
+    options_.num_af_bins = 4;
+  }
+
+  // Writes the records of vcf_ to an indexed bgzipped VCF and returns its
+  // path.
+  string WriteIndexedVcf() {
+    const string path = MakeTempFile("vcf_stats_indexed.vcf.gz");
+    std::unique_ptr<VcfReader> reader =
+        std::move(VcfReader::FromFile(vcf_, VcfReaderOptions()).ValueOrDie());
+    VcfWriterOptions writer_options;
+    writer_options.set_write_index(true);
+    std::unique_ptr<VcfWriter> writer = std::move(
+        VcfWriter::ToFile(path, reader->Header(), writer_options)
+            .ValueOrDie());
+    for (const Variant& variant : as_vector(reader->Iterate())) {
+      TF_CHECK_OK(writer->Write(variant));
+    }
+    TF_CHECK_OK(writer->Close());
+    return path;
+  }
+
+  string vcf_;
+  VcfStatsOptions options_;
+};
+
+TEST_F(VcfStatsTest, ComputesStatsSerially) {
+  StatusOr<VcfStats> stats = ComputeVcfStats(vcf_, options_);
+  ASSERT_THAT(stats.status(), IsOK());
+  ExpectAllRecordStats(stats.ValueOrDie());
+}
+
+TEST_F(VcfStatsTest, ShardsIndexedFilesByContig) {
+  const string indexed = WriteIndexedVcf();
+  for (int num_threads : {1, 2, 8}) {
+    options_.num_threads = num_threads;
+    StatusOr<VcfStats> stats = ComputeVcfStats(indexed, options_);
+    ASSERT_THAT(stats.status(), IsOK());
+    ExpectAllRecordStats(stats.ValueOrDie());
+  }
+}
+
+TEST_F(VcfStatsTest, CountsRecordsStartingInRegions) {
+  const string indexed = WriteIndexedVcf();
+  options_.num_threads = 2;
+  // The record at chr1:30, which spans [29, 31), overlaps both chr1 regions
+  // but is only counted in the one it starts in.
+  options_.regions = {MakeRange("chr1", 0, 30), MakeRange("chr1", 30, 100),
+                      MakeRange("chr2", 0, 10)};
+  StatusOr<VcfStats> stats = ComputeVcfStats(indexed, options_);
+  ASSERT_THAT(stats.status(), IsOK());
+  EXPECT_EQ(4, stats.ValueOrDie().num_records);
+  EXPECT_EQ(1, stats.ValueOrDie().num_multiallelic_records);
+  EXPECT_EQ(1, stats.ValueOrDie().num_deletions);
+  EXPECT_EQ(1, stats.ValueOrDie().num_mnps);
+}
+
+TEST_F(VcfStatsTest, AppliesReaderOptions) {
+  options_.reader_options.add_included_samples("S2");
+  options_.reader_options.set_filter_expression("N_ALT > 0 && POS > 15");
+  StatusOr<VcfStats> stats = ComputeVcfStats(vcf_, options_);
+  ASSERT_THAT(stats.status(), IsOK());
+  const VcfStats& s = stats.ValueOrDie();
+  // The records at chr1:20, chr1:30, and chr2:25.
+  EXPECT_EQ(3, s.num_records);
+  ASSERT_EQ(1, s.samples.size());
+  EXPECT_EQ(1, s.samples[0].num_called);
+  EXPECT_EQ(2, s.samples[0].num_no_calls);
+}
+
+TEST_F(VcfStatsTest, MergesPartialStats) {
+  std::unique_ptr<VcfReader> reader =
+      std::move(VcfReader::FromFile(vcf_, VcfReaderOptions()).ValueOrDie());
+  // Counts the first three records into one VcfStats and the others into
+  // another.
+  VcfStats first(2, 4);
+  VcfStats second(2, 4);
+  auto views = reader->IterateViews().ValueOrDie();
+  VcfVariantView view;
+  for (int i = 0; views->Next(&view).ValueOrDie(); ++i) {
+    (i < 3 ? first : second).Add(view, view.FormatTagId("GT"));
+  }
+  ASSERT_THAT(first.Merge(second), IsOK());
+  ExpectAllRecordStats(first);
+
+  EXPECT_THAT(first.Merge(VcfStats(3, 4)),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+  EXPECT_THAT(first.Merge(VcfStats(2, 10)),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+}
+
+TEST_F(VcfStatsTest, RegionsNeedAnIndex) {
+  options_.regions = {MakeRange("chr1", 0, 100)};
+  EXPECT_THAT(ComputeVcfStats(vcf_, options_).status(),
+              IsNotOKWithCode(tensorflow::error::FAILED_PRECONDITION));
+}
+
+}  // namespace nucleus
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_variant_view.h"
+
+#include <string.h>
+
+namespace nucleus {
+
+namespace {
+
+// The string of |len| bytes at |p|, up to its first NUL padding byte.
+absl::string_view PackedString(const uint8_t* p, int len) {
+  const char* s = reinterpret_cast<const char*>(p);
+  return absl::string_view(s, strnlen(s, len));
+}
+
+}  // namespace
+
+absl::string_view VcfVariantView::allele(int i) const {
+  bcf_unpack(record_, BCF_UN_STR);
+  return record_->d.allele[i];
+}
+
+int VcfVariantView::num_filters() const {
+  bcf_unpack(record_, BCF_UN_FLT);
+  return record_->d.n_flt;
+}
+
+int VcfVariantView::filter_id(int i) const {
+  bcf_unpack(record_, BCF_UN_FLT);
+  return record_->d.flt[i];
+}
+
+const char* VcfVariantView::filter_name(int i) const {
+  return bcf_hdr_int2id(header_, BCF_DT_ID, filter_id(i));
+}
+
+int VcfVariantView::InfoTagId(const char* tag) const {
+  const int id = bcf_hdr_id2int(header_, BCF_DT_ID, tag);
+  return bcf_hdr_idinfo_exists(header_, BCF_HL_INFO, id) ? id : -1;
+}
+
+int VcfVariantView::FormatTagId(const char* tag) const {
+  const int id = bcf_hdr_id2int(header_, BCF_DT_ID, tag);
+  return bcf_hdr_idinfo_exists(header_, BCF_HL_FMT, id) ? id : -1;
+}
+
+bool VcfVariantView::HasInfo(int tag_id) const {
+  const bcf_info_t* info = bcf_get_info_id(record_, tag_id);
+  return info != nullptr && info->vptr != nullptr;
+}
+
+absl::string_view VcfVariantView::InfoString(int tag_id) const {
+  const bcf_info_t* info = bcf_get_info_id(record_, tag_id);
+  if (info == nullptr || info->vptr == nullptr || info->type != BCF_BT_CHAR) {
+    return absl::string_view();
+  }
+  return PackedString(info->vptr, info->len);
+}
+
+absl::string_view VcfVariantView::FormatString(int tag_id, int sample) const {
+  const bcf_fmt_t* fmt = bcf_get_fmt_id(record_, tag_id);
+  if (fmt == nullptr || fmt->p == nullptr || fmt->type != BCF_BT_CHAR ||
+      sample < 0 || sample >= record_->n_sample) {
+    return absl::string_view();
+  }
+  return PackedString(fmt->p + sample * fmt->size, fmt->size);
+}
+
+GenotypeSummary SummarizeGenotype(const VcfValues<int>& gt) {
+  GenotypeSummary summary;
+  int first_allele = -1;
+  for (int j = 0; j < gt.size(); ++j) {
+    const int allele = GenotypeAllele(gt, j);
+    if (allele < 0) {
+      summary.missing = true;
+      continue;
+    }
+    summary.any_alt |= allele > 0;
+    if (first_allele < 0) {
+      first_allele = allele;
+    } else if (allele != first_allele) {
+      summary.all_same = false;
+    }
+  }
+  return summary;
+}
+
+}  // namespace nucleus
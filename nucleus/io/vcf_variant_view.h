@@ -0,0 +1,193 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef THIRD_PARTY_NUCLEUS_IO_VCF_VARIANT_VIEW_H_
+#define THIRD_PARTY_NUCLEUS_IO_VCF_VARIANT_VIEW_H_
+
+#include "absl/strings/string_view.h"
+#include "htslib/vcf.h"
+#include "nucleus/io/vcf_conversion.h"
+#include "nucleus/platform/types.h"
+
+namespace nucleus {
+
+// The int or float values of an INFO field, or of a FORMAT field for one
+// sample, read in place from the packed htslib encoding. Narrower integer
+// encodings are widened to int, with their missing value mapped to
+// bcf_int32_missing. Only valid as long as the record they come from.
+template <class T>
+class VcfValues {
+ public:
+  // No values.
+  VcfValues() : p_(nullptr), type_(0), size_(0) {}
+
+  // The values at |p|, of BCF_BT_* |type|, up to |max_size| of them or the
+  // first vector end padding.
+  VcfValues(const uint8_t* p, int type, int max_size)
+      : p_(p), type_(type), size_(0) {
+    while (size_ < max_size && !VcfType<T>::IsVectorEnd((*this)[size_])) {
+      ++size_;
+    }
+  }
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // The j-th value, for 0 <= j < size().
+  T operator[](int j) const { return VcfType<T>::ReadPacked(p_, type_, j); }
+
+  // Is the j-th value missing ('.')?
+  bool IsMissing(int j) const { return VcfType<T>::IsMissing((*this)[j]); }
+
+ private:
+  const uint8_t* p_;
+  int type_;
+  int size_;
+};
+
+// A non-owning, read-only view of a VCF record as decoded by htslib. It gives
+// direct access to the fields of a bcf1_t, for C++ code that only looks at a
+// few fields of each record and doesn't need a Variant proto. Record fields
+// are unpacked lazily, the first time they are needed.
+//
+// A view is only valid as long as the header and the record it was created
+// from; views handed out by VariantViewIterable::Next are invalidated by the
+// next call. Strings and values returned by the view have the same lifetime.
+//
+// INFO and FORMAT fields are looked up by their header id. Resolve the ids of
+// the fields of interest once with InfoTagId and FormatTagId, then reuse them
+// for every record read with the same header.
+class VcfVariantView {
+ public:
+  VcfVariantView() : header_(nullptr), record_(nullptr) {}
+  VcfVariantView(const bcf_hdr_t* header, bcf1_t* record)
+      : header_(header), record_(record) {}
+
+  const bcf_hdr_t* header() const { return header_; }
+  bcf1_t* record() const { return record_; }
+
+  // The index of the record's contig in the header (and in
+  // VcfHeader.contigs), and its name.
+  int contig_id() const { return record_->rid; }
+  const char* contig_name() const {
+    return bcf_hdr_id2name(header_, record_->rid);
+  }
+
+  // The 0-based, half-open interval covered by the reference allele, taking
+  // the END INFO field into account, as in Variant.start and Variant.end.
+  int64 start() const { return record_->pos; }
+  int64 end() const { return record_->pos + record_->rlen; }
+
+  // The number of alleles, including the reference, and the i-th of them.
+  // allele(0) is the reference allele. Unlike Variant.reference_bases, the
+  // alleles are returned as they appear in the file, without upper-casing.
+  int num_alleles() const { return record_->n_allele; }
+  absl::string_view allele(int i) const;
+
+  // Does the record have a QUAL value, and what is it?
+  bool has_quality() const { return !bcf_float_is_missing(record_->qual); }
+  float quality() const { return record_->qual; }
+
+  // The FILTER values of the record, as header ids or names. A record whose
+  // FILTER is missing ('.') has no filters.
+  int num_filters() const;
+  int filter_id(int i) const;
+  const char* filter_name(int i) const;
+
+  // The number of samples with FORMAT values in the record.
+  int num_samples() const { return record_->n_sample; }
+
+  // The header id of INFO or FORMAT field |tag|, or -1 if the header doesn't
+  // define it.
+  int InfoTagId(const char* tag) const;
+  int FormatTagId(const char* tag) const;
+
+  // Is the INFO field with header id |tag_id| present in the record? This is
+  // the way to read Flag fields.
+  bool HasInfo(int tag_id) const;
+
+  // The values of the INFO field with header id |tag_id|. Empty if the field
+  // isn't present in the record or its values can't be read as T, which is
+  // int for Integer fields and float for Float fields.
+  template <class T>
+  VcfValues<T> Info(int tag_id) const;
+
+  // The value of the String INFO field with header id |tag_id|, or an empty
+  // string_view if the field isn't present in the record or isn't a string.
+  absl::string_view InfoString(int tag_id) const;
+
+  // The values of the FORMAT field with header id |tag_id| for the sample with
+  // index |sample| in the record. Empty if the field isn't present in the
+  // record or its values can't be read as T. Genotypes (GT) are read as int in
+  // htslib's encoding; use bcf_gt_allele and bcf_gt_is_phased to decode them.
+  template <class T>
+  VcfValues<T> Format(int tag_id, int sample) const;
+
+  // The value of the String FORMAT field with header id |tag_id| for the
+  // sample with index |sample|, or an empty string_view if the field isn't
+  // present in the record or isn't a string.
+  absl::string_view FormatString(int tag_id, int sample) const;
+
+ private:
+  const bcf_hdr_t* header_;
+  bcf1_t* record_;
+};
+
+// The allele index of the j-th value of genotype |gt|, as returned by
+// VcfVariantView::Format for GT, or -1 if that allele is missing ('.').
+inline int GenotypeAllele(const VcfValues<int>& gt, int j) {
+  return gt.IsMissing(j) || bcf_gt_is_missing(gt[j]) ? -1
+                                                     : bcf_gt_allele(gt[j]);
+}
+
+// What the called alleles of a genotype have in common.
+struct GenotypeSummary {
+  // Is any allele of the genotype missing?
+  bool missing = false;
+  // Is any called allele an alternate allele?
+  bool any_alt = false;
+  // Are all the called alleles the same (homozygous)?
+  bool all_same = true;
+};
+
+// Summarizes genotype |gt|, as returned by VcfVariantView::Format for GT. An
+// empty genotype has no missing alleles.
+GenotypeSummary SummarizeGenotype(const VcfValues<int>& gt);
+
+template <class T>
+VcfValues<T> VcfVariantView::Info(int tag_id) const {
+  const bcf_info_t* info = bcf_get_info_id(record_, tag_id);
+  if (info == nullptr || info->vptr == nullptr ||
+      !VcfType<T>::IsPackedType(info->type)) {
+    return VcfValues<T>();
+  }
+  return VcfValues<T>(info->vptr, info->type, info->len);
+}
+
+template <class T>
+VcfValues<T> VcfVariantView::Format(int tag_id, int sample) const {
+  const bcf_fmt_t* fmt = bcf_get_fmt_id(record_, tag_id);
+  if (fmt == nullptr || fmt->p == nullptr ||
+      !VcfType<T>::IsPackedType(fmt->type) || sample < 0 ||
+      sample >= record_->n_sample) {
+    return VcfValues<T>();
+  }
+  return VcfValues<T>(fmt->p + sample * fmt->size, fmt->type, fmt->n);
+}
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_IO_VCF_VARIANT_VIEW_H_
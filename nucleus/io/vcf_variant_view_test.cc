@@ -0,0 +1,217 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/io/vcf_variant_view.h"
+
+#include "tensorflow/core/platform/test.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/testing/test_utils.h"
+
+namespace nucleus {
+
+class VcfVariantViewTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    header_ = MakeVcfHeader(
+        {
+            "##contig=<ID=Chr1,length=1000>",
+            "##contig=<ID=Chr2,length=100000>",
+            "##FILTER=<ID=LowQual,Description=\"LowQual\">",
+            "##FILTER=<ID=LowDP,Description=\"LowDP\">",
+            "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"DP\">",
+            "##INFO=<ID=AC,Number=A,Type=Integer,Description=\"AC\">",
+            "##INFO=<ID=AF,Number=A,Type=Float,Description=\"AF\">",
+            "##INFO=<ID=DB,Number=0,Type=Flag,Description=\"DB\">",
+            "##INFO=<ID=CSQ,Number=1,Type=String,Description=\"CSQ\">",
+            "##INFO=<ID=END,Number=1,Type=Integer,Description=\"END\">",
+            "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"GT\">",
+            "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"AD\">",
+            "##FORMAT=<ID=HQ,Number=.,Type=Float,Description=\"HQ\">",
+            "##FORMAT=<ID=FT,Number=1,Type=String,Description=\"FT\">",
+        },
+        {"s1", "s2", "s3"});
+    record_ = bcf_init();
+  }
+
+  void TearDown() override {
+    bcf_destroy(record_);
+    bcf_hdr_destroy(header_);
+  }
+
+  // Parses |line| into record_ and returns a view of it.
+  VcfVariantView Parse(const string& line) {
+    ParseVcfLine(header_, line, record_);
+    return VcfVariantView(header_, record_);
+  }
+
+  bcf_hdr_t* header_;
+  bcf1_t* record_;
+};
+
+TEST_F(VcfVariantViewTest, SiteFields) {
+  VcfVariantView view =
+      Parse("Chr2\t1000\trs1\tAc\tC,<NON_REF>\t12.5\tLowQual;LowDP\t.\tGT\t"
+            "0/1\t1/1\t./.");
+  EXPECT_EQ(1, view.contig_id());
+  EXPECT_STREQ("Chr2", view.contig_name());
+  EXPECT_EQ(999, view.start());
+  EXPECT_EQ(1001, view.end());
+  ASSERT_EQ(3, view.num_alleles());
+  EXPECT_EQ("Ac", view.allele(0));
+  EXPECT_EQ("C", view.allele(1));
+  EXPECT_EQ("<NON_REF>", view.allele(2));
+  EXPECT_TRUE(view.has_quality());
+  EXPECT_FLOAT_EQ(12.5, view.quality());
+  ASSERT_EQ(2, view.num_filters());
+  EXPECT_STREQ("LowQual", view.filter_name(0));
+  EXPECT_STREQ("LowDP", view.filter_name(1));
+  EXPECT_EQ(bcf_hdr_id2int(header_, BCF_DT_ID, "LowDP"), view.filter_id(1));
+  EXPECT_EQ(3, view.num_samples());
+
+  view = Parse("Chr1\t5\t.\tA\t.\t.\t.\tEND=20\tGT\t0/0\t0/0\t0/0");
+  EXPECT_EQ(0, view.contig_id());
+  EXPECT_EQ(4, view.start());
+  EXPECT_EQ(20, view.end());
+  EXPECT_EQ(1, view.num_alleles());
+  EXPECT_FALSE(view.has_quality());
+  EXPECT_EQ(0, view.num_filters());
+}
+
+TEST_F(VcfVariantViewTest, InfoFields) {
+  VcfVariantView view = Parse(
+      "Chr1\t10\t.\tA\tC,G\t.\t.\tDP=1000;AC=3,.;AF=0.25,0.5;DB;CSQ=missense"
+      "\tGT\t0/1\t1/2\t./.");
+  const int dp_id = view.InfoTagId("DP");
+  const int ac_id = view.InfoTagId("AC");
+  const int af_id = view.InfoTagId("AF");
+  const int db_id = view.InfoTagId("DB");
+  const int csq_id = view.InfoTagId("CSQ");
+  EXPECT_EQ(-1, view.InfoTagId("MISSING"));
+  EXPECT_EQ(-1, view.InfoTagId("GT"));
+
+  // DP needs 16 bits, AC fits in 8 bits.
+  const VcfValues<int> dp = view.Info<int>(dp_id);
+  ASSERT_EQ(1, dp.size());
+  EXPECT_EQ(1000, dp[0]);
+  const VcfValues<int> ac = view.Info<int>(ac_id);
+  ASSERT_EQ(2, ac.size());
+  EXPECT_EQ(3, ac[0]);
+  EXPECT_FALSE(ac.IsMissing(0));
+  EXPECT_TRUE(ac.IsMissing(1));
+  EXPECT_EQ(bcf_int32_missing, ac[1]);
+  const VcfValues<float> af = view.Info<float>(af_id);
+  ASSERT_EQ(2, af.size());
+  EXPECT_FLOAT_EQ(0.25, af[0]);
+  EXPECT_FLOAT_EQ(0.5, af[1]);
+  EXPECT_TRUE(view.HasInfo(db_id));
+  EXPECT_EQ("missense", view.InfoString(csq_id));
+
+  // Mismatched types read as empty.
+  EXPECT_TRUE(view.Info<float>(dp_id).empty());
+  EXPECT_TRUE(view.Info<int>(af_id).empty());
+  EXPECT_TRUE(view.Info<int>(csq_id).empty());
+  EXPECT_TRUE(view.InfoString(dp_id).empty());
+
+  // Ids are reused for the next record, where the fields are absent.
+  view = Parse("Chr1\t20\t.\tA\tC\t.\t.\t.\tGT\t0/1\t0/0\t0/0");
+  EXPECT_FALSE(view.HasInfo(db_id));
+  EXPECT_TRUE(view.Info<int>(dp_id).empty());
+  EXPECT_TRUE(view.InfoString(csq_id).empty());
+}
+
+TEST_F(VcfVariantViewTest, FormatFields) {
+  VcfVariantView view = Parse(
+      "Chr1\t10\t.\tA\tC,G\t.\t.\t.\tGT:AD:HQ:FT\t0|1:300,2,0:1.5,2:PASS\t"
+      "1/2:.:3:LowGQ\t./.:1,2:.:.");
+  const int gt_id = view.FormatTagId("GT");
+  const int ad_id = view.FormatTagId("AD");
+  const int hq_id = view.FormatTagId("HQ");
+  const int ft_id = view.FormatTagId("FT");
+  EXPECT_EQ(-1, view.FormatTagId("DP"));
+
+  const VcfValues<int> gt = view.Format<int>(gt_id, 0);
+  ASSERT_EQ(2, gt.size());
+  EXPECT_EQ(0, bcf_gt_allele(gt[0]));
+  EXPECT_EQ(1, bcf_gt_allele(gt[1]));
+  EXPECT_TRUE(bcf_gt_is_phased(gt[1]));
+  EXPECT_TRUE(bcf_gt_is_missing(view.Format<int>(gt_id, 2)[0]));
+
+  const VcfValues<int> ad0 = view.Format<int>(ad_id, 0);
+  ASSERT_EQ(3, ad0.size());
+  EXPECT_EQ(300, ad0[0]);
+  EXPECT_EQ(2, ad0[1]);
+  EXPECT_EQ(0, ad0[2]);
+  const VcfValues<int> ad1 = view.Format<int>(ad_id, 1);
+  ASSERT_EQ(1, ad1.size());
+  EXPECT_TRUE(ad1.IsMissing(0));
+  // The values of shorter samples end at the vector end padding.
+  EXPECT_EQ(2, view.Format<int>(ad_id, 2).size());
+
+  const VcfValues<float> hq0 = view.Format<float>(hq_id, 0);
+  ASSERT_EQ(2, hq0.size());
+  EXPECT_FLOAT_EQ(1.5, hq0[0]);
+  EXPECT_FLOAT_EQ(2, hq0[1]);
+  EXPECT_EQ(1, view.Format<float>(hq_id, 1).size());
+
+  EXPECT_EQ("PASS", view.FormatString(ft_id, 0));
+  EXPECT_EQ("LowGQ", view.FormatString(ft_id, 1));
+  EXPECT_EQ(".", view.FormatString(ft_id, 2));
+
+  // Out of range samples and mismatched types read as empty.
+  EXPECT_TRUE(view.Format<int>(ad_id, 3).empty());
+  EXPECT_TRUE(view.Format<int>(ad_id, -1).empty());
+  EXPECT_TRUE(view.Format<float>(ad_id, 0).empty());
+  EXPECT_TRUE(view.FormatString(ad_id, 0).empty());
+  EXPECT_TRUE(view.FormatString(ft_id, 3).empty());
+
+  // Fields removed from the record keep their entry, without values.
+  ASSERT_EQ(0, bcf_update_format_int32(header_, record_, "AD", nullptr, 0));
+  ASSERT_EQ(0, bcf_update_format_string(header_, record_, "FT", nullptr, 0));
+  EXPECT_TRUE(view.Format<int>(ad_id, 0).empty());
+  EXPECT_TRUE(view.FormatString(ft_id, 0).empty());
+}
+
+TEST_F(VcfVariantViewTest, SummarizesGenotypes) {
+  VcfVariantView view =
+      Parse("Chr1\t10\t.\tA\tC,G\t.\t.\t.\tGT\t1|2\t0/.\t2/2");
+  const int gt_id = view.FormatTagId("GT");
+
+  const VcfValues<int> het = view.Format<int>(gt_id, 0);
+  EXPECT_EQ(2, GenotypeAllele(het, 1));
+  GenotypeSummary summary = SummarizeGenotype(het);
+  EXPECT_FALSE(summary.missing);
+  EXPECT_TRUE(summary.any_alt);
+  EXPECT_FALSE(summary.all_same);
+
+  const VcfValues<int> partial = view.Format<int>(gt_id, 1);
+  EXPECT_EQ(0, GenotypeAllele(partial, 0));
+  EXPECT_EQ(-1, GenotypeAllele(partial, 1));
+  summary = SummarizeGenotype(partial);
+  EXPECT_TRUE(summary.missing);
+  EXPECT_FALSE(summary.any_alt);
+  EXPECT_TRUE(summary.all_same);
+
+  summary = SummarizeGenotype(view.Format<int>(gt_id, 2));
+  EXPECT_FALSE(summary.missing);
+  EXPECT_TRUE(summary.any_alt);
+  EXPECT_TRUE(summary.all_same);
+
+  summary = SummarizeGenotype(VcfValues<int>());
+  EXPECT_FALSE(summary.missing);
+  EXPECT_FALSE(summary.any_alt);
+}
+
+}  // namespace nucleus
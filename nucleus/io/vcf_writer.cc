@@ -25,8 +25,12 @@
 #include "google/protobuf/map.h"
 #include "google/protobuf/repeated_field.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/substitute.h"
+#include "htslib/bgzf.h"
+#include "htslib/hfile.h"
 #include "htslib/hts.h"
+#include "htslib/kstring.h"
 #include "htslib/sam.h"
 #include "nucleus/io/hts_path.h"
 #include "nucleus/io/vcf_conversion.h"
@@ -35,7 +39,9 @@
 #include "nucleus/util/utils.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/notification.h"
 
 namespace nucleus {
 
@@ -51,6 +57,9 @@ constexpr char kBCFOpenModeUncompressed[] = "wbu";
 constexpr char kOpenModeCompressed[] = "wz";
 constexpr char kOpenModeUncompressed[] = "w";
 
+// The default of VcfWriterOptions.conversion_batch_size.
+constexpr int kDefaultConversionBatchSize = 1024;
+
 // RAII wrapper on top of bcf1_t* to always perform cleanup.
 class BCFRecord {
  public:
@@ -71,8 +80,50 @@ class BCFRecord {
   bcf1_t* bcf1_;
 };
 
+// Returns |status|, an error writing |variant|, the |index|-th Variant passed
+// to Write, with the index and position of |variant| added to its message.
+tf::Status VariantError(const tf::Status& status, int64 index,
+                        const Variant& variant) {
+  return tf::Status(status.code(),
+                    absl::StrCat("Variant ", index, " (",
+                                 variant.reference_name(), ":",
+                                 variant.start() + 1,
+                                 "): ", status.error_message()));
+}
+
 }  // namespace
 
+struct VcfWriter::Batch {
+  Batch() : text{0, 0, nullptr} {}
+  ~Batch() {
+    for (bcf1_t* record : records) bcf_destroy(record);
+    free(text.s);
+  }
+
+  // The first num_variants elements are the Variants to write; the others are
+  // kept to reuse their memory.
+  std::vector<Variant> variants;
+  int num_variants = 0;
+  // The number of Variants passed to Write before those of this batch.
+  int64 first_index;
+  // Whether the batch is converted to text, for unindexed VCF output, or to
+  // records.
+  bool as_text;
+  // The converted records, if not as_text; only the first num_records are
+  // used, and record_variants holds the index in variants of each. For text,
+  // the first record is the scratch record.
+  std::vector<bcf1_t*> records;
+  std::vector<int> record_variants;
+  int num_records;
+  // The VCF lines of the converted records, if as_text.
+  kstring_t text;
+  // The error converting the first Variant of the batch that failed, and its
+  // index in variants. The Variants that fail conversion are left out.
+  tf::Status status;
+  int failed_variant;
+  std::unique_ptr<tf::Notification> converted;
+};
+
 StatusOr<std::unique_ptr<VcfWriter>> VcfWriter::ToFile(
     const string& variants_path, const nucleus::genomics::v1::VcfHeader& header,
     const nucleus::genomics::v1::VcfWriterOptions& options) {
@@ -81,9 +132,17 @@ StatusOr<std::unique_ptr<VcfWriter>> VcfWriter::ToFile(
   if (fp == nullptr) {
     return tf::errors::Unknown("Could not open variants_path: ", variants_path);
   }
+  // The thread pool is owned by |fp| and torn down by hts_close.
+  if (options.num_threads() > 0 &&
+      hts_set_threads(fp, options.num_threads()) < 0) {
+    hts_close(fp);
+    return tf::errors::Unknown("Failed to set up ", options.num_threads(),
+                               " threads for writing ", variants_path);
+  }
 
   auto writer = absl::WrapUnique(new VcfWriter(header, options, fp));
   TF_RETURN_IF_ERROR(writer->WriteHeader());
+  TF_RETURN_IF_ERROR(writer->InitIndex(variants_path));
   return std::move(writer);
 }
 
@@ -99,10 +158,17 @@ VcfWriter::VcfWriter(const nucleus::genomics::v1::VcfHeader& header,
                               options_.excluded_info_fields().end()),
           std::vector<string>(options_.excluded_format_fields().begin(),
                               options_.excluded_format_fields().end()),
-          options_.retrieve_gl_and_pl_from_info_map()) {
+          options_.retrieve_gl_and_pl_from_info_map()),
+      batch_size_(options_.conversion_batch_size() > 0
+                      ? options_.conversion_batch_size()
+                      : kDefaultConversionBatchSize) {
   CHECK(fp != nullptr);
 
   TF_CHECK_OK(VcfHeaderConverter::ConvertFromPb(vcf_header_, &header_));
+  if (options_.num_conversion_threads() > 0) {
+    conversion_pool_ = absl::make_unique<tf::thread::ThreadPool>(
+        tf::Env::Default(), "vcf_writer", options_.num_conversion_threads());
+  }
 }
 
 tf::Status VcfWriter::WriteHeader() {
@@ -115,8 +181,81 @@ tf::Status VcfWriter::WriteHeader() {
   return tf::Status::OK();
 }
 
+tf::Status VcfWriter::InitIndex(const string& variants_path) {
+  if (!options_.write_index()) {
+    return tf::Status::OK();
+  }
+  if (fp_->format.compression != bgzf) {
+    return tf::errors::InvalidArgument(
+        "Only bgzip-compressed output can be indexed while writing: ",
+        variants_path);
+  }
+  if (options_.exclude_header()) {
+    return tf::errors::InvalidArgument(
+        "Output written without a header can't be indexed: ", variants_path);
+  }
+  const int min_shift = options_.index_min_shift();
+  const bool is_bcf = fp_->format.format == bcf;
+  if (is_bcf && min_shift <= 0) {
+    return tf::errors::InvalidArgument(
+        "BCF files can only be indexed with CSI, which needs a positive "
+        "min_shift, but got ", min_shift);
+  }
+  index_path_ = variants_path + (min_shift > 0 ? ".csi" : ".tbi");
+  if (bcf_idx_init(fp_, header_, min_shift, index_path_.c_str()) < 0) {
+    index_path_.clear();
+    return tf::errors::Internal("Failed to start the index of ",
+                                variants_path);
+  }
+  return tf::Status::OK();
+}
+
+tf::Status VcfWriter::CheckSorted(const bcf1_t* v) {
+  if (v->rid == last_rid_) {
+    if (v->pos < last_pos_) {
+      return tf::errors::FailedPrecondition(
+          "Cannot index unsorted VCF records: ", bcf_seqname(header_, v), ":",
+          v->pos + 1, " follows ", bcf_seqname(header_, v), ":",
+          last_pos_ + 1);
+    }
+  } else {
+    if (v->rid < static_cast<int>(indexed_contigs_.size()) &&
+        indexed_contigs_[v->rid]) {
+      return tf::errors::FailedPrecondition(
+          "Cannot index unsorted VCF records: the records of ",
+          bcf_seqname(header_, v), " are not contiguous");
+    }
+    if (v->rid >= static_cast<int>(indexed_contigs_.size())) {
+      indexed_contigs_.resize(v->rid + 1, false);
+    }
+    indexed_contigs_[v->rid] = true;
+    last_rid_ = v->rid;
+  }
+  last_pos_ = v->pos;
+  return tf::Status::OK();
+}
+
+tf::Status VcfWriter::WriteRecord(bcf1_t* v) {
+  if (!index_path_.empty()) {
+    TF_RETURN_IF_ERROR(CheckSorted(v));
+  }
+  if (bcf_write(fp_, header_, v) != 0) {
+    return tf::errors::Unknown("bcf_write call failed");
+  }
+  return tf::Status::OK();
+}
+
 VcfWriter::~VcfWriter() {
   if (fp_) {
+    // Errors converting or writing the Variants queued since the last call
+    // to Write have no caller left to be returned to, so they are only
+    // logged.
+    if (conversion_pool_ != nullptr) {
+      const tf::Status status = FlushBatches();
+      if (!status.ok()) {
+        LOG(ERROR) << "Error writing VCF records: " << status;
+      }
+    }
     // There's nothing we can do but assert fail if there's an error during
     // the Close() call here.
     TF_CHECK_OK(Close());
@@ -126,34 +265,165 @@ VcfWriter::~VcfWriter() {
 tf::Status VcfWriter::Write(const Variant& variant_message) {
   if (fp_ == nullptr)
     return tf::errors::FailedPrecondition("Cannot write to closed VCF stream.");
+  if (conversion_pool_ != nullptr) {
+    if (batch_ == nullptr) {
+      if (free_batches_.empty()) {
+        batch_ = absl::make_unique<Batch>();
+      } else {
+        batch_ = std::move(free_batches_.back());
+        free_batches_.pop_back();
+      }
+    }
+    Batch& batch = *batch_;
+    if (batch.num_variants < static_cast<int>(batch.variants.size())) {
+      batch.variants[batch.num_variants] = variant_message;
+    } else {
+      batch.variants.push_back(variant_message);
+    }
+    ++batch.num_variants;
+    if (batch.num_variants == batch_size_) SubmitBatch();
+    // Writing out the batches converted so far returns their errors as soon
+    // as possible.
+    return WriteBatches(2 * conversion_pool_->NumThreads());
+  }
+
   BCFRecord v;
   if (v.get_bcf1() == nullptr) {
     return tf::errors::Unknown("bcf_init call failed");
   }
+  TF_RETURN_IF_ERROR(ConvertRecord(variant_message, v.get_bcf1()));
+  return WriteRecord(v.get_bcf1());
+}
+
+tf::Status VcfWriter::ConvertRecord(const Variant& variant_message,
+                                    bcf1_t* v) const {
   TF_RETURN_IF_ERROR(
-      RecordConverter().ConvertFromPb(variant_message, *header_, v.get_bcf1()));
-  if (options_.round_qual_values() &&
-      !bcf_float_is_missing(v.get_bcf1()->qual)) {
+      RecordConverter().ConvertFromPb(variant_message, *header_, v));
+  if (options_.round_qual_values() && !bcf_float_is_missing(v->qual)) {
     // Round quality value printed out to one digit past the decimal point.
     double rounded_quality = floor(variant_message.quality() * 10 + 0.5) / 10;
-    v.get_bcf1()->qual = rounded_quality;
-  }
-  if (bcf_write(fp_, header_, v.get_bcf1()) != 0) {
-    return tf::errors::Unknown("bcf_write call failed");
+    v->qual = rounded_quality;
   }
   return tf::Status::OK();
 }
 
+void VcfWriter::ConvertBatch(Batch* batch) const {
+  batch->status = tf::Status::OK();
+  batch->num_records = 0;
+  batch->text.l = 0;
+  for (int i = 0; i < batch->num_variants; ++i) {
+    const int r = batch->as_text ? 0 : batch->num_records;
+    if (r == static_cast<int>(batch->records.size())) {
+      batch->records.push_back(bcf_init());
+      batch->record_variants.push_back(0);
+    }
+    bcf1_t* v = batch->records[r];
+    bcf_clear(v);
+    tf::Status status = ConvertRecord(batch->variants[i], v);
+    if (status.ok() && batch->as_text) {
+      // The checks and formatting of bcf_write for VCF output.
+      const size_t text_length = batch->text.l;
+      if (bcf_hdr_nsamples(header_) != v->n_sample ||
+          vcf_format(header_, v, &batch->text) != 0) {
+        batch->text.l = text_length;
+        status = tf::errors::Unknown("bcf_write call failed");
+      }
+    }
+    if (!status.ok()) {
+      if (batch->status.ok()) {
+        batch->status =
+            VariantError(status, batch->first_index + i, batch->variants[i]);
+        batch->failed_variant = i;
+      }
+    } else if (!batch->as_text) {
+      batch->record_variants[batch->num_records++] = i;
+    }
+  }
+  batch->converted->Notify();
+}
+
+void VcfWriter::SubmitBatch() {
+  Batch* batch = batch_.get();
+  batch->first_index = num_submitted_;
+  num_submitted_ += batch->num_variants;
+  // The index is built by bcf_write as it writes each record.
+  batch->as_text =
+      index_path_.empty() &&
+      (fp_->format.format == vcf || fp_->format.format == text_format);
+  batch->converted = absl::make_unique<tf::Notification>();
+  in_flight_.push_back(std::move(batch_));
+  conversion_pool_->Schedule([this, batch]() { ConvertBatch(batch); });
+}
+
+tf::Status VcfWriter::WriteBatches(size_t max_in_flight) {
+  tf::Status status;
+  while (!in_flight_.empty() &&
+         (in_flight_.size() > max_in_flight ||
+          in_flight_.front()->converted->HasBeenNotified())) {
+    std::unique_ptr<Batch> batch = std::move(in_flight_.front());
+    in_flight_.pop_front();
+    batch->converted->WaitForNotification();
+    status.Update(WriteBatch(*batch));
+    batch->num_variants = 0;
+    free_batches_.push_back(std::move(batch));
+  }
+  return status;
+}
+
+tf::Status VcfWriter::FlushBatches() {
+  if (batch_ != nullptr && batch_->num_variants > 0) SubmitBatch();
+  return WriteBatches(0);
+}
+
+tf::Status VcfWriter::WriteBatch(const Batch& batch) {
+  if (batch.as_text) {
+    // As vcf_write does after formatting a record.
+    const ssize_t written =
+        fp_->format.compression != no_compression
+            ? bgzf_write(fp_->fp.bgzf, batch.text.s, batch.text.l)
+            : hwrite(fp_->fp.hfile, batch.text.s, batch.text.l);
+    if (written != static_cast<ssize_t>(batch.text.l)) {
+      return tf::errors::Unknown("bcf_write call failed");
+    }
+    return batch.status;
+  }
+  // Returns the error of the first Variant that failed to be converted or
+  // written.
+  tf::Status status = batch.status;
+  int failed = status.ok() ? batch.num_variants : batch.failed_variant;
+  for (int r = 0; r < batch.num_records; ++r) {
+    const tf::Status record_status = WriteRecord(batch.records[r]);
+    const int i = batch.record_variants[r];
+    if (!record_status.ok() && i < failed) {
+      failed = i;
+      status = VariantError(record_status, batch.first_index + i,
+                            batch.variants[i]);
+    }
+  }
+  return status;
+}
+
 tf::Status VcfWriter::Close() {
   if (fp_ == nullptr)
     return tf::errors::FailedPrecondition(
         "Cannot close an already closed VcfWriter");
+  tf::Status status;
+  if (conversion_pool_ != nullptr) {
+    status.Update(FlushBatches());
+    // Joins the conversion threads.
+    conversion_pool_.reset();
+  }
+  if (!index_path_.empty() &&
+      (bgzf_flush(fp_->fp.bgzf) < 0 || bcf_idx_save(fp_) < 0)) {
+    status.Update(
+        tf::errors::Unknown("Failed to write the index ", index_path_));
+  }
   if (hts_close(fp_) < 0)
     return tf::errors::Unknown("hts_close call failed");
   fp_ = nullptr;
   bcf_hdr_destroy(header_);
   header_ = nullptr;
-  return tf::Status::OK();
+  return status;
 }
 
 // static
@@ -18,8 +18,10 @@
 #ifndef THIRD_PARTY_NUCLEUS_IO_VCF_WRITER_H_
 #define THIRD_PARTY_NUCLEUS_IO_VCF_WRITER_H_
 
+#include <deque>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "htslib/hts.h"
 #include "htslib/sam.h"
@@ -31,6 +33,7 @@
 #include "nucleus/util/proto_ptr.h"
 #include "nucleus/vendor/statusor.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 
 namespace nucleus {
 
@@ -55,6 +58,10 @@ class VcfWriter {
   // Note that variant calls must be provided in the same order as samples
   // listed in the options. Returns Status::OK() if the write was successful;
   // otherwise the status provides information about what error occurred.
+  // With VcfWriterOptions.num_conversion_threads > 0, the record is only
+  // queued here. An error converting or writing it is returned, with the
+  // index of the record among those passed to Write and its position, by a
+  // later call to Write or by Close. That call still queues its own record.
   tensorflow::Status Write(
       const nucleus::genomics::v1::Variant& variant_message);
   tensorflow::Status WritePython(
@@ -92,6 +99,42 @@ class VcfWriter {
 
   tensorflow::Status WriteHeader();
 
+  // Starts building the index of the output at |variants_path|, if
+  // options_.write_index().
+  tensorflow::Status InitIndex(const string& variants_path);
+
+  // Returns an error if the index being built can't take |v| after the
+  // records written so far.
+  tensorflow::Status CheckSorted(const bcf1_t* v);
+
+  // Writes |v| to fp_, checking that it is sorted if indexing.
+  tensorflow::Status WriteRecord(bcf1_t* v);
+
+  // A batch of Variants converted by the conversion threads.
+  struct Batch;
+
+  // Converts |variant_message| into |v|, applying the writer options.
+  tensorflow::Status ConvertRecord(
+      const nucleus::genomics::v1::Variant& variant_message, bcf1_t* v) const;
+
+  // Converts the Variants of |batch| to records or, for unindexed VCF output,
+  // to text. Runs on the conversion threads.
+  void ConvertBatch(Batch* batch) const;
+
+  // Hands batch_ to the conversion threads.
+  void SubmitBatch();
+
+  // Writes out converted batches in order, waiting for them as needed until
+  // at most |max_in_flight| batches remain. Returns the first error of the
+  // written batches.
+  tensorflow::Status WriteBatches(size_t max_in_flight);
+
+  // Submits the partial batch_, if any, and writes out all batches.
+  tensorflow::Status FlushBatches();
+
+  // Writes the converted |batch| to fp_.
+  tensorflow::Status WriteBatch(const Batch& batch);
+
   // A pointer to the htslib file used to write the VCF data.
   htsFile* fp_;
 
@@ -106,6 +149,26 @@ class VcfWriter {
 
   // VCF record interconverter.
   VcfRecordConverter record_converter_;
+
+  // The conversion pipeline, if options_.num_conversion_threads() > 0: the
+  // conversion threads, the batch Write is filling, the batches submitted for
+  // conversion in Write order, and written batches kept for reuse.
+  std::unique_ptr<tensorflow::thread::ThreadPool> conversion_pool_;
+  std::unique_ptr<Batch> batch_;
+  std::deque<std::unique_ptr<Batch>> in_flight_;
+  std::vector<std::unique_ptr<Batch>> free_batches_;
+  int batch_size_;
+  // The number of Variants submitted for conversion so far.
+  int64 num_submitted_ = 0;
+
+  // The path of the index being built, or empty if not indexing. htslib
+  // keeps a pointer to it until the index is saved.
+  string index_path_;
+  // The contig id and start of the last record written while indexing, and
+  // the contig ids written so far.
+  int last_rid_ = -1;
+  int64 last_pos_ = -1;
+  std::vector<bool> indexed_contigs_;
 };
 
 }  // namespace nucleus
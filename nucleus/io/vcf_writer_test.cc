@@ -27,6 +27,8 @@
 #include <gmock/gmock-more-matchers.h>
 
 #include "tensorflow/core/platform/test.h"
+#include "absl/strings/str_cat.h"
+#include "nucleus/io/vcf_reader.h"
 #include "nucleus/platform/types.h"
 #include "nucleus/protos/reference.pb.h"
 #include "nucleus/protos/variants.pb.h"
@@ -91,7 +93,8 @@ std::unique_ptr<VcfWriter> MakeDogVcfWriter(
     const string& fname, const bool round_qual, const bool include_gl = true,
     const std::vector<string>& excluded_infos = {},
     const std::vector<string>& excluded_formats = {},
-    bool exclude_header = false) {
+    bool exclude_header = false, int num_conversion_threads = 0,
+    bool write_index = false, int index_min_shift = 0) {
   nucleus::genomics::v1::VcfHeader header;
   // FILTERs. Note that the PASS filter automatically gets added even though it
   // is not present here.
@@ -215,6 +218,13 @@ std::unique_ptr<VcfWriter> MakeDogVcfWriter(
   }
 
   writer_options.set_exclude_header(exclude_header);
+  if (num_conversion_threads > 0) {
+    writer_options.set_num_conversion_threads(num_conversion_threads);
+    // Small batches, to have many of them in flight.
+    writer_options.set_conversion_batch_size(3);
+  }
+  writer_options.set_write_index(write_index);
+  writer_options.set_index_min_shift(index_min_shift);
 
   return std::move(
       VcfWriter::ToFile(fname, header, writer_options).ValueOrDie());
@@ -470,6 +480,208 @@ TEST(VcfWriterTest, WritesVCFWithLikelihoods) {
   EXPECT_EQ(expected_vcf_contents, vcf_contents);
 }
 
+TEST(VcfWriterTest, MatchesCallsToSamplesByNameOrIndex) {
+  auto writer = MakeDogVcfWriter(MakeTempFile("call_sets.vcf"), false, true);
+  Variant v = MakeVariant({}, "Chr1", 20, 21, "A", {"T"});
+  VariantCall* fido = v.add_calls();
+  fido->set_call_set_index(0);
+  fido->add_genotype(0);
+  fido->add_genotype(1);
+  *v.add_calls() = MakeVariantCall("Spot", {0, 0});
+  EXPECT_THAT(writer->Write(v), IsOK());
+
+  // A call with neither a name nor an index isn't taken for the first sample.
+  fido->clear_call_set_index();
+  EXPECT_THAT(writer->Write(v),
+              IsNotOKWithCodeAndMessage(tensorflow::error::FAILED_PRECONDITION,
+                                        "unrecognized call set name"));
+
+  fido->set_call_set_index(1);
+  EXPECT_THAT(writer->Write(v),
+              IsNotOKWithCodeAndMessage(tensorflow::error::FAILED_PRECONDITION,
+                                        "Out-of-order call set index"));
+  EXPECT_THAT(writer->Close(), IsOK());
+}
+
+TEST(VcfWriterTest, ConversionThreadsWriteSameOutput) {
+  std::vector<Variant> variants = ReadProtosFromTFRecord<Variant>(
+      GetTestData(kVcfLikelihoodsGoldenFilename));
+  // Repeat the variants so that batches are converted concurrently.
+  const size_t num_golden = variants.size();
+  for (int i = 0; i < 10; ++i) {
+    variants.insert(variants.end(), variants.begin(),
+                    variants.begin() + num_golden);
+  }
+  for (const string& extension : {".vcf", ".bcf", ".vcf.gz"}) {
+    std::vector<string> contents;
+    for (int num_threads : {0, 4}) {
+      const string out_fname = MakeTempFile(
+          absl::StrCat("conversion_threads_", num_threads, extension));
+      auto writer = MakeDogVcfWriter(out_fname, false, false, {}, {}, false,
+                                     num_threads);
+      for (const auto& variant : variants) {
+        ASSERT_THAT(writer->Write(variant), IsOK());
+      }
+      ASSERT_THAT(writer->Close(), IsOK());
+      string file_contents;
+      TF_CHECK_OK(tensorflow::ReadFileToString(tensorflow::Env::Default(),
+                                               out_fname, &file_contents));
+      contents.push_back(file_contents);
+    }
+    EXPECT_EQ(contents[0], contents[1]) << extension;
+  }
+}
+
+TEST(VcfWriterTest, ConversionThreadsReportErrors) {
+  string output_filename = MakeTempFile("conversion_threads_error.vcf");
+  auto writer = MakeDogVcfWriter(output_filename, false, true, {}, {}, false,
+                                 /*num_conversion_threads=*/2);
+  Variant good = MakeVariant({}, "Chr1", 20, 21, "A", {"T"});
+  *good.add_calls() = MakeVariantCall("Fido", {0, 1});
+  *good.add_calls() = MakeVariantCall("Spot", {0, 0});
+  Variant bad = good;
+  bad.set_reference_name("Chr3");
+
+  // The error is returned once, by a later Write or by Close, and names the
+  // failing Variant.
+  std::vector<tensorflow::Status> errors;
+  for (const Variant* variant : {&good, &bad, &good, &good}) {
+    const tensorflow::Status status = writer->Write(*variant);
+    if (!status.ok()) errors.push_back(status);
+  }
+  const tensorflow::Status status = writer->Close();
+  if (!status.ok()) errors.push_back(status);
+  ASSERT_EQ(1, errors.size());
+  EXPECT_THAT(errors[0],
+              IsNotOKWithCodeAndMessage(tensorflow::error::NOT_FOUND,
+                                        "Variant 1 (Chr3:21)"));
+
+  // The other records are written.
+  string vcf_contents;
+  TF_CHECK_OK(tensorflow::ReadFileToString(tensorflow::Env::Default(),
+                                           output_filename, &vcf_contents));
+  const string record = "Chr1\t21\t.\tA\tT\t0\t.\t.\tGT\t0/1\t0/0\n";
+  EXPECT_THAT(vcf_contents,
+              testing::EndsWith(absl::StrCat("\n", record, record, record)));
+}
+
+TEST(VcfWriterTest, ConversionThreadsReportUnsortedRecordsWhenIndexing) {
+  const string output_filename =
+      MakeTempFile("conversion_threads_unsorted.vcf.gz");
+  auto writer = MakeDogVcfWriter(output_filename, false, true, {}, {}, false,
+                                 /*num_conversion_threads=*/2,
+                                 /*write_index=*/true);
+  tensorflow::Status status;
+  for (int start : {10, 20, 5, 30}) {
+    Variant v = MakeVariant({}, "Chr1", start, start + 1, "A", {"T"});
+    *v.add_calls() = MakeVariantCall("Fido", {0, 1});
+    *v.add_calls() = MakeVariantCall("Spot", {0, 0});
+    status.Update(writer->Write(v));
+  }
+  status.Update(writer->Close());
+  EXPECT_THAT(status,
+              IsNotOKWithCodeAndMessage(tensorflow::error::FAILED_PRECONDITION,
+                                        "Variant 2 (Chr1:6)"));
+}
+
+TEST(VcfWriterTest, DestroyingUnclosedWriterAfterBadRecordClosesIt) {
+  for (const string& extension : {".vcf", ".vcf.gz", ".bcf.gz"}) {
+    for (bool write_index : {false, true}) {
+      if (write_index && extension == ".vcf") continue;
+      const string output_filename =
+          MakeTempFile(absl::StrCat("unclosed_", write_index, extension));
+      auto writer = MakeDogVcfWriter(
+          output_filename, false, true, {}, {}, false,
+          /*num_conversion_threads=*/2, write_index,
+          /*index_min_shift=*/extension == ".bcf.gz" ? 14 : 0);
+      auto write = [&writer](const string& contig, int start) {
+        Variant v = MakeVariant({}, contig, start, start + 1, "A", {"T"});
+        *v.add_calls() = MakeVariantCall("Fido", {0, 1});
+        *v.add_calls() = MakeVariantCall("Spot", {0, 0});
+        return writer->Write(v);
+      };
+      // Fewer records than a batch, so the bad one is still queued when the
+      // writer is destroyed: an unknown contig, or an unsorted record.
+      EXPECT_THAT(write("Chr1", 20), IsOK());
+      EXPECT_THAT(write(write_index ? "Chr1" : "Chr3", 10), IsOK());
+      // The destructor logs its error and closes the writer.
+      writer.reset();
+
+      std::unique_ptr<VcfReader> reader = std::move(
+          VcfReader::FromFile(output_filename,
+                              nucleus::genomics::v1::VcfReaderOptions())
+              .ValueOrDie());
+      EXPECT_EQ(1, as_vector(reader->Iterate()).size());
+    }
+  }
+}
+
+TEST(VcfWriterTest, IndexesWhileWriting) {
+  for (const string& extension : {".vcf.gz", ".bcf.gz"}) {
+    for (int num_threads : {0, 2}) {
+      const bool is_bcf = extension == ".bcf.gz";
+      const string output_filename =
+          MakeTempFile(absl::StrCat("indexed_", num_threads, extension));
+      auto writer = MakeDogVcfWriter(output_filename, false, true, {}, {},
+                                     false, num_threads, /*write_index=*/true,
+                                     /*index_min_shift=*/is_bcf ? 14 : 0);
+      for (const auto& contig_start :
+           std::vector<std::pair<string, int>>{
+               {"Chr1", 10}, {"Chr1", 10}, {"Chr1", 30}, {"Chr2", 5}}) {
+        Variant v = MakeVariant({}, contig_start.first, contig_start.second,
+                                contig_start.second + 1, "A", {"T"});
+        *v.add_calls() = MakeVariantCall("Fido", {0, 1});
+        *v.add_calls() = MakeVariantCall("Spot", {0, 0});
+        ASSERT_THAT(writer->Write(v), IsOK());
+      }
+      ASSERT_THAT(writer->Close(), IsOK());
+      EXPECT_THAT(tensorflow::Env::Default()->FileExists(
+                      output_filename + (is_bcf ? ".csi" : ".tbi")),
+                  IsOK());
+
+      std::unique_ptr<VcfReader> reader = std::move(
+          VcfReader::FromFile(output_filename,
+                              nucleus::genomics::v1::VcfReaderOptions())
+              .ValueOrDie());
+      EXPECT_EQ(2, as_vector(reader->Query(MakeRange("Chr1", 0, 20))).size());
+      EXPECT_EQ(1, as_vector(reader->Query(MakeRange("Chr1", 20, 40))).size());
+      EXPECT_EQ(1, as_vector(reader->Query(MakeRange("Chr2", 0, 50))).size());
+    }
+  }
+}
+
+TEST(VcfWriterTest, IndexingRejectsUnsortedRecords) {
+  const string output_filename = MakeTempFile("indexed_unsorted.vcf.gz");
+  auto writer = MakeDogVcfWriter(output_filename, false, true, {}, {}, false,
+                                 0, /*write_index=*/true);
+  auto write = [&writer](const string& contig, int start) {
+    Variant v = MakeVariant({}, contig, start, start + 1, "A", {"T"});
+    *v.add_calls() = MakeVariantCall("Fido", {0, 1});
+    *v.add_calls() = MakeVariantCall("Spot", {0, 0});
+    return writer->Write(v);
+  };
+  EXPECT_THAT(write("Chr1", 10), IsOK());
+  EXPECT_THAT(write("Chr1", 5),
+              IsNotOKWithCodeAndMessage(tensorflow::error::FAILED_PRECONDITION,
+                                        "Chr1:6 follows Chr1:11"));
+  EXPECT_THAT(write("Chr2", 5), IsOK());
+  EXPECT_THAT(write("Chr1", 20), IsNotOKWithMessage("not contiguous"));
+  EXPECT_THAT(writer->Close(), IsOK());
+}
+
+TEST(VcfWriterTest, IndexingNeedsCompressedOutput) {
+  nucleus::genomics::v1::VcfWriterOptions options;
+  options.set_write_index(true);
+  EXPECT_THAT(VcfWriter::ToFile(MakeTempFile("indexed_uncompressed.vcf"),
+                                nucleus::genomics::v1::VcfHeader(), options)
+                  .status(),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+  EXPECT_THAT(VcfWriter::ToFile(MakeTempFile("indexed_tabix.bcf.gz"),
+                                nucleus::genomics::v1::VcfHeader(), options)
+                  .status(),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+}
+
 TEST(VcfWriterTest, WritesGzippedVCF) {
   string output_filename = MakeTempFile("writes_gzipped_vcf.vcf.gz");
   auto writer = MakeDogVcfWriter(output_filename, false);
@@ -21,6 +21,7 @@
 #include "nucleus/util/utils.h"
 
 #include "absl/strings/str_join.h"
+#include "tensorflow/core/platform/env.h"
 
 namespace nucleus {
 
@@ -128,6 +129,43 @@ bool IsGzipped(absl::string_view file_contents) {
           file_contents[1] == gzip_magic[1]);
 }
 
+bcf_hdr_t* MakeVcfHeader(const std::vector<string>& lines,
+                         const std::vector<string>& samples) {
+  bcf_hdr_t* header = bcf_hdr_init("w");
+  for (const string& line : lines) {
+    CHECK_EQ(0, bcf_hdr_append(header, line.c_str())) << line;
+  }
+  for (const string& sample : samples) {
+    CHECK_EQ(0, bcf_hdr_add_sample(header, sample.c_str())) << sample;
+  }
+  CHECK_EQ(0, bcf_hdr_sync(header));
+  return header;
+}
+
+void ParseVcfLine(bcf_hdr_t* header, const string& line, bcf1_t* record) {
+  // vcf_parse tokenizes the line in place.
+  std::vector<char> buffer(line.begin(), line.end());
+  buffer.push_back('\0');
+  kstring_t str = {line.size(), buffer.size(), buffer.data()};
+  CHECK_EQ(0, vcf_parse(&str, header, record)) << line;
+}
+
+string MakeTempFileWithContents(absl::string_view filename,
+                                const string& contents) {
+  const string path = MakeTempFile(filename);
+  TF_CHECK_OK(tensorflow::WriteStringToFile(tensorflow::Env::Default(), path,
+                                            contents));
+  return path;
+}
+
+std::unique_ptr<VcfReader> MakeVcfReader(
+    absl::string_view filename, const string& vcf,
+    const nucleus::genomics::v1::VcfReaderOptions& options) {
+  return std::move(
+      VcfReader::FromFile(MakeTempFileWithContents(filename, vcf), options)
+          .ValueOrDie());
+}
+
 
 
 }  // namespace nucleus
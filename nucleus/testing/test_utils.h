@@ -25,7 +25,9 @@
 
 #include "tensorflow/core/platform/test.h"
 #include "absl/strings/string_view.h"
+#include "htslib/vcf.h"
 #include "nucleus/io/reader_base.h"
+#include "nucleus/io/vcf_reader.h"
 #include "nucleus/protos/reads.pb.h"
 #include "nucleus/protos/reference.pb.h"
 #include "nucleus/vendor/statusor.h"
@@ -136,6 +138,28 @@ std::vector<Record> as_vector(const std::shared_ptr<Iterable<Record>>& it) {
 // Determines whether file content represents GZIP'd data, based on file magic.
 bool IsGzipped(absl::string_view file_contents);
 
+// Creates an htslib VCF header with the meta-information `lines`, like
+// "##contig=<ID=chr1,length=100>", and the samples `samples`. The caller owns
+// the header and must free it with bcf_hdr_destroy.
+bcf_hdr_t* MakeVcfHeader(const std::vector<string>& lines,
+                         const std::vector<string>& samples);
+
+// Parses the VCF data line `line`, without its trailing newline, into
+// `record`, which must have been created with bcf_init.
+void ParseVcfLine(bcf_hdr_t* header, const string& line, bcf1_t* record);
+
+// Writes `contents` to the temporary file `filename` (see MakeTempFile) and
+// returns its path.
+string MakeTempFileWithContents(absl::string_view filename,
+                                const string& contents);
+
+// Writes the VCF text `vcf` to the temporary file `filename` and returns a
+// reader for it.
+std::unique_ptr<VcfReader> MakeVcfReader(
+    absl::string_view filename, const string& vcf,
+    const nucleus::genomics::v1::VcfReaderOptions& options =
+        nucleus::genomics::v1::VcfReaderOptions());
+
 }  // namespace nucleus
 
 
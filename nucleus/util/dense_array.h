@@ -0,0 +1,46 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef THIRD_PARTY_NUCLEUS_UTIL_DENSE_ARRAY_H_
+#define THIRD_PARTY_NUCLEUS_UTIL_DENSE_ARRAY_H_
+
+#include <vector>
+
+#include "nucleus/platform/types.h"
+
+namespace nucleus {
+
+// A dense N-dimensional array of T stored in row-major (C) order.
+//
+// When returned to Python through CLIF (see numpy_clif_converter.h), the
+// values are handed over to a numpy array without copying.
+template <class T>
+struct DenseArray {
+  // Resizes the array to |shape|, setting all values to |fill|.
+  void Reset(const std::vector<int64>& new_shape, T fill = T()) {
+    shape = new_shape;
+    int64 size = 1;
+    for (int64 dim : shape) size *= dim;
+    values.assign(size, fill);
+  }
+
+  // The extent of each dimension. The product of shape is values.size().
+  std::vector<int64> shape;
+  std::vector<T> values;
+};
+
+}  // namespace nucleus
+#endif  // THIRD_PARTY_NUCLEUS_UTIL_DENSE_ARRAY_H_
@@ -82,4 +82,21 @@ std::vector<double> ZeroShiftLikelihoods(
   return normalized;
 }
 
+void PhredsToLog10PErrors(const int* phreds, const int n,
+                          double* log10_perrors) {
+  for (int i = 0; i < n; ++i) {
+    log10_perrors[i] = -static_cast<double>(phreds[i]) / 10;
+  }
+}
+
+void ZeroShiftedLog10PErrorsToPhreds(const double* log10_perrors, const int n,
+                                     int* phreds) {
+  if (n <= 0) return;
+  double max = log10_perrors[0];
+  for (int i = 1; i < n; ++i) max = std::max(max, log10_perrors[i]);
+  for (int i = 0; i < n; ++i) {
+    phreds[i] = static_cast<int>(-10 * (log10_perrors[i] - max));
+  }
+}
+
 }  // namespace nucleus
@@ -104,6 +104,22 @@ double Log10ToReal(double log10_probability);
 std::vector<double> ZeroShiftLikelihoods(
     const std::vector<double>& likelihoods);
 
+// Batch versions of the conversions above for arrays of genotype likelihoods,
+// as found in the PL and GL fields of VCF records. Unlike the scalar versions
+// they don't CHECK their inputs, and their loops have no data-dependent
+// branches so they can be vectorized.
+
+// Sets log10_perrors[i] to PhredToLog10PError(phreds[i]) for each of the n
+// phreds, which must be >= 0.
+void PhredsToLog10PErrors(const int* phreds, int n, double* log10_perrors);
+
+// Sets phreds[i] to Log10PErrorToPhred of the i-th element of
+// ZeroShiftLikelihoods(log10_perrors), truncated to an int, for each of the n
+// log10_perrors, which must be finite. This is how genotype likelihoods are
+// written as PLs.
+void ZeroShiftedLog10PErrorsToPhreds(const double* log10_perrors, int n,
+                                     int* phreds);
+
 }  // namespace nucleus
 
 #endif  // THIRD_PARTY_NUCLEUS_UTIL_MATH_H_
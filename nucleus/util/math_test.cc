@@ -146,4 +146,29 @@ TEST(ZeroShiftLikelihoods, HandlesValidInputs) {
               ElementsAreArray({0.0, -97.7, -85.0}));
 }
 
+TEST(PhredsToLog10PErrors, MatchesPhredToLog10PError) {
+  std::vector<int> phreds;
+  for (int phred = 0; phred < 512; phred += 7) {
+    phreds.push_back(phred);
+  }
+  phreds.push_back(1000000);
+  std::vector<double> log10_perrors(phreds.size());
+  PhredsToLog10PErrors(phreds.data(), phreds.size(), log10_perrors.data());
+  for (size_t i = 0; i < phreds.size(); ++i) {
+    EXPECT_EQ(PhredToLog10PError(phreds[i]), log10_perrors[i]) << phreds[i];
+  }
+}
+
+TEST(ZeroShiftedLog10PErrorsToPhreds, MatchesScalarConversion) {
+  const std::vector<double> test_data{-3.0, -100.7, -88.0, -3.25, -0.0};
+  const std::vector<double> shifted = ZeroShiftLikelihoods(test_data);
+  std::vector<int> phreds(test_data.size());
+  ZeroShiftedLog10PErrorsToPhreds(test_data.data(), test_data.size(),
+                                  phreds.data());
+  for (size_t i = 0; i < test_data.size(); ++i) {
+    EXPECT_EQ(static_cast<int>(Log10PErrorToPhred(shifted[i])), phreds[i]);
+  }
+  EXPECT_THAT(phreds, ElementsAreArray({30, 1007, 880, 32, 0}));
+}
+
 }  // namespace nucleus
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/util/numpy_clif_converter.h"
+
+#include <utility>
+#include <vector>
+
+// Only use the non-deprecated numpy API.
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include "numpy/arrayobject.h"
+
+namespace nucleus {
+
+namespace {
+
+// The numpy C API table is per translation unit, so it is imported lazily the
+// first time an array is created.
+bool EnsureNumpyImported() {
+  if (PyArray_API == nullptr && _import_array() < 0) {
+    PyErr_SetString(PyExc_ImportError, "Could not import numpy");
+    return false;
+  }
+  return true;
+}
+
+template <class T>
+void DestroyValues(PyObject* capsule) {
+  delete static_cast<std::vector<T>*>(PyCapsule_GetPointer(capsule, nullptr));
+}
+
+// Creates a numpy array viewing |c|'s values, which are moved into a capsule
+// that becomes the base object of the array and so lives exactly as long as
+// the array does.
+template <class T>
+PyObject* MoveToNumpy(DenseArray<T>* c, int type_num) {
+  if (!EnsureNumpyImported()) return nullptr;
+  auto* values = new std::vector<T>(std::move(c->values));
+  PyObject* capsule = PyCapsule_New(values, nullptr, &DestroyValues<T>);
+  if (capsule == nullptr) {
+    delete values;
+    return nullptr;
+  }
+  std::vector<npy_intp> dims(c->shape.begin(), c->shape.end());
+  PyObject* array = PyArray_SimpleNewFromData(dims.size(), dims.data(),
+                                              type_num, values->data());
+  if (array == nullptr) {
+    Py_DECREF(capsule);
+    return nullptr;
+  }
+  // PyArray_SetBaseObject steals the capsule reference, even on failure.
+  if (PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(array),
+                            capsule) < 0) {
+    Py_DECREF(array);
+    return nullptr;
+  }
+  return array;
+}
+
+template <class T>
+PyObject* CopyToNumpy(const DenseArray<T>& c, int type_num) {
+  DenseArray<T> copy = c;
+  return MoveToNumpy(&copy, type_num);
+}
+
+}  // namespace
+
+PyObject* Clif_PyObjFrom(DenseArray<int8>&& c, const ::clif::py::PostConv&) {
+  return MoveToNumpy(&c, NPY_INT8);
+}
+
+PyObject* Clif_PyObjFrom(DenseArray<uint8>&& c, const ::clif::py::PostConv&) {
+  return MoveToNumpy(&c, NPY_UINT8);
+}
+
+PyObject* Clif_PyObjFrom(DenseArray<int32>&& c, const ::clif::py::PostConv&) {
+  return MoveToNumpy(&c, NPY_INT32);
+}
+
+PyObject* Clif_PyObjFrom(DenseArray<int64>&& c, const ::clif::py::PostConv&) {
+  return MoveToNumpy(&c, NPY_INT64);
+}
+
+PyObject* Clif_PyObjFrom(const DenseArray<int8>& c,
+                         const ::clif::py::PostConv&) {
+  return CopyToNumpy(c, NPY_INT8);
+}
+
+PyObject* Clif_PyObjFrom(const DenseArray<uint8>& c,
+                         const ::clif::py::PostConv&) {
+  return CopyToNumpy(c, NPY_UINT8);
+}
+
+PyObject* Clif_PyObjFrom(const DenseArray<int32>& c,
+                         const ::clif::py::PostConv&) {
+  return CopyToNumpy(c, NPY_INT32);
+}
+
+PyObject* Clif_PyObjFrom(const DenseArray<int64>& c,
+                         const ::clif::py::PostConv&) {
+  return CopyToNumpy(c, NPY_INT64);
+}
+
+}  // namespace nucleus
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef THIRD_PARTY_NUCLEUS_UTIL_NUMPY_CLIF_CONVERTER_H_
+#define THIRD_PARTY_NUCLEUS_UTIL_NUMPY_CLIF_CONVERTER_H_
+
+#include "clif/python/postconv.h"
+#include "clif/python/types.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/util/dense_array.h"
+
+namespace nucleus {
+
+// Note: the comments below are instructions to CLIF.
+// CLIF use `::nucleus::DenseArray<::nucleus::int8>` as Int8Array
+// CLIF use `::nucleus::DenseArray<::nucleus::uint8>` as Uint8Array
+// CLIF use `::nucleus::DenseArray<::nucleus::int32>` as Int32Array
+// CLIF use `::nucleus::DenseArray<::nucleus::int64>` as Int64Array
+
+// Convert a C++ DenseArray into a numpy array of the same shape. The rvalue
+// overloads move the values into storage owned by the numpy array, so no data
+// is copied; the const overloads have to copy.
+PyObject* Clif_PyObjFrom(DenseArray<int8>&& c, const ::clif::py::PostConv&);
+PyObject* Clif_PyObjFrom(DenseArray<uint8>&& c, const ::clif::py::PostConv&);
+PyObject* Clif_PyObjFrom(DenseArray<int32>&& c, const ::clif::py::PostConv&);
+PyObject* Clif_PyObjFrom(DenseArray<int64>&& c, const ::clif::py::PostConv&);
+
+PyObject* Clif_PyObjFrom(const DenseArray<int8>& c,
+                         const ::clif::py::PostConv&);
+PyObject* Clif_PyObjFrom(const DenseArray<uint8>& c,
+                         const ::clif::py::PostConv&);
+PyObject* Clif_PyObjFrom(const DenseArray<int32>& c,
+                         const ::clif::py::PostConv&);
+PyObject* Clif_PyObjFrom(const DenseArray<int64>& c,
+                         const ::clif::py::PostConv&);
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_UTIL_NUMPY_CLIF_CONVERTER_H_
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/util/parallel.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+int NumShards(int num_threads, int64 num_items) {
+  return static_cast<int>(std::max<int64>(
+      1, std::min<int64>(std::max(num_threads, 1), num_items)));
+}
+
+void RunShards(const char* name, int num_shards,
+               const std::function<void(int)>& run_shard) {
+  if (num_shards < 2) {
+    for (int shard = 0; shard < num_shards; ++shard) run_shard(shard);
+    return;
+  }
+  // The destructor of the pool waits for all shards to finish.
+  tf::thread::ThreadPool pool(tf::Env::Default(), name, num_shards);
+  for (int shard = 0; shard < num_shards; ++shard) {
+    pool.Schedule([&run_shard, shard]() { run_shard(shard); });
+  }
+}
+
+}  // namespace nucleus
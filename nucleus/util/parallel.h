@@ -0,0 +1,39 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef THIRD_PARTY_NUCLEUS_UTIL_PARALLEL_H_
+#define THIRD_PARTY_NUCLEUS_UTIL_PARALLEL_H_
+
+#include <functional>
+
+#include "nucleus/platform/types.h"
+
+namespace nucleus {
+
+// The number of shards to split |num_items| items into for up to
+// |num_threads| threads: one per thread, but no more than there are items,
+// and always at least one.
+int NumShards(int num_threads, int64 num_items);
+
+// Calls |run_shard| with each shard index in [0, |num_shards|), in parallel
+// on a thread pool named |name| with one thread per shard, and returns once
+// all of them have returned. A single shard runs on the calling thread.
+void RunShards(const char* name, int num_shards,
+               const std::function<void(int)>& run_shard);
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_UTIL_PARALLEL_H_
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/util/parallel.h"
+
+#include <vector>
+
+#include "tensorflow/core/platform/test.h"
+
+namespace nucleus {
+
+TEST(ParallelTest, NumShards) {
+  EXPECT_EQ(4, NumShards(4, 100));
+  EXPECT_EQ(3, NumShards(8, 3));
+  // There is always at least one shard, even without items or threads.
+  EXPECT_EQ(1, NumShards(4, 0));
+  EXPECT_EQ(1, NumShards(0, 100));
+  EXPECT_EQ(1, NumShards(-1, 100));
+}
+
+TEST(ParallelTest, RunsEachShardOnce) {
+  for (int num_shards : {1, 2, 7}) {
+    std::vector<int> runs(num_shards, 0);
+    RunShards("parallel_test", num_shards, [&runs](int shard) {
+      ++runs[shard];
+    });
+    EXPECT_EQ(std::vector<int>(num_shards, 1), runs);
+  }
+}
+
+}  // namespace nucleus
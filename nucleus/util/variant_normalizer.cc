@@ -0,0 +1,305 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/util/variant_normalizer.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "google/protobuf/repeated_field.h"
+#include "absl/strings/ascii.h"
+#include "nucleus/util/parallel.h"
+#include "nucleus/util/utils.h"
+#include "tensorflow/core/lib/core/errors.h"
+
+namespace nucleus {
+
+namespace tf = tensorflow;
+
+using nucleus::genomics::v1::ListValue;
+using nucleus::genomics::v1::Variant;
+using nucleus::genomics::v1::VariantCall;
+using nucleus::genomics::v1::VcfFormatInfo;
+using nucleus::genomics::v1::VcfHeader;
+using nucleus::genomics::v1::VcfInfo;
+
+namespace {
+
+// The number of bases read to the left of a variant at a time while
+// left-aligning it.
+constexpr int64 kLeftAlignWindow = 100;
+
+// Can |allele| be trimmed and left-aligned?
+bool IsNormalizableAllele(const string& allele) {
+  for (char base : allele) {
+    switch (base) {
+      case 'A': case 'C': case 'G': case 'T': case 'N':
+      case 'a': case 'c': case 'g': case 't': case 'n':
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool AnyEmpty(const std::vector<string>& alleles) {
+  for (const string& allele : alleles) {
+    if (allele.empty()) return true;
+  }
+  return false;
+}
+
+// Do all |alleles|, none of them empty, end with the same base?
+bool SameLastBase(const std::vector<string>& alleles) {
+  for (const string& allele : alleles) {
+    if (allele.empty() || allele.back() != alleles[0].back()) return false;
+  }
+  return true;
+}
+
+// Do all |alleles|, all longer than one base, start with the same base?
+bool SameFirstLongerAlleles(const std::vector<string>& alleles) {
+  for (const string& allele : alleles) {
+    if (allele.size() < 2 || allele[0] != alleles[0][0]) return false;
+  }
+  return true;
+}
+
+// Returns the indices of the values a biallelic split of alternate allele
+// |alt| keeps from a list of |size| values of a field with VCF Number
+// |number|, for a variant with |num_alleles| alleles and calls of |ploidy|.
+// Returns an empty vector if all values are kept, either because the number
+// doesn't depend on the alleles or because |size| doesn't match it.
+std::vector<int> SplitIndices(const string& number, int alt, int num_alleles,
+                              int ploidy, int size) {
+  if (number == "A" && size == num_alleles - 1) return {alt - 1};
+  if (number == "R" && size == num_alleles) return {0, alt};
+  if (number == "G") {
+    // The index of genotype j/k, j <= k, is k * (k + 1) / 2 + j.
+    if (ploidy == 1 && size == num_alleles) return {0, alt};
+    if (ploidy == 2 && size == num_alleles * (num_alleles + 1) / 2) {
+      const int first_alt = alt * (alt + 1) / 2;
+      return {0, first_alt, first_alt + alt};
+    }
+  }
+  return {};
+}
+
+void KeepValues(const std::vector<int>& indices, ListValue* list) {
+  ListValue kept;
+  for (int i : indices) *kept.add_values() = list->values(i);
+  list->Swap(&kept);
+}
+
+void KeepValues(const std::vector<int>& indices,
+                google::protobuf::RepeatedField<double>* values) {
+  google::protobuf::RepeatedField<double> kept;
+  for (int i : indices) kept.Add(values->Get(i));
+  values->Swap(&kept);
+}
+
+// Subsets the values of the fields of |info| to those of alternate allele
+// |alt|, using the VCF Number of the fields in |numbers|.
+void SplitInfoMap(
+    const std::map<string, string>& numbers, int alt, int num_alleles,
+    int ploidy, google::protobuf::Map<string, ListValue>* info) {
+  for (auto& field : *info) {
+    const auto number = numbers.find(field.first);
+    if (number == numbers.end()) continue;
+    const std::vector<int> indices =
+        SplitIndices(number->second, alt, num_alleles, ploidy,
+                     field.second.values_size());
+    if (!indices.empty()) KeepValues(indices, &field.second);
+  }
+}
+
+}  // namespace
+
+VariantNormalizer::VariantNormalizer(const GenomeReference& ref,
+                                     const VcfHeader& header,
+                                     bool split_multiallelics)
+    : ref_(ref),
+      split_multiallelics_(split_multiallelics),
+      info_numbers_({{"AC", "A"}, {"AF", "A"}}),
+      format_numbers_({{"AD", "R"}, {"GL", "G"}, {"PL", "G"}}) {
+  for (const VcfInfo& info : header.infos()) {
+    info_numbers_[info.id()] = info.number();
+  }
+  for (const VcfFormatInfo& format : header.formats()) {
+    format_numbers_[format.id()] = format.number();
+  }
+}
+
+tf::Status VariantNormalizer::Normalize(
+    const Variant& variant, std::vector<Variant>* normalized) const {
+  const int num_alts = variant.alternate_bases_size();
+  if (!split_multiallelics_ || num_alts < 2) {
+    normalized->push_back(variant);
+    return NormalizeAlleles(&normalized->back());
+  }
+  for (int alt = 1; alt <= num_alts; ++alt) {
+    normalized->emplace_back();
+    SplitAllele(variant, alt, &normalized->back());
+    TF_RETURN_IF_ERROR(NormalizeAlleles(&normalized->back()));
+  }
+  return tf::Status::OK();
+}
+
+tf::Status VariantNormalizer::NormalizeAll(
+    const std::vector<Variant>& variants, int num_threads,
+    std::vector<Variant>* normalized) const {
+  normalized->clear();
+  const int64 num_variants = variants.size();
+  const int num_shards = NumShards(num_threads, num_variants);
+  std::vector<std::vector<Variant>> shard_variants(num_shards);
+  std::vector<tf::Status> shard_statuses(num_shards);
+  auto normalize_shard = [&](int shard) {
+    const int64 begin = num_variants * shard / num_shards;
+    const int64 end = num_variants * (shard + 1) / num_shards;
+    for (int64 i = begin; i < end && shard_statuses[shard].ok(); ++i) {
+      shard_statuses[shard] = Normalize(variants[i], &shard_variants[shard]);
+    }
+  };
+  RunShards("normalize_variants", num_shards, normalize_shard);
+
+  for (int shard = 0; shard < num_shards; ++shard) {
+    TF_RETURN_IF_ERROR(shard_statuses[shard]);
+    for (Variant& variant : shard_variants[shard]) {
+      normalized->push_back(std::move(variant));
+    }
+  }
+  return tf::Status::OK();
+}
+
+tf::Status VariantNormalizer::NormalizeAlleles(Variant* variant) const {
+  std::vector<string> alleles;
+  alleles.push_back(variant->reference_bases());
+  for (const string& alt : variant->alternate_bases()) alleles.push_back(alt);
+  if (alleles.size() < 2) return tf::Status::OK();
+  for (string& allele : alleles) {
+    if (!IsNormalizableAllele(allele)) return tf::Status::OK();
+    absl::AsciiStrToUpper(&allele);
+  }
+  // Like bcftools norm, leave alone records whose alleles are all the same,
+  // which would otherwise be trimmed and left-aligned to the contig start.
+  if (std::all_of(alleles.begin() + 1, alleles.end(),
+                  [&alleles](const string& a) { return a == alleles[0]; })) {
+    return tf::Status::OK();
+  }
+
+  // window holds the reference bases of [window_start, ref_end).
+  const string& contig = variant->reference_name();
+  int64 pos = variant->start();
+  const int64 ref_end = pos + alleles[0].size();
+  int64 window_start = std::max<int64>(0, pos - kLeftAlignWindow);
+  StatusOr<string> bases = GetBases(contig, window_start, ref_end);
+  TF_RETURN_IF_ERROR(bases.status());
+  string window = bases.ConsumeValueOrDie();
+  absl::AsciiStrToUpper(&window);
+  if (window.compare(pos - window_start, string::npos, alleles[0]) != 0) {
+    return tf::errors::InvalidArgument(
+        "The reference bases ", variant->reference_bases(), " of the variant "
+        "at ", contig, ":", pos + 1, " don't match the reference ",
+        window.substr(pos - window_start));
+  }
+
+  // Trim the last base of all alleles while they share it, and extend them
+  // all with the base on the left when one of them becomes empty, until
+  // neither applies. Alleles at the start of the contig can't be extended,
+  // so there they aren't trimmed down to nothing either.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    const bool can_empty_alleles = pos > 0;
+    if (SameLastBase(alleles) &&
+        (can_empty_alleles ||
+         std::all_of(alleles.begin(), alleles.end(),
+                     [](const string& a) { return a.size() > 1; }))) {
+      for (string& allele : alleles) allele.pop_back();
+      changed = true;
+    }
+    if (AnyEmpty(alleles) && pos > 0) {
+      if (pos == window_start) {
+        const int64 new_start = std::max<int64>(
+            0, window_start - std::max<int64>(kLeftAlignWindow,
+                                              ref_end - window_start));
+        StatusOr<string> more = GetBases(contig, new_start, window_start);
+        TF_RETURN_IF_ERROR(more.status());
+        string left = more.ConsumeValueOrDie();
+        absl::AsciiStrToUpper(&left);
+        window.insert(0, left);
+        window_start = new_start;
+      }
+      --pos;
+      const char base = window[pos - window_start];
+      for (string& allele : alleles) allele.insert(allele.begin(), base);
+      changed = true;
+    }
+  }
+  // Trim the shared first bases, keeping at least one base per allele.
+  int64 trimmed = 0;
+  while (SameFirstLongerAlleles(alleles)) {
+    for (string& allele : alleles) allele.erase(0, 1);
+    ++trimmed;
+  }
+  pos += trimmed;
+
+  variant->set_start(pos);
+  variant->set_end(pos + alleles[0].size());
+  variant->set_reference_bases(alleles[0]);
+  for (int i = 1; i < static_cast<int>(alleles.size()); ++i) {
+    variant->set_alternate_bases(i - 1, alleles[i]);
+  }
+  return tf::Status::OK();
+}
+
+void VariantNormalizer::SplitAllele(const Variant& variant, int alt,
+                                    Variant* split) const {
+  const int num_alleles = variant.alternate_bases_size() + 1;
+  *split = variant;
+  split->clear_alternate_bases();
+  split->add_alternate_bases(variant.alternate_bases(alt - 1));
+  // Variant-level fields don't depend on the ploidy.
+  SplitInfoMap(info_numbers_, alt, num_alleles, 2, split->mutable_info());
+
+  for (VariantCall& call : *split->mutable_calls()) {
+    const int ploidy = call.genotype_size();
+    for (int i = 0; i < ploidy; ++i) {
+      const int allele = call.genotype(i);
+      if (allele > 0) call.set_genotype(i, allele == alt ? 1 : 0);
+    }
+    const std::vector<int> indices =
+        SplitIndices("G", alt, num_alleles, ploidy,
+                     call.genotype_likelihood_size());
+    if (!indices.empty()) {
+      KeepValues(indices, call.mutable_genotype_likelihood());
+    } else if (call.genotype_likelihood_size() > 0) {
+      // Likelihoods of other ploidies can't be subset.
+      call.clear_genotype_likelihood();
+    }
+    SplitInfoMap(format_numbers_, alt, num_alleles, ploidy,
+                 call.mutable_info());
+  }
+}
+
+StatusOr<string> VariantNormalizer::GetBases(const string& contig,
+                                             int64 start, int64 end) const {
+  tf::mutex_lock lock(ref_mu_);
+  return ref_.GetBases(MakeRange(contig, start, end));
+}
+
+}  // namespace nucleus
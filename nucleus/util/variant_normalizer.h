@@ -0,0 +1,109 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+// Normalization of the alleles of Variants, so that equivalent variants can be
+// compared by their position and alleles.
+//
+// A normalized variant is parsimonious (no base can be trimmed from the start
+// or end of all of its alleles without leaving one empty) and left-aligned (it
+// can't be moved left by shifting a repeated sequence), following Tan et al.,
+// "Unified representation of genetic variants", Bioinformatics 2015.
+#ifndef THIRD_PARTY_NUCLEUS_UTIL_VARIANT_NORMALIZER_H_
+#define THIRD_PARTY_NUCLEUS_UTIL_VARIANT_NORMALIZER_H_
+
+#include <map>
+#include <vector>
+
+#include "nucleus/io/reference.h"
+#include "nucleus/platform/types.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/vendor/statusor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace nucleus {
+
+class VariantNormalizer {
+ public:
+  // Creates a normalizer reading bases from |ref|, which must outlive it.
+  // The INFO and FORMAT definitions of |header| tell which fields have a value
+  // per alternate allele (Number=A), per allele (R) or per genotype (G), for
+  // splitting multi-allelic variants. AC and AF (A) INFO fields and AD (R), GL
+  // and PL (G) FORMAT fields are recognized without definitions.
+  // If |split_multiallelics|, variants with more than one alternate allele are
+  // split into one biallelic variant per alternate allele before they are
+  // normalized.
+  VariantNormalizer(const GenomeReference& ref,
+                    const nucleus::genomics::v1::VcfHeader& header,
+                    bool split_multiallelics);
+
+  // Disable copy or assignment
+  VariantNormalizer(const VariantNormalizer& other) = delete;
+  VariantNormalizer& operator=(const VariantNormalizer&) = delete;
+
+  // Appends the normalized |variant|, or the normalized variants it is split
+  // into, to |normalized|.
+  //
+  // The alleles of a variant are only trimmed and left-aligned if they are all
+  // made of A, C, G, T and N bases; otherwise, as for symbolic alleles, the
+  // variant is left as it is. The alleles of normalized variants are
+  // upper-cased.
+  // Returns an error if the reference bases of the variant don't match |ref|.
+  //
+  // When splitting, the calls of each biallelic variant keep their genotype
+  // alleles that are its alternate allele (as 1) or the reference; the other
+  // alternate alleles become the reference, as with bcftools norm. The
+  // values of Number=A, R and G fields, and the genotype likelihoods of
+  // haploid and diploid calls, are subset to the alleles kept.
+  tensorflow::Status Normalize(const nucleus::genomics::v1::Variant& variant,
+                               std::vector<nucleus::genomics::v1::Variant>*
+                                   normalized) const;
+
+  // Normalizes all of |variants| into |normalized|, in order, splitting them
+  // into up to |num_threads| contiguous shards normalized in parallel. Reads
+  // of the reference are serialized, as GenomeReferences aren't thread safe.
+  // As normalization moves variants to the left, the normalized variants of
+  // sorted input may need to be sorted again.
+  tensorflow::Status NormalizeAll(
+      const std::vector<nucleus::genomics::v1::Variant>& variants,
+      int num_threads,
+      std::vector<nucleus::genomics::v1::Variant>* normalized) const;
+
+ private:
+  // Trims and left-aligns the alleles of |variant| in place.
+  tensorflow::Status NormalizeAlleles(
+      nucleus::genomics::v1::Variant* variant) const;
+
+  // Sets |split| to the biallelic variant of alternate allele |alt| (1-based)
+  // of |variant|.
+  void SplitAllele(const nucleus::genomics::v1::Variant& variant, int alt,
+                   nucleus::genomics::v1::Variant* split) const;
+
+  // Reads the bases of [start, end) of |contig| from ref_.
+  StatusOr<string> GetBases(const string& contig, int64 start,
+                            int64 end) const;
+
+  const GenomeReference& ref_;
+  const bool split_multiallelics_;
+  // The VCF Number of the INFO and FORMAT fields, by id.
+  std::map<string, string> info_numbers_;
+  std::map<string, string> format_numbers_;
+  mutable tensorflow::mutex ref_mu_;
+};
+
+}  // namespace nucleus
+
+#endif  // THIRD_PARTY_NUCLEUS_UTIL_VARIANT_NORMALIZER_H_
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2018 Google LLC.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "nucleus/util/variant_normalizer.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock-generated-matchers.h>
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock-more-matchers.h>
+
+#include "tensorflow/core/platform/test.h"
+#include "nucleus/protos/reference.pb.h"
+#include "nucleus/protos/variants.pb.h"
+#include "nucleus/testing/protocol-buffer-matchers.h"
+#include "nucleus/testing/test_utils.h"
+#include "nucleus/util/utils.h"
+#include "nucleus/vendor/status_matchers.h"
+
+namespace nucleus {
+
+using genomics::v1::ContigInfo;
+using genomics::v1::ReferenceSequence;
+using genomics::v1::Variant;
+using genomics::v1::VariantCall;
+using genomics::v1::VcfHeader;
+using ::testing::DoubleEq;
+using ::testing::ElementsAre;
+using ::testing::Pointwise;
+
+namespace {
+
+//                                 0123456789012345678901234
+constexpr char kReferenceBases[] = "TTCACACAGGATTTTGCAACGTACG";
+
+Variant MakeVariant(int64 start, const string& ref,
+                    const std::vector<string>& alts) {
+  Variant variant;
+  variant.set_reference_name("chr1");
+  variant.set_start(start);
+  variant.set_end(start + ref.size());
+  variant.set_reference_bases(ref);
+  for (const string& alt : alts) variant.add_alternate_bases(alt);
+  return variant;
+}
+
+}  // namespace
+
+class VariantNormalizerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::vector<ContigInfo> contigs(1);
+    contigs[0].set_name("chr1");
+    contigs[0].set_n_bases(sizeof(kReferenceBases) - 1);
+    std::vector<ReferenceSequence> seqs(1);
+    *seqs[0].mutable_region() =
+        MakeRange("chr1", 0, sizeof(kReferenceBases) - 1);
+    seqs[0].set_bases(kReferenceBases);
+    ref_ = std::move(InMemoryFastaReader::Create(contigs, seqs).ValueOrDie());
+  }
+
+  // Normalizes |variant|, which must be normalized without errors.
+  std::vector<Variant> Normalize(const Variant& variant,
+                                 bool split_multiallelics) {
+    VariantNormalizer normalizer(*ref_, header_, split_multiallelics);
+    std::vector<Variant> normalized;
+    TF_CHECK_OK(normalizer.Normalize(variant, &normalized));
+    return normalized;
+  }
+
+  // Checks that |variant| is at [start, end) with alleles |ref| and |alts|.
+  void ExpectAlleles(const Variant& variant, int64 start, int64 end,
+                     const string& ref, const std::vector<string>& alts) {
+    EXPECT_EQ(start, variant.start());
+    EXPECT_EQ(end, variant.end());
+    EXPECT_EQ(ref, variant.reference_bases());
+    EXPECT_EQ(alts, std::vector<string>(variant.alternate_bases().begin(),
+                                        variant.alternate_bases().end()));
+  }
+
+  std::unique_ptr<InMemoryFastaReader> ref_;
+  VcfHeader header_;
+};
+
+TEST_F(VariantNormalizerTest, TrimsSharedBases) {
+  const std::vector<Variant> normalized =
+      Normalize(MakeVariant(8, "GGATT", {"GGCTT"}), false);
+  ASSERT_EQ(1, normalized.size());
+  ExpectAlleles(normalized[0], 10, 11, "A", {"C"});
+}
+
+TEST_F(VariantNormalizerTest, LeftAlignsDeletionInRepeat) {
+  // Deleting any CA of the CACACA repeat at 2-7 gives the same sequence.
+  const std::vector<Variant> normalized =
+      Normalize(MakeVariant(5, "ACA", {"A"}), false);
+  ASSERT_EQ(1, normalized.size());
+  ExpectAlleles(normalized[0], 1, 4, "TCA", {"T"});
+}
+
+TEST_F(VariantNormalizerTest, LeftAlignsInsertionInHomopolymer) {
+  const std::vector<Variant> normalized =
+      Normalize(MakeVariant(13, "T", {"TT"}), false);
+  ASSERT_EQ(1, normalized.size());
+  ExpectAlleles(normalized[0], 10, 11, "A", {"AT"});
+}
+
+TEST_F(VariantNormalizerTest, LeftAlignsWithLowercaseAlleles) {
+  const std::vector<Variant> normalized =
+      Normalize(MakeVariant(13, "t", {"tt"}), false);
+  ASSERT_EQ(1, normalized.size());
+  ExpectAlleles(normalized[0], 10, 11, "A", {"AT"});
+}
+
+TEST_F(VariantNormalizerTest, KeepsVariantsAtContigStart) {
+  const std::vector<Variant> normalized =
+      Normalize(MakeVariant(0, "TT", {"T"}), false);
+  ASSERT_EQ(1, normalized.size());
+  ExpectAlleles(normalized[0], 0, 2, "TT", {"T"});
+}
+
+TEST_F(VariantNormalizerTest, LeavesSymbolicAllelesAlone) {
+  const Variant variant = MakeVariant(5, "ACA", {"<DEL>"});
+  EXPECT_THAT(Normalize(variant, false), ElementsAre(EqualsProto(variant)));
+  // A mixture of symbolic and sequence alleles isn't normalized either.
+  const Variant mixed = MakeVariant(5, "ACA", {"A", "<*>"});
+  EXPECT_THAT(Normalize(mixed, false), ElementsAre(EqualsProto(mixed)));
+}
+
+TEST_F(VariantNormalizerTest, LeavesIdenticalAllelesAlone) {
+  const Variant variant = MakeVariant(9, "GA", {"ga"});
+  EXPECT_THAT(Normalize(variant, false), ElementsAre(EqualsProto(variant)));
+}
+
+TEST_F(VariantNormalizerTest, RejectsMismatchedReferenceBases) {
+  VariantNormalizer normalizer(*ref_, header_, false);
+  std::vector<Variant> normalized;
+  EXPECT_THAT(normalizer.Normalize(MakeVariant(0, "G", {"C"}), &normalized),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+}
+
+TEST_F(VariantNormalizerTest, SplitsMultiallelics) {
+  Variant variant = MakeVariant(10, "AT", {"A", "CT"});
+  SetInfoField("AF", std::vector<double>{0.25, 0.5}, &variant);
+  SetInfoField("DP", 20, &variant);
+  VariantCall* call = variant.add_calls();
+  call->add_genotype(1);
+  call->add_genotype(2);
+  for (double gl : {-1.0, -2.0, -3.0, -4.0, -5.0, -6.0}) {
+    call->add_genotype_likelihood(gl);
+  }
+  SetInfoField("AD", std::vector<int>{3, 4, 5}, call);
+
+  const std::vector<Variant> normalized = Normalize(variant, true);
+  ASSERT_EQ(2, normalized.size());
+
+  // The deletion can't move left of the A before the TTTT homopolymer.
+  ExpectAlleles(normalized[0], 10, 12, "AT", {"A"});
+  EXPECT_THAT(ListValues<double>(normalized[0].info().at("AF")),
+              ElementsAre(DoubleEq(0.25)));
+  EXPECT_THAT(ListValues<int>(normalized[0].info().at("DP")), ElementsAre(20));
+  EXPECT_THAT(normalized[0].calls(0).genotype(), ElementsAre(1, 0));
+  EXPECT_THAT(normalized[0].calls(0).genotype_likelihood(),
+              ElementsAre(DoubleEq(-1), DoubleEq(-2), DoubleEq(-3)));
+  EXPECT_THAT(ListValues<int>(normalized[0].calls(0).info().at("AD")),
+              ElementsAre(3, 4));
+
+  // The second alternate allele is trimmed into a SNP.
+  ExpectAlleles(normalized[1], 10, 11, "A", {"C"});
+  EXPECT_THAT(ListValues<double>(normalized[1].info().at("AF")),
+              ElementsAre(DoubleEq(0.5)));
+  EXPECT_THAT(normalized[1].calls(0).genotype(), ElementsAre(0, 1));
+  EXPECT_THAT(normalized[1].calls(0).genotype_likelihood(),
+              ElementsAre(DoubleEq(-1), DoubleEq(-4), DoubleEq(-6)));
+  EXPECT_THAT(ListValues<int>(normalized[1].calls(0).info().at("AD")),
+              ElementsAre(3, 5));
+}
+
+TEST_F(VariantNormalizerTest, DoesNotSplitUnlessAsked) {
+  const std::vector<Variant> normalized =
+      Normalize(MakeVariant(10, "AT", {"A", "CT"}), false);
+  ASSERT_EQ(1, normalized.size());
+  ExpectAlleles(normalized[0], 10, 12, "AT", {"A", "CT"});
+}
+
+TEST_F(VariantNormalizerTest, NormalizeAllMatchesNormalize) {
+  std::vector<Variant> variants;
+  for (int i = 0; i < 10; ++i) {
+    variants.push_back(MakeVariant(5, "ACA", {"A"}));
+    variants.push_back(MakeVariant(10, "AT", {"A", "CT"}));
+    variants.push_back(MakeVariant(13, "T", {"TT"}));
+  }
+  std::vector<Variant> expected;
+  for (const Variant& variant : variants) {
+    for (const Variant& v : Normalize(variant, true)) expected.push_back(v);
+  }
+
+  VariantNormalizer normalizer(*ref_, header_, true);
+  for (int num_threads : {1, 4, 100}) {
+    std::vector<Variant> normalized;
+    ASSERT_THAT(normalizer.NormalizeAll(variants, num_threads, &normalized),
+                IsOK());
+    EXPECT_THAT(normalized, Pointwise(EqualsProto(), expected));
+  }
+}
+
+TEST_F(VariantNormalizerTest, NormalizeAllReturnsErrors) {
+  VariantNormalizer normalizer(*ref_, header_, false);
+  std::vector<Variant> variants(8, MakeVariant(13, "T", {"TT"}));
+  variants[5] = MakeVariant(0, "G", {"C"});
+  std::vector<Variant> normalized;
+  EXPECT_THAT(normalizer.NormalizeAll(variants, 4, &normalized),
+              IsNotOKWithCode(tensorflow::error::INVALID_ARGUMENT));
+}
+
+}  // namespace nucleus
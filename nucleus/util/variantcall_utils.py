@@ -196,6 +196,26 @@ def set_bam_fname(variant_call, bam_fname):
                                        bam_fname)
 
 
+def get_call_set_name(variant_call, vcf_header):
+  """Returns the call set (sample) name of the VariantCall.
+
+  Calls read with VcfReaderOptions.omit_call_set_names only carry the index of
+  their sample in the header; their name is looked up in vcf_header. A call
+  with neither a name nor an index has an empty name.
+
+  Args:
+    variant_call: VariantCall proto. The VariantCall to evaluate.
+    vcf_header: VcfHeader proto. The header the call was read with.
+
+  Returns:
+    The name of the call set of the VariantCall.
+  """
+  if (variant_call.WhichOneof('call_set') == 'call_set_index' and
+      0 <= variant_call.call_set_index < len(vcf_header.sample_names)):
+    return vcf_header.sample_names[variant_call.call_set_index]
+  return variant_call.call_set_name
+
+
 def has_genotypes(variant_call):
   """Returns True iff the VariantCall has one or more called genotypes.
 
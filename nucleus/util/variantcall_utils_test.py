@@ -224,6 +224,20 @@ class VariantcallUtilsTests(parameterized.TestCase):
     actual = variantcall_utils.is_heterozygous(call)
     self.assertEqual(actual, expected)
 
+  @parameterized.parameters(
+      dict(call=variants_pb2.VariantCall(call_set_name='Fido'), expected='Fido'),
+      dict(call=variants_pb2.VariantCall(call_set_index=1), expected='Spot'),
+      dict(call=variants_pb2.VariantCall(call_set_index=0), expected='Fido'),
+      dict(call=variants_pb2.VariantCall(), expected=''),
+      dict(
+          call=variants_pb2.VariantCall(call_set_name='Rex', call_set_index=1),
+          expected='Rex'),
+  )
+  def test_get_call_set_name(self, call, expected):
+    header = variants_pb2.VcfHeader(sample_names=['Fido', 'Spot'])
+    actual = variantcall_utils.get_call_set_name(call, header)
+    self.assertEqual(actual, expected)
+
 
 if __name__ == '__main__':
   absltest.main()